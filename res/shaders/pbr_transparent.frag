@@ -24,12 +24,13 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     vec3 viewPos;
     float t;
     /* Lights */
-    float ambientLight;
+    float environmentIntensity;
     uint noPointLights;
     DirLight sun;
     vec4 splitDepths[(5 + 4) / 4];
     mat4 cascadeSpace[5];
     PointLight pointLights[4];
+    vec4 irradianceSH[9];
 } ubo;
 
 layout(set = 0, binding = 1) uniform texture2D textures[64];
@@ -37,6 +38,9 @@ layout(set = 0, binding = 2) uniform sampler samp;
 
 layout(set = 0, binding = 3) uniform sampler2DArray shadowMap;
 
+layout(set = 0, binding = 4) uniform samplerCube prefilteredMap;
+layout(set = 0, binding = 5) uniform sampler2D brdfLut;
+
 layout(push_constant) uniform MATERIAL {
     layout(offset = 0) int   modelMatrixIdx;
     layout(offset = 4) int   albedoIndex;
@@ -108,6 +112,44 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness) {
     return ggx1 * ggx2;
 }
 
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness) {
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(max(1.0 - cosTheta, 0.0), 5.0);
+}
+
+// irradiance divided by pi, from order 2 spherical harmonics
+vec3 Irradiance(vec3 N) {
+    return ubo.irradianceSH[0].rgb * 0.282095 +
+           ubo.irradianceSH[1].rgb * 0.488603 * N.y +
+           ubo.irradianceSH[2].rgb * 0.488603 * N.z +
+           ubo.irradianceSH[3].rgb * 0.488603 * N.x +
+           ubo.irradianceSH[4].rgb * 1.092548 * N.x * N.y +
+           ubo.irradianceSH[5].rgb * 1.092548 * N.y * N.z +
+           ubo.irradianceSH[6].rgb * 0.315392 * (3.0 * N.z * N.z - 1.0) +
+           ubo.irradianceSH[7].rgb * 1.092548 * N.x * N.z +
+           ubo.irradianceSH[8].rgb * 0.546274 * (N.x * N.x - N.y * N.y);
+}
+
+// split sum image based lighting
+vec3 CalcAmbient(vec3  V,
+                 vec3  N,
+                 vec3  F0,
+                 vec3  albedo,
+                 float metallic,
+                 float roughness) {
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 F = fresnelSchlickRoughness(NdotV, F0, roughness);
+    vec3 kD = (vec3(1.0) - F) * (1.0 - metallic);
+    vec3 diffuse = kD * max(Irradiance(N), 0.0) * albedo;
+
+    vec3 R = reflect(-V, N);
+    float lod = roughness * float(textureQueryLevels(prefilteredMap) - 1);
+    vec3 prefiltered = textureLod(prefilteredMap, R, lod).rgb;
+    vec2 brdf = texture(brdfLut, vec2(NdotV, roughness)).rg;
+    vec3 specular = prefiltered * (F0 * brdf.x + brdf.y);
+
+    return ubo.environmentIntensity * (diffuse + specular);
+}
+
 vec3 CalcPointLight(int i, 
                     vec3 V, 
                     vec3 N, 
@@ -253,7 +295,7 @@ void main() {
             CalcDirLight(ubo.sun.direction, ubo.sun.color, 
                          V, N, F0, albedo, metallic, roughness);
 
-    vec3 ambient = vec3(ubo.ambientLight) * albedo * ao;
+    vec3 ambient = CalcAmbient(V, N, F0, albedo, metallic, roughness) * ao;
     vec3 emissive = albedo * material.emissive;
     vec3 color = ambient + emissive + Lo;
     // gamma correction
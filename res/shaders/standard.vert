@@ -24,12 +24,13 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     vec3 viewPos;
     float t;
     /* Lights */
-    float ambientLight;
+    float environmentIntensity;
     uint noPointLights;
     DirLight sun;
     vec4 splitDepths[(5 + 4) / 4];
     mat4 cascadeSpace[5];
     PointLight pointLights[4];
+    vec4 irradianceSH[9];
 } ubo;
 
 layout(push_constant) uniform PER_OBJECT
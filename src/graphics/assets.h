@@ -12,6 +12,7 @@ struct VertexData {
     VkDeviceMemory vertexBufferMemory;
     VkBuffer       indexBuffer;
     VkDeviceMemory indexBufferMemory;
+    VkIndexType    indexType = VK_INDEX_TYPE_UINT32;
 };
 
 struct TextureImages {
@@ -0,0 +1,60 @@
+#ifndef COMPUTE_PIPELINE_H
+#define COMPUTE_PIPELINE_H
+
+#include <vulkan/vulkan.h>
+
+#include "graphics_pipeline.h"
+
+#include "src/container/vector.h"
+#include "src/container/array.h"
+
+struct Dispatch {
+    uint32_t groupCountX;
+    using PushConstants = prt::array<unsigned char, 64>;
+    alignas(16) PushConstants pushConstants;
+};
+
+/*
+ * Binds the device buffer of each swapchain image
+ **/
+struct DeviceBufferAttachment {
+    size_t descriptorIndex;
+    size_t deviceBufferIndex;
+};
+
+/*
+ * Binds the vertex buffer of assets
+ **/
+struct VertexBufferAttachment {
+    size_t descriptorIndex;
+    size_t assetsIndex;
+};
+
+/*
+ * Pipeline that is dispatched at the start of every
+ * frame, before the render passes. What it writes
+ * can be read as vertices by the graphics pipelines
+ **/
+struct ComputePipeline {
+    // Descriptors
+    prt::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    prt::vector<VkDescriptorPoolSize> descriptorPoolSizes;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    prt::vector<VkDescriptorSet> descriptorSets;
+    prt::vector<prt::vector<VkWriteDescriptorSet> > descriptorWrites;
+
+    // Pipeline
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    ShaderStage shaderStage;
+
+    prt::vector<StorageBufferAttachment> storageBufferAttachments;
+    prt::vector<DeviceBufferAttachment> deviceBufferAttachments;
+    prt::vector<VertexBufferAttachment> vertexBufferAttachments;
+
+    // Dispatches
+    prt::vector<Dispatch> dispatches;
+};
+
+#endif
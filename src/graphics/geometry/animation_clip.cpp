@@ -0,0 +1,541 @@
+#include "animation_clip.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    /*
+     * The few operations the sampler needs, on as many
+     * floats as the target's widest vector holds
+     **/
+#if defined(__AVX__)
+    constexpr size_t simdWidth = 8;
+    typedef __m256 simd;
+    typedef __m256 simdMask;
+    inline simd load(float const * p) { return _mm256_load_ps(p); }
+    // converts unsigned 16 bit integers to floats
+    inline simd loadU16(uint16_t const * p) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
+        __m128i lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        __m128i hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+        return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    }
+    inline void store(float * p, simd v) { _mm256_store_ps(p, v); }
+    inline simd set1(float f) { return _mm256_set1_ps(f); }
+    inline simd add(simd a, simd b) { return _mm256_add_ps(a, b); }
+    inline simd sub(simd a, simd b) { return _mm256_sub_ps(a, b); }
+    inline simd mul(simd a, simd b) { return _mm256_mul_ps(a, b); }
+    inline simd max(simd a, simd b) { return _mm256_max_ps(a, b); }
+    inline simd sqrt(simd a) { return _mm256_sqrt_ps(a); }
+    inline simd invSqrt(simd a) { return _mm256_div_ps(set1(1.0f), _mm256_sqrt_ps(a)); }
+    inline simd abs(simd a) { return _mm256_andnot_ps(set1(-0.0f), a); }
+    // negates the lanes of a where sign is negative
+    inline simd copySign(simd a, simd sign) { return _mm256_xor_ps(a, _mm256_and_ps(sign, set1(-0.0f))); }
+    // bit i is set if lane i of a is less than b
+    inline int lessThan(simd a, simd b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+    inline simdMask greaterEqual(simd a, simd b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    // lanes of a where mask is set, b elsewhere
+    inline simd select(simdMask mask, simd a, simd b) { return _mm256_blendv_ps(b, a, mask); }
+#elif defined(__SSE2__)
+    constexpr size_t simdWidth = 4;
+    typedef __m128 simd;
+    typedef __m128 simdMask;
+    inline simd load(float const * p) { return _mm_load_ps(p); }
+    inline simd loadU16(uint16_t const * p) {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(p));
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+    }
+    inline void store(float * p, simd v) { _mm_store_ps(p, v); }
+    inline simd set1(float f) { return _mm_set1_ps(f); }
+    inline simd add(simd a, simd b) { return _mm_add_ps(a, b); }
+    inline simd sub(simd a, simd b) { return _mm_sub_ps(a, b); }
+    inline simd mul(simd a, simd b) { return _mm_mul_ps(a, b); }
+    inline simd max(simd a, simd b) { return _mm_max_ps(a, b); }
+    inline simd sqrt(simd a) { return _mm_sqrt_ps(a); }
+    inline simd invSqrt(simd a) { return _mm_div_ps(set1(1.0f), _mm_sqrt_ps(a)); }
+    inline simd abs(simd a) { return _mm_andnot_ps(set1(-0.0f), a); }
+    inline simd copySign(simd a, simd sign) { return _mm_xor_ps(a, _mm_and_ps(sign, set1(-0.0f))); }
+    inline int lessThan(simd a, simd b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+    inline simdMask greaterEqual(simd a, simd b) { return _mm_cmpge_ps(a, b); }
+    inline simd select(simdMask mask, simd a, simd b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#else
+    constexpr size_t simdWidth = 1;
+    typedef float simd;
+    typedef bool simdMask;
+    inline simd load(float const * p) { return *p; }
+    inline simd loadU16(uint16_t const * p) { return *p; }
+    inline void store(float * p, simd v) { *p = v; }
+    inline simd set1(float f) { return f; }
+    inline simd add(simd a, simd b) { return a + b; }
+    inline simd sub(simd a, simd b) { return a - b; }
+    inline simd mul(simd a, simd b) { return a * b; }
+    inline simd max(simd a, simd b) { return std::max(a, b); }
+    inline simd sqrt(simd a) { return std::sqrt(a); }
+    inline simd invSqrt(simd a) { return 1.0f / std::sqrt(a); }
+    inline simd abs(simd a) { return std::fabs(a); }
+    inline simd copySign(simd a, simd sign) { return sign < 0.0f ? -a : a; }
+    inline int lessThan(simd a, simd b) { return a < b ? 1 : 0; }
+    inline simdMask greaterEqual(simd a, simd b) { return a >= b; }
+    inline simd select(simdMask mask, simd a, simd b) { return mask ? a : b; }
+#endif
+    static_assert(AnimationClip::laneWidth % simdWidth == 0, "lanes must fill the padded channels");
+
+    inline simd lerp(simd a, simd b, simd t) { return add(a, mul(sub(b, a), t)); }
+
+    // translations and scales are quantized to 16 bits
+    constexpr float quantizedMax = 65535.0f;
+    // the three smallest components of a unit quaternion are
+    // within +-1/sqrt(2), they are quantized to 15 bits and the
+    // top bits of the first two hold the index of the largest
+    constexpr float rotationRange = 0.70710678f;
+    constexpr float rotationMax = 32767.0f;
+    constexpr float rotationHighBit = 32768.0f;
+    // tracks that change less than this are stored once
+    constexpr float constantTolerance = 1e-5f;
+
+    void encodeRotation(glm::quat const & q, uint16_t * encoded) {
+        float const components[4] = { q.x, q.y, q.z, q.w };
+        uint32_t largest = 0;
+        for (uint32_t i = 1; i < 4; ++i) {
+            if (std::fabs(components[i]) > std::fabs(components[largest])) largest = i;
+        }
+        // q and -q are the same rotation, so the
+        // largest component is made positive
+        float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+        uint16_t values[3];
+        uint32_t j = 0;
+        for (uint32_t i = 0; i < 4; ++i) {
+            if (i == largest) continue;
+            float v = (sign * components[i] + rotationRange) / (2.0f * rotationRange);
+            values[j++] = uint16_t(std::lround(std::min(std::max(v, 0.0f), 1.0f) * rotationMax));
+        }
+        encoded[0] = values[0] | ((largest >> 1) << 15);
+        encoded[1] = values[1] | ((largest & 1) << 15);
+        encoded[2] = values[2];
+    }
+
+    glm::quat decodeRotation(uint16_t a, uint16_t b, uint16_t c) {
+        uint32_t largest = ((a >> 15) << 1) | (b >> 15);
+        float const values[3] = { (a & 0x7fff) * (2.0f * rotationRange / rotationMax) - rotationRange,
+                                  (b & 0x7fff) * (2.0f * rotationRange / rotationMax) - rotationRange,
+                                  c * (2.0f * rotationRange / rotationMax) - rotationRange };
+        float d = std::sqrt(std::max(0.0f, 1.0f - values[0] * values[0] - 
+                                                  values[1] * values[1] - 
+                                                  values[2] * values[2]));
+        float components[4];
+        uint32_t j = 0;
+        for (uint32_t i = 0; i < 4; ++i) {
+            components[i] = i == largest ? d : values[j++];
+        }
+        return glm::quat{ components[3], components[0], components[1], components[2] };
+    }
+
+    /**
+     * Decodes the rotations of simdWidth channels
+     */
+    inline void decodeRotations(uint16_t const * a, uint16_t const * b, uint16_t const * c,
+                                simd & x, simd & y, simd & z, simd & w) {
+        simd const highBit = set1(rotationHighBit);
+        simd const scale = set1(2.0f * rotationRange / rotationMax);
+        simd const offset = set1(-rotationRange);
+
+        simd va = loadU16(a);
+        simd vb = loadU16(b);
+        simd vc = loadU16(c);
+        // the index of the largest component is high * 2 + low
+        simdMask high = greaterEqual(va, highBit);
+        simdMask low = greaterEqual(vb, highBit);
+        va = add(mul(select(high, sub(va, highBit), va), scale), offset);
+        vb = add(mul(select(low, sub(vb, highBit), vb), scale), offset);
+        vc = add(mul(vc, scale), offset);
+        simd d = sqrt(max(set1(0.0f), sub(set1(1.0f), add(add(mul(va, va), mul(vb, vb)), mul(vc, vc)))));
+
+        x = select(high, va, select(low, va, d));
+        y = select(high, vb, select(low, d, va));
+        z = select(high, select(low, vc, d), vb);
+        w = select(high, select(low, d, vc), vc);
+    }
+
+    // rows of a sampled batch of channels
+    enum Result {
+        RESULT_TRANSLATION_X,
+        RESULT_TRANSLATION_Y,
+        RESULT_TRANSLATION_Z,
+        RESULT_ROTATION_X,
+        RESULT_ROTATION_Y,
+        RESULT_ROTATION_Z,
+        RESULT_ROTATION_W,
+        RESULT_SCALE_X,
+        RESULT_SCALE_Y,
+        RESULT_SCALE_Z,
+        NUM_RESULTS
+    };
+}
+
+glm::mat4 TRS::toMatrix() const {
+    glm::mat3 r = glm::mat3_cast(rotation);
+    return glm::mat4{ glm::vec4{ r[0] * scale.x, 0.0f },
+                      glm::vec4{ r[1] * scale.y, 0.0f },
+                      glm::vec4{ r[2] * scale.z, 0.0f },
+                      glm::vec4{ translation, 1.0f } };
+}
+
+TRS TRS::fromMatrix(glm::mat4 const & m) {
+    TRS trs;
+    trs.translation = glm::vec3{ m[3] };
+    trs.scale = { glm::length(glm::vec3{ m[0] }),
+                  glm::length(glm::vec3{ m[1] }),
+                  glm::length(glm::vec3{ m[2] }) };
+    glm::mat3 r{ glm::vec3{ m[0] } / trs.scale.x,
+                 glm::vec3{ m[1] } / trs.scale.y,
+                 glm::vec3{ m[2] } / trs.scale.z };
+    // a mirroring matrix is a rotation with negative scale
+    if (glm::determinant(r) < 0.0f) {
+        trs.scale.x = -trs.scale.x;
+        r[0] = -r[0];
+    }
+    trs.rotation = glm::normalize(glm::quat_cast(r));
+    return trs;
+}
+
+AnimationClip::AnimationClip()
+    : m_duration(0.0f), m_ticksPerSecond(1.0), m_numChannels(0), m_stride(0), m_numKeys(0),
+      m_channelData(prt::ALIGNMENT::ALIGN_32_BYTES), m_groupStrides{}, m_groupOffsets{}, 
+      m_keySize(0) {}
+
+void AnimationClip::compress(float duration, double ticksPerSecond,
+                             uint32_t numChannels, TRS const * keys, float const * keyTimes,
+                             uint32_t numKeys, prt::vector<uint32_t> const & keptKeys) {
+    assert(!keptKeys.empty() && keptKeys[0] == 0 && "the first key needs to be kept");
+    assert(keyTimes[0] == 0.0f && "the first key needs to be at the start of the clip");
+    m_duration = duration;
+    m_ticksPerSecond = ticksPerSecond;
+    m_numChannels = numChannels;
+    m_stride = (numChannels + laneWidth - 1) / laneWidth * laneWidth;
+    m_numKeys = keptKeys.size();
+
+    m_keyTimes.resize(m_numKeys);
+    for (uint32_t i = 0; i < m_numKeys; ++i) {
+        assert(keptKeys[i] < numKeys);
+        m_keyTimes[i] = keyTimes[keptKeys[i]];
+    }
+
+    // padding is sampled as identity transforms
+    m_channelData.resize(NUM_CHANNEL_ROWS * m_stride);
+    for (uint32_t row = 0; row < NUM_CHANNEL_ROWS; ++row) {
+        bool one = (row >= CHANNEL_SCALE_MIN_X && row <= CHANNEL_SCALE_MIN_Z) || row == CHANNEL_ROTATION_W;
+        std::fill(m_channelData.data() + row * m_stride, m_channelData.data() + (row + 1) * m_stride, one ? 1.0f : 0.0f);
+    }
+
+    // ranges of the kept keys of each channel
+    uint32_t numAnimated[NUM_TRACK_GROUPS] = {};
+    for (uint32_t c = 0; c < numChannels; ++c) {
+        TRS const & first = keys[c];
+        glm::vec3 minTranslation = first.translation;
+        glm::vec3 maxTranslation = first.translation;
+        glm::vec3 minScale = first.scale;
+        glm::vec3 maxScale = first.scale;
+        bool constantRotation = true;
+        for (uint32_t k : keptKeys) {
+            TRS const & key = keys[k * numChannels + c];
+            minTranslation = glm::min(minTranslation, key.translation);
+            maxTranslation = glm::max(maxTranslation, key.translation);
+            minScale = glm::min(minScale, key.scale);
+            maxScale = glm::max(maxScale, key.scale);
+            constantRotation &= std::fabs(glm::dot(first.rotation, key.rotation)) >= 1.0f - constantTolerance;
+        }
+
+        for (uint32_t i = 0; i < 3; ++i) {
+            float translationExtent = maxTranslation[i] - minTranslation[i];
+            float scaleExtent = maxScale[i] - minScale[i];
+            m_channelData[(CHANNEL_TRANSLATION_MIN_X + i) * m_stride + c] = minTranslation[i];
+            m_channelData[(CHANNEL_SCALE_MIN_X + i) * m_stride + c] = minScale[i];
+            if (translationExtent > constantTolerance) {
+                m_channelData[(CHANNEL_TRANSLATION_STEP_X + i) * m_stride + c] = translationExtent / quantizedMax;
+                numAnimated[TRACK_GROUP_TRANSLATION] = c + 1;
+            }
+            if (scaleExtent > constantTolerance) {
+                m_channelData[(CHANNEL_SCALE_STEP_X + i) * m_stride + c] = scaleExtent / quantizedMax;
+                numAnimated[TRACK_GROUP_SCALE] = c + 1;
+            }
+        }
+        m_channelData[CHANNEL_ROTATION_X * m_stride + c] = first.rotation.x;
+        m_channelData[CHANNEL_ROTATION_Y * m_stride + c] = first.rotation.y;
+        m_channelData[CHANNEL_ROTATION_Z * m_stride + c] = first.rotation.z;
+        m_channelData[CHANNEL_ROTATION_W * m_stride + c] = first.rotation.w;
+        if (!constantRotation) {
+            numAnimated[TRACK_GROUP_ROTATION] = c + 1;
+        }
+    }
+
+    m_keySize = 0;
+    for (uint32_t g = 0; g < NUM_TRACK_GROUPS; ++g) {
+        m_groupStrides[g] = (numAnimated[g] + laneWidth - 1) / laneWidth * laneWidth;
+        m_groupOffsets[g] = m_keySize;
+        m_keySize += 3 * m_groupStrides[g];
+    }
+
+    m_keys.resize(size_t(m_numKeys) * m_keySize);
+    std::fill(m_keys.begin(), m_keys.end(), 0);
+    for (uint32_t k = 0; k < m_numKeys; ++k) {
+        for (uint32_t c = 0; c < m_groupStrides[TRACK_GROUP_ROTATION]; ++c) {
+            glm::quat rotation = c < numChannels ? keys[keptKeys[k] * numChannels + c].rotation 
+                                                 : glm::quat{ 1.0f, 0.0f, 0.0f, 0.0f };
+            uint16_t encoded[3];
+            encodeRotation(rotation, encoded);
+            for (uint32_t i = 0; i < 3; ++i) {
+                getKeyRow(k, TRACK_GROUP_ROTATION, i)[c] = encoded[i];
+            }
+        }
+
+        for (uint32_t c = 0; c < numChannels; ++c) {
+            TRS const & key = keys[keptKeys[k] * numChannels + c];
+            for (uint32_t i = 0; i < 3; ++i) {
+                if (c < m_groupStrides[TRACK_GROUP_TRANSLATION]) {
+                    float step = getChannelRow(CHANNEL_TRANSLATION_STEP_X + i)[c];
+                    float min = getChannelRow(CHANNEL_TRANSLATION_MIN_X + i)[c];
+                    getKeyRow(k, TRACK_GROUP_TRANSLATION, i)[c] = 
+                        step > 0.0f ? uint16_t(std::lround(std::min((key.translation[i] - min) / step, quantizedMax))) : 0;
+                }
+                if (c < m_groupStrides[TRACK_GROUP_SCALE]) {
+                    float step = getChannelRow(CHANNEL_SCALE_STEP_X + i)[c];
+                    float min = getChannelRow(CHANNEL_SCALE_MIN_X + i)[c];
+                    getKeyRow(k, TRACK_GROUP_SCALE, i)[c] = 
+                        step > 0.0f ? uint16_t(std::lround(std::min((key.scale[i] - min) / step, quantizedMax))) : 0;
+                }
+            }
+        }
+    }
+}
+
+TRS AnimationClip::getKey(uint32_t channel, uint32_t key) const {
+    TRS trs;
+    for (uint32_t i = 0; i < 3; ++i) {
+        trs.translation[i] = getChannelRow(CHANNEL_TRANSLATION_MIN_X + i)[channel];
+        trs.scale[i] = getChannelRow(CHANNEL_SCALE_MIN_X + i)[channel];
+        if (channel < m_groupStrides[TRACK_GROUP_TRANSLATION]) {
+            trs.translation[i] += getKeyRow(key, TRACK_GROUP_TRANSLATION, i)[channel] * 
+                                  getChannelRow(CHANNEL_TRANSLATION_STEP_X + i)[channel];
+        }
+        if (channel < m_groupStrides[TRACK_GROUP_SCALE]) {
+            trs.scale[i] += getKeyRow(key, TRACK_GROUP_SCALE, i)[channel] * 
+                            getChannelRow(CHANNEL_SCALE_STEP_X + i)[channel];
+        }
+    }
+    if (channel < m_groupStrides[TRACK_GROUP_ROTATION]) {
+        trs.rotation = decodeRotation(getKeyRow(key, TRACK_GROUP_ROTATION, 0)[channel],
+                                      getKeyRow(key, TRACK_GROUP_ROTATION, 1)[channel],
+                                      getKeyRow(key, TRACK_GROUP_ROTATION, 2)[channel]);
+    } else {
+        trs.rotation = { getChannelRow(CHANNEL_ROTATION_W)[channel],
+                         getChannelRow(CHANNEL_ROTATION_X)[channel],
+                         getChannelRow(CHANNEL_ROTATION_Y)[channel],
+                         getChannelRow(CHANNEL_ROTATION_Z)[channel] };
+    }
+    return trs;
+}
+
+uint32_t AnimationClip::findKey(float clipTime, uint32_t const * keyCursor) const {
+    float const * keyTimes = m_keyTimes.data();
+    uint32_t key = 0;
+    // playing forward, the key is the one found
+    // last or one of the few after it
+    if (keyCursor != nullptr && *keyCursor < m_numKeys && keyTimes[*keyCursor] <= clipTime) {
+        key = *keyCursor;
+        for (uint32_t i = 0; i < maxCursorSteps; ++i) {
+            if (key + 1 == m_numKeys || keyTimes[key + 1] > clipTime) return key;
+            ++key;
+        }
+    }
+    // looped, moved back or skipped ahead
+    return std::upper_bound(keyTimes + key, keyTimes + m_numKeys, clipTime) - keyTimes - 1;
+}
+
+void AnimationClip::sample(float t, TRS * pose, uint32_t numChannels, 
+                           uint32_t * keyCursor) const {
+    assert(numChannels <= m_numChannels);
+    if (m_numKeys == 0) return;
+
+    // every channel shares the keys to interpolate between
+    float clipTime = t / getDuration();
+    clipTime -= std::floor(clipTime);
+    uint32_t prevKey = findKey(clipTime, keyCursor);
+    if (keyCursor != nullptr) {
+        *keyCursor = prevKey;
+    }
+    uint32_t nextKey = prevKey + 1 < m_numKeys ? prevKey + 1 : 0;
+    float nextTime = prevKey + 1 < m_numKeys ? m_keyTimes[prevKey + 1] : 1.0f;
+    float frac = (clipTime - m_keyTimes[prevKey]) / (nextTime - m_keyTimes[prevKey]);
+
+    simd const factor = set1(frac);
+    simd const threshold = set1(animation_util::nlerpThreshold);
+
+    // min + lerp(a, b) * step, or the constant min past
+    // the channels that have keys
+    auto sampleRange = [&](uint32_t group, uint32_t minRow, uint32_t stepRow, 
+                           uint32_t component, uint32_t c) {
+        simd value = load(getChannelRow(minRow + component) + c);
+        if (c < m_groupStrides[group]) {
+            simd quantized = lerp(loadU16(getKeyRow(prevKey, group, component) + c),
+                                  loadU16(getKeyRow(nextKey, group, component) + c), factor);
+            value = add(value, mul(quantized, load(getChannelRow(stepRow + component) + c)));
+        }
+        return value;
+    };
+
+    alignas(32) float result[NUM_RESULTS][laneWidth];
+    for (uint32_t first = 0; first < numChannels; first += laneWidth) {
+        bool rotated = first < m_groupStrides[TRACK_GROUP_ROTATION];
+        int slerpMask = 0;
+        for (uint32_t lane = 0; lane < laneWidth; lane += simdWidth) {
+            uint32_t c = first + lane;
+            for (uint32_t i = 0; i < 3; ++i) {
+                store(&result[RESULT_TRANSLATION_X + i][lane], 
+                      sampleRange(TRACK_GROUP_TRANSLATION, CHANNEL_TRANSLATION_MIN_X, 
+                                  CHANNEL_TRANSLATION_STEP_X, i, c));
+                store(&result[RESULT_SCALE_X + i][lane], 
+                      sampleRange(TRACK_GROUP_SCALE, CHANNEL_SCALE_MIN_X, 
+                                  CHANNEL_SCALE_STEP_X, i, c));
+            }
+
+            if (!rotated) {
+                for (uint32_t i = 0; i < 4; ++i) {
+                    store(&result[RESULT_ROTATION_X + i][lane], load(getChannelRow(CHANNEL_ROTATION_X + i) + c));
+                }
+                continue;
+            }
+
+            simd ax, ay, az, aw, bx, by, bz, bw;
+            decodeRotations(getKeyRow(prevKey, TRACK_GROUP_ROTATION, 0) + c,
+                            getKeyRow(prevKey, TRACK_GROUP_ROTATION, 1) + c,
+                            getKeyRow(prevKey, TRACK_GROUP_ROTATION, 2) + c,
+                            ax, ay, az, aw);
+            decodeRotations(getKeyRow(nextKey, TRACK_GROUP_ROTATION, 0) + c,
+                            getKeyRow(nextKey, TRACK_GROUP_ROTATION, 1) + c,
+                            getKeyRow(nextKey, TRACK_GROUP_ROTATION, 2) + c,
+                            bx, by, bz, bw);
+
+            // shortest path
+            simd cosTheta = add(add(mul(ax, bx), mul(ay, by)), add(mul(az, bz), mul(aw, bw)));
+            bx = copySign(bx, cosTheta);
+            by = copySign(by, cosTheta);
+            bz = copySign(bz, cosTheta);
+            bw = copySign(bw, cosTheta);
+            slerpMask |= lessThan(abs(cosTheta), threshold) << lane;
+
+            simd x = lerp(ax, bx, factor);
+            simd y = lerp(ay, by, factor);
+            simd z = lerp(az, bz, factor);
+            simd w = lerp(aw, bw, factor);
+            simd invLength = invSqrt(add(add(mul(x, x), mul(y, y)), add(mul(z, z), mul(w, w))));
+            store(&result[RESULT_ROTATION_X][lane], mul(x, invLength));
+            store(&result[RESULT_ROTATION_Y][lane], mul(y, invLength));
+            store(&result[RESULT_ROTATION_Z][lane], mul(z, invLength));
+            store(&result[RESULT_ROTATION_W][lane], mul(w, invLength));
+        }
+
+        uint32_t numLanes = std::min(uint32_t(laneWidth), numChannels - first);
+        for (uint32_t lane = 0; lane < numLanes; ++lane) {
+            TRS & trs = pose[first + lane];
+            trs.translation = { result[RESULT_TRANSLATION_X][lane],
+                                result[RESULT_TRANSLATION_Y][lane],
+                                result[RESULT_TRANSLATION_Z][lane] };
+            trs.scale = { result[RESULT_SCALE_X][lane],
+                          result[RESULT_SCALE_Y][lane],
+                          result[RESULT_SCALE_Z][lane] };
+            if (slerpMask & (1 << lane)) {
+                // keys far apart, where a normalized lerp is off
+                trs.rotation = glm::slerp(getKey(first + lane, prevKey).rotation,
+                                          getKey(first + lane, nextKey).rotation, frac);
+            } else {
+                trs.rotation = { result[RESULT_ROTATION_W][lane],
+                                 result[RESULT_ROTATION_X][lane],
+                                 result[RESULT_ROTATION_Y][lane],
+                                 result[RESULT_ROTATION_Z][lane] };
+            }
+        }
+    }
+}
+
+size_t AnimationClip::getSize() const {
+    return sizeof(*this) + 
+           m_keyTimes.size() * sizeof(float) + 
+           m_channelData.size() * sizeof(float) +
+           m_keys.size() * sizeof(uint16_t);
+}
+
+void AnimationClip::serialize(io_util::BinaryWriter & writer) const {
+    writer.write(m_duration);
+    writer.write(m_ticksPerSecond);
+    writer.write(m_numChannels);
+    writer.write(m_stride);
+    writer.write(m_numKeys);
+    writer.writeVector(m_keyTimes);
+    writer.writeVector(m_channelData);
+    writer.write(m_groupStrides);
+    writer.write(m_groupOffsets);
+    writer.write(m_keySize);
+    writer.writeVector(m_keys);
+}
+
+bool AnimationClip::deserialize(io_util::BinaryReader & reader) {
+    bool valid = reader.read(m_duration) &&
+                 reader.read(m_ticksPerSecond) &&
+                 reader.read(m_numChannels) &&
+                 reader.read(m_stride) &&
+                 reader.read(m_numKeys) &&
+                 reader.readVector(m_keyTimes) &&
+                 reader.readVector(m_channelData) &&
+                 reader.read(m_groupStrides) &&
+                 reader.read(m_groupOffsets) &&
+                 reader.read(m_keySize) &&
+                 reader.readVector(m_keys) &&
+                 m_stride >= m_numChannels &&
+                 m_stride % laneWidth == 0 &&
+                 m_keyTimes.size() == m_numKeys &&
+                 m_channelData.size() == size_t(NUM_CHANNEL_ROWS) * m_stride &&
+                 m_keys.size() == size_t(m_numKeys) * m_keySize;
+    // sampling loads whole lanes of each group, so the
+    // groups must fit in both a key and the channel rows
+    for (uint32_t g = 0; valid && g < NUM_TRACK_GROUPS; ++g) {
+        valid = m_groupStrides[g] <= m_stride &&
+                m_groupStrides[g] % laneWidth == 0 &&
+                m_groupOffsets[g] <= m_keySize &&
+                3 * uint64_t(m_groupStrides[g]) <= m_keySize - m_groupOffsets[g];
+    }
+    return valid;
+}
+
+glm::quat animation_util::interpolate(glm::quat const & a, glm::quat const & b, float factor) {
+    float cosTheta = glm::dot(a, b);
+    if (std::fabs(cosTheta) < nlerpThreshold) {
+        return glm::slerp(a, b, factor);
+    }
+    glm::quat c = cosTheta < 0.0f ? -b : b;
+    return glm::normalize(a + factor * (c - a));
+}
+
+void animation_util::blendPoses(TRS const * a, TRS const * b, float factor, TRS * pose, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        pose[i].translation = glm::mix(a[i].translation, b[i].translation, factor);
+        pose[i].rotation = interpolate(a[i].rotation, b[i].rotation, factor);
+        pose[i].scale = glm::mix(a[i].scale, b[i].scale, factor);
+    }
+}
+
+void animation_util::addPose(TRS const * additive, TRS const * reference, float weight, TRS * pose, size_t n) {
+    glm::quat const identity{ 1.0f, 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < n; ++i) {
+        glm::quat delta = additive[i].rotation * glm::conjugate(reference[i].rotation);
+        pose[i].translation += weight * (additive[i].translation - reference[i].translation);
+        pose[i].rotation = glm::normalize(interpolate(identity, delta, weight) * pose[i].rotation);
+        pose[i].scale *= glm::mix(glm::vec3{ 1.0f }, additive[i].scale / reference[i].scale, weight);
+    }
+}
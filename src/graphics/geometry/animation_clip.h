@@ -0,0 +1,239 @@
+#ifndef PBR_ANIMATION_CLIP_H
+#define PBR_ANIMATION_CLIP_H
+
+#include "src/container/vector.h"
+#include "src/util/io_util.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/*
+ * Local transform of a node as translation,
+ * rotation and scale
+ **/
+struct TRS {
+    glm::vec3 translation;
+    glm::quat rotation;
+    glm::vec3 scale;
+
+    /**
+     * @return translation * rotation * scale as a matrix
+     */
+    glm::mat4 toMatrix() const;
+
+    /**
+     * Decomposes a matrix without shear or projection
+     * @param m matrix to decompose
+     * @return transform that toMatrix() maps to m
+     */
+    static TRS fromMatrix(glm::mat4 const & m);
+};
+
+/*
+ * Compressed keys of an animation, stored as one array per
+ * component of each track so that several channels are
+ * sampled at once with SIMD.
+ *
+ * Every channel shares the same key times, so that the keys
+ * to interpolate between are found once per clip. Keys need
+ * not be evenly spaced, and a cursor that remembers the key
+ * found last makes finding them take amortized constant
+ * time while the clip plays forward, however many keys it
+ * has. Rotations are stored as their three smallest
+ * components in 48 bits, translations and scales as 16 bits
+ * in the range of their channel. Tracks that do not change
+ * are stored once. The clip loops, from the last key back
+ * to the first.
+ **/
+class AnimationClip {
+public:
+    // channels are padded to a multiple of this,
+    // enough for both SSE and AVX
+    static constexpr size_t laneWidth = 8;
+
+    AnimationClip();
+
+    /**
+     * Compresses keys into the clip
+     * @param duration duration in ticks
+     * @param ticksPerSecond ticks per second
+     * @param numChannels number of animated nodes
+     * @param keys key k of channel c at k * numChannels + c
+     * @param keyTimes ascending time of each key as a fraction
+     *                 of the duration, starting at 0
+     * @param numKeys number of keys of every channel
+     * @param keptKeys ascending indices of the keys that
+     *                 are stored, starting at 0, the rest
+     *                 are interpolated
+     */
+    void compress(float duration, double ticksPerSecond,
+                  uint32_t numChannels, TRS const * keys, float const * keyTimes,
+                  uint32_t numKeys, prt::vector<uint32_t> const & keptKeys);
+
+    /**
+     * @param channel index of the channel
+     * @param key index of a stored key
+     * @return decompressed key
+     */
+    TRS getKey(uint32_t channel, uint32_t key) const;
+
+    /**
+     * Samples the leading channels of the clip
+     * @param t time in seconds
+     * @param pose local transform of each channel,
+     *             must hold numChannels transforms
+     * @param numChannels number of channels to sample,
+     *                    at most getNumChannels()
+     * @param keyCursor key found by the last sample, updated
+     *                  to the key found by this one. Any
+     *                  value is valid, may be null
+     */
+    void sample(float t, TRS * pose, uint32_t numChannels, 
+                uint32_t * keyCursor = nullptr) const;
+
+    /**
+     * Samples every channel of the clip
+     * @param t time in seconds
+     * @param pose local transform of each channel,
+     *             must hold getNumChannels() transforms
+     */
+    inline void sample(float t, TRS * pose) const { sample(t, pose, m_numChannels); }
+
+    /**
+     * @return duration in seconds
+     */
+    inline float getDuration() const { return m_duration / m_ticksPerSecond; }
+
+    inline uint32_t getNumChannels() const { return m_numChannels; }
+
+    /**
+     * @return number of stored keys
+     */
+    inline uint32_t getNumKeys() const { return m_numKeys; }
+
+    /**
+     * @param key index of a stored key
+     * @return time of the key as a fraction of the duration
+     */
+    inline float getKeyTime(uint32_t key) const { return m_keyTimes[key]; }
+
+    /**
+     * @return size of the compressed clip in bytes
+     */
+    size_t getSize() const;
+
+    void serialize(io_util::BinaryWriter & writer) const;
+
+    bool deserialize(io_util::BinaryReader & reader);
+
+private:
+    enum TrackGroup {
+        TRACK_GROUP_TRANSLATION,
+        TRACK_GROUP_ROTATION,
+        TRACK_GROUP_SCALE,
+        NUM_TRACK_GROUPS
+    };
+
+    // rows of per channel data
+    enum ChannelRow {
+        CHANNEL_TRANSLATION_MIN_X,
+        CHANNEL_TRANSLATION_MIN_Y,
+        CHANNEL_TRANSLATION_MIN_Z,
+        CHANNEL_TRANSLATION_STEP_X,
+        CHANNEL_TRANSLATION_STEP_Y,
+        CHANNEL_TRANSLATION_STEP_Z,
+        CHANNEL_SCALE_MIN_X,
+        CHANNEL_SCALE_MIN_Y,
+        CHANNEL_SCALE_MIN_Z,
+        CHANNEL_SCALE_STEP_X,
+        CHANNEL_SCALE_STEP_Y,
+        CHANNEL_SCALE_STEP_Z,
+        // rotation of channels with a constant rotation
+        CHANNEL_ROTATION_X,
+        CHANNEL_ROTATION_Y,
+        CHANNEL_ROTATION_Z,
+        CHANNEL_ROTATION_W,
+        NUM_CHANNEL_ROWS
+    };
+
+    // keys a cursor steps over before
+    // the rest are binary searched
+    static constexpr uint32_t maxCursorSteps = 4;
+
+    float m_duration;
+    double m_ticksPerSecond;
+    uint32_t m_numChannels;
+    // channels rounded up to laneWidth
+    uint32_t m_stride;
+    uint32_t m_numKeys;
+    // time of each key as a fraction of the duration
+    prt::vector<float> m_keyTimes;
+    // row r of channel c is at r * m_stride + c
+    prt::vector<float> m_channelData;
+    // the leading channels of a group that have keys, rounded
+    // up to laneWidth, the rest are constant. A key holds
+    // three rows of each group, one per component, where
+    // component i of group g is at
+    // m_groupOffsets[g] + i * m_groupStrides[g]
+    uint32_t m_groupStrides[NUM_TRACK_GROUPS];
+    uint32_t m_groupOffsets[NUM_TRACK_GROUPS];
+    uint32_t m_keySize;
+    prt::vector<uint16_t> m_keys;
+
+    /**
+     * @param clipTime time as a fraction of the duration
+     * @param keyCursor key found last, may be null
+     * @return last stored key at or before clipTime
+     */
+    uint32_t findKey(float clipTime, uint32_t const * keyCursor) const;
+
+    inline float const * getChannelRow(uint32_t row) const { return &m_channelData[row * m_stride]; }
+    inline uint16_t const * getKeyRow(uint32_t key, uint32_t group, uint32_t component) const {
+        return &m_keys[key * m_keySize + m_groupOffsets[group] + component * m_groupStrides[group]];
+    }
+    inline uint16_t * getKeyRow(uint32_t key, uint32_t group, uint32_t component) {
+        return &m_keys[key * m_keySize + m_groupOffsets[group] + component * m_groupStrides[group]];
+    }
+};
+
+namespace animation_util {
+    // quaternions that are further apart than this
+    // are slerped, closer ones are normalized lerped
+    static constexpr float nlerpThreshold = 0.95f;
+
+    /**
+     * Interpolates along the shortest path, as glm::slerp,
+     * but with a normalized lerp if the quaternions are close
+     * @param a quaternion at factor 0
+     * @param b quaternion at factor 1
+     * @param factor interpolation factor
+     * @return interpolated quaternion
+     */
+    glm::quat interpolate(glm::quat const & a, glm::quat const & b, float factor);
+
+    /**
+     * Blends two poses
+     * @param a pose at factor 0
+     * @param b pose at factor 1
+     * @param factor blend factor
+     * @param pose blended pose, may alias a or b
+     * @param n number of transforms in each pose
+     */
+    void blendPoses(TRS const * a, TRS const * b, float factor, TRS * pose, size_t n);
+
+    /**
+     * Adds the difference of an additive pose from
+     * its reference pose on top of a pose
+     * @param additive additive pose
+     * @param reference pose that additive is relative to
+     * @param weight how much of the difference is added
+     * @param pose pose to add to
+     * @param n number of transforms in each pose
+     */
+    void addPose(TRS const * additive, TRS const * reference, float weight, TRS * pose, size_t n);
+};
+
+#endif
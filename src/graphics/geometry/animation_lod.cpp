@@ -0,0 +1,227 @@
+#include "animation_lod.h"
+
+#include "src/container/hash_map.h"
+#include "src/util/math_util.h"
+#include "src/util/parallel_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // instances per job when interpolating
+    constexpr size_t interpolationJobSize = 8;
+
+    float maxScale(glm::mat4 const & m) {
+        return glm::max(glm::length(glm::vec3(m[0])),
+                        glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+    }
+
+    void copyBones(prt::vector<glm::mat4> const & src, uint32_t srcOffset,
+                   prt::vector<glm::mat4> & dst, uint32_t dstOffset, uint32_t numBones) {
+        if (numBones == 0) return;
+        memcpy(dst.data() + dstOffset, src.data() + srcOffset, numBones * sizeof(glm::mat4));
+    }
+}
+
+void AnimationLOD::bind(ModelManager const & modelManager,
+                        ModelID const * modelIDs,
+                        uint32_t const * instances,
+                        uint32_t const * boneOffsets,
+                        size_t n) {
+    prt::hash_map<uint32_t, uint32_t> previous;
+    for (size_t i = 0; i < m_states.size(); ++i) {
+        previous.insert(m_states[i].instance, i);
+    }
+
+    size_t numBones = n == 0 ? 0 : boneOffsets[n - 1] +
+                                   modelManager.getModel(modelIDs[n - 1]).getNumBones();
+    prt::vector<State> states;
+    prt::vector<glm::mat4> bones;
+    prt::vector<glm::mat4> startBones;
+    prt::vector<glm::mat4> endBones;
+    states.resize(n);
+    bones.resize(numBones);
+    startBones.resize(numBones);
+    endBones.resize(numBones);
+
+    for (size_t i = 0; i < n; ++i) {
+        Model const & model = modelManager.getModel(modelIDs[i]);
+        State & state = states[i];
+        state.instance = instances[i];
+        state.numBones = model.getNumBones();
+        model.getBounds(state.center, state.radius);
+
+        // instances that stay bound keep their pose, unless
+        // their model was re-imported with another skeleton
+        auto it = previous.find(instances[i]);
+        if (it == previous.end()) continue;
+        State const & prev = m_states[it->value()];
+        if (prev.numBones != state.numBones) continue;
+
+        state.level = prev.level;
+        state.interval = prev.interval;
+        state.framesSinceUpdate = prev.framesSinceUpdate;
+        state.factor = prev.factor;
+        state.evaluated = prev.evaluated;
+        std::copy(prev.keyCursors, prev.keyCursors + BlendedAnimation::maxLayers, state.keyCursors);
+        uint32_t offset = m_boneOffsets[it->value()];
+        copyBones(m_bones, offset, bones, boneOffsets[i], state.numBones);
+        copyBones(m_startBones, offset, startBones, boneOffsets[i], state.numBones);
+        copyBones(m_endBones, offset, endBones, boneOffsets[i], state.numBones);
+    }
+
+    m_states = states;
+    m_bones = bones;
+    m_startBones = startBones;
+    m_endBones = endBones;
+    m_boneOffsets.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        m_boneOffsets[i] = boneOffsets[i];
+    }
+
+    // update does not allocate
+    m_due.reserve(n);
+    m_updateModelIDs.reserve(n);
+    m_updateBlends.reserve(n);
+    m_updateOffsets.reserve(n);
+    m_updateSkipLeafBones.reserve(n);
+    m_updateKeyCursors.reserve(n * BlendedAnimation::maxLayers);
+    m_updateIndices.reserve(n);
+}
+
+void AnimationLOD::update(ModelManager & modelManager,
+                          ModelID const * modelIDs,
+                          glm::mat4 const * transforms,
+                          BlendedAnimation const * animationBlends,
+                          size_t n,
+                          glm::mat4 const & viewProjection,
+                          glm::vec3 const & viewPosition,
+                          float pixelsPerUnit,
+                          float deltaTime) {
+    assert(n == m_states.size() && "animated instances do not match those bound!");
+
+    m_counters = Counters{};
+
+    glm::vec4 frustumPlanes[6];
+    math_util::frustumPlanes(viewProjection, frustumPlanes);
+
+    // pick levels and find the instances that are due
+    m_due.resize(0);
+    for (size_t i = 0; i < n; ++i) {
+        State & state = m_states[i];
+        glm::mat4 const & transform = transforms[i];
+        glm::vec3 center = glm::vec3(transform * glm::vec4(state.center, 1.0f));
+        float radius = boundsMargin * maxScale(transform) * state.radius;
+
+        if (!math_util::sphereInFrustum(frustumPlanes, center, radius)) {
+            state.level = ANIMATION_LOD_FROZEN;
+        } else {
+            float distance = glm::max(glm::length(center - viewPosition), 1e-4f);
+            float pixels = pixelsPerUnit * radius / distance;
+            state.level = pixels >= fullPixels ? ANIMATION_LOD_FULL :
+                          pixels >= reducedPixels ? ANIMATION_LOD_REDUCED :
+                                                    ANIMATION_LOD_LOW;
+        }
+        ++m_counters.instances[state.level];
+
+        if (state.evaluated) {
+            ++state.framesSinceUpdate;
+        }
+        uint32_t interval = updateIntervals[state.level];
+        if (!state.evaluated) {
+            // nothing to show yet, so the instance is
+            // evaluated even if it is offscreen
+            state.priority = std::numeric_limits<float>::max();
+            m_due.push_back(i);
+        } else if (interval > 0 && state.framesSinceUpdate >= interval) {
+            state.priority = float(state.framesSinceUpdate) / float(interval);
+            m_due.push_back(i);
+        }
+    }
+
+    // the instances that are furthest behind go first
+    std::sort(m_due.begin(), m_due.end(), [this](uint32_t a, uint32_t b) {
+        return m_states[a].priority > m_states[b].priority;
+    });
+
+    m_updateModelIDs.resize(0);
+    m_updateBlends.resize(0);
+    m_updateOffsets.resize(0);
+    m_updateSkipLeafBones.resize(0);
+    m_updateKeyCursors.resize(0);
+    m_updateIndices.resize(0);
+    for (uint32_t index : m_due) {
+        State & state = m_states[index];
+        if (state.evaluated && m_counters.bones + state.numBones > boneBudget) {
+            ++m_counters.deferred;
+            continue;
+        }
+        // the pose is evaluated where the animation will be
+        // when the next evaluation is due, and approached
+        // over the frames in between. Instances that have
+        // not been shown jump straight to their pose
+        uint32_t interval = state.evaluated ? glm::max(updateIntervals[state.level], 1u) : 1;
+        BlendedAnimation blend = animationBlends[index];
+        if (!blend.paused) {
+            blend.time += float(interval - 1) * deltaTime;
+        }
+        m_updateModelIDs.push_back(modelIDs[index]);
+        m_updateBlends.push_back(blend);
+        m_updateOffsets.push_back(m_boneOffsets[index]);
+        m_updateSkipLeafBones.push_back(state.level == ANIMATION_LOD_LOW);
+        for (uint32_t cursor : state.keyCursors) {
+            m_updateKeyCursors.push_back(cursor);
+        }
+        m_updateIndices.push_back(index);
+
+        copyBones(m_bones, m_boneOffsets[index], m_startBones, m_boneOffsets[index], state.numBones);
+        state.factor = 0.0f;
+        state.interval = interval;
+        state.framesSinceUpdate = 0;
+        state.evaluated = true;
+
+        ++m_counters.updates[state.level];
+        m_counters.bones += state.numBones;
+    }
+
+    modelManager.getSampledBlendedAnimation(m_updateModelIDs.data(),
+                                            m_updateBlends.data(),
+                                            m_updateOffsets.data(),
+                                            m_updateSkipLeafBones.data(),
+                                            m_updateKeyCursors.data(),
+                                            m_endBones.data(),
+                                            m_updateModelIDs.size());
+
+    for (size_t i = 0; i < m_updateIndices.size(); ++i) {
+        uint32_t const * cursors = m_updateKeyCursors.data() + i * BlendedAnimation::maxLayers;
+        std::copy(cursors, cursors + BlendedAnimation::maxLayers, m_states[m_updateIndices[i]].keyCursors);
+    }
+
+    // bones are interpolated component wise, which is
+    // close enough for the small steps between evaluations
+    parallel_util::getWorkerPool().parallelFor(n, interpolationJobSize, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            State & state = m_states[i];
+            // frozen instances hold the pose that they show,
+            // unless they were evaluated for the first time
+            if (state.level == ANIMATION_LOD_FROZEN && state.framesSinceUpdate > 0) continue;
+
+            float factor = glm::min(float(state.framesSinceUpdate + 1) / float(state.interval), 1.0f);
+            if (factor >= 1.0f && state.factor >= 1.0f) continue;
+            state.factor = factor;
+
+            uint32_t offset = m_boneOffsets[i];
+            if (factor >= 1.0f) {
+                copyBones(m_endBones, offset, m_bones, offset, state.numBones);
+                continue;
+            }
+            glm::mat4 const * start = m_startBones.data() + offset;
+            glm::mat4 const * end = m_endBones.data() + offset;
+            glm::mat4 * bones = m_bones.data() + offset;
+            for (uint32_t j = 0; j < state.numBones; ++j) {
+                bones[j] = start[j] + factor * (end[j] - start[j]);
+            }
+        }
+    });
+}
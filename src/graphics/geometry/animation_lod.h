@@ -0,0 +1,149 @@
+#ifndef PBR_ANIMATION_LOD_H
+#define PBR_ANIMATION_LOD_H
+
+#include "src/graphics/geometry/model_manager.h"
+#include "src/container/vector.h"
+
+#include <glm/glm.hpp>
+
+enum AnimationLODLevel {
+    // evaluated every frame
+    ANIMATION_LOD_FULL,
+    // evaluated every few frames
+    ANIMATION_LOD_REDUCED,
+    // evaluated rarely, without leaf bones
+    ANIMATION_LOD_LOW,
+    // offscreen, not evaluated
+    ANIMATION_LOD_FROZEN,
+    NUM_ANIMATION_LODS
+};
+
+/*
+ * Decides how often each animated instance is evaluated
+ * from its size on screen, and holds the bone transforms
+ * of every instance.
+ *
+ * An instance that is evaluated every n frames is evaluated
+ * n - 1 frames ahead, and its bone transforms are
+ * interpolated towards that pose in between. No more than
+ * boneBudget bones are evaluated per frame, instances that
+ * are furthest behind go first.
+ **/
+class AnimationLOD {
+public:
+    struct Counters {
+        // instances at each level
+        uint32_t instances[NUM_ANIMATION_LODS];
+        // instances at each level evaluated this frame
+        uint32_t updates[NUM_ANIMATION_LODS];
+        // instances due that the budget put off
+        uint32_t deferred;
+        // bones evaluated this frame
+        uint32_t bones;
+    };
+
+    // projected radius in pixels at which an
+    // instance is evaluated at full and reduced rate
+    float fullPixels = 100.0f;
+    float reducedPixels = 30.0f;
+    // frames between evaluations at each level
+    uint32_t updateIntervals[NUM_ANIMATION_LODS] = { 1, 2, 4, 0 };
+    // bones evaluated per frame at most, besides
+    // instances that have not been evaluated yet
+    size_t boneBudget = 8192;
+    // skinned meshes leave their bind pose bounds
+    float boundsMargin = 1.5f;
+
+    /**
+     * Starts tracking a new set of animated instances.
+     * Instances that were tracked before keep their bone
+     * transforms, the rest are evaluated on the next update
+     * @param modelManager manager the models are loaded in
+     * @param modelIDs model of each instance
+     * @param instances id of each instance, matched to
+     *                  the ids of the previous set
+     * @param boneOffsets first transform of each instance
+     * @param n number of instances
+     */
+    void bind(ModelManager const & modelManager,
+              ModelID const * modelIDs,
+              uint32_t const * instances,
+              uint32_t const * boneOffsets,
+              size_t n);
+
+    /**
+     * Picks the level of each instance, evaluates those that
+     * are due within the budget and interpolates the rest
+     * @param modelManager manager the models are loaded in
+     * @param modelIDs model of each instance
+     * @param transforms model matrix of each instance
+     * @param animationBlends animation of each instance
+     * @param n number of instances, as bound
+     * @param viewProjection view projection matrix
+     * @param viewPosition position of the camera
+     * @param pixelsPerUnit projected size in pixels of
+     *                      one unit at unit distance
+     * @param deltaTime time the animations advance per frame
+     */
+    void update(ModelManager & modelManager,
+                ModelID const * modelIDs,
+                glm::mat4 const * transforms,
+                BlendedAnimation const * animationBlends,
+                size_t n,
+                glm::mat4 const & viewProjection,
+                glm::vec3 const & viewPosition,
+                float pixelsPerUnit,
+                float deltaTime);
+
+    /**
+     * @return bone transforms of every instance
+     */
+    inline prt::vector<glm::mat4> const & getBones() const { return m_bones; }
+
+    /**
+     * @return counters of the last update
+     */
+    inline Counters const & getCounters() const { return m_counters; }
+
+private:
+    struct State {
+        uint32_t instance;
+        uint32_t numBones;
+        // bind pose bounding sphere of the model
+        glm::vec3 center;
+        float radius;
+        AnimationLODLevel level = ANIMATION_LOD_FULL;
+        // frames between the last two evaluations
+        uint32_t interval = 1;
+        uint32_t framesSinceUpdate = 0;
+        // interpolation factor that is shown
+        float factor = 0.0f;
+        bool evaluated = false;
+        // how far behind the instance is
+        float priority = 0.0f;
+        // key cursor of each layer, see AnimationClip::sample
+        uint32_t keyCursors[BlendedAnimation::maxLayers] = {};
+    };
+
+    prt::vector<State> m_states;
+    prt::vector<uint32_t> m_boneOffsets;
+    // bone transforms shown, at the start of the
+    // interpolation and at its end
+    prt::vector<glm::mat4> m_bones;
+    prt::vector<glm::mat4> m_startBones;
+    prt::vector<glm::mat4> m_endBones;
+
+    // instances evaluated this frame
+    prt::vector<uint32_t> m_due;
+    prt::vector<ModelID> m_updateModelIDs;
+    prt::vector<BlendedAnimation> m_updateBlends;
+    prt::vector<uint32_t> m_updateOffsets;
+    prt::vector<bool> m_updateSkipLeafBones;
+    prt::vector<uint32_t> m_updateKeyCursors;
+    // index of each instance evaluated this frame
+    prt::vector<uint32_t> m_updateIndices;
+
+    Counters m_counters{};
+};
+
+#endif
@@ -1,31 +1,213 @@
 #include "asset_manager.h"
 
+#include "src/util/io_util.h"
+#include "src/util/hash_util.h"
+#include "src/util/parallel_util.h"
+#include "src/util/trace_util.h"
+
+#include "src/config/config.h"
+
 #include <dirent.h>
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
 
-AssetManager::AssetManager(char const * assetDirectory)
-    : m_textureManager((std::string(assetDirectory) + "textures/").c_str()),
-      m_modelManager((std::string(assetDirectory) + "models/").c_str(), m_textureManager) {
+AssetManager::AssetManager(char const * assetDirectory, char const * sourceDirectory,
+                           char const * cacheDirectory)
+    : m_textureManager((std::string(assetDirectory) + "textures/").c_str(), cacheDirectory, m_archive),
+      m_modelManager((std::string(assetDirectory) + "models/").c_str(), cacheDirectory, 
+                     m_textureManager, m_archive),
+      m_cpuBudget(ASSET_CPU_BUDGET_BYTES) {
       strcpy(m_assetDirectory, assetDirectory);
+      strcpy(m_sourceDirectory, sourceDirectory);
+      strcpy(m_cacheDirectory, cacheDirectory);
+      // loose files are used if no archive has been packed
+      if (m_archive.open((std::string(assetDirectory) + "assets.pak").c_str(), assetDirectory)) {
+          m_archive.prefetch();
+      } else {
+          // the asset directory is a copy made at build time,
+          // so the files that are edited are the source files
+          m_watcher.watchDirectory((std::string(sourceDirectory) + "models/").c_str());
+          m_watcher.watchDirectory((std::string(sourceDirectory) + "textures/").c_str());
+      }
+      if (!io_util::createDirectory(cacheDirectory)) {
+          std::cout << "failed to create asset cache directory: " << cacheDirectory << std::endl;
+      }
+}
+
+namespace {
+    void getCubeMapPaths(char const * assetDirectory, char const * name, char (&paths)[6][256]) {
+        static char const * const faces[6] = { "/front.png", "/back.png",
+                                               "/up.png",    "/down.png",
+                                               "/right.png", "/left.png" };
+        for (size_t i = 0; i < 6; ++i) {
+            strcpy(paths[i], assetDirectory);
+            strcat(paths[i], "textures/skybox/");
+            strcat(paths[i], name);
+            strcat(paths[i], faces[i]);
+        }
+    }
 }
 
 void AssetManager::loadCubeMap(char const * name, prt::array<Texture, 6>& cubeMap) const {
-    char path[256];
-    strcpy(path, m_assetDirectory);
-    strcat(path, "textures/skybox/");
-    strcat(path, name);
-
-    char * tok = path + strlen(path);
-    strcpy(tok, "/front.png");
-    cubeMap[0].load(path);
-    strcpy(tok, "/back.png");
-    cubeMap[1].load(path);
-    strcpy(tok, "/up.png");
-    cubeMap[2].load(path);
-    strcpy(tok, "/down.png");
-    cubeMap[3].load(path);
-    strcpy(tok, "/right.png");
-    cubeMap[4].load(path);
-    strcpy(tok, "/left.png");
-    cubeMap[5].load(path);
-}
\ No newline at end of file
+    TRACE_SCOPE_ASSET("texture", "AssetManager::loadCubeMap", name);
+    char paths[6][256];
+    getCubeMapPaths(m_assetDirectory, name, paths);
+
+    // decoding dominates, so the faces are decoded in parallel
+    // and only copied into the textures on this thread
+    Texture::Image images[6];
+    parallel_util::parallelFor(6, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            char const * data;
+            size_t size;
+            if (m_archive.find(paths[i], data, size)) {
+                Texture::decode(reinterpret_cast<unsigned char const *>(data), size, images[i]);
+            } else {
+                Texture::decode(paths[i], images[i]);
+            }
+        }
+    });
+
+    for (size_t i = 0; i < 6; ++i) {
+        if (!cubeMap[i].load(images[i], paths[i])) {
+            assert(false && "failed to load cube map face!");
+        }
+    }
+}
+
+void AssetManager::loadEnvironmentMap(char const * name, prt::array<Texture, 6> const & cubeMap,
+                                      EnvironmentMap & environmentMap) const {
+    TRACE_SCOPE_ASSET("texture", "AssetManager::loadEnvironmentMap", name);
+    char paths[6][256];
+    getCubeMapPaths(m_assetDirectory, name, paths);
+
+    uint64_t key = EnvironmentMap::cacheVersion;
+    bool cacheable = true;
+    for (size_t i = 0; i < 6 && cacheable; ++i) {
+        uint64_t hash;
+        cacheable = m_archive.hashFile(paths[i], hash);
+        hash_util::combine(key, hash);
+    }
+
+    char cachePath[512];
+    sprintf(cachePath, "%s%016llx.ibl", m_cacheDirectory, static_cast<unsigned long long>(key));
+
+    prt::vector<char> data;
+    if (cacheable && io_util::readFile(cachePath, data)) {
+        io_util::BinaryReader reader{data.data(), data.size()};
+        uint32_t magic;
+        uint32_t version;
+        if (reader.read(magic) && magic == cacheMagic &&
+            reader.read(version) && version == EnvironmentMap::cacheVersion &&
+            environmentMap.deserialize(reader)) {
+            return;
+        }
+    }
+
+    environmentMap.bake(cubeMap);
+
+    if (cacheable) {
+        data.resize(0);
+        io_util::BinaryWriter writer{data};
+        writer.write(cacheMagic);
+        writer.write(EnvironmentMap::cacheVersion);
+        environmentMap.serialize(writer);
+        if (!io_util::writeFile(cachePath, data.data(), data.size())) {
+            std::cout << "failed to write environment map cache: " << cachePath << std::endl;
+        }
+    }
+}
+
+void AssetManager::reloadChangedAssets(prt::vector<ModelID> & modelIDs,
+                                       prt::vector<uint32_t> & textureIDs) {
+    modelIDs.resize(0);
+    textureIDs.resize(0);
+
+    prt::vector<std::string> changedFiles;
+    m_watcher.poll(changedFiles);
+    size_t sourceLength = strlen(m_sourceDirectory);
+    prt::vector<char> data;
+    for (auto const & file : changedFiles) {
+        if (file.compare(0, sourceLength, m_sourceDirectory) != 0) continue;
+
+        // assets are loaded from their copies, which
+        // have to be brought up to date first
+        std::string path = std::string(m_assetDirectory) + file.substr(sourceLength);
+        if (!io_util::readFile(file.c_str(), data) ||
+            !io_util::writeFile(path.c_str(), data.data(), data.size())) {
+            std::cout << "failed to copy changed asset: " << file << std::endl;
+            continue;
+        }
+
+        uint32_t textureID;
+        if (m_textureManager.reloadTexture(path.c_str(), textureID)) {
+            textureIDs.push_back(textureID);
+            // the texture may have split from a duplicate
+            m_modelManager.updateTextureIDs(path.c_str(), textureID, modelIDs);
+        }
+        m_modelManager.reloadModels(path.c_str(), modelIDs);
+    }
+}
+
+size_t AssetManager::getCPUMemoryUsage() const {
+    Model const * models;
+    size_t nModels;
+    m_modelManager.getModels(models, nModels);
+    Texture const * textures;
+    size_t nTextures;
+    m_textureManager.getTextures(textures, nTextures);
+
+    size_t usage = 0;
+    for (size_t i = 0; i < nModels; ++i) {
+        usage += models[i].getGeometrySize();
+    }
+    for (size_t i = 0; i < nTextures; ++i) {
+        usage += textures[i].pixelBuffer.size();
+    }
+    return usage;
+}
+
+void AssetManager::evictAssets() {
+    size_t usage = getCPUMemoryUsage();
+    if (usage <= m_cpuBudget) return;
+
+    struct Resident {
+        uint64_t lastUsedFrame;
+        uint32_t id;
+        bool texture;
+        size_t size;
+    };
+
+    Model const * models;
+    size_t nModels;
+    m_modelManager.getModels(models, nModels);
+    Texture const * textures;
+    size_t nTextures;
+    m_textureManager.getTextures(textures, nTextures);
+
+    prt::vector<Resident> residents;
+    for (size_t i = 0; i < nModels; ++i) {
+        size_t size = models[i].getGeometrySize();
+        if (size > 0) {
+            residents.push_back({ m_modelManager.getLastUsedFrame(i), uint32_t(i), false, size });
+        }
+    }
+    for (size_t i = 0; i < nTextures; ++i) {
+        size_t size = textures[i].pixelBuffer.size();
+        if (size > 0) {
+            residents.push_back({ m_textureManager.getLastUsedFrame(i), uint32_t(i), true, size });
+        }
+    }
+    std::sort(residents.begin(), residents.end(),
+              [](Resident const & a, Resident const & b) { return a.lastUsedFrame < b.lastUsedFrame; });
+
+    for (size_t i = 0; i < residents.size() && usage > m_cpuBudget; ++i) {
+        if (residents[i].texture) {
+            m_textureManager.evict(residents[i].id);
+        } else {
+            m_modelManager.evict(residents[i].id);
+        }
+        usage -= residents[i].size;
+    }
+}
@@ -3,24 +3,91 @@
 
 #include "src/graphics/geometry/model_manager.h"
 #include "src/graphics/geometry/texture_manager.h"
+#include "src/graphics/geometry/environment_map.h"
 
 #include "src/container/array.h"
+#include "src/util/file_watcher.h"
 
 class AssetManager {
 public:
-    AssetManager(char const * assetDirectory);
+    /**
+     * @param assetDirectory directory containing the
+     *                       models and textures, read from
+     *                       assets.pak in it if present
+     * @param sourceDirectory directory that assetDirectory
+     *                        is a copy of. Its files are
+     *                        watched and changed files are
+     *                        copied to assetDirectory
+     * @param cacheDirectory directory of the import cache,
+     *                       created if it doesn't exist
+     */
+    AssetManager(char const * assetDirectory, char const * sourceDirectory,
+                 char const * cacheDirectory);
 
     ModelManager& getModelManager() { return m_modelManager; };
     TextureManager& getTextureManager() { return m_textureManager; };
 
+    /**
+     * Loads the faces of a skybox, decoding them in parallel
+     * @param name name of the skybox directory
+     * @param cubeMap faces in the order of the cube map layers
+     */
     void loadCubeMap(char const * name, prt::array<Texture, 6>& cubeMap) const;
 
+    /**
+     * Loads the image based lighting of a skybox from the
+     * import cache, baking and caching it if it is missing
+     * @param name name of the skybox directory
+     * @param cubeMap faces loaded by loadCubeMap
+     * @param environmentMap baked lighting
+     */
+    void loadEnvironmentMap(char const * name, prt::array<Texture, 6> const & cubeMap,
+                            EnvironmentMap & environmentMap) const;
+
+    AssetArchive const & getArchive() const { return m_archive; }
+
+    /**
+     * Re-imports the loaded models and textures whose
+     * files in the source directory have changed since
+     * the last call. Only loose files are watched, an
+     * opened archive is not
+     * @param modelIDs ids of the re-imported models
+     * @param textureIDs ids of the re-imported textures
+     */
+    void reloadChangedAssets(prt::vector<ModelID> & modelIDs,
+                             prt::vector<uint32_t> & textureIDs);
+
+    /**
+     * Frees the CPU copies of the least recently used
+     * models and textures until the remaining copies fit
+     * the CPU budget. The copies are only needed to upload
+     * assets, see ModelManager::makeResident and
+     * TextureManager::makeResident
+     */
+    void evictAssets();
+
+    void setCPUBudget(size_t budget) { m_cpuBudget = budget; }
+
+    /**
+     * @return size of the resident CPU copies of models
+     *         and textures
+     */
+    size_t getCPUMemoryUsage() const;
+
     std::string getDirectory() const { return m_assetDirectory; }
 
 private:
+    static constexpr uint32_t cacheMagic = 0x4c424950; // "PIBL"
+
     char m_assetDirectory[256];
+    char m_sourceDirectory[256];
+    char m_cacheDirectory[256];
+    // must be constructed before the managers using it
+    AssetArchive m_archive;
     TextureManager m_textureManager;
     ModelManager m_modelManager;
+    FileWatcher m_watcher;
+    size_t m_cpuBudget;
 };
 
 #endif
\ No newline at end of file
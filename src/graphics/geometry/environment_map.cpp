@@ -0,0 +1,333 @@
+#include "environment_map.h"
+
+#include "src/util/parallel_util.h"
+#include "src/util/trace_util.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    float const pi = 3.14159265359f;
+
+    /**
+     * @param face cube map layer, +x, -x, +y, -y, +z, -z
+     * @param u horizontal face coordinate in [-1, 1]
+     * @param v vertical face coordinate in [-1, 1]
+     * @return normalized direction through the face coordinates
+     */
+    glm::vec3 faceDirection(size_t face, float u, float v) {
+        switch (face) {
+            case 0: return glm::normalize(glm::vec3{ 1.0f, -v, -u });
+            case 1: return glm::normalize(glm::vec3{ -1.0f, -v, u });
+            case 2: return glm::normalize(glm::vec3{ u, 1.0f, v });
+            case 3: return glm::normalize(glm::vec3{ u, -1.0f, -v });
+            case 4: return glm::normalize(glm::vec3{ u, -v, 1.0f });
+            default: return glm::normalize(glm::vec3{ -u, -v, -1.0f });
+        }
+    }
+
+    /**
+     * Inverse of faceDirection
+     * @param s horizontal texture coordinate in [0, 1]
+     * @param t vertical texture coordinate in [0, 1]
+     */
+    void faceCoordinates(glm::vec3 const & d, size_t & face, float & s, float & t) {
+        glm::vec3 a = glm::abs(d);
+        float sc, tc, ma;
+        if (a.x >= a.y && a.x >= a.z) {
+            ma = a.x;
+            face = d.x > 0.0f ? 0 : 1;
+            sc = d.x > 0.0f ? -d.z : d.z;
+            tc = -d.y;
+        } else if (a.y >= a.z) {
+            ma = a.y;
+            face = d.y > 0.0f ? 2 : 3;
+            sc = d.x;
+            tc = d.y > 0.0f ? d.z : -d.z;
+        } else {
+            ma = a.z;
+            face = d.z > 0.0f ? 4 : 5;
+            sc = d.z > 0.0f ? d.x : -d.x;
+            tc = -d.y;
+        }
+        s = 0.5f * (sc / ma + 1.0f);
+        t = 0.5f * (tc / ma + 1.0f);
+    }
+
+    glm::vec3 sampleFace(Texture const & face, uint32_t level, float s, float t) {
+        level = std::min(level, face.mipLevels - 1);
+        int width = face.getMipWidth(level);
+        int height = face.getMipHeight(level);
+        unsigned char const * pixels = &face.pixelBuffer[face.getMipOffset(level)];
+
+        // bilinear, clamped to the face
+        float x = glm::clamp(s * width - 0.5f, 0.0f, float(width - 1));
+        float y = glm::clamp(t * height - 0.5f, 0.0f, float(height - 1));
+        int x0 = int(x);
+        int y0 = int(y);
+        int x1 = std::min(x0 + 1, width - 1);
+        int y1 = std::min(y0 + 1, height - 1);
+        float fx = x - x0;
+        float fy = y - y0;
+
+        auto texel = [&](int tx, int ty) {
+            unsigned char const * p = &pixels[4 * (ty * width + tx)];
+            return glm::vec3{ float(p[0]), float(p[1]), float(p[2]) } / 255.0f;
+        };
+        return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), fx),
+                        glm::mix(texel(x0, y1), texel(x1, y1), fx), fy);
+    }
+
+    glm::vec3 sampleCube(prt::array<Texture, 6> const & faces, glm::vec3 const & d, uint32_t level) {
+        size_t face;
+        float s, t;
+        faceCoordinates(d, face, s, t);
+        return sampleFace(faces[face], level, s, t);
+    }
+
+    glm::vec2 hammersley(uint32_t i, uint32_t n) {
+        uint32_t bits = i;
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return glm::vec2{ float(i) / float(n), float(bits) * 2.3283064365386963e-10f };
+    }
+
+    /**
+     * @return half vector distributed by the GGX normal
+     *         distribution around n
+     */
+    glm::vec3 importanceSampleGGX(glm::vec2 const & xi, glm::vec3 const & n, float roughness) {
+        float a = roughness * roughness;
+        float phi = 2.0f * pi * xi.x;
+        float cosTheta = glm::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+        float sinTheta = glm::sqrt(1.0f - cosTheta * cosTheta);
+        glm::vec3 h{ sinTheta * glm::cos(phi), sinTheta * glm::sin(phi), cosTheta };
+
+        glm::vec3 up = glm::abs(n.z) < 0.999f ? glm::vec3{ 0.0f, 0.0f, 1.0f } : glm::vec3{ 1.0f, 0.0f, 0.0f };
+        glm::vec3 tangentX = glm::normalize(glm::cross(up, n));
+        glm::vec3 tangentY = glm::cross(n, tangentX);
+        return tangentX * h.x + tangentY * h.y + n * h.z;
+    }
+
+    float distributionGGX(float nDotH, float roughness) {
+        float a2 = roughness * roughness * roughness * roughness;
+        float denom = nDotH * nDotH * (a2 - 1.0f) + 1.0f;
+        return a2 / (pi * denom * denom);
+    }
+
+    float geometrySchlickGGX(float nDotV, float k) {
+        return nDotV / (nDotV * (1.0f - k) + k);
+    }
+
+    unsigned char toUnorm(float value) {
+        return static_cast<unsigned char>(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    void projectIrradiance(prt::array<Texture, 6> const & faces, prt::array<glm::vec4, 9> & irradianceSH) {
+        // a coarse level is plenty for the low frequency irradiance
+        uint32_t level = 0;
+        while (level + 1 < faces[0].mipLevels && faces[0].getMipWidth(level) > 64) {
+            ++level;
+        }
+
+        prt::array<prt::array<glm::vec3, 9>, 6> faceSH = {};
+        parallel_util::parallelFor(6, 1, [&](size_t begin, size_t end) {
+            for (size_t face = begin; face < end; ++face) {
+                int width = faces[face].getMipWidth(level);
+                int height = faces[face].getMipHeight(level);
+                prt::array<glm::vec3, 9> & sh = faceSH[face];
+                for (int y = 0; y < height; ++y) {
+                    for (int x = 0; x < width; ++x) {
+                        float u = 2.0f * (x + 0.5f) / width - 1.0f;
+                        float v = 2.0f * (y + 0.5f) / height - 1.0f;
+                        // solid angle of the texel
+                        float solidAngle = 4.0f / (width * height * std::pow(1.0f + u * u + v * v, 1.5f));
+                        glm::vec3 d = faceDirection(face, u, v);
+                        glm::vec3 radiance = solidAngle * sampleFace(faces[face], level,
+                                                                     (x + 0.5f) / width, (y + 0.5f) / height);
+
+                        sh[0] += radiance * 0.282095f;
+                        sh[1] += radiance * 0.488603f * d.y;
+                        sh[2] += radiance * 0.488603f * d.z;
+                        sh[3] += radiance * 0.488603f * d.x;
+                        sh[4] += radiance * 1.092548f * d.x * d.y;
+                        sh[5] += radiance * 1.092548f * d.y * d.z;
+                        sh[6] += radiance * 0.315392f * (3.0f * d.z * d.z - 1.0f);
+                        sh[7] += radiance * 1.092548f * d.x * d.z;
+                        sh[8] += radiance * 0.546274f * (d.x * d.x - d.y * d.y);
+                    }
+                }
+            }
+        });
+
+        // convolution with the clamped cosine divided by pi
+        float const bandScale[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+        for (size_t i = 0; i < 9; ++i) {
+            glm::vec3 sum{ 0.0f };
+            for (size_t face = 0; face < 6; ++face) {
+                sum += faceSH[face][i];
+            }
+            size_t band = i == 0 ? 0 : i < 4 ? 1 : 2;
+            irradianceSH[i] = glm::vec4{ sum * bandScale[band], 0.0f };
+        }
+    }
+
+    void prefilterGGX(prt::array<Texture, 6> const & faces, EnvironmentMap & environmentMap) {
+        environmentMap.faceSize = std::min(EnvironmentMap::prefilteredSize, uint32_t(faces[0].texWidth));
+        environmentMap.mipLevels = 1;
+        while (environmentMap.mipLevels < EnvironmentMap::prefilteredMipLevels &&
+               environmentMap.faceSize >> environmentMap.mipLevels > 0) {
+            ++environmentMap.mipLevels;
+        }
+        environmentMap.prefiltered.resize(environmentMap.getMipOffset(environmentMap.mipLevels));
+
+        // solid angle of a texel of the finest source level
+        float sourceSolidAngle = 4.0f * pi / (6.0f * faces[0].texWidth * faces[0].texWidth);
+        uint32_t const mipLevels = environmentMap.mipLevels;
+
+        for (uint32_t level = 0; level < mipLevels; ++level) {
+            float roughness = mipLevels > 1 ? float(level) / float(mipLevels - 1) : 0.0f;
+            uint32_t size = environmentMap.getMipSize(level);
+            unsigned char * dst = &environmentMap.prefiltered[environmentMap.getMipOffset(level)];
+            // source level that matches the size of a mirror reflection
+            uint32_t mirrorLevel = 0;
+            while (uint32_t(faces[0].getMipWidth(mirrorLevel)) > size && mirrorLevel + 1 < faces[0].mipLevels) {
+                ++mirrorLevel;
+            }
+
+            parallel_util::parallelFor(6 * size * size, 256, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    size_t face = i / (size * size);
+                    size_t x = i % size;
+                    size_t y = (i / size) % size;
+                    glm::vec3 n = faceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f,
+                                                      2.0f * (y + 0.5f) / size - 1.0f);
+
+                    glm::vec3 color{ 0.0f };
+                    if (level == 0) {
+                        color = sampleCube(faces, n, mirrorLevel);
+                    } else {
+                        // the view direction is assumed to be the normal
+                        float weight = 0.0f;
+                        for (uint32_t j = 0; j < EnvironmentMap::sampleCount; ++j) {
+                            glm::vec3 h = importanceSampleGGX(hammersley(j, EnvironmentMap::sampleCount), n, roughness);
+                            float nDotH = glm::dot(n, h);
+                            glm::vec3 l = 2.0f * nDotH * h - n;
+                            float nDotL = glm::dot(n, l);
+                            if (nDotL <= 0.0f) continue;
+
+                            // filtered importance sampling, samples of low
+                            // probability read coarser source levels
+                            float pdf = distributionGGX(nDotH, roughness) * 0.25f;
+                            float sampleSolidAngle = 1.0f / (EnvironmentMap::sampleCount * pdf + 0.0001f);
+                            float sourceLevel = 0.5f * std::log2(sampleSolidAngle / sourceSolidAngle) + 1.0f;
+                            uint32_t sourceMip = uint32_t(glm::max(sourceLevel + 0.5f, 0.0f));
+
+                            color += sampleCube(faces, l, sourceMip) * nDotL;
+                            weight += nDotL;
+                        }
+                        color /= glm::max(weight, 0.0001f);
+                    }
+
+                    unsigned char * texel = &dst[4 * i];
+                    texel[0] = toUnorm(color.x);
+                    texel[1] = toUnorm(color.y);
+                    texel[2] = toUnorm(color.z);
+                    texel[3] = 255;
+                }
+            });
+        }
+    }
+
+    void integrateBRDF(Texture & lut) {
+        uint32_t const size = EnvironmentMap::brdfLutSize;
+        lut.texWidth = size;
+        lut.texHeight = size;
+        lut.texChannels = 4;
+        lut.mipLevels = 1;
+        lut.contentHash = 0;
+        lut.pixelBuffer.resize(size * size * 4);
+
+        parallel_util::parallelFor(size * size, 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                float nDotV = (i % size + 0.5f) / size;
+                float roughness = (i / size + 0.5f) / size;
+                glm::vec3 v{ glm::sqrt(1.0f - nDotV * nDotV), 0.0f, nDotV };
+                glm::vec3 n{ 0.0f, 0.0f, 1.0f };
+                // remapped for image based lighting
+                float k = roughness * roughness / 2.0f;
+
+                float scale = 0.0f;
+                float bias = 0.0f;
+                for (uint32_t j = 0; j < EnvironmentMap::sampleCount; ++j) {
+                    glm::vec3 h = importanceSampleGGX(hammersley(j, EnvironmentMap::sampleCount), n, roughness);
+                    float vDotH = glm::dot(v, h);
+                    glm::vec3 l = 2.0f * vDotH * h - v;
+                    float nDotL = l.z;
+                    if (nDotL <= 0.0f) continue;
+
+                    float nDotH = glm::max(h.z, 0.0f);
+                    vDotH = glm::max(vDotH, 0.0f);
+                    float g = geometrySchlickGGX(nDotV, k) * geometrySchlickGGX(nDotL, k);
+                    float gVis = g * vDotH / (nDotH * nDotV);
+                    float fc = std::pow(1.0f - vDotH, 5.0f);
+                    scale += (1.0f - fc) * gVis;
+                    bias += fc * gVis;
+                }
+
+                unsigned char * texel = &lut.pixelBuffer[4 * i];
+                texel[0] = toUnorm(scale / EnvironmentMap::sampleCount);
+                texel[1] = toUnorm(bias / EnvironmentMap::sampleCount);
+                texel[2] = 0;
+                texel[3] = 255;
+            }
+        });
+    }
+}
+
+void EnvironmentMap::bake(prt::array<Texture, 6> const & faces) {
+    TRACE_SCOPE("texture", "EnvironmentMap::bake");
+    for (auto const & face : faces) {
+        assert(face.hasMipChain() && face.texWidth == faces[0].texWidth &&
+               "cube map faces need mip chains of the same size!");
+    }
+
+    projectIrradiance(faces, irradianceSH);
+    prefilterGGX(faces, *this);
+    integrateBRDF(brdfLut);
+}
+
+size_t EnvironmentMap::getMipOffset(uint32_t level) const {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; ++i) {
+        offset += 6 * size_t(getMipSize(i)) * getMipSize(i) * 4;
+    }
+    return offset;
+}
+
+void EnvironmentMap::serialize(io_util::BinaryWriter & writer) const {
+    writer.write(irradianceSH);
+    writer.write(faceSize);
+    writer.write(mipLevels);
+    writer.writeVector(prefiltered);
+    brdfLut.serialize(writer);
+}
+
+bool EnvironmentMap::deserialize(io_util::BinaryReader & reader) {
+    return reader.read(irradianceSH) &&
+           reader.read(faceSize) &&
+           reader.read(mipLevels) &&
+           reader.readVector(prefiltered) &&
+           prefiltered.size() == getMipOffset(mipLevels) &&
+           brdfLut.deserialize(reader);
+}
+
+EnvironmentMap * EnvironmentMap::defaultEnvironmentMap() {
+    static EnvironmentMap environmentMap = { {}, {0,0,0,255, 0,0,0,255, 0,0,0,255,
+                                                  0,0,0,255, 0,0,0,255, 0,0,0,255},
+                                             1, 1, *Texture::defaultTexture() };
+    return &environmentMap;
+}
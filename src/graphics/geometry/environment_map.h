@@ -0,0 +1,77 @@
+#ifndef PRT_ENVIRONMENT_MAP_H
+#define PRT_ENVIRONMENT_MAP_H
+
+#include "src/graphics/geometry/texture.h"
+
+#include "src/container/array.h"
+#include "src/container/vector.h"
+#include "src/util/io_util.h"
+
+#include <glm/glm.hpp>
+
+/*
+ * Image based lighting baked from a cube map, following
+ * the split sum approximation. Diffuse lighting is stored
+ * as spherical harmonics and specular lighting as a GGX
+ * prefiltered cube map together with a BRDF lookup table
+ **/
+struct EnvironmentMap {
+    // bump when the baked representation changes
+    static constexpr uint32_t cacheVersion = 2;
+    static constexpr uint32_t prefilteredSize = 128;
+    static constexpr uint32_t prefilteredMipLevels = 6;
+    static constexpr uint32_t brdfLutSize = 128;
+    static constexpr uint32_t sampleCount = 128;
+
+    // irradiance divided by pi as order 2 spherical
+    // harmonics, rgb in xyz, see pbr.frag
+    prt::array<glm::vec4, 9> irradianceSH;
+
+    // every mip level in order, each holding six faces in
+    // the order of the cube map layers. Roughness increases
+    // linearly from 0 at the first to 1 at the last level
+    prt::vector<unsigned char> prefiltered;
+    uint32_t faceSize;
+    uint32_t mipLevels;
+
+    // scale and bias of F0 in the split sum, by the cosine
+    // of the view angle in x and roughness in y
+    Texture brdfLut;
+
+    /**
+     * Bakes the lighting of a cube map
+     * @param faces faces of the cube map with mip chains,
+     *              see AssetManager::loadCubeMap
+     */
+    void bake(prt::array<Texture, 6> const & faces);
+
+    /**
+     * @param level mip level of the prefiltered cube map
+     * @return offset of the first face of the mip level
+     *         in prefiltered
+     */
+    size_t getMipOffset(uint32_t level) const;
+
+    inline uint32_t getMipSize(uint32_t level) const { return faceSize >> level > 0 ? faceSize >> level : 1; }
+
+    /**
+     * Writes the baked lighting for the import cache
+     * @param writer writer to append to
+     */
+    void serialize(io_util::BinaryWriter & writer) const;
+
+    /**
+     * Reads lighting written by serialize
+     * @param reader reader to read from
+     * @return true if the lighting could be read
+     */
+    bool deserialize(io_util::BinaryReader & reader);
+
+    /**
+     * @return unlit environment to bind before any
+     *         cube map is loaded
+     */
+    static EnvironmentMap * defaultEnvironmentMap();
+};
+
+#endif
@@ -1,5 +1,11 @@
 #include "model.h"
 
+#include "src/util/math_util.h"
+#include "src/util/mesh_util.h"
+#include "src/util/parallel_util.h"
+#include "src/util/hash_util.h"
+#include "src/util/trace_util.h"
+
 #include <glm/gtx/transform.hpp> 
 #include <glm/gtx/euler_angles.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -8,15 +14,178 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/MemoryIOWrapper.h>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
+
+namespace {
+    constexpr unsigned int importFlags = aiProcess_Triangulate              |
+                                         aiProcess_FlipUVs                  |
+                                         aiProcess_FindDegenerates          |
+                                         aiProcess_JoinIdenticalVertices    |
+                                         aiProcess_RemoveRedundantMaterials |
+                                         aiProcess_ImproveCacheLocality     |
+                                         aiProcess_SortByPType;
+
+    /*
+     * Records every file besides the model itself
+     * that Assimp opens during an import, and reads
+     * archived files straight from the archive
+     **/
+    class RecordingIOSystem : public Assimp::DefaultIOSystem {
+    public:
+        RecordingIOSystem(char const * modelPath, prt::vector<Model::Dependency> & dependencies,
+                          AssetArchive const & archive)
+            : m_modelPath(modelPath), m_dependencies(dependencies), m_archive(archive) {}
+
+        bool Exists(char const * file) const override {
+            char const * data;
+            size_t size;
+            return m_archive.find(file, data, size) || Assimp::DefaultIOSystem::Exists(file);
+        }
+
+        Assimp::IOStream * Open(char const * file, char const * mode) override {
+            Assimp::IOStream * stream;
+            char const * data;
+            size_t size;
+            if (m_archive.find(file, data, size)) {
+                // the stream does not own the archived data
+                stream = new Assimp::MemoryIOStream(reinterpret_cast<uint8_t const *>(data), size);
+            } else {
+                stream = Assimp::DefaultIOSystem::Open(file, mode);
+            }
+            if (stream == nullptr || strcmp(file, m_modelPath) == 0 || 
+                strlen(file) >= sizeof(Model::Dependency::path)) {
+                return stream;
+            }
+            for (auto const & dependency : m_dependencies) {
+                if (strcmp(dependency.path, file) == 0) return stream;
+            }
+            m_dependencies.push_back({});
+            strcpy(m_dependencies.back().path, file);
+            return stream;
+        }
+
+    private:
+        char const * m_modelPath;
+        prt::vector<Model::Dependency> & m_dependencies;
+        AssetArchive const & m_archive;
+    };
+
+    // key times of a clip closer than this, as
+    // a fraction of its duration, are merged
+    constexpr float keyTimeTolerance = 1e-5f;
+
+    /**
+     * Appends the times of a track, wrapped to the duration
+     * @param keys keys of the track
+     * @param numKeys number of keys
+     * @param duration duration of the clip in ticks
+     * @param times times in ticks
+     */
+    template<typename Key>
+    void appendKeyTimes(Key const * keys, uint32_t numKeys, double duration, 
+                        prt::vector<double> & times) {
+        for (uint32_t i = 0; i < numKeys; ++i) {
+            double time = duration > 0.0 ? keys[i].mTime - duration * std::floor(keys[i].mTime / duration) : 0.0;
+            times.push_back(time);
+        }
+    }
+
+    /*
+     * Finds the keys of a track to interpolate between,
+     * moving on from the keys found last. The track loops,
+     * from its last key to its first one duration later
+     **/
+    struct KeyCursor {
+        uint32_t prev = 0;
+        uint32_t next = 0;
+        float factor = 0.0f;
+        // last key at or before the time of the last seek
+        uint32_t cursor = 0;
+
+        /**
+         * @param keys keys of the track, in ascending time
+         * @param numKeys number of keys
+         * @param time time in ticks, no earlier than the last seek
+         * @param duration duration of the clip in ticks
+         * @return false if the track has no keys
+         */
+        template<typename Key>
+        bool seek(Key const * keys, uint32_t numKeys, double time, double duration) {
+            if (numKeys == 0) return false;
+            while (cursor + 1 < numKeys && keys[cursor + 1].mTime <= time) ++cursor;
+
+            double prevTime, nextTime;
+            if (time < keys[cursor].mTime) {
+                // before the first key, coming from the last
+                prev = numKeys - 1;
+                next = 0;
+                prevTime = keys[prev].mTime - duration;
+                nextTime = keys[next].mTime;
+            } else {
+                prev = cursor;
+                next = prev + 1 < numKeys ? prev + 1 : 0;
+                prevTime = keys[prev].mTime;
+                nextTime = next > prev ? keys[next].mTime : keys[next].mTime + duration;
+            }
+            double span = nextTime - prevTime;
+            factor = span > 0.0 ? float(glm::clamp((time - prevTime) / span, 0.0, 1.0)) : 0.0f;
+            return true;
+        }
+    };
+}
 
 Model::Model(char const * path)
     : mLoaded(false), mAnimated(false) {
     strcpy(mPath, path);
 }
 
-bool Model::load(bool loadAnimation, TextureManager & textureManager) {
+bool Model::dependsOn(char const * path) const {
+    if (strcmp(mPath, path) == 0) return true;
+    for (auto const & dependency : mDependencies) {
+        if (strcmp(dependency.path, path) == 0) return true;
+    }
+    return false;
+}
+
+bool Model::updateTextureID(char const * path, int32_t textureID) {
+    bool changed = false;
+    for (size_t i = 0; i < materials.size(); ++i) {
+        Material & material = materials[i];
+        int32_t * textureIndices[] = { &material.albedoIndex, &material.metallicIndex, 
+                                       &material.roughnessIndex, &material.aoIndex,
+                                       &material.normalIndex };
+        for (size_t j = 0; j < 5; ++j) {
+            if (mTexturePaths[5 * i + j] == path && *textureIndices[j] != textureID) {
+                *textureIndices[j] = textureID;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+void Model::releaseGeometry() {
+    vertexBuffer.clear();
+    vertexBoneBuffer.clear();
+    indexBuffer.clear();
+    mGeometryResident = false;
+}
+
+size_t Model::getGeometrySize() const {
+    return vertexBuffer.size() * sizeof(Vertex) +
+           vertexBoneBuffer.size() * sizeof(BoneData) +
+           indexBuffer.size() * sizeof(uint32_t);
+}
+
+bool Model::load(bool loadAnimation, TextureManager & textureManager,
+                 AssetArchive const & archive) {
+    TRACE_SCOPE_ASSET("model", "Model::load", mPath);
     assert(!mLoaded && "Model is already loaded!");
 
     mAnimated = loadAnimation;
@@ -24,16 +193,14 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
     Assimp::Importer importer;
     importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, 
                                 aiPrimitiveType_LINE | aiPrimitiveType_POINT);
+    // the importer takes ownership of the io system
+    importer.SetIOHandler(new RecordingIOSystem(mPath, mDependencies, archive));
     
-    aiScene const * scene = importer.ReadFile(mPath,
-                                              aiProcess_CalcTangentSpace         |
-                                              aiProcess_Triangulate              |
-                                              aiProcess_FlipUVs                  |
-                                              aiProcess_FindDegenerates          |
-                                              aiProcess_JoinIdenticalVertices    |
-                                              aiProcess_RemoveRedundantMaterials |
-                                              aiProcess_ImproveCacheLocality     |
-                                              aiProcess_SortByPType);
+    aiScene const * scene;
+    {
+        TRACE_SCOPE_ASSET("model", "Assimp::Importer::ReadFile", mPath);
+        scene = importer.ReadFile(mPath, importFlags);
+    }
 
     // check if import failed
     if(!scene) {
@@ -41,11 +208,18 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
         // assert(false && "failed to load file!");
         return false;
     }
+
+    for (auto & dependency : mDependencies) {
+        if (!archive.hashFile(dependency.path, dependency.hash)) {
+            dependency.hash = 0;
+        }
+    }
     
     strcpy(name, strrchr(mPath, '/') + 1);
 
     // parse materials
     materials.resize(scene->mNumMaterials);
+    mTexturePaths.resize(5 * materials.size());
     for (size_t i = 0; i < materials.size(); ++i) {
         aiString matName;
         aiGetMaterialString(scene->mMaterials[i], AI_MATKEY_NAME, &matName);
@@ -67,11 +241,12 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
             materials[i].transparent = true;
         }
 
-        materials[i].albedoIndex = getTexture(*scene->mMaterials[i], aiTextureType_DIFFUSE, mPath, textureManager);
-        materials[i].metallicIndex = getTexture(*scene->mMaterials[i], aiTextureType_EMISSIVE, mPath, textureManager);
-        materials[i].roughnessIndex = getTexture(*scene->mMaterials[i], aiTextureType_SHININESS, mPath, textureManager);
-        materials[i].aoIndex = getTexture(*scene->mMaterials[i], aiTextureType_AMBIENT, mPath, textureManager);
-        materials[i].normalIndex = getTexture(*scene->mMaterials[i], aiTextureType_NORMALS, mPath, textureManager);
+        std::string * paths = &mTexturePaths[5 * i];
+        materials[i].albedoIndex = getTexture(*scene->mMaterials[i], aiTextureType_DIFFUSE, mPath, textureManager, paths[0]);
+        materials[i].metallicIndex = getTexture(*scene->mMaterials[i], aiTextureType_EMISSIVE, mPath, textureManager, paths[1]);
+        materials[i].roughnessIndex = getTexture(*scene->mMaterials[i], aiTextureType_SHININESS, mPath, textureManager, paths[2]);
+        materials[i].aoIndex = getTexture(*scene->mMaterials[i], aiTextureType_AMBIENT, mPath, textureManager, paths[3]);
+        materials[i].normalIndex = getTexture(*scene->mMaterials[i], aiTextureType_NORMALS, mPath, textureManager, paths[4]);
         
         materials[i].metallic = materials[i].metallicIndex == -1 ? 0.0f : 1.0f;
     }
@@ -102,20 +277,15 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
         invtpos.Inverse().Transpose();
         nodes.pop_back();
 
-        // add node member
-        int32_t nodeIndex = mNodes.size();
-        mNodes.push_back({});
-        Node & n = mNodes.back();
-        n.name = node->mName;
-        memcpy(&n.transform, &tform, sizeof(glm::mat4));
+        // nodes are added after their parent, which
+        // keeps the skeleton sorted parent first
+        int32_t nodeIndex = mSkeleton.getNumNodes();
+        mSkeleton.parents.push_back(parentIndex + 1);
+        mSkeleton.localTransforms.push_back({});
+        memcpy(&mSkeleton.localTransforms.back(), &node->mTransformation, sizeof(glm::mat4));
         // assimp row-major, glm col-major
-        n.transform = glm::transpose(n.transform);
+        mSkeleton.localTransforms.back() = glm::transpose(mSkeleton.localTransforms.back());
         nodeToIndex.insert(node->mName, nodeIndex);
-        
-        n.parentIndex = parentIndex;
-        if (n.parentIndex != -1) {
-           mNodes[n.parentIndex].childIndices.push_back(nodeIndex);
-        }
 
         // process all the node's meshes (if any)
         for(size_t i = 0; i < node->mNumMeshes; ++i) {
@@ -154,6 +324,8 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
             indexBuffer.resize(prevIndSize + 3 * aiMesh->mNumFaces);
             mesh.startIndex = prevIndSize;
             mesh.numIndices = 3 * aiMesh->mNumFaces;
+            mesh.startVertex = prevVertSize;
+            mesh.numVertices = aiMesh->mNumVertices;
             size_t ind = prevIndSize;
             for (size_t j = 0; j < aiMesh->mNumFaces; ++j) {
                 indexBuffer[ind++] = prevVertSize + aiMesh->mFaces[j].mIndices[0];
@@ -209,6 +381,39 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
     }
     // parse animations
     if (loadAnimation) {
+        // every clip stores a node in the same channel,
+        // so that clips can be blended channel by channel
+        size_t numNodes = mSkeleton.getNumNodes();
+        prt::vector<int32_t> nodeToChannel;
+        nodeToChannel.resize(numNodes, -1);
+        for (size_t i = 0; i < scene->mNumAnimations; ++i) {
+            aiAnimation const * aiAnim = scene->mAnimations[i];
+            for (size_t j = 0; j < aiAnim->mNumChannels; ++j) {
+                assert(nodeToIndex.find(aiAnim->mChannels[j]->mNodeName) != nodeToIndex.end() && "animation does not correspond to node");
+                size_t nodeIndex = nodeToIndex.find(aiAnim->mChannels[j]->mNodeName)->value();
+                nodeToChannel[nodeIndex] = 0;
+            }
+        }
+
+        // channels of leaf nodes come last, so that
+        // they can be left out at low detail
+        prt::vector<bool> hasChildren;
+        hasChildren.resize(numNodes, false);
+        for (size_t i = 0; i < numNodes; ++i) {
+            if (mSkeleton.parents[i] != 0) hasChildren[mSkeleton.parents[i] - 1] = true;
+        }
+        for (bool leaves : { false, true }) {
+            for (size_t i = 0; i < numNodes; ++i) {
+                if (nodeToChannel[i] == -1 || hasChildren[i] == leaves) continue;
+                nodeToChannel[i] = mSkeleton.channelNodes.size();
+                mSkeleton.channelNodes.push_back(i + 1);
+            }
+            if (!leaves) {
+                mSkeleton.numInnerChannels = mSkeleton.channelNodes.size();
+            }
+        }
+        uint32_t numChannels = mSkeleton.channelNodes.size();
+
         animations.resize(scene->mNumAnimations);
         for (size_t i = 0; i < scene->mNumAnimations; ++i) {
             aiAnimation const * aiAnim = scene->mAnimations[i];
@@ -224,230 +429,388 @@ bool Model::load(bool loadAnimation, TextureManager & textureManager) {
                 nameToAnimation.insert(aiAnim->mName, i);
             }
 
-            Animation & anim = animations[i];
-            anim.duration = aiAnim->mDuration;
-            anim.ticksPerSecond = aiAnim->mTicksPerSecond;
-            anim.channels.resize(aiAnim->mNumChannels);
-
+            // channels share the key times of the clip, which are
+            // every time that any track of any channel has a key at
+            double duration = aiAnim->mDuration;
+            prt::vector<double> times;
             for (size_t j = 0; j < aiAnim->mNumChannels; ++j) {
                 aiNodeAnim const * aiChannel = aiAnim->mChannels[j];
-                AnimationNode & channel = anim.channels[j];
+                appendKeyTimes(aiChannel->mPositionKeys, aiChannel->mNumPositionKeys, duration, times);
+                appendKeyTimes(aiChannel->mRotationKeys, aiChannel->mNumRotationKeys, duration, times);
+                appendKeyTimes(aiChannel->mScalingKeys, aiChannel->mNumScalingKeys, duration, times);
+            }
+            std::sort(times.begin(), times.end());
+            prt::vector<float> keyTimes;
+            keyTimes.push_back(0.0f);
+            for (double time : times) {
+                float keyTime = duration > 0.0 ? float(time / duration) : 0.0f;
+                // a key at the end is the first key again as the clip loops
+                if (keyTime - keyTimes.back() > keyTimeTolerance && keyTime < 1.0f - keyTimeTolerance) {
+                    keyTimes.push_back(keyTime);
+                }
+            }
+            uint32_t numKeys = keyTimes.size();
+
+            // key k of channel c is at k * numChannels + c
+            prt::vector<TRS> keys;
+            keys.resize(size_t(numKeys) * numChannels);
+
+            // nodes that only other clips animate
+            // are held in their bind pose
+            for (uint32_t c = 0; c < numChannels; ++c) {
+                TRS bind = TRS::fromMatrix(mSkeleton.localTransforms[mSkeleton.channelNodes[c] - 1]);
+                for (uint32_t k = 0; k < numKeys; ++k) {
+                    keys[k * numChannels + c] = bind;
+                }
+            }
 
-                assert(nodeToIndex.find(aiChannel->mNodeName) != nodeToIndex.end() && "animation does not correspond to node");
+            // each track is interpolated between its own keys,
+            // which tracks without any leave in the bind pose
+            for (size_t j = 0; j < aiAnim->mNumChannels; ++j) {
+                aiNodeAnim const * aiChannel = aiAnim->mChannels[j];
                 auto nodeIndex = nodeToIndex.find(aiChannel->mNodeName)->value();
-                mNodes[nodeIndex].channelIndex = j;
-
-                assert(aiChannel->mNumPositionKeys == aiChannel->mNumRotationKeys && 
-                       aiChannel->mNumPositionKeys == aiChannel->mNumScalingKeys && "number of position, rotation and scaling keys need to match");
-                channel.keys.resize(aiChannel->mNumPositionKeys);
-
-                for (size_t k = 0; k < channel.keys.size(); ++k) {
-                    aiVector3D const & aiPos = aiChannel->mPositionKeys[k].mValue;
-                    aiQuaternion const & aiRot = aiChannel->mRotationKeys[k].mValue;
-                    aiVector3D const & aiScale = aiChannel->mScalingKeys[k].mValue;
-                    channel.keys[k].position = { aiPos.x, aiPos.y, aiPos.z };
-                    channel.keys[k].rotation = { aiRot.w, aiRot.x, aiRot.y, aiRot.z };
-                    channel.keys[k].scaling = { aiScale.x, aiScale.y, aiScale.z };
+                uint32_t channel = nodeToChannel[nodeIndex];
+
+                KeyCursor position, rotation, scaling;
+                for (uint32_t k = 0; k < numKeys; ++k) {
+                    double time = keyTimes[k] * duration;
+                    TRS & key = keys[k * numChannels + channel];
+                    if (position.seek(aiChannel->mPositionKeys, aiChannel->mNumPositionKeys, time, duration)) {
+                        aiVector3D const & prev = aiChannel->mPositionKeys[position.prev].mValue;
+                        aiVector3D const & next = aiChannel->mPositionKeys[position.next].mValue;
+                        key.translation = glm::mix(glm::vec3{ prev.x, prev.y, prev.z }, 
+                                                   glm::vec3{ next.x, next.y, next.z }, position.factor);
+                    }
+                    if (rotation.seek(aiChannel->mRotationKeys, aiChannel->mNumRotationKeys, time, duration)) {
+                        aiQuaternion const & prev = aiChannel->mRotationKeys[rotation.prev].mValue;
+                        aiQuaternion const & next = aiChannel->mRotationKeys[rotation.next].mValue;
+                        key.rotation = glm::slerp(glm::quat{ prev.w, prev.x, prev.y, prev.z },
+                                                  glm::quat{ next.w, next.x, next.y, next.z }, rotation.factor);
+                    }
+                    if (scaling.seek(aiChannel->mScalingKeys, aiChannel->mNumScalingKeys, time, duration)) {
+                        aiVector3D const & prev = aiChannel->mScalingKeys[scaling.prev].mValue;
+                        aiVector3D const & next = aiChannel->mScalingKeys[scaling.next].mValue;
+                        key.scale = glm::mix(glm::vec3{ prev.x, prev.y, prev.z }, 
+                                             glm::vec3{ next.x, next.y, next.z }, scaling.factor);
+                    }
                 }
             }
+
+            prt::vector<uint32_t> keptKeys;
+            reduceKeys(keys.data(), keyTimes.data(), numKeys, keptKeys);
+            animations[i].compress(aiAnim->mDuration, aiAnim->mTicksPerSecond, 
+                                   numChannels, keys.data(), keyTimes.data(), numKeys, keptKeys);
         }
         // set node Indices
+        mSkeleton.boneNodes.resize(bones.size());
         for (size_t i = 0; i < bones.size(); ++i) {
             aiString & boneName = boneToName[i];
 
             assert(nodeToIndex.find(boneName) != nodeToIndex.end() && "No corresponding node for bone");
             size_t nodeIndex = nodeToIndex.find(boneName)->value();
-            mNodes[nodeIndex].boneIndices.push_back(i);
+            mSkeleton.boneNodes[i] = nodeIndex + 1;
         }
     }
 
     calcTangentSpace();
+    calcMeshBounds();
+    buildMeshlets();
+    generateLODs();
 
     mLoaded = true;
     return true;
 }
 
-int Model::getAnimationIndex(char const * name) const {
-    if (nameToAnimation.find(aiString(name)) == nameToAnimation.end()) {
-        return -1;
-    }
-    return nameToAnimation.find(aiString(name))->value();
+uint64_t Model::importSettingsHash(bool loadAnimation) {
+    uint64_t hash = 0;
+    hash_util::combine(hash, cacheVersion);
+    hash_util::combine(hash, importFlags);
+    hash_util::combine(hash, loadAnimation);
+    hash_util::combine(hash, NUMBER_MESH_LODS);
+    hash_util::combine(hash, MESHLET_MAX_VERTICES);
+    hash_util::combine(hash, MESHLET_MAX_TRIANGLES);
+    // layout changes invalidate the cache as well
+    hash_util::combine(hash, sizeof(Mesh));
+    hash_util::combine(hash, sizeof(Meshlet));
+    hash_util::combine(hash, sizeof(Material));
+    hash_util::combine(hash, sizeof(Vertex));
+    hash_util::combine(hash, sizeof(BoneData));
+    hash_util::combine(hash, sizeof(Bone));
+    hash_util::combine(hash, AnimationClip::laneWidth);
+    hash_util::combine(hash, keyErrorTolerance);
+    hash_util::combine(hash, keyShellDistance);
+    return hash;
 }
 
-void Model::sampleAnimation(float t, size_t animationIndex, glm::mat4 * transforms) const {
-    assert(mAnimated);
-    auto const & animation = animations[animationIndex];
-
-    struct IndexedTForm {
-        int32_t index;
-        glm::mat4 tform;
-    };
+void Model::serialize(io_util::BinaryWriter & writer) const {
+    writer.writeVector(mDependencies);
 
-    prt::vector<IndexedTForm> nodeIndices;
-    nodeIndices.push_back({0, glm::mat4(1.0f)});
-    while (!nodeIndices.empty()) {
-        auto index = nodeIndices.back().index;
-        auto parentTForm = nodeIndices.back().tform;
-        nodeIndices.pop_back();
+    writer.write(mGlobalInverseTransform);
+    writer.writeVector(mSkeleton.parents);
+    writer.writeVector(mSkeleton.localTransforms);
+    writer.writeVector(mSkeleton.channelNodes);
+    writer.writeVector(mSkeleton.boneNodes);
+    writer.write(mSkeleton.numInnerChannels);
 
-        glm::mat4 tform = mNodes[index].transform;
-        int32_t channelIndex = mNodes[index].channelIndex;
+    writer.writeVector(meshes);
+    writer.writeVector(meshlets);
 
-        if (channelIndex != -1) {
-            auto & channel = animation.channels[channelIndex];
+    // textures are referenced by path, their ids
+    // depend on the order they are loaded in
+    writer.writeVector(materials);
+    for (auto const & path : mTexturePaths) {
+        writer.writeString(path.c_str());
+    }
 
-            // calculate prev and next frame
-            float duration = animation.duration / (1000 * animation.ticksPerSecond);
-            float animTime = t / duration;
-            size_t numFrames = animation.channels[channelIndex].keys.size();
-            float fracFrame = animTime * numFrames;
-            uint32_t prevFrame = static_cast<uint32_t>(fracFrame);
-            float frac = fracFrame - prevFrame;
-            prevFrame = prevFrame % numFrames;
-            uint32_t nextFrame = (prevFrame + 1) % numFrames;
+    writer.writeVector(vertexBuffer);
+    writer.writeVector(vertexBoneBuffer);
+    writer.writeVector(indexBuffer);
+    writer.writeVector(bones);
 
-            glm::vec3 const & prevPos = channel.keys[prevFrame].position;
-            glm::vec3 const & nextPos = channel.keys[nextFrame].position;
+    writer.write(uint64_t(animations.size()));
+    for (auto const & animation : animations) {
+        animation.serialize(writer);
+    }
 
-            glm::quat const & prevRot = channel.keys[prevFrame].rotation;
-            glm::quat const & nextRot = channel.keys[nextFrame].rotation;
+    writer.write(uint64_t(nameToAnimation.size()));
+    for (auto const & entry : nameToAnimation) {
+        writer.writeString(entry.key().C_Str());
+        writer.write(entry.value());
+    }
+}
 
-            glm::vec3 const & prevScale = channel.keys[prevFrame].scaling;
-            glm::vec3 const & nextScale = channel.keys[nextFrame].scaling;
+bool Model::deserialize(io_util::BinaryReader & reader, bool loadAnimation,
+                        TextureManager & textureManager,
+                        AssetArchive const & archive) {
+    assert(!mLoaded && "Model is already loaded!");
 
-            glm::vec3 pos = glm::lerp(prevPos, nextPos, frac);
-            glm::quat rot = glm::slerp(prevRot, nextRot, frac);
-            glm::vec3 scale = glm::lerp(prevScale, nextScale, frac);
-            tform = glm::translate(pos) * glm::toMat4(rot) * glm::scale(scale);
+    if (!reader.readVector(mDependencies)) return false;
+    for (auto const & dependency : mDependencies) {
+        uint64_t hash;
+        if (!archive.hashFile(dependency.path, hash) || hash != dependency.hash) {
+            return false;
         }
-        // pose matrix
-        glm::mat4 poseMatrix = parentTForm * tform;
+    }
 
-        for (auto & boneIndex : mNodes[index].boneIndices) {
-            transforms[boneIndex] = poseMatrix * bones[boneIndex].offsetMatrix;
-        }
+    char str[256];
+    uint64_t count;
+
+    if (!reader.read(mGlobalInverseTransform) ||
+        !reader.readVector(mSkeleton.parents) ||
+        !reader.readVector(mSkeleton.localTransforms) ||
+        !reader.readVector(mSkeleton.channelNodes) ||
+        !reader.readVector(mSkeleton.boneNodes) ||
+        !reader.read(mSkeleton.numInnerChannels) ||
+        mSkeleton.localTransforms.size() != mSkeleton.getNumNodes() ||
+        mSkeleton.numInnerChannels > mSkeleton.channelNodes.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < mSkeleton.getNumNodes(); ++i) {
+        // parents need to come first
+        if (mSkeleton.parents[i] > i) return false;
+    }
 
-        for (auto & childIndex : mNodes[index].childIndices) {
-            nodeIndices.push_back({childIndex, poseMatrix});
+    if (!reader.readVector(meshes) || 
+        !reader.readVector(meshlets) || 
+        !reader.readVector(materials)) {
+        return false;
+    }
+    mTexturePaths.resize(5 * materials.size());
+    for (size_t i = 0; i < materials.size(); ++i) {
+        Material & material = materials[i];
+        int32_t * textureIndices[] = { &material.albedoIndex, &material.metallicIndex, 
+                                       &material.roughnessIndex, &material.aoIndex,
+                                       &material.normalIndex };
+        for (size_t j = 0; j < 5; ++j) {
+            if (!reader.readString(str, sizeof(str))) return false;
+            *textureIndices[j] = str[0] == '\0' ? -1 : textureManager.loadTexture(str, true);
+            mTexturePaths[5 * i + j] = str;
         }
     }
+
+    if (!reader.readVector(vertexBuffer) ||
+        !reader.readVector(vertexBoneBuffer) ||
+        !reader.readVector(indexBuffer) ||
+        !reader.readVector(bones)) {
+        return false;
+    }
+
+    if (!reader.read(count)) return false;
+    animations.resize(count);
+    for (auto & animation : animations) {
+        if (!animation.deserialize(reader)) return false;
+    }
+
+    if (!reader.read(count)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t index;
+        if (!reader.readString(str, sizeof(str)) || !reader.read(index)) return false;
+        nameToAnimation.insert(aiString(str), index);
+    }
+
+    if (!reader.atEnd()) return false;
+
+    strcpy(name, strrchr(mPath, '/') + 1);
+    mAnimated = loadAnimation;
+    mLoaded = true;
+    return true;
 }
 
-void Model::blendAnimation(float t, 
-                           float blendFactor,
-                           size_t animationIndexA, 
-                           size_t animationIndexB,
-                           glm::mat4 * transforms) const {
-    assert(mAnimated);
-    auto const & animationA = animations[animationIndexA];
-    auto const & animationB = animations[animationIndexB];
-
-    // // calculate prev and next frame for clip A
-    // size_t numFramesA = animationA.channels[0].keys.size();
-    // float fracFrameA = clipTime * numFramesA;
-    // uint32_t prevFrameA = static_cast<uint32_t>(fracFrameA);
-    // float fracA = fracFrameA - prevFrameA;
-    // prevFrameA = prevFrameA % numFramesA;
-    // uint32_t nextFrameA = (prevFrameA + 1) % numFramesA;
-
-    // // calculate prev and next frame for clip B
-    // size_t numFramesB = animationB.channels[0].keys.size();
-    // float fracFrameB = clipTime * numFramesB;
-    // uint32_t prevFrameB = static_cast<uint32_t>(fracFrameB);
-    // float fracB = fracFrameB - prevFrameB;
-    // prevFrameB = prevFrameB % numFramesB;
-    // uint32_t nextFrameB = (prevFrameB + 1) % numFramesB;
-
-    struct IndexedTForm {
-        int32_t index;
-        glm::mat4 tform;
-    };
-    prt::vector<IndexedTForm> nodeIndices;
-    nodeIndices.push_back({0, glm::mat4(1.0f)});
-    while (!nodeIndices.empty()) {
-        auto index = nodeIndices.back().index;
-        auto parentTForm = nodeIndices.back().tform;
-        nodeIndices.pop_back();
-
-        glm::mat4 tform = mNodes[index].transform;
-        int32_t channelIndex = mNodes[index].channelIndex;
-
-        if (channelIndex != -1) {
-            auto & channelA = animationA.channels[channelIndex];
-            auto & channelB = animationB.channels[channelIndex];
-
-            float durationA = animationA.duration / animationA.ticksPerSecond;
-            float clipTimeA = t / durationA;
-
-            float durationB = animationB.duration / animationB.ticksPerSecond;
-            float clipTimeB = t / durationB;
-
-            // calculate prev and next frame for clip A
-            size_t numFramesA = animationA.channels[channelIndex].keys.size();
-            float fracFrameA = clipTimeA * numFramesA;
-            uint32_t prevFrameA = static_cast<uint32_t>(fracFrameA);
-            float fracA = fracFrameA - prevFrameA;
-            prevFrameA = prevFrameA % numFramesA;
-            uint32_t nextFrameA = (prevFrameA + 1) % numFramesA;
-
-            // calculate prev and next frame for clip B
-            size_t numFramesB = animationB.channels[channelIndex].keys.size();
-            float fracFrameB = clipTimeB * numFramesB;
-            uint32_t prevFrameB = static_cast<uint32_t>(fracFrameB);
-            float fracB = fracFrameB - prevFrameB;
-            prevFrameB = prevFrameB % numFramesB;
-            uint32_t nextFrameB = (prevFrameB + 1) % numFramesB;
-            
-            // clip A
-            glm::vec3 const & prevPosA = channelA.keys[prevFrameA].position;
-            glm::vec3 const & nextPosA = channelA.keys[nextFrameA].position;
+void Model::getBounds(glm::vec3 & center, float & radius) const {
+    center = glm::vec3{ 0.0f };
+    radius = 0.0f;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        Mesh const & mesh = meshes[i];
+        if (i == 0) {
+            center = mesh.center;
+            radius = mesh.radius;
+            continue;
+        }
+        // grow the sphere just enough to enclose the mesh
+        float distance = glm::length(mesh.center - center);
+        if (distance + mesh.radius <= radius) continue;
+        if (distance + radius <= mesh.radius) {
+            center = mesh.center;
+            radius = mesh.radius;
+            continue;
+        }
+        float newRadius = 0.5f * (distance + radius + mesh.radius);
+        center += (newRadius - radius) / distance * (mesh.center - center);
+        radius = newRadius;
+    }
+}
 
-            glm::quat const & prevRotA = channelA.keys[prevFrameA].rotation;
-            glm::quat const & nextRotA = channelA.keys[nextFrameA].rotation;
+int Model::getAnimationIndex(char const * name) const {
+    if (nameToAnimation.find(aiString(name)) == nameToAnimation.end()) {
+        return -1;
+    }
+    return nameToAnimation.find(aiString(name))->value();
+}
 
-            glm::vec3 const & prevScaleA = channelA.keys[prevFrameA].scaling;
-            glm::vec3 const & nextScaleA = channelA.keys[nextFrameA].scaling;
+void Model::sampleAnimation(float t, size_t animationIndex, 
+                            PoseScratch & scratch, glm::mat4 * transforms) const {
+    assert(mAnimated);
+    reservePoseScratch(scratch);
+    samplePose(t, animationIndex, scratch.pose.data());
+    poseBones(scratch.pose.data(), false, scratch, transforms);
+}
 
-            glm::vec3 posA = glm::lerp(prevPosA, nextPosA, fracA);
-            glm::quat rotA = glm::slerp(prevRotA, nextRotA, fracA);
-            glm::vec3 scaleA = glm::lerp(prevScaleA, nextScaleA, fracA);
+void Model::samplePose(float t, size_t animationIndex, TRS * pose,
+                       bool skipLeafBones, uint32_t * keyCursor) const {
+    assert(mAnimated);
+    animations[animationIndex].sample(t, pose, getNumChannels(skipLeafBones), keyCursor);
+}
 
-            // clip B
-            glm::vec3 const & prevPosB = channelB.keys[prevFrameB].position;
-            glm::vec3 const & nextPosB = channelB.keys[nextFrameB].position;
+void Model::poseBones(TRS const * pose, bool skipLeafBones,
+                      PoseScratch & scratch, glm::mat4 * transforms) const {
+    reservePoseScratch(scratch);
+    poseTransforms(pose, getNumChannels(skipLeafBones), scratch.nodeTransforms.data(), transforms);
+}
 
-            glm::quat const & prevRotB = channelB.keys[prevFrameB].rotation;
-            glm::quat const & nextRotB = channelB.keys[nextFrameB].rotation;
+void Model::reservePoseScratch(PoseScratch & scratch) const {
+    size_t numChannels = mSkeleton.channelNodes.size();
+    if (scratch.pose.size() < numChannels) {
+        scratch.pose.resize(numChannels);
+    }
+    if (scratch.nodeTransforms.size() < mSkeleton.getNumNodes() + 1) {
+        scratch.nodeTransforms.resize(mSkeleton.getNumNodes() + 1);
+    }
+}
 
-            glm::vec3 const & prevScaleB = channelB.keys[prevFrameB].scaling;
-            glm::vec3 const & nextScaleB = channelB.keys[nextFrameB].scaling;
+void Model::poseNodes(TRS const * pose, size_t numChannels, glm::mat4 * nodeTransforms) const {
+    size_t numNodes = mSkeleton.getNumNodes();
+    // local transforms, bind pose unless animated
+    nodeTransforms[0] = glm::mat4(1.0f);
+    memcpy(&nodeTransforms[1], mSkeleton.localTransforms.data(), numNodes * sizeof(glm::mat4));
+    for (size_t i = 0; i < numChannels; ++i) {
+        nodeTransforms[mSkeleton.channelNodes[i]] = pose[i].toMatrix();
+    }
 
-            glm::vec3 posB = glm::lerp(prevPosB, nextPosB, fracB);
-            glm::quat rotB = glm::slerp(prevRotB, nextRotB, fracB);
-            glm::vec3 scaleB = glm::lerp(prevScaleB, nextScaleB, fracB);
+    // parents come first, so they are already
+    // in model space when their children are
+    uint32_t const * parents = mSkeleton.parents.data();
+    for (size_t i = 1; i <= numNodes; ++i) {
+        nodeTransforms[i] = nodeTransforms[parents[i - 1]] * nodeTransforms[i];
+    }
+}
 
-            // blend
-            glm::vec3 pos = glm::lerp(posA, posB, blendFactor);
-            glm::quat rot = glm::slerp(rotA, rotB, blendFactor);
-            glm::vec3 scale = glm::lerp(scaleA, scaleB, blendFactor);
+void Model::poseTransforms(TRS const * pose, size_t numChannels, glm::mat4 * nodeTransforms, 
+                           glm::mat4 * transforms) const {
+    poseNodes(pose, numChannels, nodeTransforms);
+    for (size_t i = 0; i < bones.size(); ++i) {
+        transforms[i] = nodeTransforms[mSkeleton.boneNodes[i]] * bones[i].offsetMatrix;
+    }
+}
 
-            tform = glm::translate(pos) * glm::toMat4(rot) * glm::scale(scale);
-        }
-        // pose matrix
-        glm::mat4 poseMatrix = parentTForm * tform;
+void Model::reduceKeys(TRS const * keys, float const * keyTimes, uint32_t numKeys, 
+                       prt::vector<uint32_t> & keptKeys) const {
+    TRACE_SCOPE_ASSET("model", "Model::reduceKeys", mPath);
+    size_t numChannels = mSkeleton.channelNodes.size();
+    size_t numTransforms = mSkeleton.getNumNodes() + 1;
+
+    // model space transforms of every key
+    prt::vector<glm::mat4> reference;
+    reference.resize(numKeys * numTransforms);
+    for (uint32_t k = 0; k < numKeys; ++k) {
+        poseNodes(&keys[k * numChannels], numChannels, &reference[k * numTransforms]);
+    }
 
-        for (auto & boneIndex : mNodes[index].boneIndices) {
-            transforms[boneIndex] = poseMatrix * bones[boneIndex].offsetMatrix;
+    // tolerances scale with the skeleton
+    glm::vec3 minBound{ std::numeric_limits<float>::max() };
+    glm::vec3 maxBound{ std::numeric_limits<float>::lowest() };
+    for (size_t i = 1; i < numTransforms; ++i) {
+        minBound = glm::min(minBound, glm::vec3{ reference[i][3] });
+        maxBound = glm::max(maxBound, glm::vec3{ reference[i][3] });
+    }
+    float size = numTransforms > 1 ? std::max(glm::length(maxBound - minBound), 1e-3f) : 1.0f;
+    float tolerance = keyErrorTolerance * size;
+    float shell = keyShellDistance * size;
+
+    prt::vector<TRS> pose;
+    prt::vector<glm::mat4> nodeTransforms;
+    pose.resize(numChannels);
+    nodeTransforms.resize(numTransforms);
+
+    // grows the span from the last kept key for as long as
+    // interpolating over it reproduces every key in between,
+    // key numKeys is the first key again as the clip loops
+    keptKeys.resize(0);
+    keptKeys.push_back(0);
+    uint32_t first = 0;
+    for (uint32_t last = 2; last <= numKeys; ++last) {
+        TRS const * a = &keys[first * numChannels];
+        TRS const * b = &keys[(last % numKeys) * numChannels];
+        float lastTime = last < numKeys ? keyTimes[last] : 1.0f;
+        bool fits = true;
+        for (uint32_t k = first + 1; k < last && fits; ++k) {
+            float factor = (keyTimes[k] - keyTimes[first]) / (lastTime - keyTimes[first]);
+            for (size_t c = 0; c < numChannels; ++c) {
+                pose[c].translation = glm::mix(a[c].translation, b[c].translation, factor);
+                pose[c].rotation = animation_util::interpolate(a[c].rotation, b[c].rotation, factor);
+                pose[c].scale = glm::mix(a[c].scale, b[c].scale, factor);
+            }
+            poseNodes(pose.data(), numChannels, nodeTransforms.data());
+
+            // points at the node and a shell distance along its axes
+            glm::mat4 const * expected = &reference[k * numTransforms];
+            for (size_t i = 1; i < numTransforms && fits; ++i) {
+                glm::mat4 diff = nodeTransforms[i] - expected[i];
+                glm::vec3 origin{ diff[3] };
+                fits = glm::length(origin) <= tolerance &&
+                       glm::length(origin + shell * glm::vec3{ diff[0] }) <= tolerance &&
+                       glm::length(origin + shell * glm::vec3{ diff[1] }) <= tolerance &&
+                       glm::length(origin + shell * glm::vec3{ diff[2] }) <= tolerance;
+            }
         }
-
-        for (auto & childIndex : mNodes[index].childIndices) {
-            nodeIndices.push_back({childIndex, poseMatrix});
+        if (!fits) {
+            first = last - 1;
+            keptKeys.push_back(first);
         }
-    }                            
+    }
 }
 
 int32_t Model::getTexture(aiMaterial &aiMat, aiTextureType type, const char * modelPath,
-                          TextureManager & textureManager) {
+                          TextureManager & textureManager, std::string & texturePath) {
     aiString texPath;
     int32_t id = -1;
     if (aiMat.GetTexture(type, 0, &texPath) == AI_SUCCESS) {
@@ -457,57 +820,273 @@ int32_t Model::getTexture(aiMaterial &aiMat, aiTextureType type, const char * mo
         char *ptr = strrchr(fullTexPath, '/');
         strcpy(++ptr, texPath.C_Str());
         id = textureManager.loadTexture(fullTexPath, true);
+        texturePath = fullTexPath;
     }
 
     return id;
 }
 
+namespace {
+    glm::vec3 normalizeOrZero(glm::vec3 const & v) {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3{ 0.0f };
+    }
+}
+
 void Model::calcTangentSpace() {
-    for (size_t i = 0; i < indexBuffer.size(); i+=3) {
-        auto & v0 = vertexBuffer[indexBuffer[i]];
-        auto & v1 = vertexBuffer[indexBuffer[i+1]];
-        auto & v2 = vertexBuffer[indexBuffer[i+2]];
-
-        glm::vec3 edge1 = v1.pos - v0.pos;
-        glm::vec3 edge2 = v2.pos - v0.pos;
-        glm::vec2 deltaUV1 = v1.texCoord - v0.texCoord;
-        glm::vec2 deltaUV2 = v2.texCoord - v0.texCoord;  
-        
-        glm::vec3 tan;
-        glm::vec3 bi;
+    TRACE_SCOPE_ASSET("model", "Model::calcTangentSpace", mPath);
+    // MikkTSpace style tangents; triangle tangent frames are projected
+    // onto the tangent plane of each corner and weighted by corner angle
+    static constexpr size_t minChunkSize = 4096;
+
+    size_t const numTriangles = indexBuffer.size() / 3;
+    size_t const numVertices = vertexBuffer.size();
+
+    // buffers are allocated up front, the container
+    // allocator may not be used from worker threads
+    prt::vector<glm::vec3> triangleTangents;
+    prt::vector<glm::vec3> triangleBitangents;
+    triangleTangents.resize(numTriangles);
+    triangleBitangents.resize(numTriangles);
+
+    prt::vector<uint32_t> cornerOffsets;
+    prt::vector<uint32_t> corners;
+    cornerOffsets.resize(numVertices + 1, 0);
+    corners.resize(3 * numTriangles);
+    for (size_t i = 0; i < corners.size(); ++i) {
+        ++cornerOffsets[indexBuffer[i] + 1];
+    }
+    for (size_t i = 0; i < numVertices; ++i) {
+        cornerOffsets[i + 1] += cornerOffsets[i];
+    }
+    {
+        prt::vector<uint32_t> fill;
+        fill.resize(numVertices);
+        std::copy(cornerOffsets.begin(), cornerOffsets.begin() + numVertices, fill.begin());
+        for (size_t i = 0; i < corners.size(); ++i) {
+            corners[fill[indexBuffer[i]]++] = i;
+        }
+    }
 
-        float denom = (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-        if (denom == 0) {
-            continue;
+    // orientation preserving tangent frame of every triangle
+    parallel_util::parallelFor(numTriangles, minChunkSize, [&](size_t begin, size_t end) {
+        for (size_t tri = begin; tri < end; ++tri) {
+            Vertex const & v0 = vertexBuffer[indexBuffer[3 * tri]];
+            Vertex const & v1 = vertexBuffer[indexBuffer[3 * tri + 1]];
+            Vertex const & v2 = vertexBuffer[indexBuffer[3 * tri + 2]];
+
+            glm::vec3 edge1 = v1.pos - v0.pos;
+            glm::vec3 edge2 = v2.pos - v0.pos;
+            glm::vec2 deltaUV1 = v1.texCoord - v0.texCoord;
+            glm::vec2 deltaUV2 = v2.texCoord - v0.texCoord;
+
+            float signedArea = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+            if (signedArea == 0.0f) {
+                triangleTangents[tri] = glm::vec3{ 0.0f };
+                triangleBitangents[tri] = glm::vec3{ 0.0f };
+                continue;
+            }
+            float sign = signedArea > 0.0f ? 1.0f : -1.0f;
+            triangleTangents[tri] = sign * normalizeOrZero(deltaUV2.y * edge1 - deltaUV1.y * edge2);
+            triangleBitangents[tri] = sign * normalizeOrZero(deltaUV1.x * edge2 - deltaUV2.x * edge1);
+        }
+    });
+
+    // every vertex gathers from its own corners, so
+    // threads never write to shared data
+    parallel_util::parallelFor(numVertices, minChunkSize, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            Vertex & vert = vertexBuffer[v];
+            glm::vec3 const & n = vert.normal;
+
+            glm::vec3 tangent{ 0.0f };
+            glm::vec3 bitangent{ 0.0f };
+            for (uint32_t i = cornerOffsets[v]; i < cornerOffsets[v + 1]; ++i) {
+                uint32_t tri = corners[i] / 3;
+                uint32_t corner = corners[i] % 3;
+
+                glm::vec3 const & triTangent = triangleTangents[tri];
+                glm::vec3 const & triBitangent = triangleBitangents[tri];
+
+                glm::vec3 e0 = vertexBuffer[indexBuffer[3 * tri + (corner + 1) % 3]].pos - vert.pos;
+                glm::vec3 e1 = vertexBuffer[indexBuffer[3 * tri + (corner + 2) % 3]].pos - vert.pos;
+                e0 = normalizeOrZero(e0 - n * glm::dot(n, e0));
+                e1 = normalizeOrZero(e1 - n * glm::dot(n, e1));
+                float angle = glm::acos(glm::clamp(glm::dot(e0, e1), -1.0f, 1.0f));
+
+                tangent += angle * normalizeOrZero(triTangent - n * glm::dot(n, triTangent));
+                bitangent += angle * normalizeOrZero(triBitangent - n * glm::dot(n, triBitangent));
+            }
+
+            // no usable uv mapping, any frame will do
+            if (glm::length(tangent) == 0.0f) {
+                tangent = glm::abs(n.x) < 0.9f ? glm::cross(n, glm::vec3{ 1.0f, 0.0f, 0.0f }) 
+                                               : glm::cross(n, glm::vec3{ 0.0f, 1.0f, 0.0f });
+            }
+            vert.tangent = glm::normalize(tangent);
+            float sign = glm::dot(glm::cross(n, vert.tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+            vert.bitangent = sign * glm::cross(n, vert.tangent);
+        }
+    });
+}
+
+void Model::calcMeshBounds() {
+    TRACE_SCOPE_ASSET("model", "Model::calcMeshBounds", mPath);
+    for (auto & mesh : meshes) {
+        glm::vec3 min{ std::numeric_limits<float>::max() };
+        glm::vec3 max{ std::numeric_limits<float>::lowest() };
+        for (size_t i = mesh.startVertex; i < mesh.startVertex + mesh.numVertices; ++i) {
+            min = glm::min(min, vertexBuffer[i].pos);
+            max = glm::max(max, vertexBuffer[i].pos);
+        }
+        mesh.center = 0.5f * (min + max);
+        mesh.radius = 0.0f;
+        for (size_t i = mesh.startVertex; i < mesh.startVertex + mesh.numVertices; ++i) {
+            mesh.radius = glm::max(mesh.radius, glm::distance(mesh.center, vertexBuffer[i].pos));
+        }
+        mesh.boundsMin = min;
+        mesh.boundsMax = max;
+        mesh.boxCenter = mesh.center;
+        mesh.boxExtents = 0.5f * (max - min);
+        mesh.boxAxes = glm::mat3{ 1.0f };
+        if (mesh.numVertices == 0) continue;
+
+        // principal axes of the vertices
+        glm::vec3 mean{ 0.0f };
+        for (size_t i = mesh.startVertex; i < mesh.startVertex + mesh.numVertices; ++i) {
+            mean += vertexBuffer[i].pos;
+        }
+        mean /= float(mesh.numVertices);
+        glm::mat3 covariance{ 0.0f };
+        for (size_t i = mesh.startVertex; i < mesh.startVertex + mesh.numVertices; ++i) {
+            glm::vec3 d = vertexBuffer[i].pos - mean;
+            covariance += glm::outerProduct(d, d);
+        }
+        glm::mat3 axes = math_util::diagonalizer(covariance);
+
+        glm::vec3 boxMin{ std::numeric_limits<float>::max() };
+        glm::vec3 boxMax{ std::numeric_limits<float>::lowest() };
+        for (size_t i = mesh.startVertex; i < mesh.startVertex + mesh.numVertices; ++i) {
+            glm::vec3 p = axes * vertexBuffer[i].pos;
+            boxMin = glm::min(boxMin, p);
+            boxMax = glm::max(boxMax, p);
+        }
+        glm::vec3 extents = 0.5f * (boxMax - boxMin);
+        float boxVolume = extents.x * extents.y * extents.z;
+        float alignedVolume = mesh.boxExtents.x * mesh.boxExtents.y * mesh.boxExtents.z;
+        if (boxVolume <= orientedBoxVolumeRatio * alignedVolume) {
+            mesh.boxAxes = axes;
+            mesh.boxExtents = extents;
+            mesh.boxCenter = glm::transpose(axes) * (0.5f * (boxMin + boxMax));
+        }
+
+        // ratio of the texture space area to the object
+        // space area, summed over the triangles
+        float area = 0.0f;
+        float uvArea = 0.0f;
+        for (size_t i = mesh.startIndex; i + 2 < mesh.startIndex + mesh.numIndices; i += 3) {
+            Vertex const & v0 = vertexBuffer[indexBuffer[i]];
+            Vertex const & v1 = vertexBuffer[indexBuffer[i + 1]];
+            Vertex const & v2 = vertexBuffer[indexBuffer[i + 2]];
+            area += glm::length(glm::cross(v1.pos - v0.pos, v2.pos - v0.pos));
+            glm::vec2 e1 = v1.texCoord - v0.texCoord;
+            glm::vec2 e2 = v2.texCoord - v0.texCoord;
+            uvArea += glm::abs(e1.x * e2.y - e1.y * e2.x);
+        }
+        mesh.uvDensity = area > 0.0f ? glm::sqrt(uvArea / area) : 0.0f;
+    }
+}
+
+void Model::buildMeshlets() {
+    TRACE_SCOPE_ASSET("model", "Model::buildMeshlets", mPath);
+    prt::vector<glm::vec3> positions;
+    prt::vector<uint32_t> localIndices;
+    prt::vector<uint32_t> offsets;
+
+    meshlets.resize(0);
+    for (auto & mesh : meshes) {
+        positions.resize(mesh.numVertices);
+        for (size_t i = 0; i < mesh.numVertices; ++i) {
+            positions[i] = vertexBuffer[mesh.startVertex + i].pos;
+        }
+        localIndices.resize(mesh.numIndices);
+        for (size_t i = 0; i < mesh.numIndices; ++i) {
+            localIndices[i] = indexBuffer[mesh.startIndex + i] - mesh.startVertex;
+        }
+
+        // the triangles of the mesh are reordered
+        // so every meshlet is a contiguous index range
+        mesh_util::buildMeshlets(localIndices.data(), localIndices.size(),
+                                 positions.size(),
+                                 MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES,
+                                 offsets);
+        for (size_t i = 0; i < mesh.numIndices; ++i) {
+            indexBuffer[mesh.startIndex + i] = localIndices[i] + mesh.startVertex;
+        }
+
+        mesh.startMeshlet = meshlets.size();
+        mesh.numMeshlets = offsets.size() - 1;
+        for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+            Meshlet meshlet;
+            meshlet.startIndex = mesh.startIndex + offsets[i];
+            meshlet.numIndices = offsets[i + 1] - offsets[i];
+            mesh_util::clusterBounds(&localIndices[offsets[i]], meshlet.numIndices,
+                                     positions.data(),
+                                     meshlet.center, meshlet.radius,
+                                     meshlet.coneAxis, meshlet.coneCutoff);
+            meshlets.push_back(meshlet);
+        }
+    }
+}
+
+void Model::generateLODs() {
+    TRACE_SCOPE_ASSET("model", "Model::generateLODs", mPath);
+    // LOD n targets half the triangles of LOD n-1
+    // and may deviate from the surface by an amount
+    // proportional to the size of the mesh
+    static constexpr float lodErrorScale = 0.01f;
+    // stop once simplification stops paying off
+    static constexpr float minReduction = 0.85f;
+    static constexpr size_t minIndices = 3 * 32;
+
+    prt::vector<glm::vec3> positions;
+    prt::vector<uint32_t> localIndices;
+    prt::vector<uint32_t> simplified;
+
+    for (auto & mesh : meshes) {
+        mesh.lods[0] = { mesh.startIndex, mesh.numIndices, 0.0f };
+        mesh.numLODs = 1;
+
+        if (mesh.numIndices < minIndices) continue;
+
+        positions.resize(mesh.numVertices);
+        for (size_t i = 0; i < mesh.numVertices; ++i) {
+            positions[i] = vertexBuffer[mesh.startVertex + i].pos;
+        }
+        localIndices.resize(mesh.numIndices);
+        for (size_t i = 0; i < mesh.numIndices; ++i) {
+            localIndices[i] = indexBuffer[mesh.startIndex + i] - mesh.startVertex;
+        }
+
+        for (size_t lod = 1; lod < NUMBER_MESH_LODS; ++lod) {
+            size_t targetIndexCount = (mesh.numIndices >> lod) / 3 * 3;
+            float targetError = lodErrorScale * mesh.radius * float(1 << lod);
+            float error = mesh_util::simplify(localIndices.data(), localIndices.size(),
+                                              positions.data(), positions.size(),
+                                              targetIndexCount, targetError,
+                                              simplified);
+
+            LOD const & prev = mesh.lods[mesh.numLODs - 1];
+            if (simplified.empty() || simplified.size() > minReduction * prev.numIndices) break;
+
+            size_t start = indexBuffer.size();
+            indexBuffer.resize(start + simplified.size());
+            for (size_t i = 0; i < simplified.size(); ++i) {
+                indexBuffer[start + i] = simplified[i] + mesh.startVertex;
+            }
+            mesh.lods[mesh.numLODs] = { start, simplified.size(), glm::max(error, prev.error) };
+            ++mesh.numLODs;
         }
-        float f = 1.0f / denom;
-
-
-        tan.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-        tan.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-        tan.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-        // tan = glm::normalize(tan);
-        v0.tangent += tan; 
-        v1.tangent += tan;
-        v2.tangent += tan;
-
-        bi.x = f * ((-deltaUV2.x * edge1.x) + deltaUV1.x * edge2.x);
-        bi.y = f * ((-deltaUV2.x * edge1.y) + deltaUV1.x * edge2.y);
-        bi.z = f * ((-deltaUV2.x * edge1.z) + deltaUV1.x * edge2.z);
-        // bi = glm::normalize(bi); 
-        v0.bitangent += bi; 
-        v1.bitangent += bi; 
-        v2.bitangent += bi; 
-    }
-    for (auto & vert : vertexBuffer) {
-        if (glm::length(vert.tangent) == 0.0f) continue;
-        vert.tangent = normalize(vert.tangent);
-        vert.tangent = glm::normalize(vert.tangent - (vert.normal * glm::dot(vert.normal, vert.tangent)));
-        glm::vec3 c = glm::cross(vert.normal, vert.tangent);
-        if (glm::dot(c, vert.bitangent) < 0) {
-            vert.tangent = -vert.tangent;
-        }
-        vert.bitangent = glm::cross(vert.normal, vert.tangent);
     }
 }
 
@@ -2,12 +2,16 @@
 #define PBR_MODEL_H
 
 #include "texture.h"
+#include "animation_clip.h"
 
 #include "src/container/vector.h"
 #include "src/container/array.h"
 #include "src/container/hash_map.h"
 #include "src/container/hash_set.h"
 #include "src/graphics/geometry/texture_manager.h"
+#include "src/util/io_util.h"
+#include "src/util/asset_archive.h"
+#include "src/config/config.h"
 
 #include <vulkan/vulkan.h>
 
@@ -23,6 +27,8 @@
 
 #include <assimp/scene.h>
 
+#include <string>
+
 typedef int ModelID;
 
 namespace std {
@@ -47,52 +53,254 @@ namespace std {
 class Model {
 public:
     struct Mesh;
+    struct LOD;
+    struct Meshlet;
     struct Material;
     struct Vertex;
     struct BonedVertex;
     struct BoneData;
     struct Bone;
-    struct Animation;
     struct AnimatedVertex;
-    struct AnimationKey;
-    struct AnimationNode;
-    struct Node;
+    struct PoseScratch;
+    struct Dependency;
+
+    // bump when the cached representation changes
+    static constexpr uint32_t cacheVersion = 9;
+
+    // furthest that dropping animation keys may move a point
+    // near a node, relative to the size of the skeleton
+    static constexpr float keyErrorTolerance = 5e-4f;
+    // distance of those points from their node,
+    // relative to the size of the skeleton
+    static constexpr float keyShellDistance = 0.1f;
+    // the oriented bounding box of a mesh is only used
+    // if its volume is at most this fraction of the
+    // volume of the axis aligned bounding box
+    static constexpr float orientedBoxVolumeRatio = 0.8f;
 
     Model(char const * path);
 
-    bool load(bool loadAnimation, TextureManager & textureManager);
+    /**
+     * Imports the model
+     * @param loadAnimation whether animation is loaded
+     * @param textureManager manager to load textures with
+     * @param archive archive to read files from before
+     *                falling back to the file system
+     * @return true if the model could be imported
+     */
+    bool load(bool loadAnimation, TextureManager & textureManager,
+              AssetArchive const & archive);
+
+    /**
+     * Writes the imported model for the import cache
+     * @param writer writer to append to
+     */
+    void serialize(io_util::BinaryWriter & writer) const;
+
+    /**
+     * Reads a model written by serialize. Fails if any
+     * file the model was imported from has changed since
+     * @param reader reader to read from
+     * @param loadAnimation whether animation is loaded
+     * @param textureManager manager to load textures with
+     * @param archive archive to hash the source files in
+     * @return true if the model could be read
+     */
+    bool deserialize(io_util::BinaryReader & reader, bool loadAnimation,
+                     TextureManager & textureManager,
+                     AssetArchive const & archive);
+
+    /**
+     * @param loadAnimation whether animation is loaded
+     * @return hash of everything besides the source files
+     *         that affects the result of an import
+     */
+    static uint64_t importSettingsHash(bool loadAnimation);
     // TODO: add unload method
 
-    void sampleAnimation(float t, size_t animationIndex, glm::mat4 * transforms) const;
-    void blendAnimation(float t, 
-                        float blendFactor,
-                        size_t animationIndexA, 
-                        size_t animationIndexB,
-                        glm::mat4 * transforms) const;
+    /**
+     * @param t time in seconds
+     * @param animationIndex index of the clip
+     * @param scratch memory to evaluate the pose in
+     * @param transforms bone transforms, one per bone
+     */
+    void sampleAnimation(float t, size_t animationIndex, 
+                         PoseScratch & scratch, glm::mat4 * transforms) const;
+
+    /**
+     * Samples the local transforms of a clip
+     * @param t time in seconds
+     * @param animationIndex index of the clip
+     * @param pose local transform of each channel,
+     *             must hold getNumChannels() transforms
+     * @param skipLeafBones whether channels of bones
+     *                      without children are left out
+     * @param keyCursor key found by the last sample of the
+     *                  clip, updated to the key found by
+     *                  this one, may be null
+     */
+    void samplePose(float t, size_t animationIndex, TRS * pose,
+                    bool skipLeafBones = false, uint32_t * keyCursor = nullptr) const;
+
+    /**
+     * Computes the bone transforms of a pose
+     * @param pose local transform of each channel
+     * @param skipLeafBones whether bones without children
+     *                      keep their bind pose relative
+     *                      to their parent
+     * @param scratch memory to evaluate the pose in
+     * @param transforms bone transforms, one per bone
+     */
+    void poseBones(TRS const * pose, bool skipLeafBones,
+                   PoseScratch & scratch, glm::mat4 * transforms) const;
+
+    /**
+     * Grows scratch memory to fit the poses of the model,
+     * after which evaluating them does not allocate
+     * @param scratch scratch memory to grow
+     */
+    void reservePoseScratch(PoseScratch & scratch) const;
 
     int getAnimationIndex(char const * name) const;
 
+    /**
+     * Bounding sphere of the model in its bind pose
+     * @param center center, returned by reference
+     * @param radius radius, returned by reference
+     */
+    void getBounds(glm::vec3 & center, float & radius) const;
+
+    inline size_t getNumBones() const { return bones.size(); }
+
+    /**
+     * @param skipLeafBones whether channels of bones
+     *                      without children are left out
+     * @return number of channels in a pose
+     */
+    inline size_t getNumChannels(bool skipLeafBones = false) const {
+        return skipLeafBones ? mSkeleton.numInnerChannels : mSkeleton.channelNodes.size();
+    }
+
     inline bool isloaded() const { return mLoaded; }
     inline bool isAnimated() const { return mAnimated; }
 
     char const * getPath() const { return mPath; };
     char const * getName() const { return name; };
 
+    /**
+     * @param path full path of a file
+     * @return true if the model was imported from the file
+     */
+    bool dependsOn(char const * path) const;
+
+    /**
+     * Points the textures of the materials that were
+     * imported with a texture path at a new id
+     * @param path full path of the texture
+     * @param textureID id of the texture
+     * @return true if any material changed
+     */
+    bool updateTextureID(char const * path, int32_t textureID);
+
+    /**
+     * Frees the vertex and index data, which is only
+     * needed to upload the model. Everything else
+     * stays loaded
+     */
+    void releaseGeometry();
+
+    inline bool isGeometryResident() const { return mGeometryResident; }
+
+    /**
+     * @return size of the vertex and index data
+     */
+    size_t getGeometrySize() const;
+
 private:
     void calcTangentSpace();
+    void calcMeshBounds();
+    void buildMeshlets();
+    void generateLODs();
+    /**
+     * Computes the model space transforms of the nodes of a pose
+     * @param pose local transform of each channel
+     * @param numChannels number of leading channels in pose,
+     *                    the rest keep their bind pose
+     * @param nodeTransforms node transforms, one per node
+     *                       and one more
+     */
+    void poseNodes(TRS const * pose, size_t numChannels, glm::mat4 * nodeTransforms) const;
+    /**
+     * Computes the bone transforms of a pose
+     * @param pose local transform of each channel
+     * @param numChannels number of leading channels in pose
+     * @param nodeTransforms scratch, one transform
+     *                       per node and one more
+     * @param transforms bone transforms, one per bone
+     */
+    void poseTransforms(TRS const * pose, size_t numChannels, glm::mat4 * nodeTransforms, 
+                        glm::mat4 * transforms) const;
+    /**
+     * Picks the keys of a clip to store, dropping those that
+     * interpolating between their neighbours reproduces to
+     * within keyErrorTolerance in model space
+     * @param keys key k of channel c at k * numChannels + c
+     * @param keyTimes ascending time of each key as a
+     *                 fraction of the clip, starting at 0
+     * @param numKeys number of keys of every channel
+     * @param keptKeys ascending indices of the kept keys
+     */
+    void reduceKeys(TRS const * keys, float const * keyTimes, uint32_t numKeys, 
+                    prt::vector<uint32_t> & keptKeys) const;
     int32_t getTexture(aiMaterial &aiMat, aiTextureType type, const char * modelPath, 
-                       TextureManager & textureManager);
+                       TextureManager & textureManager, std::string & texturePath);
+
+    /*
+     * Node hierarchy flattened at import so that every node
+     * comes after its parent, which lets a pose be evaluated
+     * in one linear pass.
+     *
+     * Nodes are referred to by their index into the node
+     * transforms of a pose, where 0 is the identity that the
+     * root is parented to and node i is at i + 1
+     **/
+    struct Skeleton {
+        // per node, parent of the node
+        prt::vector<uint32_t> parents;
+        // per node, transform relative to the parent
+        // when the node is not animated
+        prt::vector<glm::mat4> localTransforms;
+        // per channel, node that the channel animates
+        prt::vector<uint32_t> channelNodes;
+        // per bone, node that the bone follows
+        prt::vector<uint32_t> boneNodes;
+        // channels of nodes with children, which
+        // come before the channels of leaf nodes
+        uint32_t numInnerChannels = 0;
+
+        inline size_t getNumNodes() const { return parents.size(); }
+    };
 
-    prt::vector<Node> mNodes;
+    Skeleton mSkeleton;
     glm::mat4 mGlobalInverseTransform;
 
+    // files besides mPath that were read during import
+    prt::vector<Dependency> mDependencies;
+
     bool mLoaded;
     bool mAnimated;
+    bool mGeometryResident = true;
     char mPath[256] = {};
 
     prt::vector<Mesh> meshes;
-    prt::vector<Animation> animations;
+    prt::vector<Meshlet> meshlets;
+    prt::vector<AnimationClip> animations;
     prt::vector<Material> materials;
+    // per material, paths of the albedo, metallic, roughness,
+    // ambient occlusion and normal textures, empty where it
+    // has none. Duplicate textures share an id and a single
+    // path, so the path of the material is kept here
+    prt::vector<std::string> mTexturePaths;
     prt::vector<Vertex> vertexBuffer;
     prt::vector<BoneData> vertexBoneBuffer;
     prt::vector<uint32_t> indexBuffer;
@@ -108,15 +316,22 @@ private:
     // friend classes
     friend class ModelManager;
     friend class Renderer;
+    friend class AnimationBenchmark;
+};
+
+/*
+ * Memory that poses are evaluated in, grown to the
+ * largest model it is used with and reused after
+ **/
+struct Model::PoseScratch {
+    prt::vector<TRS> pose;
+    prt::vector<glm::mat4> nodeTransforms;
 };
 
-struct Model::Node {
-    int32_t parentIndex = -1;
-    prt::vector<int32_t> childIndices;
-    prt::vector<int32_t> boneIndices;
-    int32_t channelIndex = -1;
-    glm::mat4 transform;
-    aiString name;
+struct Model::Dependency {
+    char path[256];
+    // hash of the file contents
+    uint64_t hash;
 };
 
 struct Model::Material {
@@ -140,27 +355,54 @@ struct Model::Bone {
     glm::mat4 meshTransform;
 };
 
-struct Model::Mesh {
+struct Model::LOD {
     size_t startIndex;
     size_t numIndices;
-    int32_t materialIndex = 0;
-    char name[256];
-};
-
-struct Model::AnimationKey {
-    glm::vec3 position;
-    glm::quat rotation;
-    glm::vec3 scaling;
+    // largest distance the simplified surface
+    // deviates from the full resolution mesh
+    float error;
 };
 
-struct Model::AnimationNode {
-    prt::vector<AnimationKey> keys;
+struct Model::Meshlet {
+    size_t startIndex;
+    size_t numIndices;
+    // bounding sphere
+    glm::vec3 center;
+    float radius;
+    // backface cone, see mesh_util::clusterBounds
+    glm::vec3 coneAxis;
+    float coneCutoff;
 };
 
-struct Model::Animation {
-    float duration;
-    double ticksPerSecond;
-    prt::vector<AnimationNode> channels;
+struct Model::Mesh {
+    size_t startIndex;
+    size_t numIndices;
+    size_t startVertex;
+    size_t numVertices;
+    int32_t materialIndex = 0;
+    // lods[0] is the full resolution mesh,
+    // the rest are progressively coarser
+    prt::array<LOD, NUMBER_MESH_LODS> lods;
+    uint32_t numLODs = 1;
+    // meshlets partitioning the full resolution mesh
+    size_t startMeshlet = 0;
+    size_t numMeshlets = 0;
+    // bounding sphere
+    glm::vec3 center;
+    float radius;
+    // axis aligned bounding box
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // oriented bounding box, the rows of boxAxes are
+    // its axes and boxExtents its half extents along them.
+    // Same as the axis aligned box unless that is looser
+    glm::vec3 boxCenter;
+    glm::vec3 boxExtents;
+    glm::mat3 boxAxes;
+    // average texture coordinate units per object space
+    // unit, used to estimate the mip level that is sampled
+    float uvDensity;
+    char name[256];
 };
 
 struct Model::BoneData {
@@ -2,10 +2,17 @@
 
 #include "src/graphics/geometry/asset_manager.h"
 #include "src/util/string_util.h"
+#include "src/util/hash_util.h"
+#include "src/util/io_util.h"
+#include "src/util/trace_util.h"
 #include "src/container/hash_map.h"
 
 #include <dirent.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <string>   
 
 #include <fstream>
@@ -13,9 +20,11 @@
 bool ModelManager::defAlreadyLoaded = false;
 
 
-ModelManager::ModelManager(const char* modelDirectory, TextureManager & textureManager) 
-    : m_textureManager(textureManager) {
+ModelManager::ModelManager(const char* modelDirectory, const char * cacheDirectory, 
+                           TextureManager & textureManager, AssetArchive const & archive) 
+    : m_textureManager(textureManager), m_archive(archive) {
     strcpy(m_modelDirectory, modelDirectory);
+    strcpy(m_cacheDirectory, cacheDirectory);
 }
 
 void ModelManager::getBoneOffsets(ModelID const * modelIDs,
@@ -41,37 +50,159 @@ void ModelManager::getSampledAnimation(float t,
     size_t tIndex = 0;
     for (size_t i = 0; i < modelIDs.size(); ++i) {
         auto const & model = m_loadedModels[modelIDs[i]];
-        model.sampleAnimation(t, animationIndices[i], &transforms[tIndex]);
+        model.sampleAnimation(t, animationIndices[i], m_poseScratches[0], &transforms[tIndex]);
         tIndex += model.bones.size();
     }
 }
 
 void ModelManager::getSampledBlendedAnimation(ModelID const * modelIDs,
                                               BlendedAnimation const * animationBlends, 
-                                              prt::vector<glm::mat4> & transforms,
+                                              uint32_t const * boneOffsets,
+                                              bool const * skipLeafBones,
+                                              uint32_t * keyCursors,
+                                              glm::mat4 * transforms,
                                               size_t n) {
-    size_t numBones = 0;
+    static constexpr uint32_t posesPerInstance = 2 * BlendedAnimation::maxLayers;
+
+    // workers may not allocate, so scratch memory
+    // is grown up front to fit every model
+    parallel_util::WorkerPool & pool = parallel_util::getWorkerPool();
     for (size_t i = 0; i < n; ++i) {
-        numBones += m_loadedModels[modelIDs[i]].bones.size();
+        for (size_t j = 0; j < pool.getNumThreads(); ++j) {
+            m_loadedModels[modelIDs[i]].reservePoseScratch(m_poseScratches[j]);
+        }
     }
-    transforms.resize(numBones);
 
-    size_t tIndex = 0;
+    // every layer asks for the clip samples it needs
+    m_poseRequests.resize(0);
+    m_layerPoses.resize(n * posesPerInstance);
     for (size_t i = 0; i < n; ++i) {
-        auto const & model = m_loadedModels[modelIDs[i]];
-        model.blendAnimation(animationBlends[i].time, 
-                             animationBlends[i].blendFactor, 
-                             animationBlends[i].clipA, 
-                             animationBlends[i].clipB, 
-                             &transforms[tIndex]);
-        tIndex += model.bones.size();
+        BlendedAnimation const & blend = animationBlends[i];
+        assert(blend.numLayers <= BlendedAnimation::maxLayers);
+        for (uint32_t j = 0; j < blend.numLayers; ++j) {
+            AnimationLayer const & layer = blend.layers[j];
+            uint32_t layerPose = i * posesPerInstance + j;
+            uint32_t * keyCursor = keyCursors != nullptr ? &keyCursors[i * BlendedAnimation::maxLayers + j] 
+                                                         : nullptr;
+            requestPose(modelIDs[i], layer.clip, blend.time, layerPose, keyCursor);
+            if (layer.additive) {
+                // the reference pose is the first key
+                requestPose(modelIDs[i], layer.clip, 0.0f, layerPose + BlendedAnimation::maxLayers, nullptr);
+            }
+        }
+    }
+
+    // requests for the same sample end up next to each other
+    std::sort(m_poseRequests.begin(), m_poseRequests.end(), 
+              [](PoseRequest const & a, PoseRequest const & b) { return a.key < b.key; });
+    m_cachedPoses.resize(0);
+    size_t numTransforms = 0;
+    for (size_t i = 0; i < m_poseRequests.size(); ++i) {
+        PoseRequest const & request = m_poseRequests[i];
+        bool skip = skipLeafBones != nullptr && skipLeafBones[request.layerPose / posesPerInstance];
+        if (i == 0 || request.key != m_poseRequests[i - 1].key) {
+            CachedPose cached;
+            cached.modelID = ModelID(request.key >> 48);
+            cached.clip = uint32_t(request.key >> 32) & 0xffff;
+            cached.time = request.time;
+            cached.skipLeafBones = true;
+            cached.keyCursor = std::numeric_limits<uint32_t>::max();
+            cached.offset = numTransforms;
+            m_cachedPoses.push_back(cached);
+            numTransforms += m_loadedModels[cached.modelID].getNumChannels();
+        }
+        CachedPose & cached = m_cachedPoses.back();
+        cached.skipLeafBones = cached.skipLeafBones && skip;
+        if (request.keyCursor != nullptr && cached.keyCursor == std::numeric_limits<uint32_t>::max()) {
+            cached.keyCursor = *request.keyCursor;
+        }
+        m_layerPoses[request.layerPose] = m_cachedPoses.size() - 1;
+    }
+    if (m_poseCache.size() < numTransforms) {
+        m_poseCache.resize(numTransforms);
+    }
+
+    pool.parallelFor(m_cachedPoses.size(), poseJobSize, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            CachedPose & cached = m_cachedPoses[i];
+            m_loadedModels[cached.modelID].samplePose(cached.time, cached.clip,
+                                                      m_poseCache.data() + cached.offset,
+                                                      cached.skipLeafBones, &cached.keyCursor);
+        }
+    });
+
+    for (PoseRequest const & request : m_poseRequests) {
+        if (request.keyCursor != nullptr) {
+            *request.keyCursor = m_cachedPoses[m_layerPoses[request.layerPose]].keyCursor;
+        }
     }
+
+    pool.parallelFor(n, animationJobSize, [&](size_t begin, size_t end) {
+        Model::PoseScratch & scratch = m_poseScratches[parallel_util::WorkerPool::getThreadIndex()];
+        for (size_t i = begin; i < end; ++i) {
+            auto const & model = m_loadedModels[modelIDs[i]];
+            BlendedAnimation const & blend = animationBlends[i];
+            bool skip = skipLeafBones != nullptr && skipLeafBones[i];
+            size_t numChannels = model.getNumChannels(skip);
+            uint32_t const * layerPoses = m_layerPoses.data() + i * posesPerInstance;
+            auto getPose = [&](uint32_t layerPose) { 
+                return m_poseCache.data() + m_cachedPoses[layerPoses[layerPose]].offset; 
+            };
+
+            // blending one layer at a time by its share of the
+            // weight so far weighs every layer by its share
+            // of the total
+            TRS * pose = scratch.pose.data();
+            float totalWeight = 0.0f;
+            bool blended = false;
+            for (uint32_t j = 0; j < blend.numLayers; ++j) {
+                AnimationLayer const & layer = blend.layers[j];
+                if (layer.additive) continue;
+                float weight = glm::max(layer.weight, 0.0f);
+                if (!blended) {
+                    std::copy(getPose(j), getPose(j) + numChannels, pose);
+                    blended = true;
+                } else if (weight > 0.0f) {
+                    animation_util::blendPoses(pose, getPose(j), weight / (totalWeight + weight), 
+                                               pose, numChannels);
+                }
+                totalWeight += weight;
+            }
+            assert(blended && "blended animation has no layer that is not additive!");
+
+            for (uint32_t j = 0; j < blend.numLayers; ++j) {
+                AnimationLayer const & layer = blend.layers[j];
+                if (!layer.additive || layer.weight == 0.0f) continue;
+                animation_util::addPose(getPose(j), getPose(j + BlendedAnimation::maxLayers), 
+                                        layer.weight, pose, numChannels);
+            }
+
+            model.poseBones(pose, skip, scratch, &transforms[boneOffsets[i]]);
+        }
+    });
+}
+
+void ModelManager::requestPose(ModelID modelID, uint32_t clip, float time, uint32_t layerPose,
+                               uint32_t * keyCursor) {
+    assert(uint32_t(modelID) <= 0xffff && clip <= 0xffff && "pose cache key out of range!");
+    // looping clips repeat their samples
+    float duration = m_loadedModels[modelID].animations[clip].getDuration();
+    float clipTime = duration > 0.0f ? time - duration * std::floor(time / duration) : 0.0f;
+    uint32_t step = uint32_t(clipTime / poseCacheTimeStep + 0.5f);
+
+    PoseRequest request;
+    request.key = (uint64_t(modelID) << 48) | (uint64_t(clip) << 32) | step;
+    request.time = step * poseCacheTimeStep;
+    request.layerPose = layerPose;
+    request.keyCursor = keyCursor;
+    m_poseRequests.push_back(request);
 }
 
 // TODO: Fix so that no conflict arises if model
 // has been loaded as both animated and non-animated 
 ModelID ModelManager::loadModel(char const * path,
                                 bool animated, bool & alreadyLoaded) {
+    TRACE_SCOPE_ASSET("model", "ModelManager::loadModel", path);
     ModelID id;
     
     char fullPath[256];
@@ -86,13 +217,14 @@ ModelID ModelManager::loadModel(char const * path,
         id = m_loadedModels.size();
 
         m_loadedModels.push_back(Model{fullPath});
-        Model & model = m_loadedModels.back();
+        bool loaded = importModel(animated, m_loadedModels.back());
 
-        if (!model.load(animated, m_textureManager)) {
+        if (!loaded) {
             m_loadedModels.pop_back();
             id = -1;
         } else {
             m_pathToModelID.insert(path, id);
+            m_lastUsedFrames.push_back(0);
         }
         
     } else {
@@ -103,6 +235,74 @@ ModelID ModelManager::loadModel(char const * path,
     return id;
 }
 
+void ModelManager::reloadModels(char const * path, prt::vector<ModelID> & modelIDs) {
+    for (size_t i = 0; i < m_loadedModels.size(); ++i) {
+        if (!m_loadedModels[i].dependsOn(path)) continue;
+
+        Model model{m_loadedModels[i].getPath()};
+        if (importModel(m_loadedModels[i].isAnimated(), model)) {
+            m_loadedModels[i] = model;
+            modelIDs.push_back(i);
+        } else {
+            std::cout << "failed to reload model: " << model.getPath() << std::endl;
+        }
+    }
+}
+
+void ModelManager::updateTextureIDs(char const * path, uint32_t textureID, 
+                                    prt::vector<ModelID> & modelIDs) {
+    for (size_t i = 0; i < m_loadedModels.size(); ++i) {
+        if (!m_loadedModels[i].updateTextureID(path, textureID)) continue;
+
+        if (std::find(modelIDs.begin(), modelIDs.end(), ModelID(i)) == modelIDs.end()) {
+            modelIDs.push_back(i);
+        }
+    }
+}
+
+bool ModelManager::makeResident(ModelID modelID, uint64_t frame) {
+    TRACE_SCOPE_ASSET("model", "ModelManager::makeResident", m_loadedModels[modelID].getPath());
+    Model & loaded = m_loadedModels[modelID];
+    if (!loaded.isGeometryResident()) {
+        Model model{loaded.getPath()};
+        if (!importModel(loaded.isAnimated(), model)) {
+            return false;
+        }
+        loaded = model;
+    }
+    markUsed(modelID, frame);
+
+    for (auto const & material : loaded.materials) {
+        prt::array<int, 5> indices = { material.albedoIndex,
+                                       material.metallicIndex,
+                                       material.roughnessIndex,
+                                       material.aoIndex,
+                                       material.normalIndex };
+        for (int ind : indices) {
+            if (ind == -1) continue;
+            m_textureManager.makeResident(ind);
+            m_textureManager.markUsed(ind, frame);
+        }
+    }
+    return true;
+}
+
+bool ModelManager::importModel(bool animated, Model & model) {
+    char cachePath[512];
+    bool cacheable = getCachePath(model.getPath(), animated, cachePath);
+    if (cacheable && loadCached(cachePath, animated, model)) {
+        return true;
+    }
+
+    // discard anything a stale cache entry left behind
+    model = Model{model.getPath()};
+    bool loaded = model.load(animated, m_textureManager, m_archive);
+    if (loaded && cacheable) {
+        saveCached(cachePath, model);
+    }
+    return loaded;
+}
+
 // void ModelManager::loadModels(char const * paths[], size_t count,
 //                               ModelID * ids, bool animated) {    
 //     char path[256];
@@ -124,6 +324,58 @@ ModelID ModelManager::loadModel(char const * path,
 //     }
 // }
 
+bool ModelManager::getCachePath(char const * path, bool animated, char * cachePath) const {
+    uint64_t seed = Model::importSettingsHash(animated);
+    seed = hash_util::hash64(path, strlen(path), seed);
+    uint64_t key;
+    if (!m_archive.hashFile(path, key, seed)) {
+        return false;
+    }
+    sprintf(cachePath, "%s%016llx.mdl", m_cacheDirectory, static_cast<unsigned long long>(key));
+    return true;
+}
+
+bool ModelManager::loadCached(char const * cachePath, bool animated, Model & model) {
+    TRACE_SCOPE_ASSET("model", "ModelManager::loadCached", model.getPath());
+    prt::vector<char> data;
+    if (!io_util::readFile(cachePath, data)) {
+        return false;
+    }
+
+    io_util::BinaryReader reader{data.data(), data.size()};
+    uint32_t magic;
+    uint32_t version;
+    return reader.read(magic) && magic == cacheMagic &&
+           reader.read(version) && version == Model::cacheVersion &&
+           model.deserialize(reader, animated, m_textureManager, m_archive);
+}
+
+void ModelManager::saveCached(char const * cachePath, Model const & model) const {
+    TRACE_SCOPE_ASSET("model", "ModelManager::saveCached", model.getPath());
+    prt::vector<char> data;
+    io_util::BinaryWriter writer{data};
+    writer.write(cacheMagic);
+    writer.write(Model::cacheVersion);
+    model.serialize(writer);
+
+    if (!io_util::writeFile(cachePath, data.data(), data.size())) {
+        std::cout << "failed to write model cache: " << cachePath << std::endl;
+    }
+}
+
 uint32_t ModelManager::getAnimationIndex(ModelID modelID, char const * name) {
     return m_loadedModels[modelID].getAnimationIndex(name);
 }
+
+void ModelManager::prefetch(char const * path) const {
+    char fullPath[256];
+    strcpy(fullPath, m_modelDirectory);
+    strcat(fullPath, path);
+
+    // an opened archive is prefetched as a whole
+    char const * data;
+    size_t size;
+    if (!m_archive.find(fullPath, data, size)) {
+        io_util::prefetchFile(fullPath);
+    }
+}
@@ -8,18 +8,43 @@
 
 #include "src/graphics/geometry/model.h"
 
-/* Animation blending */
+#include "src/util/parallel_util.h"
+
+/* Clip of a blended animation */
+struct AnimationLayer {
+    uint32_t clip = 0;
+    float weight = 1.0f;
+    // additive layers add the difference of their clip
+    // from its first key, instead of being blended
+    bool additive = false;
+};
+
+/* 
+ * Animation blending. The layers that are not additive are
+ * blended by their weights relative to each other, after
+ * which the additive layers are added on top in order.
+ * Every layer plays at the same time
+ **/
 struct BlendedAnimation {
-    uint32_t clipA;
-    uint32_t clipB;
-    float blendFactor = 0.0f;
+    static constexpr uint32_t maxLayers = 4;
+
+    AnimationLayer layers[maxLayers] = {};
+    uint32_t numLayers = 1;
     float time = 0.0f;
     bool paused = false;
 };
 
 class ModelManager {
 public:
-    ModelManager(const char * directory, TextureManager & textureManager);
+    /**
+     * @param directory model directory
+     * @param cacheDirectory directory of the import cache
+     * @param textureManager manager to load textures with
+     * @param archive archive to read models from before
+     *                falling back to the file system
+     */
+    ModelManager(const char * directory, const char * cacheDirectory, 
+                 TextureManager & textureManager, AssetArchive const & archive);
 
     inline void getModels(Model const * & models, size_t & n) const { models = m_loadedModels.data();
                                                                       n = m_loadedModels.size(); }
@@ -35,24 +60,184 @@ public:
                              prt::vector<uint32_t> const & animationIndices, 
                              prt::vector<glm::mat4> & transforms);
 
+    /**
+     * Evaluates the poses of animated instances on the
+     * worker pool, each into its own slice of transforms.
+     * Layers that play the same clip of the same model
+     * within poseCacheTimeStep of each other share one
+     * sample of the clip
+     * @param modelIDs model of each instance
+     * @param animationBlends animation of each instance
+     * @param boneOffsets first transform of each instance
+     * @param skipLeafBones whether each instance leaves out
+     *                      its leaf bones, may be null
+     * @param keyCursors key cursor of each layer of each
+     *                   instance, layer j of instance i at
+     *                   i * BlendedAnimation::maxLayers + j,
+     *                   see AnimationClip::sample, may be null
+     * @param transforms bone transforms of every instance
+     * @param n number of instances
+     */
     void getSampledBlendedAnimation(ModelID const * modelIDs,
                                     BlendedAnimation const * animationBlends, 
-                                    prt::vector<glm::mat4> & transforms,
+                                    uint32_t const * boneOffsets,
+                                    bool const * skipLeafBones,
+                                    uint32_t * keyCursors,
+                                    glm::mat4 * transforms,
                                     size_t n);
 
+    /**
+     * @param requested clip samples the layers of the last
+     *                  evaluation asked for
+     * @param sampled clip samples taken after sharing
+     */
+    inline void getPoseCacheCounts(size_t & requested, size_t & sampled) const {
+        requested = m_poseRequests.size();
+        sampled = m_cachedPoses.size();
+    }
+
+    // layers share a clip sample if their times round
+    // to the same multiple of this, in seconds
+    float poseCacheTimeStep = 1.0f / 240.0f;
+
     static bool defAlreadyLoaded;
     ModelID loadModel(char const * path, 
                       bool animated, bool & alreadyLoaded = defAlreadyLoaded);
 
     uint32_t getAnimationIndex(ModelID modelID, char const * name);
 
+    /**
+     * Hints the OS to start reading a model file ahead
+     * of loading it, without waiting for the read
+     * @param path path of the model, relative to the
+     *             model directory
+     */
+    void prefetch(char const * path) const;
+
+    /**
+     * Imports every loaded model that was imported from
+     * a file again. A model that fails to import keeps
+     * its previous contents
+     * @param path full path of the changed file
+     * @param modelIDs ids of the re-imported models
+     */
+    void reloadModels(char const * path, prt::vector<ModelID> & modelIDs);
+
+    /**
+     * Points the materials of the loaded models that use
+     * a texture path at a new texture id, see
+     * TextureManager::reloadTexture
+     * @param path full path of the texture
+     * @param textureID id of the texture
+     * @param modelIDs ids of the changed models, appended
+     *                 to unless already listed
+     */
+    void updateTextureIDs(char const * path, uint32_t textureID, 
+                          prt::vector<ModelID> & modelIDs);
+
+    /**
+     * Stamps a model with the frame it was last used in,
+     * which decides the order models are evicted in
+     */
+    void markUsed(ModelID modelID, uint64_t frame) { m_lastUsedFrames[modelID] = frame; }
+
+    uint64_t getLastUsedFrame(ModelID modelID) const { return m_lastUsedFrames[modelID]; }
+
+    /**
+     * Imports the geometry of a model again if it has
+     * been evicted and makes its textures resident,
+     * stamping both with the frame
+     * @param modelID id of the model
+     * @param frame current frame
+     * @return false if the model could not be imported
+     */
+    bool makeResident(ModelID modelID, uint64_t frame);
+
+    /**
+     * Frees the geometry of a model. Everything needed
+     * to draw and animate it stays loaded
+     */
+    void evict(ModelID modelID) { m_loadedModels[modelID].releaseGeometry(); }
+
 private:
+    static constexpr uint32_t cacheMagic = 0x4c444d50; // "PMDL"
+
     TextureManager & m_textureManager;  
+    AssetArchive const & m_archive;
 
     prt::hash_map<std::string, ModelID> m_pathToModelID;
     char m_modelDirectory[256];
+    char m_cacheDirectory[256];
 
     prt::vector<Model> m_loadedModels;
+    prt::vector<uint64_t> m_lastUsedFrames;
+
+    // instances evaluated per job on the worker pool
+    static constexpr size_t animationJobSize = 4;
+
+    // one per worker pool thread, reused by
+    // every pose that thread evaluates
+    Model::PoseScratch m_poseScratches[parallel_util::maxThreads];
+
+    // clip samples per job on the worker pool
+    static constexpr size_t poseJobSize = 8;
+
+    struct PoseRequest {
+        // model, clip and quantized time
+        uint64_t key;
+        float time;
+        // index into m_layerPoses
+        uint32_t layerPose;
+        // key cursor of the layer, may be null
+        uint32_t * keyCursor;
+    };
+
+    struct CachedPose {
+        ModelID modelID;
+        uint32_t clip;
+        float time;
+        // only if every layer that shares it does
+        bool skipLeafBones;
+        // key cursor of the first layer that has one,
+        // which every layer that shares it moves to
+        uint32_t keyCursor;
+        // first transform in m_poseCache
+        size_t offset;
+    };
+
+    // clip samples of the last evaluation, rebuilt every
+    // evaluation without shrinking
+    prt::vector<PoseRequest> m_poseRequests;
+    prt::vector<CachedPose> m_cachedPoses;
+    prt::vector<TRS> m_poseCache;
+    // per instance, the cached pose of each layer followed
+    // by the reference pose of each additive layer
+    prt::vector<uint32_t> m_layerPoses;
+
+    /**
+     * Asks for a clip sample for the pose cache
+     * @param modelID model of the clip
+     * @param clip index of the clip
+     * @param time time in seconds
+     * @param layerPose index into m_layerPoses
+     *                  that receives the sample
+     * @param keyCursor key cursor of the layer, may be null
+     */
+    void requestPose(ModelID modelID, uint32_t clip, float time, uint32_t layerPose,
+                     uint32_t * keyCursor);
+
+    /**
+     * Finds the import cache entry of a model, keyed by
+     * the hash of its contents, path and import settings
+     * @param path path of the model
+     * @param animated whether animation is loaded
+     * @param cachePath path of the cache entry
+     * @return false if the model could not be read
+     */
+    bool getCachePath(char const * path, bool animated, char * cachePath) const;
+    bool importModel(bool animated, Model & model);
+    bool loadCached(char const * cachePath, bool animated, Model & model);
+    void saveCached(char const * cachePath, Model const & model) const;
 };
 
 #endif
\ No newline at end of file
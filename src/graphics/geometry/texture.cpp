@@ -1,29 +1,131 @@
 #include "texture.h"
 
+#include "src/util/hash_util.h"
+#include "src/util/trace_util.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 #include <cstdio>
 #include <cmath>
 #include <algorithm>
 
-void Texture::load(char const * path) {
-    stbi_uc* pixels = stbi_load(path, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    if (!pixels) {
-        printf("failed to load texture: %s\n", path);
-        assert(false && "failed to load texture image!");
+namespace {
+    void copyPixels(Texture & texture, stbi_uc const * pixels) {
+        size_t bufferSize = texture.texWidth * texture.texHeight * 4;
+        texture.pixelBuffer.resize(bufferSize);
+        for (size_t i = 0; i < texture.pixelBuffer.size(); i++) {
+            texture.pixelBuffer[i] = pixels[i];
+        }
+
+        uint64_t seed = 0;
+        hash_util::combine(seed, texture.texWidth);
+        hash_util::combine(seed, texture.texHeight);
+        texture.contentHash = hash_util::hash64(pixels, bufferSize, seed);
+
+        texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texture.texWidth, texture.texHeight)))) + 1;
+        texture.generateMipChain();
+    }
+}
+
+bool Texture::load(char const * path) {
+    Image image;
+    decode(path, image);
+    return load(image, path);
+}
+
+bool Texture::load(unsigned char const * data, size_t size, char const * name) {
+    Image image;
+    decode(data, size, image);
+    return load(image, name);
+}
+
+bool Texture::load(Image & image, char const * name) {
+    // a file that is still being written fails to decode
+    if (!image.pixels) {
+        printf("failed to load texture: %s\n", name);
+        return false;
+    }
+
+    texWidth = image.width;
+    texHeight = image.height;
+    texChannels = image.channels;
+    copyPixels(*this, image.pixels);
+    stbi_image_free(image.pixels);
+    image.pixels = nullptr;
+    return true;
+}
+
+bool Texture::decode(char const * path, Image & image) {
+    TRACE_SCOPE_ASSET("texture", "stbi_load", path);
+    image.pixels = stbi_load(path, &image.width, &image.height, &image.channels, STBI_rgb_alpha);
+    return image.pixels != nullptr;
+}
+
+bool Texture::decode(unsigned char const * data, size_t size, Image & image) {
+    TRACE_SCOPE("texture", "stbi_load_from_memory");
+    image.pixels = stbi_load_from_memory(data, size, &image.width, &image.height, &image.channels, STBI_rgb_alpha);
+    return image.pixels != nullptr;
+}
+
+size_t Texture::getMipOffset(uint32_t level) const {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < level; ++i) {
+        offset += size_t(getMipWidth(i)) * getMipHeight(i) * 4;
     }
+    return offset;
+}
+
+void Texture::generateMipChain() {
+    TRACE_SCOPE("texture", "Texture::generateMipChain");
+    pixelBuffer.resize(getMipOffset(mipLevels));
+
+    for (uint32_t level = 1; level < mipLevels; ++level) {
+        unsigned char const * src = &pixelBuffer[getMipOffset(level - 1)];
+        unsigned char * dst = &pixelBuffer[getMipOffset(level)];
+        int srcWidth = getMipWidth(level - 1);
+        int srcHeight = getMipHeight(level - 1);
+        int width = getMipWidth(level);
+        int height = getMipHeight(level);
 
-    size_t bufferSize = texWidth * texHeight * 4;
-    pixelBuffer.resize(bufferSize);
-    for (size_t i = 0; i < pixelBuffer.size(); i++) {
-        pixelBuffer[i] = pixels[i];
+        for (int y = 0; y < height; ++y) {
+            // odd sizes repeat the last row or column
+            int y0 = std::min(2 * y, srcHeight - 1);
+            int y1 = std::min(2 * y + 1, srcHeight - 1);
+            for (int x = 0; x < width; ++x) {
+                int x0 = std::min(2 * x, srcWidth - 1);
+                int x1 = std::min(2 * x + 1, srcWidth - 1);
+                for (int c = 0; c < 4; ++c) {
+                    unsigned int sum = src[4 * (y0 * srcWidth + x0) + c] +
+                                       src[4 * (y0 * srcWidth + x1) + c] +
+                                       src[4 * (y1 * srcWidth + x0) + c] +
+                                       src[4 * (y1 * srcWidth + x1) + c];
+                    dst[4 * (y * width + x) + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
     }
+}
+
+void Texture::serialize(io_util::BinaryWriter & writer) const {
+    writer.write(texWidth);
+    writer.write(texHeight);
+    writer.write(texChannels);
+    writer.write(mipLevels);
+    writer.write(contentHash);
+    writer.writeVector(pixelBuffer);
+}
 
-    mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-    stbi_image_free(pixels);
+bool Texture::deserialize(io_util::BinaryReader & reader) {
+    return reader.read(texWidth) &&
+           reader.read(texHeight) &&
+           reader.read(texChannels) &&
+           reader.read(mipLevels) &&
+           reader.read(contentHash) &&
+           reader.readVector(pixelBuffer) &&
+           hasMipChain();
 }
 
 Texture* Texture::defaultTexture() {
-    static Texture texture = {{0,0,0,1},1,1,4,1};
+    static Texture texture = {{0,0,0,1},1,1,4,1,0};
     return &texture;
 }
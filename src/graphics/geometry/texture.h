@@ -2,13 +2,109 @@
 #define PRT_TEXTURE_H
 
 #include "src/container/vector.h"
+#include "src/util/io_util.h"
 
 struct Texture {
+    // bump when the cached representation changes
+    static constexpr uint32_t cacheVersion = 3;
+
+    /*
+     * Decoded image that has not been copied into a texture
+     * yet. Decoding does not allocate from the container
+     * allocator, so images may be decoded on worker threads
+     **/
+    struct Image {
+        unsigned char * pixels = nullptr;
+        int width, height, channels;
+    };
+
+    // every mip level in order, starting with the
+    // full resolution image
     prt::vector<unsigned char> pixelBuffer;
     int texWidth, texHeight, texChannels;
     uint32_t mipLevels;
+    // hash of the decoded full resolution image, equal
+    // for identical images stored under different names
+    uint64_t contentHash;
+
+    /**
+     * Decodes a texture from an image file. The texture
+     * is left unchanged if the file cannot be decoded
+     * @param path path of the image
+     * @return true if the image could be decoded
+     */
+    bool load(char const * path);
+
+    /**
+     * Decodes a texture from an encoded image in memory.
+     * The texture is left unchanged if it cannot be decoded
+     * @param data encoded image
+     * @param size size of the encoded image
+     * @param name name to report errors with
+     * @return true if the image could be decoded
+     */
+    bool load(unsigned char const * data, size_t size, char const * name);
+
+    /**
+     * Copies a decoded image into the texture and frees it
+     * @param image image decoded by decode
+     * @param name name to report errors with
+     * @return false if the image failed to decode, in
+     *         which case the texture is left unchanged
+     */
+    bool load(Image & image, char const * name);
+
+    /**
+     * Decodes an image file to RGBA
+     * @param path path of the image
+     * @param image decoded image, to be passed to load
+     * @return true if the image could be decoded
+     */
+    static bool decode(char const * path, Image & image);
+
+    /**
+     * Decodes an encoded image in memory to RGBA
+     * @param data encoded image
+     * @param size size of the encoded image
+     * @param image decoded image, to be passed to load
+     * @return true if the image could be decoded
+     */
+    static bool decode(unsigned char const * data, size_t size, Image & image);
+
+    /**
+     * Writes the decoded texture for the import cache
+     * @param writer writer to append to
+     */
+    void serialize(io_util::BinaryWriter & writer) const;
+
+    /**
+     * Reads a texture written by serialize
+     * @param reader reader to read from
+     * @return true if the texture could be read
+     */
+    bool deserialize(io_util::BinaryReader & reader);
+
+    inline int getMipWidth(uint32_t level) const { return texWidth >> level > 0 ? texWidth >> level : 1; }
+    inline int getMipHeight(uint32_t level) const { return texHeight >> level > 0 ? texHeight >> level : 1; }
+
+    /**
+     * @param level mip level
+     * @return offset of the mip level in pixelBuffer,
+     *         or the size of the mip chain for mipLevels
+     */
+    size_t getMipOffset(uint32_t level) const;
+
+    /**
+     * @return true if pixelBuffer holds every mip level
+     *         and not only the full resolution image
+     */
+    inline bool hasMipChain() const { return pixelBuffer.size() == getMipOffset(mipLevels); }
 
-    void load(char const * path);
+    /**
+     * Appends the mip levels to the full resolution
+     * image by box filtering
+     */
+    void generateMipChain();
 
     inline unsigned char* sample(float x, float y) {
         int sx = static_cast<int>(float(texWidth - 1) * x + 0.5f);
@@ -3,6 +3,9 @@
 #include "model_manager.h"
 #include "src/graphics/geometry/asset_manager.h"
 #include "src/util/string_util.h"
+#include "src/util/hash_util.h"
+#include "src/util/io_util.h"
+#include "src/util/trace_util.h"
 #include "src/container/hash_map.h"
 
 #include <dirent.h>
@@ -11,11 +14,15 @@
 
 #include <fstream>
 
-TextureManager::TextureManager(const char* directory) {
+TextureManager::TextureManager(const char* directory, const char* cacheDirectory,
+                               AssetArchive const & archive)
+    : m_archive(archive), m_numDuplicates(0), m_duplicateBytes(0) {
     strcpy(m_textureDirectory, directory);
+    strcpy(m_cacheDirectory, cacheDirectory);
 }
 
 uint32_t TextureManager::loadTexture(char const * texturePath, bool fullPath) {    
+    TRACE_SCOPE_ASSET("texture", "TextureManager::loadTexture", texturePath);
     uint32_t id = 0;
 
     char path[256] = {};    
@@ -25,14 +32,155 @@ uint32_t TextureManager::loadTexture(char const * texturePath, bool fullPath) {
     strcat(path, texturePath);
 
     if (m_pathToTextureID.find(path) == m_pathToTextureID.end()) {
-        id = m_loadedTextures.size();
-        m_pathToTextureID.insert(path, id);
+        // load in place to avoid copying the pixels
         m_loadedTextures.push_back({});
         Texture & texture = m_loadedTextures.back();
-        texture.load(path);
+        if (!loadTextureData(path, texture)) {
+            assert(false && "failed to load texture image!");
+        }
+
+        auto duplicate = m_contentToTextureID.find(texture.contentHash);
+        if (duplicate != m_contentToTextureID.end() &&
+            m_loadedTextures[duplicate->value()].texWidth == texture.texWidth &&
+            m_loadedTextures[duplicate->value()].texHeight == texture.texHeight) {
+            id = duplicate->value();
+            ++m_numDuplicates;
+            m_duplicateBytes += texture.pixelBuffer.size();
+            m_loadedTextures.pop_back();
+        } else {
+            id = m_loadedTextures.size() - 1;
+            m_contentToTextureID.insert(texture.contentHash, id);
+            m_texturePaths.push_back(path);
+            m_lastUsedFrames.push_back(0);
+        }
+        m_pathToTextureID.insert(path, id);
     } else {
         id = m_pathToTextureID.find(path)->value();
     }
 
     return id;
 }
+
+bool TextureManager::reloadTexture(char const * path, uint32_t & textureID) {
+    auto it = m_pathToTextureID.find(path);
+    if (it == m_pathToTextureID.end()) {
+        return false;
+    }
+
+    textureID = it->value();
+    // the changed contents hash to a new cache entry. A file
+    // that fails to decode, such as one that is still being
+    // written, leaves the loaded texture as it is
+    Texture texture;
+    if (!loadTextureData(path, texture)) {
+        return false;
+    }
+
+    // other paths sharing the texture as a duplicate keep
+    // the old contents, so the path gets a texture of its own
+    bool changed = texture.contentHash != m_loadedTextures[textureID].contentHash ||
+                   texture.texWidth != m_loadedTextures[textureID].texWidth ||
+                   texture.texHeight != m_loadedTextures[textureID].texHeight;
+    std::string const * sharedPath = nullptr;
+    for (auto const & node : m_pathToTextureID) {
+        if (node.value() == textureID && node.key() != path) {
+            sharedPath = &node.key();
+            break;
+        }
+    }
+    if (changed && sharedPath != nullptr) {
+        // the old texture is made resident from a path that still has its contents
+        if (m_texturePaths[textureID] == path) {
+            m_texturePaths[textureID] = *sharedPath;
+        }
+        textureID = m_loadedTextures.size();
+        it->value() = textureID;
+        if (m_contentToTextureID.find(texture.contentHash) == m_contentToTextureID.end()) {
+            m_contentToTextureID.insert(texture.contentHash, textureID);
+        }
+        m_loadedTextures.push_back(texture);
+        m_texturePaths.push_back(path);
+        m_lastUsedFrames.push_back(0);
+        return true;
+    }
+
+    auto content = m_contentToTextureID.find(m_loadedTextures[textureID].contentHash);
+    if (content != m_contentToTextureID.end() && content->value() == textureID) {
+        m_contentToTextureID.erase(m_loadedTextures[textureID].contentHash);
+    }
+    if (m_contentToTextureID.find(texture.contentHash) == m_contentToTextureID.end()) {
+        m_contentToTextureID.insert(texture.contentHash, textureID);
+    }
+    m_loadedTextures[textureID] = texture;
+    return true;
+}
+
+bool TextureManager::makeResident(uint32_t textureID) {
+    TRACE_SCOPE_ASSET("texture", "TextureManager::makeResident", m_texturePaths[textureID].c_str());
+    if (isResident(textureID)) return true;
+
+    Texture texture;
+    if (!loadTextureData(m_texturePaths[textureID].c_str(), texture)) {
+        return false;
+    }
+    m_loadedTextures[textureID] = texture;
+    return true;
+}
+
+bool TextureManager::loadTextureData(char const * path, Texture & texture) const {
+    char cachePath[512];
+    bool cacheable = getCachePath(path, cachePath);
+    if (cacheable && loadCached(cachePath, texture)) {
+        return true;
+    }
+
+    char const * data;
+    size_t size;
+    bool loaded;
+    if (m_archive.find(path, data, size)) {
+        loaded = texture.load(reinterpret_cast<unsigned char const *>(data), size, path);
+    } else {
+        loaded = texture.load(path);
+    }
+    if (loaded && cacheable) {
+        saveCached(cachePath, texture);
+    }
+    return loaded;
+}
+
+bool TextureManager::getCachePath(char const * path, char * cachePath) const {
+    uint64_t key;
+    if (!m_archive.hashFile(path, key, Texture::cacheVersion)) {
+        return false;
+    }
+    sprintf(cachePath, "%s%016llx.tex", m_cacheDirectory, static_cast<unsigned long long>(key));
+    return true;
+}
+
+bool TextureManager::loadCached(char const * cachePath, Texture & texture) const {
+    TRACE_SCOPE_ASSET("texture", "TextureManager::loadCached", cachePath);
+    prt::vector<char> data;
+    if (!io_util::readFile(cachePath, data)) {
+        return false;
+    }
+
+    io_util::BinaryReader reader{data.data(), data.size()};
+    uint32_t magic;
+    uint32_t version;
+    return reader.read(magic) && magic == cacheMagic &&
+           reader.read(version) && version == Texture::cacheVersion &&
+           texture.deserialize(reader);
+}
+
+void TextureManager::saveCached(char const * cachePath, Texture const & texture) const {
+    TRACE_SCOPE_ASSET("texture", "TextureManager::saveCached", cachePath);
+    prt::vector<char> data;
+    io_util::BinaryWriter writer{data};
+    writer.write(cacheMagic);
+    writer.write(Texture::cacheVersion);
+    texture.serialize(writer);
+
+    if (!io_util::writeFile(cachePath, data.data(), data.size())) {
+        std::cout << "failed to write texture cache: " << cachePath << std::endl;
+    }
+}
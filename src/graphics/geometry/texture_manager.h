@@ -4,10 +4,18 @@
 #include "src/graphics/geometry/texture.h"
 
 #include "src/container/hash_map.h"
+#include "src/util/asset_archive.h"
 
 class TextureManager {
 public:
-    TextureManager(const char* directory);
+    /**
+     * @param directory texture directory
+     * @param cacheDirectory directory of the import cache
+     * @param archive archive to read textures from before
+     *                falling back to the file system
+     */
+    TextureManager(const char* directory, const char* cacheDirectory,
+                   AssetArchive const & archive);
 
     inline void getTextures(Texture const * & textures, 
                             size_t & nTextures) const { textures = m_loadedTextures.data();
@@ -15,13 +23,105 @@ public:
 
     Texture const & getTexture(uint32_t textureID) const { return m_loadedTextures[textureID]; }
 
+    /**
+     * @return path the texture is loaded from, the first
+     *         loaded of the paths that share the texture
+     */
+    char const * getTexturePath(uint32_t textureID) const { return m_texturePaths[textureID].c_str(); }
+
+    /**
+     * Loads a texture, or returns the id of the texture
+     * if it has already been loaded. Textures with the same
+     * contents as a loaded texture share its id, and thus
+     * its GPU image, even if their paths differ
+     * @param texturePath path of the texture
+     * @param fullPath true if texturePath is not relative
+     *                 to the texture directory
+     * @return id of the texture
+     */
     uint32_t loadTexture(char const * texturePath, bool fullPath = false);
 
+    /**
+     * Loads a texture again if it has been loaded before.
+     * If the path shared its texture with a duplicate and
+     * the contents changed, the path is given a new id
+     * and the other paths keep the old texture
+     * @param path full path of the texture
+     * @param textureID id of the texture, which is new
+     *                  if the path no longer shares it
+     * @return true if the texture had been loaded and
+     *         could be loaded again. Otherwise the texture
+     *         is left as it was
+     */
+    bool reloadTexture(char const * path, uint32_t & textureID);
+
+    /**
+     * Stamps a texture with the frame it was last used in,
+     * which decides the order textures are evicted in
+     */
+    void markUsed(uint32_t textureID, uint64_t frame) { m_lastUsedFrames[textureID] = frame; }
+
+    uint64_t getLastUsedFrame(uint32_t textureID) const { return m_lastUsedFrames[textureID]; }
+
+    inline bool isResident(uint32_t textureID) const { return !m_loadedTextures[textureID].pixelBuffer.empty(); }
+
+    /**
+     * Loads the pixels of a texture again if they
+     * have been evicted
+     * @return true if the pixels are resident
+     */
+    bool makeResident(uint32_t textureID);
+
+    /**
+     * Frees the pixels of a texture. The texture keeps
+     * its id and can be made resident again
+     */
+    void evict(uint32_t textureID) { m_loadedTextures[textureID].pixelBuffer.clear(); }
+
+    /**
+     * @return number of loaded textures that were
+     *         duplicates of another texture
+     */
+    size_t getNumDuplicates() const { return m_numDuplicates; }
+
+    /**
+     * @return size of the pixels, including mips, that
+     *         did not have to be kept or uploaded since
+     *         they duplicated another texture
+     */
+    size_t getDuplicateBytes() const { return m_duplicateBytes; }
+
 private:
+    static constexpr uint32_t cacheMagic = 0x43585450; // "PTXC"
+
+    AssetArchive const & m_archive;
+
     prt::hash_map<std::string, uint32_t> m_pathToTextureID;
+    prt::hash_map<uint64_t, uint32_t> m_contentToTextureID;
     char m_textureDirectory[256];
+    char m_cacheDirectory[256];
     prt::vector<Texture> m_loadedTextures;
-    ;
+    prt::vector<std::string> m_texturePaths;
+    prt::vector<uint64_t> m_lastUsedFrames;
+    size_t m_numDuplicates;
+    size_t m_duplicateBytes;
+
+    /**
+     * Finds the import cache entry of a texture,
+     * keyed by the hash of its contents
+     * @param path path of the texture
+     * @param cachePath path of the cache entry
+     * @return false if the texture could not be read
+     */
+    bool getCachePath(char const * path, char * cachePath) const;
+    /**
+     * Loads a texture from the import cache, or decodes
+     * it and caches it
+     * @return false if the texture could not be decoded
+     */
+    bool loadTextureData(char const * path, Texture & texture) const;
+    bool loadCached(char const * cachePath, Texture & texture) const;
+    void saveCached(char const * cachePath, Texture const & texture) const;
 };
 
 #endif
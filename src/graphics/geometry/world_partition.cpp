@@ -0,0 +1,300 @@
+#include "world_partition.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+WorldPartition::WorldPartition()
+    : m_origin{ 0.0f, 0.0f }, m_width(0), m_depth(0), m_numLoadedCells(0) {}
+
+void WorldPartition::clear() {
+    m_strings.resize(0);
+    m_models.resize(0);
+    m_animations.resize(0);
+    m_instances.resize(0);
+    m_pointLights.resize(0);
+    m_cellModels.resize(0);
+    m_cells.resize(0);
+    m_width = 0;
+    m_depth = 0;
+    m_numLoadedCells = 0;
+}
+
+uint32_t WorldPartition::addModel(char const * path, bool animated) {
+    SceneModel model;
+    model.pathOffset = addString(path);
+    model.animated = animated;
+    model.id = -1;
+    model.failed = false;
+    model.numCells = 0;
+    m_models.push_back(model);
+    return m_models.size() - 1;
+}
+
+uint32_t WorldPartition::addAnimation(char const * clipA, char const * clipB, float blendFactor) {
+    Animation animation;
+    animation.clipAOffset = addString(clipA);
+    animation.clipBOffset = addString(clipB[0] == '\0' ? clipA : clipB);
+    animation.blendFactor = blendFactor;
+    m_animations.push_back(animation);
+    return m_animations.size() - 1;
+}
+
+void WorldPartition::addInstance(uint32_t model, glm::mat4 const & transform, uint32_t animation) {
+    Instance instance;
+    instance.model = model;
+    instance.transform = transform;
+    instance.animation = animation;
+    instance.blend = {};
+    m_instances.push_back(instance);
+}
+
+void WorldPartition::addPointLight(UBOPointLight const & pointLight) {
+    m_pointLights.push_back(pointLight);
+}
+
+void WorldPartition::build() {
+    m_cells.resize(0);
+    m_cellModels.resize(0);
+    m_numLoadedCells = 0;
+    if (m_instances.empty() && m_pointLights.empty()) {
+        m_width = 0;
+        m_depth = 0;
+        return;
+    }
+
+    glm::vec2 minimum{ std::numeric_limits<float>::max() };
+    glm::vec2 maximum{ std::numeric_limits<float>::lowest() };
+    for (auto const & instance : m_instances) {
+        glm::vec2 position{ instance.transform[3].x, instance.transform[3].z };
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    for (auto const & pointLight : m_pointLights) {
+        glm::vec2 position{ pointLight.pos.x, pointLight.pos.z };
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    m_origin = minimum;
+    m_width = static_cast<uint32_t>((maximum.x - minimum.x) / cellSize) + 1;
+    m_depth = static_cast<uint32_t>((maximum.y - minimum.y) / cellSize) + 1;
+
+    Cell empty = {};
+    empty.state = CELL_STATE_UNLOADED;
+    empty.distance = std::numeric_limits<float>::max();
+    m_cells.resize(m_width * m_depth, empty);
+
+    // counting sort of the instances and lights by cell
+    for (auto const & instance : m_instances) {
+        ++m_cells[getCellIndex(glm::vec3{ instance.transform[3] })].numInstances;
+    }
+    for (auto const & pointLight : m_pointLights) {
+        ++m_cells[getCellIndex(pointLight.pos)].numLights;
+    }
+    uint32_t firstInstance = 0;
+    uint32_t firstLight = 0;
+    for (auto & cell : m_cells) {
+        cell.firstInstance = firstInstance;
+        cell.firstLight = firstLight;
+        firstInstance += cell.numInstances;
+        firstLight += cell.numLights;
+        cell.numInstances = 0;
+        cell.numLights = 0;
+    }
+
+    prt::vector<Instance> instances;
+    instances.resize(m_instances.size());
+    for (auto const & instance : m_instances) {
+        Cell & cell = m_cells[getCellIndex(glm::vec3{ instance.transform[3] })];
+        instances[cell.firstInstance + cell.numInstances++] = instance;
+    }
+    m_instances = instances;
+
+    prt::vector<UBOPointLight> pointLights;
+    pointLights.resize(m_pointLights.size());
+    for (auto const & pointLight : m_pointLights) {
+        Cell & cell = m_cells[getCellIndex(pointLight.pos)];
+        pointLights[cell.firstLight + cell.numLights++] = pointLight;
+    }
+    m_pointLights = pointLights;
+
+    // the models each cell depends on
+    prt::vector<uint32_t> lastCell;
+    lastCell.resize(m_models.size(), uint32_t(-1));
+    for (uint32_t i = 0; i < m_cells.size(); ++i) {
+        Cell & cell = m_cells[i];
+        cell.firstModel = m_cellModels.size();
+        for (uint32_t j = cell.firstInstance; j < cell.firstInstance + cell.numInstances; ++j) {
+            uint32_t model = m_instances[j].model;
+            if (lastCell[model] != i) {
+                lastCell[model] = i;
+                m_cellModels.push_back(model);
+            }
+        }
+        cell.numModels = m_cellModels.size() - cell.firstModel;
+    }
+}
+
+bool WorldPartition::update(glm::vec3 const & position, glm::vec3 const & velocity,
+                            ModelManager & modelManager, uint64_t frame, size_t maxLoads) {
+    glm::vec2 current{ position.x, position.z };
+    glm::vec2 ahead = current + glm::vec2{ velocity.x, velocity.z } * loadAheadTime;
+    float unloadRadius = loadRadius + unloadHysteresis;
+
+    for (size_t i = 0; i < m_cells.size(); ++i) {
+        Cell & cell = m_cells[i];
+        cell.distance = getDistance(i, current);
+        float distance = std::min(cell.distance, getDistance(i, ahead));
+
+        if (cell.state == CELL_STATE_UNLOADED && distance <= loadRadius &&
+            cell.numInstances + cell.numLights > 0) {
+            cell.state = CELL_STATE_QUEUED;
+            prefetchCell(cell, modelManager);
+        } else if (cell.state == CELL_STATE_QUEUED && distance > unloadRadius) {
+            cell.state = CELL_STATE_UNLOADED;
+        }
+    }
+
+    bool changed = false;
+    // nearest cells first. Cells are loaded before others are
+    // unloaded so that models they share stay resident
+    for (size_t n = 0; n < maxLoads; ++n) {
+        Cell * nearest = nullptr;
+        for (auto & cell : m_cells) {
+            if (cell.state == CELL_STATE_QUEUED &&
+                (nearest == nullptr || cell.distance < nearest->distance)) {
+                nearest = &cell;
+            }
+        }
+        if (nearest == nullptr) break;
+
+        loadCell(*nearest, modelManager, frame);
+        changed = true;
+    }
+
+    for (size_t i = 0; i < m_cells.size(); ++i) {
+        Cell & cell = m_cells[i];
+        if (cell.state == CELL_STATE_LOADED &&
+            std::min(cell.distance, getDistance(i, ahead)) > unloadRadius) {
+            unloadCell(cell, modelManager);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void WorldPartition::getLoadedInstances(prt::vector<uint32_t> & instances) const {
+    instances.resize(0);
+    for (auto const & cell : m_cells) {
+        if (cell.state != CELL_STATE_LOADED) continue;
+        for (uint32_t i = cell.firstInstance; i < cell.firstInstance + cell.numInstances; ++i) {
+            if (m_models[m_instances[i].model].id != -1) {
+                instances.push_back(i);
+            }
+        }
+    }
+}
+
+void WorldPartition::getLoadedPointLights(prt::vector<UBOPointLight> & pointLights) const {
+    pointLights.resize(0);
+    for (auto const & cell : m_cells) {
+        if (cell.state != CELL_STATE_LOADED) continue;
+        for (uint32_t i = cell.firstLight; i < cell.firstLight + cell.numLights; ++i) {
+            pointLights.push_back(m_pointLights[i]);
+        }
+    }
+}
+
+uint32_t WorldPartition::addString(char const * str) {
+    uint32_t offset = m_strings.size();
+    size_t length = strlen(str) + 1;
+    m_strings.resize(offset + length);
+    memcpy(&m_strings[offset], str, length);
+    return offset;
+}
+
+uint32_t WorldPartition::getCellIndex(glm::vec3 const & position) const {
+    int x = static_cast<int>(std::floor((position.x - m_origin.x) / cellSize));
+    int z = static_cast<int>(std::floor((position.z - m_origin.y) / cellSize));
+    x = glm::clamp(x, 0, int(m_width) - 1);
+    z = glm::clamp(z, 0, int(m_depth) - 1);
+    return z * m_width + x;
+}
+
+float WorldPartition::getDistance(size_t cellIndex, glm::vec2 const & position) const {
+    glm::vec2 minimum = m_origin + cellSize * glm::vec2{ float(cellIndex % m_width), float(cellIndex / m_width) };
+    glm::vec2 maximum = minimum + glm::vec2{ cellSize };
+    // distance to the closest point of the cell
+    glm::vec2 closest = glm::clamp(position, minimum, maximum);
+    return glm::length(position - closest);
+}
+
+void WorldPartition::prefetchCell(Cell const & cell, ModelManager & modelManager) const {
+    for (uint32_t i = cell.firstModel; i < cell.firstModel + cell.numModels; ++i) {
+        SceneModel const & model = m_models[m_cellModels[i]];
+        if (model.failed) continue;
+        if (model.id == -1 || !modelManager.getModel(model.id).isGeometryResident()) {
+            modelManager.prefetch(&m_strings[model.pathOffset]);
+        }
+    }
+}
+
+void WorldPartition::loadCell(Cell & cell, ModelManager & modelManager, uint64_t frame) {
+    for (uint32_t i = cell.firstModel; i < cell.firstModel + cell.numModels; ++i) {
+        SceneModel & model = m_models[m_cellModels[i]];
+        if (model.failed) continue;
+        if (model.id == -1) {
+            model.id = modelManager.loadModel(&m_strings[model.pathOffset], model.animated);
+            if (model.id == -1) {
+                std::cout << "failed to load model: " << &m_strings[model.pathOffset] << std::endl;
+                model.failed = true;
+                continue;
+            }
+        }
+        modelManager.makeResident(model.id, frame);
+        ++model.numCells;
+    }
+
+    // clips can only be looked up once their model is loaded
+    for (uint32_t i = cell.firstInstance; i < cell.firstInstance + cell.numInstances; ++i) {
+        Instance & instance = m_instances[i];
+        SceneModel const & model = m_models[instance.model];
+        if (model.id == -1 || !model.animated || instance.animation == noAnimation) continue;
+
+        Animation const & animation = m_animations[instance.animation];
+        BlendedAnimation & blend = instance.blend;
+        blend.numLayers = 2;
+        blend.layers[0] = {};
+        blend.layers[0].clip = modelManager.getAnimationIndex(model.id, &m_strings[animation.clipAOffset]);
+        blend.layers[0].weight = 1.0f - animation.blendFactor;
+        blend.layers[1] = {};
+        blend.layers[1].clip = modelManager.getAnimationIndex(model.id, &m_strings[animation.clipBOffset]);
+        blend.layers[1].weight = animation.blendFactor;
+        if (blend.layers[0].clip == uint32_t(-1) || blend.layers[1].clip == uint32_t(-1)) {
+            std::cout << "unknown animation clip of model: " << &m_strings[model.pathOffset] << std::endl;
+            blend.numLayers = 1;
+            blend.layers[0] = {};
+        }
+    }
+
+    cell.state = CELL_STATE_LOADED;
+    ++m_numLoadedCells;
+}
+
+void WorldPartition::unloadCell(Cell & cell, ModelManager & modelManager) {
+    for (uint32_t i = cell.firstModel; i < cell.firstModel + cell.numModels; ++i) {
+        SceneModel & model = m_models[m_cellModels[i]];
+        if (model.id == -1) continue;
+        // the geometry is freed once no loaded cell uses it. The
+        // model stays loaded, and is bound without any vertices
+        // or indices until a cell using it is loaded again
+        if (--model.numCells == 0) {
+            modelManager.evict(model.id);
+        }
+    }
+
+    cell.state = CELL_STATE_UNLOADED;
+    --m_numLoadedCells;
+}
@@ -0,0 +1,188 @@
+#ifndef WORLD_PARTITION_H
+#define WORLD_PARTITION_H
+
+#include "src/graphics/geometry/model_manager.h"
+#include "src/graphics/geometry/light.h"
+
+#include "src/container/vector.h"
+
+#include <glm/glm.hpp>
+
+/*
+ * Uniform grid over the xz plane that partitions the
+ * instances and point lights of a scene into cells. Cells
+ * near the camera are streamed in and cells far from it
+ * are streamed out, so only the models of the loaded cells
+ * are kept resident and bound for rendering.
+ *
+ * Usage: add the models, animations, instances and lights
+ * of a scene, build the grid and call update every frame.
+ **/
+class WorldPartition {
+public:
+    enum CellState {
+        CELL_STATE_UNLOADED,
+        // files are prefetched while waiting to be loaded
+        CELL_STATE_QUEUED,
+        CELL_STATE_LOADED
+    };
+
+    struct Instance {
+        uint32_t model;
+        glm::mat4 transform;
+        uint32_t animation;
+        BlendedAnimation blend;
+    };
+
+    // side length of a cell
+    float cellSize = 32.0f;
+    // cells closer than this to the camera are loaded
+    float loadRadius = 96.0f;
+    // loaded cells are only unloaded beyond the load radius
+    // plus this distance, so that cells on the border are
+    // not loaded and unloaded back and forth
+    float unloadHysteresis = 16.0f;
+    // cells are loaded ahead of where the camera will be
+    // this many seconds from now at its current velocity
+    float loadAheadTime = 1.0f;
+    // queued cells loaded per update, so that loading
+    // is spread over frames instead of stalling one
+    size_t cellLoadsPerUpdate = 1;
+
+    WorldPartition();
+
+    void clear();
+
+    /**
+     * @param path path of the model, relative to the model
+     *             directory. The model is not loaded until
+     *             a cell using it is
+     * @param animated whether the model is animated
+     * @return index of the model in the partition
+     */
+    uint32_t addModel(char const * path, bool animated);
+
+    /**
+     * Adds an animation assignment, resolved once its
+     * model is loaded
+     * @param clipA name of the first clip
+     * @param clipB name of the second clip, empty for
+     *              a single clip
+     * @param blendFactor blend factor between the clips
+     * @return index of the assignment in the partition
+     */
+    uint32_t addAnimation(char const * clipA, char const * clipB, float blendFactor);
+
+    /**
+     * @param model index returned by addModel
+     * @param transform model matrix of the instance
+     * @param animation index returned by addAnimation,
+     *                  or noAnimation
+     */
+    void addInstance(uint32_t model, glm::mat4 const & transform, uint32_t animation);
+
+    void addPointLight(UBOPointLight const & pointLight);
+
+    /**
+     * Sorts the added instances and lights into cells.
+     * Call once everything is added
+     */
+    void build();
+
+    /**
+     * Queues the cells that come within the load radius,
+     * loads up to maxLoads queued cells, nearest first,
+     * and unloads the cells beyond the unload radius
+     * @param position position of the camera
+     * @param velocity velocity of the camera
+     * @param modelManager manager to load models with
+     * @param frame current frame
+     * @param maxLoads maximum number of cells to load
+     * @return true if any cell was loaded or unloaded
+     */
+    bool update(glm::vec3 const & position, glm::vec3 const & velocity,
+                ModelManager & modelManager, uint64_t frame, size_t maxLoads);
+
+    /**
+     * @param instances indices of the instances of every
+     *                  loaded cell whose model could be loaded
+     */
+    void getLoadedInstances(prt::vector<uint32_t> & instances) const;
+
+    /**
+     * @param pointLights point lights of every loaded cell
+     */
+    void getLoadedPointLights(prt::vector<UBOPointLight> & pointLights) const;
+
+    inline Instance const & getInstance(uint32_t index) const { return m_instances[index]; }
+
+    inline ModelID getModelID(uint32_t model) const { return m_models[model].id; }
+
+    inline bool isAnimated(uint32_t model) const { return m_models[model].animated; }
+
+    /**
+     * Keeps the playback state of an instance across
+     * the reloading of other cells
+     */
+    inline void setBlend(uint32_t instance, BlendedAnimation const & blend) { m_instances[instance].blend = blend; }
+
+    inline size_t getNumCells() const { return m_cells.size(); }
+
+    inline size_t getNumLoadedCells() const { return m_numLoadedCells; }
+
+    static constexpr uint32_t noAnimation = uint32_t(-1);
+
+private:
+    struct SceneModel {
+        uint32_t pathOffset;
+        bool animated;
+        ModelID id;
+        // set if the model could not be loaded
+        bool failed;
+        // loaded cells using the model
+        uint32_t numCells;
+    };
+
+    struct Animation {
+        uint32_t clipAOffset;
+        uint32_t clipBOffset;
+        float blendFactor;
+    };
+
+    struct Cell {
+        uint32_t firstInstance;
+        uint32_t numInstances;
+        uint32_t firstLight;
+        uint32_t numLights;
+        uint32_t firstModel;
+        uint32_t numModels;
+        CellState state;
+        // distance to the camera as of the last update
+        float distance;
+    };
+
+    // null terminated paths and clip names
+    prt::vector<char> m_strings;
+    prt::vector<SceneModel> m_models;
+    prt::vector<Animation> m_animations;
+    // sorted by cell once built
+    prt::vector<Instance> m_instances;
+    prt::vector<UBOPointLight> m_pointLights;
+    // models used by each cell, without duplicates
+    prt::vector<uint32_t> m_cellModels;
+    prt::vector<Cell> m_cells;
+
+    glm::vec2 m_origin;
+    uint32_t m_width;
+    uint32_t m_depth;
+    size_t m_numLoadedCells;
+
+    uint32_t addString(char const * str);
+    uint32_t getCellIndex(glm::vec3 const & position) const;
+    float getDistance(size_t cellIndex, glm::vec2 const & position) const;
+    void prefetchCell(Cell const & cell, ModelManager & modelManager) const;
+    void loadCell(Cell & cell, ModelManager & modelManager, uint64_t frame);
+    void unloadCell(Cell & cell, ModelManager & modelManager);
+};
+
+#endif
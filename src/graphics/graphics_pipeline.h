@@ -9,6 +9,8 @@
 struct DrawCall {
     uint32_t firstIndex;
     uint32_t indexCount;
+    // added to every index before fetching vertices
+    int32_t vertexOffset = 0;
     using PushConstants = prt::array<unsigned char, 64>;
     alignas(16) PushConstants pushConstants;
 };
@@ -44,11 +46,29 @@ struct ImageAttachment {
 };
 
 
+/*
+ * Binds a single texture of the texture array of
+ * other assets, e.g. precomputed lighting
+ **/
+struct TextureAttachment {
+    size_t descriptorIndex;
+    size_t assetsIndex;
+    size_t textureIndex;
+};
+
 struct UBOAttachment {
     prt::vector<VkDescriptorBufferInfo> descriptorBufferInfos;
     size_t descriptorIndex;
 };
 
+/*
+ * Binds the storage buffer of each swapchain image
+ **/
+struct StorageBufferAttachment {
+    size_t descriptorIndex;
+    size_t storageBufferIndex;
+};
+
 struct GraphicsPipeline {
     static constexpr size_t NULL_INDEX = -1;
     // Assets handle
@@ -56,6 +76,9 @@ struct GraphicsPipeline {
     size_t dynamicAssetsIndex = NULL_INDEX;
     // UBO handle
     size_t uboIndex = NULL_INDEX;
+    // device buffer bound as vertex buffer instead of that
+    // of the assets, e.g. vertices written by a compute pipeline
+    size_t vertexDeviceBufferIndex = NULL_INDEX;
 
     // Descriptors
     prt::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings;
@@ -99,12 +122,22 @@ struct GraphicsPipeline {
 
     int textureDescriptorIndex = -1;
     prt::vector<ImageAttachment> imageAttachments;
+    prt::vector<TextureAttachment> textureAttachments;
     prt::vector<UBOAttachment> uboAttachments;
+    prt::vector<StorageBufferAttachment> storageBufferAttachments;
 
     // Draw calls
     prt::vector<DrawCall> drawCalls;
+    // Optional draw calls per framebuffer, used instead
+    // of drawCalls when rendering to that framebuffer,
+    // e.g. coarser geometry for distant shadow cascades
+    prt::vector<prt::vector<DrawCall> > framebufferDrawCalls;
 
     prt::vector<GUIDrawCall> guiDrawCalls;
+
+    prt::vector<DrawCall> & getDrawCalls(size_t framebufferIndex) {
+        return framebufferIndex < framebufferDrawCalls.size() ? framebufferDrawCalls[framebufferIndex] : drawCalls;
+    }
 };
 
 #endif
\ No newline at end of file
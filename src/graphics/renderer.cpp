@@ -1,6 +1,8 @@
 #include "renderer.h"
 
 #include "src/util/math_util.h"
+#include "src/util/mesh_util.h"
+#include "src/util/trace_util.h"
 
 Renderer::Renderer(unsigned int width, unsigned int height)
     : VulkanApplication(width, height),
@@ -12,6 +14,7 @@ Renderer::~Renderer() {
 }
 
 void Renderer::init() {
+    TRACE_SCOPE("renderer", "Renderer::init");
     samplerInfo.sampler = textureSampler;
     initFBAs();
     pushBackShadowRenderPass();
@@ -99,6 +102,10 @@ void Renderer::initPipelines() {
                            animatedStandardAssetIndex,
                            skyboxAssetIndex);
 
+    /* image based lighting */
+    environmentAssetIndex = pushBackAssets();
+    loadEnvironmentMap(*EnvironmentMap::defaultEnvironmentMap(), environmentAssetIndex);
+
     /* non-animated */
     createStandardAndShadowPipelines(standardAssetIndex, standardUboIndex, shadowMapUboIndex,
                                      "shaders/standard.vert.spv", "shaders/pbr.frag.spv",
@@ -111,15 +118,20 @@ void Renderer::initPipelines() {
                                      pipelineIndices.shadow);
 
     /* animated */
+    // skinned vertices are drawn like static ones
     createStandardAndShadowPipelines(animatedStandardAssetIndex, animatedStandardUboIndex, animatedShadowMapUboIndex,
-                                     "shaders/standard_animated.vert.spv", "shaders/pbr.frag.spv",
+                                     "shaders/standard.vert.spv", "shaders/pbr.frag.spv",
                                      "shaders/pbr_transparent.frag.spv",
-                                     "shaders/shadow_map_animated.vert.spv",
-                                     Model::BonedVertex::getBindingDescription(),
-                                     Model::BonedVertex::getAttributeDescriptions(),
+                                     "shaders/shadow_map.vert.spv",
+                                     Model::Vertex::getBindingDescription(),
+                                     Model::Vertex::getAttributeDescriptions(),
                                      pipelineIndices.opaqueAnimated,
                                      pipelineIndices.transparentAnimated,
                                      pipelineIndices.shadowAnimated);
+    createSkinningPipeline(animatedStandardAssetIndex);
+    getPipeline(pipelineIndices.opaqueAnimated).vertexDeviceBufferIndex = skinnedVertexBufferIndex;
+    getPipeline(pipelineIndices.transparentAnimated).vertexDeviceBufferIndex = skinnedVertexBufferIndex;
+    getPipeline(pipelineIndices.shadowAnimated).vertexDeviceBufferIndex = skinnedVertexBufferIndex;
 
     /* skybox */
     // temporary workaround for loading empty skybox
@@ -188,6 +200,23 @@ void Renderer::createStandardAndShadowPipelines(size_t standardAssetIndex, size_
                                              bindingDescription, attributeDescription);
 }
 
+void Renderer::createSkinningPipeline(size_t animatedAssetIndex) {
+    boneBufferIndex = pushBackStorageBufferData(0);
+    skinnedVertexBufferIndex = pushBackDeviceBufferData(0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+
+    skinningPipelineIndex = pushBackComputePipeline();
+    ComputePipeline & pipeline = getComputePipeline(skinningPipelineIndex);
+
+    pipeline.shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    strcpy(pipeline.shaderStage.pName, "main");
+    strcpy(pipeline.shaderStage.shader, RESOURCE_PATH);
+    strcat(pipeline.shaderStage.shader, "shaders/skinning.comp.spv");
+
+    attachComputeStorageBuffer(skinningPipelineIndex, boneBufferIndex, 0);
+    attachComputeVertexBuffer(skinningPipelineIndex, animatedAssetIndex, 1);
+    attachComputeDeviceBuffer(skinningPipelineIndex, skinnedVertexBufferIndex, 2);
+}
+
 void Renderer::createCompositionPipeline() {
     pipelineIndices.composition = pushBackPipeline();
     GraphicsPipeline & pipeline = getPipeline(pipelineIndices.composition);
@@ -489,12 +518,24 @@ int Renderer::createStandardPipeline(size_t assetIndex, size_t uboIndex,
     shadowmapLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     shadowmapLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     shadowmapLayoutBinding.pImmutableSamplers = nullptr;
+    // prefiltered environment map
+    VkDescriptorSetLayoutBinding environmentLayoutBinding = {};
+    environmentLayoutBinding.descriptorCount = 1;
+    environmentLayoutBinding.binding = 4;
+    environmentLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    environmentLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    environmentLayoutBinding.pImmutableSamplers = nullptr;
+    // brdf lookup table
+    VkDescriptorSetLayoutBinding brdfLutLayoutBinding = environmentLayoutBinding;
+    brdfLutLayoutBinding.binding = 5;
     
-    pipeline.descriptorSetLayoutBindings.resize(4);
+    pipeline.descriptorSetLayoutBindings.resize(6);
     pipeline.descriptorSetLayoutBindings[0] = uboLayoutBinding;
     pipeline.descriptorSetLayoutBindings[1] = textureLayoutBinding;
     pipeline.descriptorSetLayoutBindings[2] = samplerLayoutBinding;
     pipeline.descriptorSetLayoutBindings[3] = shadowmapLayoutBinding;
+    pipeline.descriptorSetLayoutBindings[4] = environmentLayoutBinding;
+    pipeline.descriptorSetLayoutBindings[5] = brdfLutLayoutBinding;
 
     // Descriptor pools
     pipeline.descriptorPoolSizes.resize(4);
@@ -505,7 +546,7 @@ int Renderer::createStandardPipeline(size_t assetIndex, size_t uboIndex,
     pipeline.descriptorPoolSizes[2].type = VK_DESCRIPTOR_TYPE_SAMPLER;
     pipeline.descriptorPoolSizes[2].descriptorCount = static_cast<uint32_t>(swapchain.swapchainImages.size());
     pipeline.descriptorPoolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pipeline.descriptorPoolSizes[3].descriptorCount = static_cast<uint32_t>(swapchain.swapchainImages.size());
+    pipeline.descriptorPoolSizes[3].descriptorCount = static_cast<uint32_t>(3 * swapchain.swapchainImages.size());
 
     // Descriptor sets
     pipeline.descriptorSets.resize(swapchain.swapchainImages.size());
@@ -517,6 +558,14 @@ int Renderer::createStandardPipeline(size_t assetIndex, size_t uboIndex,
     pipeline.imageAttachments[0].layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
     pipeline.imageAttachments[0].sampler = shadowMapSampler;
 
+    pipeline.textureAttachments.resize(2);
+    pipeline.textureAttachments[0].descriptorIndex = 4;
+    pipeline.textureAttachments[0].assetsIndex = environmentAssetIndex;
+    pipeline.textureAttachments[0].textureIndex = 0;
+    pipeline.textureAttachments[1].descriptorIndex = 5;
+    pipeline.textureAttachments[1].assetsIndex = environmentAssetIndex;
+    pipeline.textureAttachments[1].textureIndex = 1;
+
     pipeline.uboAttachments.resize(1);
     pipeline.uboAttachments[0].descriptorBufferInfos.resize(swapchain.swapchainImages.size());
     pipeline.uboAttachments[0].descriptorIndex = 0;
@@ -525,7 +574,7 @@ int Renderer::createStandardPipeline(size_t assetIndex, size_t uboIndex,
         pipeline.uboAttachments[0].descriptorBufferInfos[i].offset = 0;
         pipeline.uboAttachments[0].descriptorBufferInfos[i].range = uniformBufferData.uboData.size();
         
-        pipeline.descriptorWrites[i].resize(4, VkWriteDescriptorSet{});
+        pipeline.descriptorWrites[i].resize(6, VkWriteDescriptorSet{});
         
         pipeline.descriptorWrites[i][0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         // pipeline.descriptorWrites[i][0].dstSet = pipeline.descriptorSets[i];
@@ -567,6 +616,16 @@ int Renderer::createStandardPipeline(size_t assetIndex, size_t uboIndex,
         pipeline.descriptorWrites[i][3].descriptorCount = 1;
         pipeline.descriptorWrites[i][3].pBufferInfo = 0;
         // pipeline.descriptorWrites[i][3].pImageInfo = &offscreenPass.descriptors[i];
+
+        for (size_t j = 4; j < 6; ++j) {
+            pipeline.descriptorWrites[i][j] = {};
+            pipeline.descriptorWrites[i][j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            pipeline.descriptorWrites[i][j].dstBinding = j;
+            pipeline.descriptorWrites[i][j].dstArrayElement = 0;
+            pipeline.descriptorWrites[i][j].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            pipeline.descriptorWrites[i][j].descriptorCount = 1;
+            pipeline.descriptorWrites[i][j].pBufferInfo = 0;
+        }
     }
 
     // Vertex input
@@ -705,8 +764,6 @@ int Renderer::createShadowmapPipeline(size_t assetIndex, size_t uboIndex,
     return pipelineIndex;
 }
 
-// TODO: On rebind only add new assets instead
-// of recreating everything
 void Renderer::bindAssets(Model const * models, size_t nModels,
                           ModelID const * staticModelIDs,
                           size_t nStaticModelIDs,
@@ -715,35 +772,240 @@ void Renderer::bindAssets(Model const * models, size_t nModels,
                           size_t nAnimatedModelIDs,
                           Texture const * textures,
                           size_t nTextures,
-                          prt::array<Texture, 6> const & skybox) {
+                          prt::array<Texture, 6> const & skybox,
+                          EnvironmentMap const & environmentMap) {
+    TRACE_SCOPE("renderer", "Renderer::bindAssets");
     vkDeviceWaitIdle(getDevice());
 
-    prt::hash_map<int, int> standardTextureIndices;
-    prt::hash_map<int, int> animatedTextureIndices;
+    textureIndices.standard = prt::hash_map<int, int>{};
+    textureIndices.animated = prt::hash_map<int, int>{};
     loadModels(models, nModels, textures, nTextures,
                getPipeline(pipelineIndices.opaque).assetsIndex, getPipeline(pipelineIndices.opaqueAnimated).assetsIndex,
-               standardTextureIndices,
-               animatedTextureIndices);
+               textureIndices.standard,
+               textureIndices.animated);
 
     createModelDrawCalls(models, nModels, 
                          staticModelIDs, nStaticModelIDs,
                          animatedModelIDs, nAnimatedModelIDs,
                          boneOffsets, 
-                         standardTextureIndices,
-                         animatedTextureIndices,
-                         getPipeline(pipelineIndices.opaque).drawCalls,
-                         getPipeline(pipelineIndices.transparent).drawCalls,
-                         getPipeline(pipelineIndices.opaqueAnimated).drawCalls,
-                         getPipeline(pipelineIndices.transparentAnimated).drawCalls,
-                         getPipeline(pipelineIndices.shadow).drawCalls,
-                         getPipeline(pipelineIndices.shadowAnimated).drawCalls);
+                         textureIndices.standard,
+                         textureIndices.animated,
+                         meshDraws.standard,
+                         meshDraws.transparent,
+                         meshDraws.animated,
+                         meshDraws.transparentAnimated,
+                         meshDraws.shadow,
+                         meshDraws.shadowAnimated);
+    updateDrawCalls();
+
+    createTextureSlots(textureIndices.standard, textures,
+                       getAssets(getPipeline(pipelineIndices.opaque).assetsIndex).textureImages.numTextures,
+                       textureSlots.standard);
+    createTextureSlots(textureIndices.animated, textures,
+                       getAssets(getPipeline(pipelineIndices.opaqueAnimated).assetsIndex).textureImages.numTextures,
+                       textureSlots.animated);
 
     /* skybox */
     loadCubeMap(skybox, getPipeline(pipelineIndices.skybox).assetsIndex);
+    loadEnvironmentMap(environmentMap, environmentAssetIndex);
+
+    // the descriptor sets are created again along with the swapchain
+    reserveStorageBufferData(boneBufferIndex, 
+                             getNumBones(models, animatedModelIDs, boneOffsets, nAnimatedModelIDs) * sizeof(PackedBone));
+    reserveDeviceBufferData(skinnedVertexBufferIndex,
+                            getNumSkinnedVertices(animatedModelIDs, nAnimatedModelIDs) * sizeof(Model::Vertex));
 
     recreateSwapchain();
 }
 
+bool Renderer::updateModel(ModelID modelID,
+                           Model const * models, size_t nModels,
+                           ModelID const * staticModelIDs,
+                           size_t nStaticModelIDs,
+                           ModelID const * animatedModelIDs,
+                           uint32_t const * boneOffsets,
+                           size_t nAnimatedModelIDs) {
+    if (modelID < 0 || size_t(modelID) >= modelRanges.size() || nModels != modelRanges.size()) {
+        return false;
+    }
+
+    Model const & model = models[modelID];
+    ModelRange const & range = modelRanges[modelID];
+    bool animated = model.isAnimated();
+    Assets & asset = getAssets(getPipeline(animated ? pipelineIndices.opaqueAnimated : 
+                                                      pipelineIndices.opaque).assetsIndex);
+    prt::hash_map<int, int> const & indices = animated ? textureIndices.animated : textureIndices.standard;
+    VkIndexType indexType = asset.vertexData.indexType;
+
+    if (model.vertexBuffer.size() > range.numVertices || 
+        model.indexBuffer.size() > range.numIndices) {
+        return false;
+    }
+    for (auto const & mesh : model.meshes) {
+        if (indexType == VK_INDEX_TYPE_UINT16 && mesh.numVertices > 0x10000) return false;
+    }
+    if (getNumBones(models, animatedModelIDs, boneOffsets, nAnimatedModelIDs) * sizeof(PackedBone) > 
+        getStorageBufferData(boneBufferIndex).data.size()) {
+        return false;
+    }
+    if (getNumSkinnedVertices(animatedModelIDs, nAnimatedModelIDs) * sizeof(Model::Vertex) >
+        getDeviceBufferData(skinnedVertexBufferIndex).size) {
+        return false;
+    }
+    for (auto const & material : model.materials) {
+        prt::array<int, 5> textures = { material.albedoIndex,
+                                        material.metallicIndex,
+                                        material.roughnessIndex,
+                                        material.aoIndex,
+                                        material.normalIndex };
+        for (int ind : textures) {
+            if (ind != -1 && indices.find(ind) == indices.end()) return false;
+        }
+    }
+
+    vkDeviceWaitIdle(getDevice());
+
+    size_t vertexSize = animated ? sizeof(Model::BonedVertex) : sizeof(Model::Vertex);
+    size_t indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+    if (model.vertexBuffer.size() != 0) {
+        prt::vector<unsigned char> vertexData;
+        vertexData.resize(vertexSize * model.vertexBuffer.size());
+        writeVertices(model, vertexData.data());
+        updateBuffer(vertexData.data(), vertexData.size(), 
+                     asset.vertexData.vertexBuffer, vertexSize * range.firstVertex);
+    }
+
+    if (model.indexBuffer.size() != 0) {
+        prt::vector<unsigned char> indexData{prt::getAlignment(alignof(uint32_t))};
+        indexData.resize(indexSize * model.indexBuffer.size());
+        writeIndices(model, indexType, indexData.data());
+        updateBuffer(indexData.data(), indexData.size(), 
+                     asset.vertexData.indexBuffer, indexSize * range.firstIndex);
+    }
+
+    createModelDrawCalls(models, nModels, 
+                         staticModelIDs, nStaticModelIDs,
+                         animatedModelIDs, nAnimatedModelIDs,
+                         boneOffsets, 
+                         textureIndices.standard,
+                         textureIndices.animated,
+                         meshDraws.standard,
+                         meshDraws.transparent,
+                         meshDraws.animated,
+                         meshDraws.transparentAnimated,
+                         meshDraws.shadow,
+                         meshDraws.shadowAnimated);
+    updateDrawCalls();
+    invalidateStaticCommandBuffers();
+
+    return true;
+}
+
+size_t Renderer::getNumBones(Model const * models,
+                             ModelID const * animatedModelIDs,
+                             uint32_t const * boneOffsets,
+                             size_t nAnimatedModelIDs) {
+    if (nAnimatedModelIDs == 0) return 0;
+    return boneOffsets[nAnimatedModelIDs - 1] + models[animatedModelIDs[nAnimatedModelIDs - 1]].bones.size();
+}
+
+size_t Renderer::getNumSkinnedVertices(ModelID const * animatedModelIDs,
+                                       size_t nAnimatedModelIDs) const {
+    // every instance is given room for the vertices of
+    // the range of its model, see createModelDrawCalls
+    size_t numVertices = 0;
+    for (size_t i = 0; i < nAnimatedModelIDs; ++i) {
+        numVertices += modelRanges[animatedModelIDs[i]].numVertices;
+    }
+    return numVertices;
+}
+
+namespace {
+    VkDeviceSize mipChainSize(uint32_t width, uint32_t height, 
+                              uint32_t baseMip, uint32_t mipLevels) {
+        VkDeviceSize size = 0;
+        for (uint32_t level = baseMip; level < mipLevels; ++level) {
+            size += VkDeviceSize(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+        }
+        return size;
+    }
+}
+
+void Renderer::updateTexture(uint32_t textureID, Texture const & texture) {
+    prt::array<int, 2> pipelines = { pipelineIndices.opaque, pipelineIndices.opaqueAnimated };
+    prt::array<prt::hash_map<int, int> *, 2> indices = { &textureIndices.standard, &textureIndices.animated };
+    prt::array<prt::vector<TextureSlot> *, 2> slots = { &textureSlots.standard, &textureSlots.animated };
+
+    bool waited = false;
+    for (size_t i = 0; i < pipelines.size(); ++i) {
+        auto it = indices[i]->find(textureID);
+        if (it == indices[i]->end()) continue;
+
+        if (!waited) {
+            vkDeviceWaitIdle(getDevice());
+            waited = true;
+        }
+
+        TextureSlot & slot = (*slots[i])[it->value()];
+        // a re-imported texture may have changed size
+        slot.width = texture.texWidth;
+        slot.height = texture.texHeight;
+        slot.mipLevels = texture.mipLevels;
+        slot.baseMip = texture.hasMipChain() ? std::min(slot.requestedMip, slot.mipLevels - 1) : 0;
+        slot.requestedMip = slot.baseMip;
+        slot.size = mipChainSize(slot.width, slot.height, slot.baseMip, slot.mipLevels);
+        slot.resident = true;
+
+        size_t assetsIndex = getPipeline(pipelines[i]).assetsIndex;
+        Assets & asset = getAssets(assetsIndex);
+        destroyTexture(asset.textureImages, it->value());
+        createTexture(asset.textureImages, texture, it->value(), slot.baseMip);
+        updateTextureDescriptors(assetsIndex);
+    }
+
+    if (waited) {
+        invalidateStaticCommandBuffers();
+    }
+}
+
+void Renderer::getRequestedTextures(prt::vector<uint32_t> & textureIDs) const {
+    textureIDs.resize(0);
+    for (auto const * slots : { &textureSlots.standard, &textureSlots.animated }) {
+        for (auto const & slot : *slots) {
+            if (slot.lastUsedFrame != frameIndex) continue;
+            if (slot.resident && slot.requestedMip >= slot.baseMip) continue;
+            // a texture may be bound to both texture arrays
+            if (std::find(textureIDs.begin(), textureIDs.end(), slot.textureID) == textureIDs.end()) {
+                textureIDs.push_back(slot.textureID);
+            }
+        }
+    }
+}
+
+void Renderer::getUsedTextures(prt::vector<uint32_t> & textureIDs) const {
+    textureIDs.resize(0);
+    for (auto const * slots : { &textureSlots.standard, &textureSlots.animated }) {
+        for (auto const & slot : *slots) {
+            if (slot.lastUsedFrame != frameIndex) continue;
+            // a texture may be bound to both texture arrays
+            if (std::find(textureIDs.begin(), textureIDs.end(), slot.textureID) == textureIDs.end()) {
+                textureIDs.push_back(slot.textureID);
+            }
+        }
+    }
+}
+
+VkDeviceSize Renderer::getTextureMemoryUsage() const {
+    VkDeviceSize usage = 0;
+    for (auto const * slots : { &textureSlots.standard, &textureSlots.animated }) {
+        for (auto const & slot : *slots) {
+            if (slot.resident) usage += slot.size;
+        }
+    }
+    return usage;
+}
+
 void Renderer::update(prt::vector<glm::mat4> const & modelMatrices, 
                       prt::vector<glm::mat4> const & animatedModelMatrices,
                       prt::vector<glm::mat4> const & bones,
@@ -751,6 +1013,8 @@ void Renderer::update(prt::vector<glm::mat4> const & modelMatrices,
                       SkyLight  const & sun,
                       prt::vector<UBOPointLight> const & pointLights,
                       float t) {      
+    ++frameIndex;
+
     updateUBOs(modelMatrices, 
                animatedModelMatrices,
                bones,
@@ -758,6 +1022,9 @@ void Renderer::update(prt::vector<glm::mat4> const & modelMatrices,
                sun,
                pointLights,
                t);
+
+    updateMeshDraws(modelMatrices, animatedModelMatrices, camera);
+    streamTextures();
 }
 
 void Renderer::updateUBOs(prt::vector<glm::mat4> const & modelMatrices, 
@@ -809,7 +1076,7 @@ void Renderer::updateUBOs(prt::vector<glm::mat4> const & modelMatrices,
         // lights
         standardUBO.lighting.sun.color = sun.color;
         standardUBO.lighting.sun.direction = sun.direction;
-        standardUBO.lighting.ambientLight = 0.03f;
+        standardUBO.lighting.environmentIntensity = environmentIntensity;
         standardUBO.lighting.noPointLights = glm::min(size_t(NUMBER_SUPPORTED_POINTLIGHTS), pointLights.size());
         for (unsigned int i = 0; i < standardUBO.lighting.noPointLights; ++i) {
             standardUBO.lighting.pointLights[i] = pointLights[i];
@@ -819,6 +1086,9 @@ void Renderer::updateUBOs(prt::vector<glm::mat4> const & modelMatrices,
             standardUBO.lighting.cascadeSpace[i] = cascadeSpace[i];
             standardUBO.lighting.splitDepths[i/4][i%4] = splitDepths[i];
         }
+        for (size_t i = 0; i < irradianceSH.size(); ++i) {
+            standardUBO.lighting.irradianceSH[i] = irradianceSH[i];
+        }
         // shadow map ubo
         auto shadowUboData = getUniformBufferData(getPipeline(pipelineIndices.shadow).uboIndex).uboData.data();
         ShadowMapUBO & shadowUBO = *reinterpret_cast<ShadowMapUBO*>(shadowUboData);
@@ -849,7 +1119,7 @@ void Renderer::updateUBOs(prt::vector<glm::mat4> const & modelMatrices,
         // lights
         animatedStandardUBO.lighting.sun.color = sun.color;
         animatedStandardUBO.lighting.sun.direction = sun.direction;
-        animatedStandardUBO.lighting.ambientLight = 0.2f;
+        animatedStandardUBO.lighting.environmentIntensity = environmentIntensity;
         animatedStandardUBO.lighting.noPointLights = glm::min(size_t(NUMBER_SUPPORTED_POINTLIGHTS), pointLights.size());
         for (unsigned int i = 0; i < animatedStandardUBO.lighting.noPointLights; ++i) {
             animatedStandardUBO.lighting.pointLights[i] = pointLights[i];
@@ -859,15 +1129,22 @@ void Renderer::updateUBOs(prt::vector<glm::mat4> const & modelMatrices,
             animatedStandardUBO.lighting.cascadeSpace[i] = cascadeSpace[i];
             animatedStandardUBO.lighting.splitDepths[i/4][i%4] = splitDepths[i];
         }
-        // bones
-        assert(bones.size() <= NUMBER_MAX_BONES);
-        memcpy(&animatedStandardUBO.bones.bones[0], bones.data(), sizeof(glm::mat4) * bones.size()); 
+        for (size_t i = 0; i < irradianceSH.size(); ++i) {
+            animatedStandardUBO.lighting.irradianceSH[i] = irradianceSH[i];
+        }
+        // bones, packed straight into the storage buffer
+        StorageBufferData & boneBuffer = getStorageBufferData(boneBufferIndex);
+        boneBuffer.size = bones.size() * sizeof(PackedBone);
+        assert(boneBuffer.size <= boneBuffer.data.size() && "bone buffer is too small, assets must be bound again!");
+        PackedBone * packedBones = reinterpret_cast<PackedBone*>(boneBuffer.data.data());
+        for (size_t i = 0; i < bones.size(); ++i) {
+            packedBones[i] = PackedBone::pack(bones[i]);
+        }
         // shadow map ubo
         auto animatedShadowUboData = getUniformBufferData(getPipeline(pipelineIndices.shadowAnimated).uboIndex).uboData.data();
         AnimatedShadowMapUBO & animatedShadowUBO = *reinterpret_cast<AnimatedShadowMapUBO*>(animatedShadowUboData);
         // shadow model
         memcpy(animatedShadowUBO.model, animatedStandardUBO.model.model, sizeof(animatedStandardUBO.model.model[0]) * animatedModelMatrices.size());
-        memcpy(animatedShadowUBO.bones.bones, animatedStandardUBO.bones.bones, sizeof(animatedStandardUBO.bones.bones[0]) * bones.size());
         // depth view and projection;
         for (unsigned int i = 0; i < cascadeSpace.size(); ++i) {
             animatedShadowUBO.depthVP[i] = cascadeSpace[i];
@@ -974,6 +1251,7 @@ void Renderer::updateCascades(glm::mat4 const & projectionMatrix,
 
         cascadeSpace[i] = cascadeProjection * cascadeView;
         splitDepths[i] = (nearPlane + splitDist * clipRange) *  -1.0f;
+        cascadeTexelSizes[i] = 2.0f * radius / shadowmapDimension;
 
         lastSplitDist = cascadeSplits[i];
     }
@@ -985,6 +1263,7 @@ void Renderer::loadModels(Model const * models, size_t nModels,
                           size_t animatedAssetIndex,
                           prt::hash_map<int, int> & staticTextureIndices,
                           prt::hash_map<int, int> & animatedTextureIndices) {
+    createModelRanges(models, nModels);
     createVertexBuffers(models, nModels, staticAssetIndex, animatedAssetIndex);
     createIndexBuffers(models, nModels, staticAssetIndex, animatedAssetIndex);
 
@@ -1002,6 +1281,7 @@ void Renderer::loadTextures(size_t staticAssetIndex,
                                 Texture const * textures,
                                 prt::hash_map<int, int> & staticTextureIndices,
                                 prt::hash_map<int, int> & animatedTextureIndices) {
+    TRACE_SCOPE("renderer", "Renderer::loadTextures");
     Assets & staticAsset = getAssets(staticAssetIndex);
     Assets & animatedAsset = getAssets(animatedAssetIndex);
 
@@ -1012,6 +1292,8 @@ void Renderer::loadTextures(size_t staticAssetIndex,
     animatedTextureIndices.insert(-1, -1);
 
     for (size_t i = 0; i < nModels; ++i) {
+        // models that are not drawn may have had their textures evicted
+        if (!models[i].isGeometryResident()) continue;
         bool animated = models[i].isAnimated();
 
         Assets & asset = animated ? animatedAsset : staticAsset;
@@ -1027,8 +1309,10 @@ void Renderer::loadTextures(size_t staticAssetIndex,
             for (int ind : indices) {
                 if (ind != -1 && textureIndices.find(ind) == textureIndices.end()) {
                     Texture const & texture = textures[ind];
+                    uint32_t baseMip = texture.hasMipChain() ? 
+                                       initialMip(texture.texWidth, texture.texHeight, texture.mipLevels) : 0;
                     destroyTexture(asset.textureImages, numTex);
-                    createTexture(asset.textureImages, texture, numTex);
+                    createTexture(asset.textureImages, texture, numTex, baseMip);
 
                     textureIndices.insert(ind, numTex);
                      ++numTex;
@@ -1056,6 +1340,7 @@ void Renderer::loadCubeMap(prt::array<Texture, 6> const & skybox, size_t assetIn
     asset.textureImages.resize(1);
 
     if (asset.textureImages.images[0] != VK_NULL_HANDLE) {
+    TRACE_SCOPE("renderer", "Renderer::loadCubeMap");
         destroyTexture(asset.textureImages, 0);
     }
 
@@ -1073,6 +1358,72 @@ void Renderer::loadCubeMap(prt::array<Texture, 6> const & skybox, size_t assetIn
     }
 }
 
+uint32_t Renderer::initialMip(uint32_t width, uint32_t height, uint32_t mipLevels) const {
+    if (!textureStreaming) return 0;
+
+    uint32_t mip = 0;
+    while (mip + 1 < mipLevels && std::max(width >> mip, height >> mip) > streamingInitialSize) {
+        ++mip;
+    }
+    return mip;
+}
+
+void Renderer::loadEnvironmentMap(EnvironmentMap const & environmentMap, size_t assetIndex) {
+    TRACE_SCOPE("renderer", "Renderer::loadEnvironmentMap");
+    Assets & asset = getAssets(assetIndex);
+
+    // the prefiltered cube map followed by the lookup table
+    if (asset.textureImages.images.size() == 0) {
+        asset.textureImages.resize(2);
+    } else {
+        destroyTexture(asset.textureImages, 0);
+        destroyTexture(asset.textureImages, 1);
+    }
+
+    createCubeMapImage(asset.textureImages.images[0], 
+                       asset.textureImages.imageMemories[0], 
+                       environmentMap.prefiltered.data(),
+                       environmentMap.faceSize,
+                       environmentMap.mipLevels);
+    createCubeMapImageView(asset.textureImages.imageViews[0], 
+                           asset.textureImages.images[0], 
+                           environmentMap.mipLevels);
+    createTexture(asset.textureImages, environmentMap.brdfLut, 1);
+
+    for (size_t i = 0; i < asset.textureImages.images.size(); ++i) {
+        asset.textureImages.descriptorImageInfos[i].sampler = environmentSampler;
+        asset.textureImages.descriptorImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        asset.textureImages.descriptorImageInfos[i].imageView = asset.textureImages.imageViews[i];
+    }
+    asset.textureImages.numTextures = 2;
+
+    irradianceSH = environmentMap.irradianceSH;
+}
+
+void Renderer::createTextureSlots(prt::hash_map<int, int> const & indices,
+                                  Texture const * textures,
+                                  size_t numSlots,
+                                  prt::vector<TextureSlot> & slots) const {
+    slots.resize(numSlots);
+    for (auto const & entry : indices) {
+        if (entry.key() == -1) continue;
+
+        Texture const & texture = textures[entry.key()];
+        TextureSlot & slot = slots[entry.value()];
+        slot.textureID = entry.key();
+        slot.width = texture.texWidth;
+        slot.height = texture.texHeight;
+        slot.mipLevels = texture.mipLevels;
+        // see loadTextures
+        slot.baseMip = texture.hasMipChain() ? initialMip(slot.width, slot.height, slot.mipLevels) : 0;
+        slot.desiredMip = slot.baseMip;
+        slot.requestedMip = slot.baseMip;
+        slot.size = mipChainSize(slot.width, slot.height, slot.baseMip, slot.mipLevels);
+        slot.lastUsedFrame = 0;
+        slot.resident = true;
+    }
+}
+
 void Renderer::createSkyboxDrawCalls() {
     GraphicsPipeline & pipeline = getPipeline(pipelineIndices.skybox);
     DrawCall drawCall;
@@ -1089,33 +1440,24 @@ void Renderer::createModelDrawCalls(Model const * models, size_t nModels,
                                     uint32_t const * boneOffsets,
                                     prt::hash_map<int, int> const & staticTextureIndices,
                                     prt::hash_map<int, int> const & animatedTextureIndices,
-                                    prt::vector<DrawCall> & standard,
-                                    prt::vector<DrawCall> & transparent,
-                                    prt::vector<DrawCall> & animated,
-                                    prt::vector<DrawCall> & transparentAnimated,
-                                    prt::vector<DrawCall> & shadow,
-                                    prt::vector<DrawCall> & shadowAnimated) {
+                                    prt::vector<MeshDraw> & standard,
+                                    prt::vector<MeshDraw> & transparent,
+                                    prt::vector<MeshDraw> & animated,
+                                    prt::vector<MeshDraw> & transparentAnimated,
+                                    prt::vector<MeshDraw> & shadow,
+                                    prt::vector<MeshDraw> & shadowAnimated) {
+    TRACE_SCOPE("renderer", "Renderer::createModelDrawCalls");
     standard.resize(0);
     transparent.resize(0);
     animated.resize(0);
     transparentAnimated.resize(0);
     shadow.resize(0);
     shadowAnimated.resize(0);
+    clusters.resize(0);
 
-    /* non-animated */
-    prt::vector<uint32_t> indexOffsets;
-    uint32_t animatedOffset = 0;
-    uint32_t staticOffset = 0;
-    for (size_t i = 0; i < nModels; ++i) {
-        if (models[i].isAnimated()) {
-            indexOffsets.push_back(animatedOffset);
-            animatedOffset += models[i].indexBuffer.size();
-        } else {
-            indexOffsets.push_back(staticOffset);
-            staticOffset = models[i].indexBuffer.size();
-        }
-    }
+    assert(nModels == modelRanges.size());
 
+    /* non-animated */
     for (size_t i = 0; i < nStaticModelIDs; ++i) {
         const Model& model = models[staticModelIDs[i]];
 
@@ -1143,21 +1485,47 @@ void Renderer::createModelDrawCalls(Model const * models, size_t nModels,
             pc.metallic = material.metallic;
 
             // geometry
-            drawCall.firstIndex = indexOffsets[staticModelIDs[i]] + mesh.startIndex;
-            drawCall.indexCount = mesh.numIndices;
+            MeshDraw meshDraw;
+            ModelRange const & range = modelRanges[staticModelIDs[i]];
+            createMeshDraw(mesh, range.firstIndex, range.firstVertex, 
+                           i, drawCall, meshDraw);
+
+            // shadow casters are not culled by the camera
+            if (!material.transparent) {
+                shadow.push_back(meshDraw);
+            }
+            createClusters(model, mesh, range.firstIndex, meshDraw);
 
             if (material.transparent) {
-                transparent.push_back(drawCall);
+                transparent.push_back(meshDraw);
             } else {
-                standard.push_back(drawCall);
-                shadow.push_back(drawCall);
+                standard.push_back(meshDraw);
             }
         }
     }
 
     /* animated */
+    // each instance is skinned into its own vertices
+    static_assert(sizeof(Model::Vertex) == 14 * sizeof(float) &&
+                  sizeof(Model::BonedVertex) == 22 * sizeof(float),
+                  "skinning.comp reads and writes vertices as packed floats!");
+    prt::vector<Dispatch> & dispatches = getComputePipeline(skinningPipelineIndex).dispatches;
+    dispatches.resize(0);
+    uint32_t firstSkinnedVertex = 0;
     for (size_t i = 0; i < nAnimatedModelIDs; ++i) {
         const Model& model = models[animatedModelIDs[i]];
+        ModelRange const & range = modelRanges[animatedModelIDs[i]];
+
+        if (!model.vertexBuffer.empty()) {
+            Dispatch dispatch;
+            SkinningPushConstants & pc = *reinterpret_cast<SkinningPushConstants*>(dispatch.pushConstants.data());
+            pc.srcFirstVertex = range.firstVertex;
+            pc.dstFirstVertex = firstSkinnedVertex;
+            pc.numVertices = model.vertexBuffer.size();
+            pc.boneOffset = boneOffsets[i];
+            dispatch.groupCountX = (pc.numVertices + skinningGroupSize - 1) / skinningGroupSize;
+            dispatches.push_back(dispatch);
+        }
 
         for (auto const & mesh : model.meshes) {
             auto const & material = model.materials[mesh.materialIndex];
@@ -1181,19 +1549,502 @@ void Renderer::createModelDrawCalls(Model const * models, size_t nModels,
             pc.emissive = material.emissive;
             pc.ao = material.ao;
             pc.metallic = material.metallic;
-            pc.boneOffset = boneOffsets[i];
 
-            // geometry
-            drawCall.firstIndex = indexOffsets[animatedModelIDs[i]] + mesh.startIndex;
-            drawCall.indexCount = mesh.numIndices;
+            // geometry, drawn from the skinned vertices of the instance
+            MeshDraw meshDraw;
+            createMeshDraw(mesh, range.firstIndex, firstSkinnedVertex, 
+                           i, drawCall, meshDraw);
 
             if (material.transparent) {
-                transparentAnimated.push_back(drawCall);
+                transparentAnimated.push_back(meshDraw);
             } else {
-                animated.push_back(drawCall);
-                shadowAnimated.push_back(drawCall);
+                animated.push_back(meshDraw);
+                shadowAnimated.push_back(meshDraw);
             }
         }
+        firstSkinnedVertex += range.numVertices;
+    }
+}
+
+void Renderer::createMeshDraw(Model::Mesh const & mesh,
+                              uint32_t indexOffset, uint32_t vertexOffset,
+                              uint32_t modelMatrixIndex,
+                              DrawCall const & drawCall, MeshDraw & meshDraw) {
+    meshDraw.drawCall = drawCall;
+    meshDraw.drawCall.firstIndex = indexOffset + mesh.startIndex;
+    meshDraw.drawCall.indexCount = mesh.numIndices;
+    // indices are relative to the first vertex of the mesh
+    meshDraw.drawCall.vertexOffset = vertexOffset + mesh.startVertex;
+    meshDraw.modelMatrixIndex = modelMatrixIndex;
+    meshDraw.center = mesh.center;
+    meshDraw.radius = mesh.radius;
+    meshDraw.boxCenter = mesh.boxCenter;
+    // the rows of the mesh box axes are its axes
+    meshDraw.boxHalfAxes = glm::transpose(mesh.boxAxes);
+    for (int i = 0; i < 3; ++i) {
+        meshDraw.boxHalfAxes[i] *= mesh.boxExtents[i];
+    }
+    meshDraw.visible = true;
+    meshDraw.uvDensity = mesh.uvDensity;
+    meshDraw.numLODs = mesh.numLODs;
+    for (size_t i = 0; i < mesh.numLODs; ++i) {
+        meshDraw.lodFirstIndex[i] = indexOffset + mesh.lods[i].startIndex;
+        meshDraw.lodIndexCount[i] = mesh.lods[i].numIndices;
+        meshDraw.lodError[i] = mesh.lods[i].error;
+    }
+    meshDraw.lod = 0;
+    for (size_t i = 0; i < meshDraw.cascadeLODs.size(); ++i) {
+        meshDraw.cascadeLODs[i] = 0;
+    }
+}
+
+void Renderer::createClusters(Model const & model, Model::Mesh const & mesh,
+                              uint32_t indexOffset, MeshDraw & meshDraw) {
+    meshDraw.firstCluster = clusters.size();
+    meshDraw.numClusters = mesh.numMeshlets;
+    for (size_t i = mesh.startMeshlet; i < mesh.startMeshlet + mesh.numMeshlets; ++i) {
+        Model::Meshlet const & meshlet = model.meshlets[i];
+        Cluster cluster;
+        cluster.firstIndex = indexOffset + meshlet.startIndex;
+        cluster.indexCount = meshlet.numIndices;
+        cluster.center = meshlet.center;
+        cluster.radius = meshlet.radius;
+        cluster.coneAxis = meshlet.coneAxis;
+        cluster.coneCutoff = meshlet.coneCutoff;
+        clusters.push_back(cluster);
+    }
+}
+
+void Renderer::updateMeshDraws(prt::vector<glm::mat4> const & modelMatrices, 
+                               prt::vector<glm::mat4> const & animatedModelMatrices,
+                               Camera const & camera) {
+    int w = 0, h = 0;
+    getWindowSize(w, h);
+    // projected size in pixels of one world unit at unit distance
+    float pixelsPerUnit = float(h) / (2.0f * glm::tan(0.5f * glm::radians(camera.getFOV())));
+    glm::vec3 const & viewPosition = camera.getPosition();
+
+    glm::vec4 frustumPlanes[6];
+    math_util::frustumPlanes(camera.getProjectionMatrix() * camera.getViewMatrix(), frustumPlanes);
+
+    bool changed = false;
+    changed |= selectLODs(meshDraws.standard, modelMatrices, viewPosition, pixelsPerUnit);
+    changed |= selectLODs(meshDraws.transparent, modelMatrices, viewPosition, pixelsPerUnit);
+    changed |= selectLODs(meshDraws.animated, animatedModelMatrices, viewPosition, pixelsPerUnit);
+    changed |= selectLODs(meshDraws.transparentAnimated, animatedModelMatrices, viewPosition, pixelsPerUnit);
+    changed |= selectCascadeLODs(meshDraws.shadow, modelMatrices);
+    changed |= selectCascadeLODs(meshDraws.shadowAnimated, animatedModelMatrices);
+    changed |= cullMeshDraws(meshDraws.standard, modelMatrices, frustumPlanes, 1.0f);
+    changed |= cullMeshDraws(meshDraws.transparent, modelMatrices, frustumPlanes, 1.0f);
+    changed |= cullMeshDraws(meshDraws.animated, animatedModelMatrices, frustumPlanes, skinnedBoundsScale);
+    changed |= cullMeshDraws(meshDraws.transparentAnimated, animatedModelMatrices, frustumPlanes, skinnedBoundsScale);
+    // skinned meshes leave their bind pose clusters, so only static meshes are culled
+    changed |= cullClusters(meshDraws.standard, modelMatrices, viewPosition, frustumPlanes);
+    changed |= cullClusters(meshDraws.transparent, modelMatrices, viewPosition, frustumPlanes);
+
+    markTexturesUsed(meshDraws.standard, modelMatrices, frustumPlanes, 
+                     viewPosition, pixelsPerUnit, textureSlots.standard);
+    markTexturesUsed(meshDraws.transparent, modelMatrices, frustumPlanes, 
+                     viewPosition, pixelsPerUnit, textureSlots.standard);
+    // skinned meshes may leave their bind pose bounds
+    markTexturesUsed(meshDraws.animated, animatedModelMatrices, nullptr, 
+                     viewPosition, pixelsPerUnit, textureSlots.animated);
+    markTexturesUsed(meshDraws.transparentAnimated, animatedModelMatrices, nullptr, 
+                     viewPosition, pixelsPerUnit, textureSlots.animated);
+
+    if (changed) {
+        updateDrawCalls();
+        invalidateStaticCommandBuffers();
+    }
+}
+
+namespace {
+    float maxScale(glm::mat4 const & m) {
+        return glm::max(glm::length(glm::vec3(m[0])), 
+                        glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+    }
+}
+
+bool Renderer::selectLODs(prt::vector<MeshDraw> & draws,
+                          prt::vector<glm::mat4> const & modelMatrices,
+                          glm::vec3 const & viewPosition,
+                          float pixelsPerUnit) {
+    bool changed = false;
+    for (auto & draw : draws) {
+        if (draw.numLODs < 2 || draw.modelMatrixIndex >= modelMatrices.size()) continue;
+
+        glm::mat4 const & model = modelMatrices[draw.modelMatrixIndex];
+        float scale = maxScale(model);
+        glm::vec3 center = model * glm::vec4(draw.center, 1.0f);
+        float distance = glm::max(glm::length(center - viewPosition) - scale * draw.radius, nearPlane);
+        // pixels per object space unit at the closest point of the mesh
+        float pixels = scale * pixelsPerUnit / distance;
+
+        uint32_t lod = 0;
+        while (lod + 1 < draw.numLODs && draw.lodError[lod + 1] * pixels <= lodPixelError) {
+            ++lod;
+        }
+        if (lod != draw.lod) {
+            draw.lod = lod;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool Renderer::selectCascadeLODs(prt::vector<MeshDraw> & draws,
+                                 prt::vector<glm::mat4> const & modelMatrices) {
+    bool changed = false;
+    for (auto & draw : draws) {
+        if (draw.numLODs < 2 || draw.modelMatrixIndex >= modelMatrices.size()) continue;
+
+        float scale = maxScale(modelMatrices[draw.modelMatrixIndex]);
+        for (size_t i = 0; i < NUMBER_SHADOWMAP_CASCADES; ++i) {
+            float maxError = lodShadowTexelError * cascadeTexelSizes[i];
+            uint32_t lod = 0;
+            while (lod + 1 < draw.numLODs && draw.lodError[lod + 1] * scale <= maxError) {
+                ++lod;
+            }
+            if (lod != draw.cascadeLODs[i]) {
+                draw.cascadeLODs[i] = lod;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+bool Renderer::cullMeshDraws(prt::vector<MeshDraw> & draws,
+                             prt::vector<glm::mat4> const & modelMatrices,
+                             glm::vec4 const * frustumPlanes,
+                             float boundsScale) {
+    using namespace math_util;
+    size_t n = draws.size();
+    size_t stride = (n + boxLaneWidth - 1) / boxLaneWidth * boxLaneWidth;
+    cullBoxes.resize(NUM_BOX_ROWS * stride, 0.0f);
+    cullResults.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        MeshDraw const & draw = draws[i];
+        if (draw.modelMatrixIndex >= modelMatrices.size()) continue;
+
+        glm::mat4 const & model = modelMatrices[draw.modelMatrixIndex];
+        glm::vec3 center = model * glm::vec4(draw.boxCenter, 1.0f);
+        glm::vec3 axes[3];
+        for (int j = 0; j < 3; ++j) {
+            axes[j] = boundsScale * (glm::mat3(model) * draw.boxHalfAxes[j]);
+        }
+        for (int j = 0; j < 3; ++j) {
+            cullBoxes[(BOX_CENTER_X + j) * stride + i] = center[j];
+            cullBoxes[(BOX_AXIS_0_X + j) * stride + i] = axes[0][j];
+            cullBoxes[(BOX_AXIS_1_X + j) * stride + i] = axes[1][j];
+            cullBoxes[(BOX_AXIS_2_X + j) * stride + i] = axes[2][j];
+        }
+    }
+
+    boxesInFrustum(frustumPlanes, cullBoxes.data(), stride, n, cullResults.data());
+
+    bool changed = false;
+    for (size_t i = 0; i < n; ++i) {
+        // draws without a model matrix are never culled
+        bool visible = cullResults[i] != 0 || draws[i].modelMatrixIndex >= modelMatrices.size();
+        if (visible != draws[i].visible) {
+            draws[i].visible = visible;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool Renderer::cullClusters(prt::vector<MeshDraw> const & draws,
+                            prt::vector<glm::mat4> const & modelMatrices,
+                            glm::vec3 const & viewPosition,
+                            glm::vec4 const * frustumPlanes) {
+    bool changed = false;
+    for (auto const & draw : draws) {
+        // clusters only partition the full resolution mesh
+        if (!draw.visible || draw.lod != 0 || draw.modelMatrixIndex >= modelMatrices.size()) continue;
+
+        glm::mat4 const & model = modelMatrices[draw.modelMatrixIndex];
+        float scale = maxScale(model);
+        // the cone axis is a normal, so non uniform scale
+        // must be undone by the inverse transpose
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        for (size_t i = draw.firstCluster; i < draw.firstCluster + draw.numClusters; ++i) {
+            Cluster & cluster = clusters[i];
+            glm::vec3 center = model * glm::vec4(cluster.center, 1.0f);
+            float radius = scale * cluster.radius;
+
+            bool visible = math_util::sphereInFrustum(frustumPlanes, center, radius);
+            if (visible && cluster.coneCutoff < 1.0f) {
+                glm::vec3 axis = glm::normalize(normalMatrix * cluster.coneAxis);
+                glm::vec3 d = center - viewPosition;
+                visible = glm::dot(d, axis) < cluster.coneCutoff * glm::length(d) + radius;
+            }
+
+            if (visible != cluster.visible) {
+                cluster.visible = visible;
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
+
+void Renderer::markTexturesUsed(prt::vector<MeshDraw> const & draws,
+                                prt::vector<glm::mat4> const & modelMatrices,
+                                glm::vec4 const * frustumPlanes,
+                                glm::vec3 const & viewPosition,
+                                float pixelsPerUnit,
+                                prt::vector<TextureSlot> & slots) {
+    for (auto const & draw : draws) {
+        // texels of the finest mip level per pixel, 
+        // zero if unknown so the finest level is sampled
+        float texelsPerPixel = 0.0f;
+        if (draw.modelMatrixIndex < modelMatrices.size()) {
+            glm::mat4 const & model = modelMatrices[draw.modelMatrixIndex];
+            float scale = maxScale(model);
+            glm::vec3 center = model * glm::vec4(draw.center, 1.0f);
+            if (frustumPlanes != nullptr && 
+                !math_util::sphereInFrustum(frustumPlanes, center, scale * draw.radius)) {
+                continue;
+            }
+            // pixels per object space unit at the closest point of the mesh
+            float distance = glm::max(glm::length(center - viewPosition) - scale * draw.radius, nearPlane);
+            float pixels = scale * pixelsPerUnit / distance;
+            texelsPerPixel = draw.uvDensity / pixels;
+        }
+
+        StandardPushConstants const & pc = *reinterpret_cast<StandardPushConstants const*>(draw.drawCall.pushConstants.data());
+        prt::array<int32_t, 5> indices = { pc.albedoIndex,
+                                           pc.metallicIndex,
+                                           pc.roughnessIndex,
+                                           pc.aoIndex,
+                                           pc.normalIndex };
+        for (int32_t ind : indices) {
+            if (ind < 0 || size_t(ind) >= slots.size()) continue;
+
+            TextureSlot & slot = slots[ind];
+            uint32_t mip = 0;
+            if (textureStreaming) {
+                float texels = texelsPerPixel * float(std::max(slot.width, slot.height));
+                while (mip + 1 < slot.mipLevels && texels >= 2.0f) {
+                    texels *= 0.5f;
+                    ++mip;
+                }
+            }
+
+            if (slot.lastUsedFrame != frameIndex) {
+                slot.lastUsedFrame = frameIndex;
+                slot.desiredMip = mip;
+            } else {
+                slot.desiredMip = std::min(slot.desiredMip, mip);
+            }
+        }
+    }
+}
+
+void Renderer::streamTextures() {
+    prt::array<int, 2> pipelines = { pipelineIndices.opaque, pipelineIndices.opaqueAnimated };
+    prt::array<prt::vector<TextureSlot> *, 2> slots = { &textureSlots.standard, &textureSlots.animated };
+    VkDeviceSize usage = getTextureMemoryUsage();
+
+    // drop the mip levels finer than the frame samples, 
+    // starting with the least recently used textures
+    prt::array<bool, 2> dropped = { false, false };
+    while (textureStreaming && usage > textureBudget) {
+        size_t list = 0;
+        TextureSlot * lru = nullptr;
+        uint32_t lruTarget = 0;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            for (auto & slot : *slots[i]) {
+                if (!slot.resident) continue;
+                uint32_t target = slot.lastUsedFrame == frameIndex ? 
+                                  slot.desiredMip : initialMip(slot.width, slot.height, slot.mipLevels);
+                if (target <= slot.baseMip) continue;
+                if (lru == nullptr || slot.lastUsedFrame < lru->lastUsedFrame) {
+                    lru = &slot;
+                    lruTarget = target;
+                    list = i;
+                }
+            }
+        }
+        if (lru == nullptr) break;
+
+        if (!dropped[0] && !dropped[1]) {
+            vkDeviceWaitIdle(getDevice());
+        }
+
+        // the coarser levels are copied on the GPU, 
+        // so the texture does not need to be resident
+        Assets & asset = getAssets(getPipeline(pipelines[list]).assetsIndex);
+        size_t index = lru - slots[list]->data();
+        dropTextureMips(asset.textureImages, index,
+                        std::max(lru->width >> lru->baseMip, 1u),
+                        std::max(lru->height >> lru->baseMip, 1u),
+                        lru->mipLevels - lru->baseMip,
+                        lruTarget - lru->baseMip);
+        usage -= lru->size;
+        lru->baseMip = lruTarget;
+        lru->requestedMip = lruTarget;
+        lru->size = mipChainSize(lru->width, lru->height, lru->baseMip, lru->mipLevels);
+        usage += lru->size;
+        dropped[list] = true;
+    }
+
+    for (size_t i = 0; i < pipelines.size(); ++i) {
+        if (dropped[i]) {
+            updateTextureDescriptors(getPipeline(pipelines[i]).assetsIndex);
+        }
+    }
+    if (dropped[0] || dropped[1]) {
+        invalidateStaticCommandBuffers();
+    }
+
+    evictTextures();
+    if (!textureStreaming) return;
+
+    // request finer mip levels for the textures that are
+    // sampled the furthest from their resident levels
+    usage = getTextureMemoryUsage();
+    for (uint32_t n = 0; n < streamingUploadsPerFrame; ++n) {
+        TextureSlot * best = nullptr;
+        for (auto * list : slots) {
+            for (auto & slot : *list) {
+                if (!slot.resident || slot.lastUsedFrame != frameIndex || 
+                    slot.requestedMip != slot.baseMip || slot.desiredMip >= slot.baseMip) {
+                    continue;
+                }
+                if (best == nullptr || 
+                    slot.baseMip - slot.desiredMip > best->baseMip - best->desiredMip) {
+                    best = &slot;
+                }
+            }
+        }
+        if (best == nullptr) break;
+
+        // finest level that fits the budget
+        uint32_t mip = best->desiredMip;
+        while (mip < best->baseMip &&
+               usage - best->size + mipChainSize(best->width, best->height, mip, best->mipLevels) > textureBudget) {
+            ++mip;
+        }
+        if (mip == best->baseMip) break;
+
+        usage = usage - best->size + mipChainSize(best->width, best->height, mip, best->mipLevels);
+        best->requestedMip = mip;
+    }
+}
+
+void Renderer::evictTextures() {
+    VkDeviceSize usage = getTextureMemoryUsage();
+    if (usage <= textureBudget) return;
+
+    prt::array<int, 2> pipelines = { pipelineIndices.opaque, pipelineIndices.opaqueAnimated };
+    prt::array<prt::vector<TextureSlot> *, 2> slots = { &textureSlots.standard, &textureSlots.animated };
+    prt::array<bool, 2> evicted = { false, false };
+
+    while (usage > textureBudget) {
+        // least recently used slot that the frame does not use
+        size_t list = 0;
+        TextureSlot * lru = nullptr;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            for (auto & slot : *slots[i]) {
+                if (!slot.resident || slot.lastUsedFrame == frameIndex) continue;
+                if (lru == nullptr || slot.lastUsedFrame < lru->lastUsedFrame) {
+                    lru = &slot;
+                    list = i;
+                }
+            }
+        }
+        if (lru == nullptr) break;
+
+        if (!evicted[0] && !evicted[1]) {
+            vkDeviceWaitIdle(getDevice());
+        }
+
+        Assets & asset = getAssets(getPipeline(pipelines[list]).assetsIndex);
+        size_t index = lru - slots[list]->data();
+        destroyTexture(asset.textureImages, index);
+        createTexture(asset.textureImages, *Texture::defaultTexture(), index);
+        lru->resident = false;
+        // restored at the level it would first be bound with
+        lru->requestedMip = initialMip(lru->width, lru->height, lru->mipLevels);
+        usage -= lru->size;
+        evicted[list] = true;
+    }
+
+    for (size_t i = 0; i < pipelines.size(); ++i) {
+        if (evicted[i]) {
+            updateTextureDescriptors(getPipeline(pipelines[i]).assetsIndex);
+        }
+    }
+    if (evicted[0] || evicted[1]) {
+        invalidateStaticCommandBuffers();
+    }
+}
+
+void Renderer::updateDrawCalls() {
+    fillDrawCalls(meshDraws.standard, getPipeline(pipelineIndices.opaque).drawCalls);
+    fillDrawCalls(meshDraws.transparent, getPipeline(pipelineIndices.transparent).drawCalls);
+    fillDrawCalls(meshDraws.animated, getPipeline(pipelineIndices.opaqueAnimated).drawCalls);
+    fillDrawCalls(meshDraws.transparentAnimated, getPipeline(pipelineIndices.transparentAnimated).drawCalls);
+    fillCascadeDrawCalls(meshDraws.shadow, getPipeline(pipelineIndices.shadow));
+    fillCascadeDrawCalls(meshDraws.shadowAnimated, getPipeline(pipelineIndices.shadowAnimated));
+}
+
+void Renderer::fillDrawCalls(prt::vector<MeshDraw> const & draws, 
+                             prt::vector<DrawCall> & drawCalls) const {
+    drawCalls.resize(0);
+    for (auto const & draw : draws) {
+        if (!draw.visible) continue;
+        if (draw.lod != 0 || draw.numClusters == 0) {
+            drawCalls.push_back(draw.drawCall);
+            drawCalls.back().firstIndex = draw.lodFirstIndex[draw.lod];
+            drawCalls.back().indexCount = draw.lodIndexCount[draw.lod];
+            continue;
+        }
+
+        // merge visible clusters that are adjacent in the index buffer
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        for (size_t i = draw.firstCluster; i < draw.firstCluster + draw.numClusters; ++i) {
+            Cluster const & cluster = clusters[i];
+            if (!cluster.visible) continue;
+            if (indexCount > 0 && firstIndex + indexCount == cluster.firstIndex) {
+                indexCount += cluster.indexCount;
+                continue;
+            }
+            if (indexCount > 0) {
+                drawCalls.push_back(draw.drawCall);
+                drawCalls.back().firstIndex = firstIndex;
+                drawCalls.back().indexCount = indexCount;
+            }
+            firstIndex = cluster.firstIndex;
+            indexCount = cluster.indexCount;
+        }
+        if (indexCount > 0) {
+            drawCalls.push_back(draw.drawCall);
+            drawCalls.back().firstIndex = firstIndex;
+            drawCalls.back().indexCount = indexCount;
+        }
+    }
+}
+
+void Renderer::fillCascadeDrawCalls(prt::vector<MeshDraw> const & draws, 
+                                    GraphicsPipeline & pipeline) const {
+    fillDrawCalls(draws, pipeline.drawCalls);
+
+    pipeline.framebufferDrawCalls.resize(NUMBER_SHADOWMAP_CASCADES);
+    for (size_t i = 0; i < NUMBER_SHADOWMAP_CASCADES; ++i) {
+        prt::vector<DrawCall> & drawCalls = pipeline.framebufferDrawCalls[i];
+        drawCalls.resize(draws.size());
+        for (size_t j = 0; j < draws.size(); ++j) {
+            MeshDraw const & draw = draws[j];
+            drawCalls[j] = draw.drawCall;
+            drawCalls[j].firstIndex = draw.lodFirstIndex[draw.cascadeLODs[i]];
+            drawCalls[j].indexCount = draw.lodIndexCount[draw.cascadeLODs[i]];
+        }
     }
 }
 
@@ -1205,10 +2056,33 @@ void Renderer::createCompositionDrawCalls(size_t pipelineIndex) {
     pipeline.drawCalls.push_back(drawCall);
 }
 
+void Renderer::createModelRanges(Model const * models, size_t nModels) {
+    modelRanges.resize(nModels);
+    uint32_t staticVertices = 0;
+    uint32_t staticIndices = 0;
+    uint32_t animatedVertices = 0;
+    uint32_t animatedIndices = 0;
+    for (size_t i = 0; i < nModels; ++i) {
+        bool animated = models[i].isAnimated();
+        uint32_t & numVertices = animated ? animatedVertices : staticVertices;
+        uint32_t & numIndices = animated ? animatedIndices : staticIndices;
+
+        // evicted models are not drawn and take up no space
+        bool resident = models[i].isGeometryResident();
+        ModelRange & range = modelRanges[i];
+        range.firstVertex = numVertices;
+        range.numVertices = resident ? models[i].vertexBuffer.size() : 0;
+        range.firstIndex = numIndices;
+        range.numIndices = resident ? models[i].indexBuffer.size() : 0;
+
+        numVertices += range.numVertices;
+        numIndices += range.numIndices;
+    }
+}
+
 void Renderer::createVertexBuffers(Model const * models, size_t nModels,
                                    size_t staticAssetIndex, size_t animatedAssetIndex) {
-    // TODO: On rebind only add new assets instead
-    // of recreating everything
+    TRACE_SCOPE("renderer", "Renderer::createVertexBuffers");
     Assets & staticAssets = getAssets(staticAssetIndex);
     if (staticAssets.vertexData.vertexBuffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(getDevice(), staticAssets.vertexData.vertexBuffer, nullptr);
@@ -1219,6 +2093,8 @@ void Renderer::createVertexBuffers(Model const * models, size_t nModels,
     if (animatedAssets.vertexData.vertexBuffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(getDevice(), animatedAssets.vertexData.vertexBuffer, nullptr);
         vkFreeMemory(getDevice(), animatedAssets.vertexData.vertexBufferMemory, nullptr);
+        // the skinning pipeline is only bound to a buffer that exists
+        animatedAssets.vertexData.vertexBuffer = VK_NULL_HANDLE;
     }
 
     if (nModels == 0) return;
@@ -1234,18 +2110,7 @@ void Renderer::createVertexBuffers(Model const * models, size_t nModels,
         size_t prevSize = vertexData.size();
 
         vertexData.resize(prevSize + vertexSize * models[i].vertexBuffer.size());
-        unsigned char* dest = &vertexData[prevSize];
-
-        if (animated) {
-            assert(models[i].vertexBuffer.size() == models[i].vertexBoneBuffer.size());
-            for (size_t j = 0; j < models[i].vertexBuffer.size(); ++j) {
-                memcpy(dest, &models[i].vertexBuffer[j], sizeof(Model::Vertex));
-                memcpy(dest + sizeof(Model::Vertex), &models[i].vertexBoneBuffer[j], sizeof(Model::BoneData));
-                dest += vertexSize;
-            }
-        } else {
-            memcpy(dest, models[i].vertexBuffer.data(), vertexSize * models[i].vertexBuffer.size());
-        }
+        writeVertices(models[i], vertexData.data() + prevSize);
     }    
 
     if (staticVertexData.size() != 0) {
@@ -1257,9 +2122,10 @@ void Renderer::createVertexBuffers(Model const * models, size_t nModels,
     }
 
     if (animatedVertexData.size() != 0) {
+        // only read by the skinning pipeline
         VertexData & animatedData = animatedAssets.vertexData;
         createAndMapBuffer(animatedVertexData.data(), animatedVertexData.size(),
-                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                         animatedData.vertexBuffer, 
                         animatedData.vertexBufferMemory);  
     }
@@ -1267,6 +2133,7 @@ void Renderer::createVertexBuffers(Model const * models, size_t nModels,
 
 void Renderer::createIndexBuffers(Model const * models, size_t nModels, 
                                       size_t staticAssetIndex, size_t animatedAssetIndex) {
+    TRACE_SCOPE("renderer", "Renderer::createIndexBuffers");
     Assets & staticAssets = getAssets(staticAssetIndex);
     if (staticAssets.vertexData.indexBuffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(getDevice(), staticAssets.vertexData.indexBuffer, nullptr);
@@ -1281,41 +2148,92 @@ void Renderer::createIndexBuffers(Model const * models, size_t nModels,
 
     if (nModels == 0) return;
 
-    prt::vector<uint32_t> allStaticIndices;
-    prt::vector<uint32_t> allAnimatedIndices;
+    // 16 bit indices suffice if every mesh
+    // spans at most 2^16 vertices
+    size_t maxStaticMeshVertices = 0;
+    size_t maxAnimatedMeshVertices = 0;
+    size_t numStaticIndices = 0;
+    size_t numAnimatedIndices = 0;
+    for (size_t i = 0; i < nModels; ++i) {
+        // evicted models keep their meshes but not their indices
+        if (!models[i].isGeometryResident()) continue;
+        bool animated = models[i].isAnimated();
+        size_t & maxMeshVertices = animated ? maxAnimatedMeshVertices : maxStaticMeshVertices;
+        for (auto const & mesh : models[i].meshes) {
+            maxMeshVertices = glm::max(maxMeshVertices, mesh.numVertices);
+        }
+        (animated ? numAnimatedIndices : numStaticIndices) += models[i].indexBuffer.size();
+    }
 
-    uint32_t staticVertexOffset = 0;
-    uint32_t animatedVertexOffset = 0;
+    VertexData & staticData = staticAssets.vertexData;
+    VertexData & animatedData = animatedAssets.vertexData;
+    staticData.indexType = maxStaticMeshVertices <= 0x10000 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    animatedData.indexType = maxAnimatedMeshVertices <= 0x10000 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    size_t staticIndexSize = staticData.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    size_t animatedIndexSize = animatedData.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
 
-    for (size_t i = 0; i < nModels; i++) {
-        bool animated = models[i].isAnimated();
-        prt::vector<uint32_t> & allIndices = animated ? allAnimatedIndices : allStaticIndices;
-        uint32_t & vertexOffset = animated ? animatedVertexOffset : staticVertexOffset;
+    prt::vector<unsigned char> allStaticIndices{prt::getAlignment(alignof(uint32_t))};
+    prt::vector<unsigned char> allAnimatedIndices{prt::getAlignment(alignof(uint32_t))};
+    allStaticIndices.resize(numStaticIndices * staticIndexSize);
+    allAnimatedIndices.resize(numAnimatedIndices * animatedIndexSize);
 
-        for (size_t j = 0; j < models[i].indexBuffer.size(); j++) {
-            allIndices.push_back(models[i].indexBuffer[j] + vertexOffset);
-        }
+    for (size_t i = 0; i < nModels; ++i) {
+        bool animated = models[i].isAnimated();
+        unsigned char * allIndices = animated ? allAnimatedIndices.data() : allStaticIndices.data();
+        VkIndexType indexType = animated ? animatedData.indexType : staticData.indexType;
+        size_t indexSize = animated ? animatedIndexSize : staticIndexSize;
 
-        vertexOffset += models[i].vertexBuffer.size();
+        writeIndices(models[i], indexType, allIndices + indexSize * modelRanges[i].firstIndex);
     }
 
     if (allStaticIndices.size() != 0) {
-        VertexData& staticData = getAssets(staticAssetIndex).vertexData;
-        createAndMapBuffer(allStaticIndices.data(), sizeof(uint32_t) * allStaticIndices.size(),
+        createAndMapBuffer(allStaticIndices.data(), allStaticIndices.size(),
                         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                         staticData.indexBuffer, 
                         staticData.indexBufferMemory);
     }
 
     if (allAnimatedIndices.size() != 0) {
-        VertexData& animatedData = getAssets(animatedAssetIndex).vertexData;
-        createAndMapBuffer(allAnimatedIndices.data(), sizeof(uint32_t) * allAnimatedIndices.size(),
+        createAndMapBuffer(allAnimatedIndices.data(), allAnimatedIndices.size(),
                         VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                         animatedData.indexBuffer, 
                         animatedData.indexBufferMemory);
     }
 }
 
+void Renderer::writeVertices(Model const & model, unsigned char * dest) {
+    if (!model.isGeometryResident()) return;
+    if (model.isAnimated()) {
+        assert(model.vertexBuffer.size() == model.vertexBoneBuffer.size());
+        for (size_t j = 0; j < model.vertexBuffer.size(); ++j) {
+            memcpy(dest, &model.vertexBuffer[j], sizeof(Model::Vertex));
+            memcpy(dest + sizeof(Model::Vertex), &model.vertexBoneBuffer[j], sizeof(Model::BoneData));
+            dest += sizeof(Model::BonedVertex);
+        }
+    } else {
+        memcpy(dest, model.vertexBuffer.data(), sizeof(Model::Vertex) * model.vertexBuffer.size());
+    }
+}
+
+void Renderer::writeIndices(Model const & model, VkIndexType indexType, unsigned char * dest) {
+    if (!model.isGeometryResident()) return;
+    // every LOD range of a mesh is rebased onto the
+    // first vertex of the mesh, see createMeshDraw
+    for (auto const & mesh : model.meshes) {
+        for (size_t lod = 0; lod < mesh.numLODs; ++lod) {
+            Model::LOD const & range = mesh.lods[lod];
+            uint32_t const * src = &model.indexBuffer[range.startIndex];
+            if (indexType == VK_INDEX_TYPE_UINT16) {
+                mesh_util::rebaseIndices(src, range.numIndices, mesh.startVertex,
+                                         reinterpret_cast<uint16_t*>(dest) + range.startIndex);
+            } else {
+                mesh_util::rebaseIndices(src, range.numIndices, mesh.startVertex,
+                                         reinterpret_cast<uint32_t*>(dest) + range.startIndex);
+            }
+        }
+    }
+}
+
 void Renderer::createCubeMapBuffers(size_t assetIndex) {
     prt::vector<glm::vec3> vertices;
 
@@ -8,6 +8,7 @@
 #include "src/graphics/camera.h"
 #include "src/graphics/imgui_renderer.h"
 #include "src/graphics/geometry/model.h"
+#include "src/graphics/geometry/environment_map.h"
 #include "src/container/hash_map.h"
 
 class Renderer : public VulkanApplication {
@@ -31,7 +32,67 @@ public:
                     size_t nAnimatedModelIDs,
                     Texture const * textures,
                     size_t nTextures,
-                    prt::array<Texture, 6> const & skybox);
+                    prt::array<Texture, 6> const & skybox,
+                    EnvironmentMap const & environmentMap);
+
+    /**
+     * Uploads a re-imported model into the part of the
+     * vertex and index buffers it was bound to and
+     * updates the draw calls, leaving the rest of the
+     * bound scene untouched
+     * @param modelID id of the re-imported model
+     * @return false if the model no longer fits its part
+     *         of the buffers or uses textures that are not
+     *         bound, in which case the scene has to be
+     *         bound again with bindAssets
+     */
+    bool updateModel(ModelID modelID,
+                     Model const * models, size_t nModels,
+                     ModelID const * staticModelIDs,
+                     size_t nStaticModelIDs,
+                     ModelID const * animatedModelIDs,
+                     uint32_t const * boneOffsets,
+                     size_t nAnimatedModelIDs);
+
+    /**
+     * Replaces the image of a re-imported texture in
+     * every texture array it is bound to
+     * @param textureID id of the re-imported texture
+     * @param texture re-imported texture
+     */
+    void updateTexture(uint32_t textureID, Texture const & texture);
+
+    /**
+     * @param textureIDs ids of the bound textures that the
+     *                   current frame uses but that have been
+     *                   evicted or that need finer mip levels,
+     *                   to be uploaded with updateTexture
+     */
+    void getRequestedTextures(prt::vector<uint32_t> & textureIDs) const;
+
+    /**
+     * @param textureIDs ids of the bound textures that
+     *                   the current frame samples
+     */
+    void getUsedTextures(prt::vector<uint32_t> & textureIDs) const;
+
+    /**
+     * @param enabled whether bound textures only keep the
+     *                mip levels that the frame samples
+     */
+    void setTextureStreaming(bool enabled) { textureStreaming = enabled; }
+
+    /**
+     * @param budget memory allowed for the images of bound
+     *               textures before the least recently used
+     *               are evicted
+     */
+    void setTextureBudget(VkDeviceSize budget) { textureBudget = budget; }
+
+    /**
+     * @return memory used by the images of bound textures
+     */
+    VkDeviceSize getTextureMemoryUsage() const;
 
     /**
      * updates the scene
@@ -60,10 +121,24 @@ private:
 
     static constexpr float depthBiasConstant = 0.0f;//0.01f;//1.25f;
     static constexpr float depthBiasSlope = 0.0f;//0.01f;//1.75f;
+    // vertices per workgroup of skinning.comp
+    static constexpr uint32_t skinningGroupSize = 64;
     float nearPlane = 0.03f;
     float farPlane = 500.0f;
     float maxShadowDistance = 100.0f;
     float cascadeSplitLambda = 0.85f;
+    // largest projected simplification error
+    // allowed for a mesh LOD, in pixels
+    float lodPixelError = 1.0f;
+    // largest simplification error allowed for a
+    // shadow caster LOD, in shadow map texels
+    float lodShadowTexelError = 1.0f;
+    // scale of the bind pose bounding boxes of skinned
+    // meshes when culling, as animation may move the
+    // vertices outside of them
+    float skinnedBoundsScale = 1.5f;
+    // world space size of a shadow map texel per cascade
+    prt::array<float, NUMBER_SHADOWMAP_CASCADES> cascadeTexelSizes;
 
     struct RenderPassIndices {
         unsigned int scene;
@@ -84,6 +159,21 @@ private:
     } fbaIndices;
 
     unsigned int shadowMapIndex;
+
+    // prefiltered cube map and BRDF lookup table
+    // of the image based lighting
+    size_t environmentAssetIndex;
+    prt::array<glm::vec4, 9> irradianceSH = {};
+    // scales the image based lighting
+    float environmentIntensity = 1.0f;
+
+    // bone transforms of every animated instance
+    size_t boneBufferIndex;
+    // animated instances are skinned once per frame into
+    // the skinned vertex buffer, which the animated
+    // pipelines then draw like static geometry
+    size_t skinningPipelineIndex;
+    size_t skinnedVertexBufferIndex;
     
     struct PipelineIndices {
         int skybox = -1;
@@ -99,6 +189,123 @@ private:
 
     VkDescriptorImageInfo samplerInfo;
 
+    /*
+     * A mesh draw call together with the data 
+     * needed to pick its level of detail
+     **/
+    struct MeshDraw {
+        DrawCall drawCall;
+        uint32_t modelMatrixIndex;
+        // object space bounding sphere
+        glm::vec3 center;
+        float radius;
+        // object space oriented bounding box,
+        // the columns of boxHalfAxes reach from
+        // its center to the faces
+        glm::vec3 boxCenter;
+        glm::mat3 boxHalfAxes;
+        // whether the box intersects the view frustum
+        bool visible = true;
+        // see Model::Mesh::uvDensity
+        float uvDensity;
+        uint32_t numLODs;
+        prt::array<uint32_t, NUMBER_MESH_LODS> lodFirstIndex;
+        prt::array<uint32_t, NUMBER_MESH_LODS> lodIndexCount;
+        prt::array<float, NUMBER_MESH_LODS> lodError;
+        // currently selected LOD
+        uint32_t lod = 0;
+        prt::array<uint32_t, NUMBER_SHADOWMAP_CASCADES> cascadeLODs;
+        // clusters of the full resolution mesh,
+        // culled individually when lod is 0
+        uint32_t firstCluster = 0;
+        uint32_t numClusters = 0;
+    };
+
+    /*
+     * A meshlet of a mesh draw together with
+     * its culling state
+     **/
+    struct Cluster {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        // object space bounding sphere
+        glm::vec3 center;
+        float radius;
+        // object space backface cone
+        glm::vec3 coneAxis;
+        float coneCutoff;
+        bool visible = true;
+    };
+    prt::vector<Cluster> clusters;
+
+    // world space boxes of the mesh draws culled by
+    // cullMeshDraws, see math_util::boxesInFrustum
+    prt::vector<float> cullBoxes;
+    prt::vector<uint8_t> cullResults;
+
+    struct MeshDraws {
+        prt::vector<MeshDraw> standard;
+        prt::vector<MeshDraw> transparent;
+        prt::vector<MeshDraw> animated;
+        prt::vector<MeshDraw> transparentAnimated;
+        prt::vector<MeshDraw> shadow;
+        prt::vector<MeshDraw> shadowAnimated;
+    } meshDraws;
+
+    // slots of the bound textures in the texture arrays
+    // of the static and animated assets, by texture id
+    struct TextureIndices {
+        prt::hash_map<int, int> standard;
+        prt::hash_map<int, int> animated;
+    } textureIndices;
+
+    /*
+     * Part of the static or animated vertex and index
+     * buffers that a model is bound to
+     **/
+    struct ModelRange {
+        uint32_t firstVertex;
+        uint32_t numVertices;
+        uint32_t firstIndex;
+        uint32_t numIndices;
+    };
+    // by model id
+    prt::vector<ModelRange> modelRanges;
+
+    /*
+     * Residency of the texture bound to a slot of the
+     * texture array of the static or animated assets
+     **/
+    struct TextureSlot {
+        uint32_t textureID;
+        // memory of the resident mip levels
+        VkDeviceSize size;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        // finest mip level of the image
+        uint32_t baseMip = 0;
+        // finest mip level the current frame samples
+        uint32_t desiredMip = 0;
+        // finest mip level to upload with updateTexture
+        uint32_t requestedMip = 0;
+        uint64_t lastUsedFrame = 0;
+        bool resident = true;
+    };
+    struct TextureSlots {
+        prt::vector<TextureSlot> standard;
+        prt::vector<TextureSlot> animated;
+    } textureSlots;
+    VkDeviceSize textureBudget = ASSET_GPU_BUDGET_BYTES;
+    bool textureStreaming = true;
+    // largest dimension of the finest mip level that a
+    // texture is bound with before it has been drawn
+    static constexpr uint32_t streamingInitialSize = 64;
+    // largest number of textures requested finer mip levels per frame
+    static constexpr uint32_t streamingUploadsPerFrame = 4;
+    // number of updates so far
+    uint64_t frameIndex = 0;
+
     void init();
     void initFBAs();
     void initPipelines();
@@ -121,6 +328,8 @@ private:
 
     void createCompositionPipeline();
 
+    void createSkinningPipeline(size_t animatedAssetIndex);
+
     void createSkyboxPipeline(size_t assetIndex, size_t uboIndex);
 
     int createStandardPipeline(size_t assetIndex, size_t uboIndex, 
@@ -137,12 +346,17 @@ private:
     void createCommandBuffers();
     void createCommandBuffer(size_t imageIndex);
 
+    void createModelRanges(Model const * models, size_t nModels);
+
     void createVertexBuffers(Model const * models, size_t nModels, 
                              size_t staticAssetIndex, size_t animatedAssetIndex);
     
     void createIndexBuffers(Model const * models, size_t nModels,
                             size_t staticAssetIndex, size_t animatedAssetIndex);
 
+    static void writeVertices(Model const & model, unsigned char * dest);
+    static void writeIndices(Model const & model, VkIndexType indexType, unsigned char * dest);
+
     void createCubeMapBuffers(size_t assetIndex);
     
     void loadModels(Model const * models, size_t nModels, 
@@ -161,6 +375,68 @@ private:
 
     void loadCubeMap(prt::array<Texture, 6> const & skybox, size_t assetIndex);
 
+    void loadEnvironmentMap(EnvironmentMap const & environmentMap, size_t assetIndex);
+
+    /**
+     * @return finest mip level a texture is bound with
+     *         before it is known how large it appears
+     */
+    uint32_t initialMip(uint32_t width, uint32_t height, uint32_t mipLevels) const;
+
+    void createTextureSlots(prt::hash_map<int, int> const & indices,
+                            Texture const * textures,
+                            size_t numSlots,
+                            prt::vector<TextureSlot> & slots) const;
+
+    /**
+     * Stamps the texture slots used by mesh draws with
+     * the current frame and the finest mip level that
+     * the draws sample
+     * @param frustumPlanes planes of the view frustum, draws
+     *                      outside of it are skipped, or 
+     *                      nullptr to mark every draw
+     * @param viewPosition world space camera position
+     * @param pixelsPerUnit projected size in pixels of one
+     *                      world unit at unit distance
+     */
+    void markTexturesUsed(prt::vector<MeshDraw> const & draws,
+                          prt::vector<glm::mat4> const & modelMatrices,
+                          glm::vec4 const * frustumPlanes,
+                          glm::vec3 const & viewPosition,
+                          float pixelsPerUnit,
+                          prt::vector<TextureSlot> & slots);
+
+    /**
+     * Drops mip levels that the frame does not sample
+     * and evicts textures until the bound textures fit
+     * the texture budget, then requests finer mip levels
+     * for the textures that are sampled finer than they
+     * are resident
+     */
+    void streamTextures();
+
+    /**
+     * Replaces the images of the least recently used
+     * texture slots with the default texture until the
+     * bound textures fit the texture budget. Slots used
+     * by the current frame are never evicted
+     */
+    void evictTextures();
+
+    /**
+     * @return number of bone transforms of the animated models
+     */
+    static size_t getNumBones(Model const * models,
+                              ModelID const * animatedModelIDs,
+                              uint32_t const * boneOffsets,
+                              size_t nAnimatedModelIDs);
+
+    /**
+     * @return number of skinned vertices of the animated models
+     */
+    size_t getNumSkinnedVertices(ModelID const * animatedModelIDs,
+                                 size_t nAnimatedModelIDs) const;
+
     void createSkyboxDrawCalls();
     void createModelDrawCalls(Model const * models,   size_t nModels,
                               ModelID const * staticModelIDs,
@@ -170,12 +446,71 @@ private:
                               uint32_t const * boneOffsets,
                               prt::hash_map<int, int> const & staticTextureIndices,
                               prt::hash_map<int, int> const & animatedTextureIndices,
-                              prt::vector<DrawCall> & standard,
-                              prt::vector<DrawCall> & transparent,
-                              prt::vector<DrawCall> & animated,
-                              prt::vector<DrawCall> & transparentAnimated,
-                              prt::vector<DrawCall> & shadow,
-                              prt::vector<DrawCall> & shadowAnimated);
+                              prt::vector<MeshDraw> & standard,
+                              prt::vector<MeshDraw> & transparent,
+                              prt::vector<MeshDraw> & animated,
+                              prt::vector<MeshDraw> & transparentAnimated,
+                              prt::vector<MeshDraw> & shadow,
+                              prt::vector<MeshDraw> & shadowAnimated);
+
+    static void createMeshDraw(Model::Mesh const & mesh,
+                               uint32_t indexOffset, uint32_t vertexOffset,
+                               uint32_t modelMatrixIndex,
+                               DrawCall const & drawCall, MeshDraw & meshDraw);
+
+    void createClusters(Model const & model, Model::Mesh const & mesh,
+                        uint32_t indexOffset, MeshDraw & meshDraw);
+
+    /**
+     * Selects the level of detail and the visible clusters
+     * of every mesh draw and updates the draw calls if 
+     * anything changed
+     */
+    void updateMeshDraws(prt::vector<glm::mat4> const & modelMatrices, 
+                         prt::vector<glm::mat4> const & animatedModelMatrices,
+                         Camera const & camera);
+
+    bool selectLODs(prt::vector<MeshDraw> & draws,
+                    prt::vector<glm::mat4> const & modelMatrices,
+                    glm::vec3 const & viewPosition,
+                    float pixelsPerUnit);
+
+    bool selectCascadeLODs(prt::vector<MeshDraw> & draws,
+                           prt::vector<glm::mat4> const & modelMatrices);
+
+    /**
+     * Culls mesh draws by their bounding boxes
+     * against the view frustum
+     * @param draws mesh draws
+     * @param modelMatrices model matrices
+     * @param frustumPlanes planes of the view frustum
+     * @param boundsScale scale of the bounding boxes
+     * @return true if the visibility of any draw changed
+     */
+    bool cullMeshDraws(prt::vector<MeshDraw> & draws,
+                       prt::vector<glm::mat4> const & modelMatrices,
+                       glm::vec4 const * frustumPlanes,
+                       float boundsScale);
+
+    /**
+     * Culls clusters against the view frustum and
+     * by their backface cones
+     * @param draws mesh draws
+     * @param modelMatrices model matrices
+     * @param viewPosition position of the camera
+     * @param frustumPlanes planes of the view frustum
+     * @return true if the visibility of any cluster changed
+     */
+    bool cullClusters(prt::vector<MeshDraw> const & draws,
+                      prt::vector<glm::mat4> const & modelMatrices,
+                      glm::vec3 const & viewPosition,
+                      glm::vec4 const * frustumPlanes);
+
+    void updateDrawCalls();
+    void fillDrawCalls(prt::vector<MeshDraw> const & draws, 
+                       prt::vector<DrawCall> & drawCalls) const;
+    void fillCascadeDrawCalls(prt::vector<MeshDraw> const & draws, 
+                              GraphicsPipeline & pipeline) const;
 
     void createShadowDrawCalls(size_t shadowPipelineIndex, size_t pipelineIndex);
 
@@ -22,17 +22,27 @@ struct ModelUBO {
 };
 
 struct LightUBO {
-    alignas(4)  float ambientLight;
+    alignas(4)  float environmentIntensity;
     alignas(4)  uint32_t noPointLights;
     alignas(16) DirLight sun;
     alignas(16) glm::vec4 splitDepths[(NUMBER_SHADOWMAP_CASCADES + 4)/ 4];
     alignas(16) glm::mat4 cascadeSpace[NUMBER_SHADOWMAP_CASCADES];
     alignas(16) UBOPointLight pointLights[NUMBER_SUPPORTED_POINTLIGHTS];
-
+    // see EnvironmentMap::irradianceSH
+    alignas(16) glm::vec4 irradianceSH[9];
 };
 
-struct BoneUBO {
-    alignas(16) glm::mat4 bones[NUMBER_MAX_BONES];
+/*
+ * Bone transform as the top three rows of its matrix,
+ * the bottom row of an affine transform being implied
+ **/
+struct PackedBone {
+    alignas(16) glm::vec4 rows[3];
+
+    inline static PackedBone pack(glm::mat4 const & m) {
+        glm::mat4 t = glm::transpose(m);
+        return { { t[0], t[1], t[2] } };
+    }
 };
 
 struct StandardUBO {
@@ -43,7 +53,6 @@ struct StandardUBO {
 struct AnimatedStandardUBO {
     ModelUBO model;
     LightUBO lighting;
-    BoneUBO bones;
 };
 
 struct StandardPushConstants {
@@ -58,6 +67,12 @@ struct StandardPushConstants {
     alignas(4)  float     emissive;
     alignas(4)  int32_t   aoIndex;
     alignas(4)  int32_t   normalIndex;
+};
+
+struct SkinningPushConstants {
+    alignas(4)  uint32_t  srcFirstVertex;
+    alignas(4)  uint32_t  dstFirstVertex;
+    alignas(4)  uint32_t  numVertices;
     alignas(4)  uint32_t  boneOffset;
 };
 
@@ -82,7 +97,6 @@ struct ShadowMapUBO  {
 struct AnimatedShadowMapUBO {
     alignas(16) glm::mat4 model[NUMBER_SUPPORTED_MODEL_MATRICES];
     alignas(16) glm::mat4 depthVP[NUMBER_SHADOWMAP_CASCADES];
-    alignas(16) BoneUBO bones;
 };
 
 #endif
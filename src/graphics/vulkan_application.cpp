@@ -2,10 +2,51 @@
 
 #include "src/container/array.h"
 #include "src/container/hash_set.h"
+#include "src/util/trace_util.h"
 
 #include <chrono>
 #include <thread>
 
+namespace {
+    /**
+     * Adds a storage buffer binding to the descriptor set
+     * layout, pool and writes of a pipeline
+     * @param pipeline graphics or compute pipeline
+     * @param binding binding in the descriptor set
+     * @param stageFlags shader stages that access the buffer
+     * @param imageCount number of swapchain images
+     * @return index of the descriptor writes of the binding
+     */
+    template<typename Pipeline>
+    size_t pushBackBufferDescriptor(Pipeline & pipeline, uint32_t binding,
+                                    VkShaderStageFlags stageFlags, size_t imageCount) {
+        VkDescriptorSetLayoutBinding layoutBinding = {};
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBinding.pImmutableSamplers = nullptr;
+        layoutBinding.stageFlags = stageFlags;
+        pipeline.descriptorSetLayoutBindings.push_back(layoutBinding);
+
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = static_cast<uint32_t>(imageCount);
+        pipeline.descriptorPoolSizes.push_back(poolSize);
+
+        size_t descriptorIndex = pipeline.descriptorWrites[0].size();
+        for (size_t i = 0; i < imageCount; ++i) {
+            VkWriteDescriptorSet descriptorWrite = {};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstBinding = binding;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrite.descriptorCount = 1;
+            pipeline.descriptorWrites[i].push_back(descriptorWrite);
+        }
+        return descriptorIndex;
+    }
+}
+
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
     if (func != nullptr) {
@@ -47,6 +88,7 @@ void VulkanApplication::framebufferResizeCallback(GLFWwindow* window, int /*widt
 }
     
 void VulkanApplication::initVulkan() {
+    TRACE_SCOPE("vulkan", "VulkanApplication::initVulkan");
     createInstance();
     setupDebugMessenger();
     createSurface();
@@ -55,6 +97,7 @@ void VulkanApplication::initVulkan() {
     createSwapchain();
     createSwapchainImageViews();
     prepareGraphicsPipelines();
+    prepareComputePipelines();
 
     // TODO: Break out into function
     commandPools.resize(swapchain.swapchainImageCount);
@@ -65,6 +108,7 @@ void VulkanApplication::initVulkan() {
 
     createTextureSampler();
     createShadowMapSampler();
+    createEnvironmentSampler();
     createSyncObjects();
     createDescriptorPools();
 }
@@ -118,6 +162,11 @@ void VulkanApplication::cleanupSwapchain() {
         vkDestroyPipelineLayout(device, graphicsPipeline.pipelineLayout, nullptr);
     }
 
+    for (auto & computePipeline : computePipelines) {
+        vkDestroyPipeline(device, computePipeline.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, computePipeline.pipelineLayout, nullptr);
+    }
+
     for (RenderPass & pass : renderPasses) {
         if (pass.renderPass != VK_NULL_HANDLE) {
             for (SubPass & sub : pass.subpasses) {
@@ -141,6 +190,11 @@ void VulkanApplication::cleanupSwapchain() {
         vkDestroyDescriptorPool(device, graphicsPipeline.descriptorPool, nullptr);
         vkDestroyDescriptorSetLayout(device, graphicsPipeline.descriptorSetLayout, nullptr);
     }
+
+    for (auto & computePipeline : computePipelines) {
+        vkDestroyDescriptorPool(device, computePipeline.descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, computePipeline.descriptorSetLayout, nullptr);
+    }
     
 }
     
@@ -155,6 +209,14 @@ void VulkanApplication::cleanup() {
         }
     }
 
+    for (auto & storageBufferData : storageBufferDatas) {
+        destroyStorageBuffers(storageBufferData);
+    }
+
+    for (auto & deviceBufferData : deviceBufferDatas) {
+        destroyDeviceBuffers(deviceBufferData);
+    }
+
     for (auto & ass : assets) {
         for (size_t i = 0; i < ass.textureImages.imageViews.size(); i++) {
             vkDestroyImageView(device, ass.textureImages.imageViews[i], nullptr);
@@ -175,6 +237,7 @@ void VulkanApplication::cleanup() {
 
     vkDestroySampler(device, textureSampler, nullptr);
     vkDestroySampler(device, shadowMapSampler, nullptr);
+    vkDestroySampler(device, environmentSampler, nullptr);
 
     for (auto & ass : assets) {
         vkDestroyBuffer(device, ass.vertexData.vertexBuffer, nullptr);
@@ -222,6 +285,7 @@ void VulkanApplication::cleanup() {
 }
 
 void VulkanApplication::recreateSwapchain() {
+    TRACE_SCOPE("vulkan", "VulkanApplication::recreateSwapchain");
     _width = 0;
     _height = 0;
     while (_width == 0 || _height == 0) {
@@ -237,6 +301,7 @@ void VulkanApplication::recreateSwapchain() {
     createSwapchainImageViews();
     createRenderPasses();
     prepareGraphicsPipelines();
+    prepareComputePipelines();
     createFramebufferAttachments();
     createSwapchainFrameBuffers();
     createShadowMaps();
@@ -380,6 +445,7 @@ void VulkanApplication::createLogicalDevice() {
 }
     
 void VulkanApplication::createSwapchain() {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createSwapchain");
     SwapchainSupportDetails swapchainSupport = querySwapchainSupport(physicalDevice);
     
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
@@ -513,6 +579,27 @@ void VulkanApplication::createShadowMapSampler() {
     }
 }
 
+void VulkanApplication::createEnvironmentSampler() {
+    VkSamplerCreateInfo sampler{};
+    sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler.magFilter = VK_FILTER_LINEAR;
+    sampler.minFilter = VK_FILTER_LINEAR;
+    sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    // the lookup table must not wrap around
+    sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler.mipLodBias = 0.0f;
+    sampler.maxAnisotropy = 1.0f;
+    sampler.anisotropyEnable = VK_FALSE;
+    sampler.minLod = 0.0f;
+    sampler.maxLod = VK_LOD_CLAMP_NONE;
+    sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    if (vkCreateSampler(device, &sampler, nullptr, &environmentSampler) != VK_SUCCESS) {
+        assert(false && "failed to create sampler for environment maps!");
+    }
+}
+
 void VulkanApplication::prepareGraphicsPipelines() {
     createDescriptorSetLayouts(graphicsPipelines);
     createPipelineCaches(graphicsPipelines);
@@ -525,7 +612,8 @@ void VulkanApplication::createDescriptorSetLayouts(prt::vector<GraphicsPipeline>
     }
 }
 
-void VulkanApplication::createDescriptorSetLayout(GraphicsPipeline & pipeline) {
+template<typename Pipeline>
+void VulkanApplication::createDescriptorSetLayout(Pipeline & pipeline) {
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(pipeline.descriptorSetLayoutBindings.size());
@@ -551,6 +639,7 @@ void VulkanApplication::createPipelineCache(GraphicsPipeline & pipeline) {
 }
 
 void VulkanApplication::createGraphicsPipeline(GraphicsPipeline & graphicsPipeline) {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createGraphicsPipeline");
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
@@ -686,6 +775,49 @@ void VulkanApplication::createGraphicsPipelines(prt::vector<GraphicsPipeline> co
     }
 }
 
+void VulkanApplication::prepareComputePipelines() {
+    for (auto & pipeline : computePipelines) {
+        createDescriptorSetLayout(pipeline);
+        createComputePipeline(pipeline);
+    }
+}
+
+void VulkanApplication::createComputePipeline(ComputePipeline & computePipeline) {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createComputePipeline");
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &computePipeline.descriptorSetLayout;
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = Dispatch::PushConstants::DataSize;
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &computePipeline.pipelineLayout) != VK_SUCCESS) {
+        assert(false && "failed to create pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.pName = computePipeline.shaderStage.pName;
+    pipelineInfo.stage.module = createShaderModule(computePipeline.shaderStage.shader);
+    pipelineInfo.layout = computePipeline.pipelineLayout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, 
+                                 &pipelineInfo, nullptr, &computePipeline.pipeline) != VK_SUCCESS) {
+        assert(false && "failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(device, pipelineInfo.stage.module, nullptr);
+}
+
 void VulkanApplication::createSwapchainFrameBuffers() {
     swapchain.swapchainFramebuffers.resize(swapchain.swapchainImageViews.size());
     
@@ -757,6 +889,7 @@ void VulkanApplication::createFramebufferAttachments() {
 }
 
 void VulkanApplication::createShadowMaps() {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createShadowMaps");
     for (CascadeShadowMap & map : shadowMaps) {
         createShadowMap(map);
     }
@@ -859,13 +992,15 @@ bool VulkanApplication::hasStencilComponent(VkFormat format) {
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-void VulkanApplication::createTexture(TextureImages & textureImages, Texture const & texture, size_t i) {
+void VulkanApplication::createTexture(TextureImages & textureImages, Texture const & texture, size_t i,
+                                      uint32_t baseMip) {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createTexture");
     createTextureImage(textureImages.images[i], 
                        textureImages.imageMemories[i], 
-                       texture);
+                       texture, baseMip);
     createTextureImageView(textureImages.imageViews[i], 
                            textureImages.images[i], 
-                           texture.mipLevels);
+                           texture.mipLevels - baseMip);
 
     textureImages.descriptorImageInfos[i].sampler = textureSampler;
     textureImages.descriptorImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -878,8 +1013,113 @@ void VulkanApplication::destroyTexture(TextureImages & textureImages, size_t i)
     vkFreeMemory(getDevice(), textureImages.imageMemories[i], nullptr);
 }
 
+void VulkanApplication::dropTextureMips(TextureImages & textureImages, size_t i,
+                                        uint32_t width, uint32_t height,
+                                        uint32_t mipLevels, uint32_t numDropped) {
+    VkImage srcImage = textureImages.images[i];
+    VkDeviceMemory srcMemory = textureImages.imageMemories[i];
+    uint32_t dstLevels = mipLevels - numDropped;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = 0;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = width >> numDropped > 0 ? width >> numDropped : 1;
+    imageInfo.extent.height = height >> numDropped > 0 ? height >> numDropped : 1;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = dstLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage dstImage;
+    VkDeviceMemory dstMemory;
+    createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dstImage, dstMemory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    prt::array<VkImageMemoryBarrier, 2> barriers = {};
+    for (auto & barrier : barriers) {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.subresourceRange.baseMipLevel = 0;
+    }
+    barriers[0].image = srcImage;
+    barriers[0].subresourceRange.levelCount = mipLevels;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[1].image = dstImage;
+    barriers[1].subresourceRange.levelCount = dstLevels;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr,
+                         0, nullptr,
+                         barriers.size(), barriers.data());
+
+    prt::vector<VkImageCopy> regions;
+    regions.resize(dstLevels);
+    for (uint32_t level = 0; level < dstLevels; ++level) {
+        VkImageCopy & region = regions[level];
+        region = {};
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel = level + numDropped;
+        region.srcSubresource.layerCount = 1;
+        region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.dstSubresource.mipLevel = level;
+        region.dstSubresource.layerCount = 1;
+        region.extent.width = imageInfo.extent.width >> level > 0 ? imageInfo.extent.width >> level : 1;
+        region.extent.height = imageInfo.extent.height >> level > 0 ? imageInfo.extent.height >> level : 1;
+        region.extent.depth = 1;
+    }
+    vkCmdCopyImage(commandBuffer, 
+                   srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   regions.size(), regions.data());
+
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &barriers[1]);
+
+    endSingleTimeCommands(commandBuffer);
+
+    vkDestroyImageView(device, textureImages.imageViews[i], nullptr);
+    vkDestroyImage(device, srcImage, nullptr);
+    vkFreeMemory(device, srcMemory, nullptr);
+
+    textureImages.images[i] = dstImage;
+    textureImages.imageMemories[i] = dstMemory;
+    createTextureImageView(textureImages.imageViews[i], textureImages.images[i], dstLevels);
+    textureImages.descriptorImageInfos[i].imageView = textureImages.imageViews[i];
+}
+
 void VulkanApplication::createTextureImage(VkImage& texImage, VkDeviceMemory& texImageMemory, 
-                                           const Texture& texture) {
+                                           const Texture& texture, uint32_t baseMip) {
+    if (texture.hasMipChain()) {
+        createTextureImageFromMips(texImage, texImageMemory, texture, baseMip);
+        return;
+    }
+    assert(baseMip == 0 && "texture has no mip chain to upload from!");
+
     VkDeviceSize imageSize = texture.texWidth * texture.texHeight * 4;
 
     unsigned char* pixels = texture.pixelBuffer.data();
@@ -932,6 +1172,151 @@ void VulkanApplication::createTextureImage(VkImage& texImage, VkDeviceMemory& te
                     texture.mipLevels, 1);
 }
 
+void VulkanApplication::createTextureImageFromMips(VkImage& texImage, VkDeviceMemory& texImageMemory, 
+                                                   const Texture& texture, uint32_t baseMip) {
+    size_t offset = texture.getMipOffset(baseMip);
+    VkDeviceSize imageSize = texture.pixelBuffer.size() - offset;
+    uint32_t mipLevels = texture.mipLevels - baseMip;
+ 
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+                 stagingBuffer, stagingBufferMemory);
+ 
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+    memcpy(data, &texture.pixelBuffer[offset], static_cast<size_t>(imageSize));
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = 0;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = texture.getMipWidth(baseMip);
+    imageInfo.extent.height = texture.getMipHeight(baseMip);
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    createImage(imageInfo, 
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texImage, texImageMemory);
+ 
+    transitionImageLayout(texImage, VK_FORMAT_R8G8B8A8_UNORM, 
+                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                          mipLevels, 1);
+
+    // the mip levels are already filtered, so
+    // every level is copied instead of blitted
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    prt::vector<VkBufferImageCopy> regions;
+    regions.resize(mipLevels);
+    for (uint32_t level = 0; level < mipLevels; ++level) {
+        VkBufferImageCopy & region = regions[level];
+        region = {};
+        region.bufferOffset = texture.getMipOffset(baseMip + level) - offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = { static_cast<uint32_t>(texture.getMipWidth(baseMip + level)),
+                               static_cast<uint32_t>(texture.getMipHeight(baseMip + level)),
+                               1 };
+    }
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, 
+                           texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                           regions.size(), regions.data());
+    endSingleTimeCommands(commandBuffer);
+
+    transitionImageLayout(texImage, VK_FORMAT_R8G8B8A8_UNORM, 
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+                          mipLevels, 1);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+void VulkanApplication::createCubeMapImage(VkImage& texImage, VkDeviceMemory& texImageMemory, 
+                                           unsigned char const * pixels,
+                                           uint32_t faceSize, uint32_t mipLevels) {
+    VkDeviceSize imageSize = 0;
+    for (uint32_t level = 0; level < mipLevels; ++level) {
+        uint32_t size = std::max(faceSize >> level, 1u);
+        imageSize += 6 * size * size * 4;
+    }
+ 
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+                 stagingBuffer, stagingBufferMemory);
+
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+    memcpy(data, pixels, static_cast<size_t>(imageSize));
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = faceSize;
+    imageInfo.extent.height = faceSize;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 6;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    createImage(imageInfo, 
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texImage, texImageMemory);
+ 
+    transitionImageLayout(texImage, VK_FORMAT_R8G8B8A8_UNORM, 
+                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                          mipLevels, 6);
+
+    // every level holds all six faces, one after another
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    prt::vector<VkBufferImageCopy> regions;
+    regions.resize(mipLevels);
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < mipLevels; ++level) {
+        uint32_t size = std::max(faceSize >> level, 1u);
+        VkBufferImageCopy & region = regions[level];
+        region = {};
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 6;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = { size, size, 1 };
+        offset += 6 * size * size * 4;
+    }
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, 
+                           texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                           regions.size(), regions.data());
+    endSingleTimeCommands(commandBuffer);
+
+    transitionImageLayout(texImage, VK_FORMAT_R8G8B8A8_UNORM, 
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+                          mipLevels, 6);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
 void VulkanApplication::createCubeMapImage(VkImage& texImage, VkDeviceMemory& texImageMemory, 
                                            const prt::array<Texture, 6>& textures) {
     VkDeviceSize layerSize = textures[0].texWidth * textures[0].texHeight * 4;
@@ -1292,9 +1677,13 @@ void VulkanApplication::createDescriptorPools() {
     for (auto & pipeline : graphicsPipelines) {
         createDescriptorPool(pipeline);
     }
+    for (auto & pipeline : computePipelines) {
+        createDescriptorPool(pipeline);
+    }
 }
 
-void VulkanApplication::createDescriptorPool(GraphicsPipeline & pipeline) {
+template<typename Pipeline>
+void VulkanApplication::createDescriptorPool(Pipeline & pipeline) {
     VkDescriptorPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(pipeline.descriptorPoolSizes.size());
@@ -1307,6 +1696,7 @@ void VulkanApplication::createDescriptorPool(GraphicsPipeline & pipeline) {
 }
 
 void VulkanApplication::createDescriptorSets() {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createDescriptorSets");
     for (auto & pipeline : graphicsPipelines) {
         prt::vector<VkDescriptorSetLayout> layout(swapchain.swapchainImages.size(), pipeline.descriptorSetLayout);
 
@@ -1333,10 +1723,22 @@ void VulkanApplication::createDescriptorSets() {
                 pipeline.descriptorWrites[i][attach.descriptorIndex].pImageInfo = &imDesc[j];
             }
 
-            prt::vector<VkDescriptorImageInfo> uboDesc;
-            uboDesc.resize(pipeline.uboAttachments.size());
             for (size_t j = 0; j < pipeline.uboAttachments.size(); ++j) {
-                pipeline.descriptorWrites[i][0].pBufferInfo = &pipeline.uboAttachments[j].descriptorBufferInfos[i];     
+                UBOAttachment const & attach = pipeline.uboAttachments[j];
+                pipeline.descriptorWrites[i][attach.descriptorIndex].pBufferInfo = &attach.descriptorBufferInfos[i];     
+            }
+
+            // storage buffers may have been reallocated since
+            // the pipeline was created, so they are looked up
+            prt::vector<VkDescriptorBufferInfo> storageDesc;
+            storageDesc.resize(pipeline.storageBufferAttachments.size());
+            for (size_t j = 0; j < pipeline.storageBufferAttachments.size(); ++j) {
+                StorageBufferAttachment const & attach = pipeline.storageBufferAttachments[j];
+                storageDesc[j].buffer = storageBufferDatas[attach.storageBufferIndex].storageBuffers[i];
+                storageDesc[j].offset = 0;
+                storageDesc[j].range = VK_WHOLE_SIZE;
+
+                pipeline.descriptorWrites[i][attach.descriptorIndex].pBufferInfo = &storageDesc[j];
             }
 
             for (auto & descriptorWrite : pipeline.descriptorWrites[i]) {
@@ -1348,10 +1750,67 @@ void VulkanApplication::createDescriptorSets() {
                 pipeline.descriptorWrites[i][pipeline.textureDescriptorIndex].pImageInfo = asset.textureImages.descriptorImageInfos.data();
             }
 
+            for (auto const & attach : pipeline.textureAttachments) {
+                Assets & asset = getAssets(attach.assetsIndex);
+                pipeline.descriptorWrites[i][attach.descriptorIndex].pImageInfo = &asset.textureImages.descriptorImageInfos[attach.textureIndex];
+            }
+
             vkUpdateDescriptorSets(device, static_cast<uint32_t>(pipeline.descriptorWrites[i].size()), 
                                    pipeline.descriptorWrites[i].data(), 0, nullptr);       
         }
     }
+
+    for (auto & pipeline : computePipelines) {
+        prt::vector<VkDescriptorSetLayout> layout(swapchain.swapchainImages.size(), pipeline.descriptorSetLayout);
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pipeline.descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(swapchain.swapchainImages.size());
+        allocInfo.pSetLayouts = layout.data();
+
+        pipeline.descriptorSets.resize(swapchain.swapchainImages.size());
+        if (vkAllocateDescriptorSets(device, &allocInfo, pipeline.descriptorSets.data()) != VK_SUCCESS) {
+            assert(false && "failed to allocate descriptor sets!");
+        }
+
+        for (size_t i = 0; i < swapchain.swapchainImages.size(); i++) {
+            prt::vector<VkDescriptorBufferInfo> bufferDesc;
+            bufferDesc.resize(pipeline.storageBufferAttachments.size() +
+                              pipeline.deviceBufferAttachments.size() +
+                              pipeline.vertexBufferAttachments.size());
+            VkDescriptorBufferInfo * desc = bufferDesc.data();
+            for (StorageBufferAttachment const & attach : pipeline.storageBufferAttachments) {
+                desc->buffer = storageBufferDatas[attach.storageBufferIndex].storageBuffers[i];
+                pipeline.descriptorWrites[i][attach.descriptorIndex].pBufferInfo = desc++;
+            }
+            for (DeviceBufferAttachment const & attach : pipeline.deviceBufferAttachments) {
+                desc->buffer = deviceBufferDatas[attach.deviceBufferIndex].buffers[i];
+                pipeline.descriptorWrites[i][attach.descriptorIndex].pBufferInfo = desc++;
+            }
+            for (VertexBufferAttachment const & attach : pipeline.vertexBufferAttachments) {
+                desc->buffer = getAssets(attach.assetsIndex).vertexData.vertexBuffer;
+                pipeline.descriptorWrites[i][attach.descriptorIndex].pBufferInfo = desc++;
+            }
+
+            // assets without vertices have no vertex buffer,
+            // in which case there is nothing to dispatch
+            bool complete = true;
+            for (auto & bufferInfo : bufferDesc) {
+                bufferInfo.offset = 0;
+                bufferInfo.range = VK_WHOLE_SIZE;
+                complete &= bufferInfo.buffer != VK_NULL_HANDLE;
+            }
+            if (!complete) continue;
+
+            for (auto & descriptorWrite : pipeline.descriptorWrites[i]) {
+                descriptorWrite.dstSet = pipeline.descriptorSets[i];
+            }
+
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(pipeline.descriptorWrites[i].size()), 
+                                   pipeline.descriptorWrites[i].data(), 0, nullptr);
+        }
+    }
 }
 
 void VulkanApplication::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory) {    
@@ -1403,6 +1862,48 @@ void VulkanApplication::createAndMapBuffer(void* bufferData, VkDeviceSize buffer
     vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
+void VulkanApplication::updateBuffer(void const * bufferData, VkDeviceSize bufferSize,
+                                     VkBuffer destinationBuffer, VkDeviceSize offset) {
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+                 stagingBuffer, stagingBufferMemory);
+    
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+    memcpy(data, bufferData, (size_t) bufferSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+    
+    copyBuffer(stagingBuffer, destinationBuffer, bufferSize, offset);
+    
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+void VulkanApplication::updateTextureDescriptors(size_t assetsIndex) {
+    Assets & asset = getAssets(assetsIndex);
+    for (auto & pipeline : graphicsPipelines) {
+        for (auto const & attach : pipeline.textureAttachments) {
+            if (attach.assetsIndex != assetsIndex) continue;
+
+            for (size_t i = 0; i < pipeline.descriptorSets.size(); ++i) {
+                VkWriteDescriptorSet & descriptorWrite = pipeline.descriptorWrites[i][attach.descriptorIndex];
+                descriptorWrite.pImageInfo = &asset.textureImages.descriptorImageInfos[attach.textureIndex];
+                vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+            }
+        }
+
+        if (pipeline.assetsIndex != assetsIndex || pipeline.textureDescriptorIndex == -1) continue;
+
+        for (size_t i = 0; i < pipeline.descriptorSets.size(); ++i) {
+            VkWriteDescriptorSet & descriptorWrite = pipeline.descriptorWrites[i][pipeline.textureDescriptorIndex];
+            descriptorWrite.pImageInfo = asset.textureImages.descriptorImageInfos.data();
+            vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+        }
+    }
+}
+
 size_t VulkanApplication::pushBackAssets() {
     size_t index = assets.size();
     assets.push_back({});
@@ -1440,6 +1941,142 @@ size_t VulkanApplication::pushBackUniformBufferData(size_t uboSize) {
     return index;
 }
 
+size_t VulkanApplication::pushBackStorageBufferData(size_t capacity) {
+    size_t index = storageBufferDatas.size();
+    storageBufferDatas.push_back({});
+    StorageBufferData & storageBufferData = storageBufferDatas.back();
+    // empty buffers are not allowed
+    storageBufferData.data.resize(capacity > 0 ? capacity : 16);
+    createStorageBuffers(storageBufferData);
+
+    return index;
+}
+
+void VulkanApplication::reserveStorageBufferData(size_t index, size_t capacity) {
+    StorageBufferData & storageBufferData = storageBufferDatas[index];
+    if (capacity <= storageBufferData.data.size()) return;
+
+    destroyStorageBuffers(storageBufferData);
+    storageBufferData.data.resize(capacity);
+    createStorageBuffers(storageBufferData);
+}
+
+void VulkanApplication::createStorageBuffers(StorageBufferData & storageBufferData) {
+    storageBufferData.mappedMemories.resize(swapchain.swapchainImages.size());
+    storageBufferData.storageBuffers.resize(swapchain.swapchainImages.size());
+    storageBufferData.storageBufferMemories.resize(swapchain.swapchainImages.size());
+
+    size_t size = storageBufferData.data.size();
+    for (size_t i = 0; i < swapchain.swapchainImages.size(); i++) {
+        createBuffer(size, 
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
+                     storageBufferData.storageBuffers[i], 
+                     storageBufferData.storageBufferMemories[i]);
+        vkMapMemory(device, storageBufferData.storageBufferMemories[i], 0, size, 0, &storageBufferData.mappedMemories[i]);
+    }
+}
+
+void VulkanApplication::destroyStorageBuffers(StorageBufferData & storageBufferData) {
+    for (size_t i = 0; i < storageBufferData.storageBuffers.size(); i++) {
+        vkUnmapMemory(device, storageBufferData.storageBufferMemories[i]);
+        vkDestroyBuffer(device, storageBufferData.storageBuffers[i], nullptr);
+        vkFreeMemory(device, storageBufferData.storageBufferMemories[i], nullptr);
+    }
+}
+
+void VulkanApplication::attachStorageBuffer(size_t pipelineIndex, size_t storageBufferIndex,
+                                            uint32_t binding, VkShaderStageFlags stageFlags) {
+    GraphicsPipeline & pipeline = getPipeline(pipelineIndex);
+
+    StorageBufferAttachment attach;
+    attach.descriptorIndex = pushBackBufferDescriptor(pipeline, binding, stageFlags, 
+                                                      swapchain.swapchainImages.size());
+    attach.storageBufferIndex = storageBufferIndex;
+    pipeline.storageBufferAttachments.push_back(attach);
+}
+
+size_t VulkanApplication::pushBackDeviceBufferData(VkDeviceSize size, VkBufferUsageFlags usage) {
+    size_t index = deviceBufferDatas.size();
+    deviceBufferDatas.push_back({});
+    DeviceBufferData & deviceBufferData = deviceBufferDatas.back();
+    // empty buffers are not allowed
+    deviceBufferData.size = size > 0 ? size : 16;
+    deviceBufferData.usage = usage;
+    createDeviceBuffers(deviceBufferData);
+
+    return index;
+}
+
+void VulkanApplication::reserveDeviceBufferData(size_t index, VkDeviceSize size) {
+    DeviceBufferData & deviceBufferData = deviceBufferDatas[index];
+    if (size <= deviceBufferData.size) return;
+
+    destroyDeviceBuffers(deviceBufferData);
+    deviceBufferData.size = size;
+    createDeviceBuffers(deviceBufferData);
+}
+
+void VulkanApplication::createDeviceBuffers(DeviceBufferData & deviceBufferData) {
+    deviceBufferData.buffers.resize(swapchain.swapchainImages.size());
+    deviceBufferData.bufferMemories.resize(swapchain.swapchainImages.size());
+
+    for (size_t i = 0; i < swapchain.swapchainImages.size(); i++) {
+        createBuffer(deviceBufferData.size, 
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | deviceBufferData.usage, 
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+                     deviceBufferData.buffers[i], 
+                     deviceBufferData.bufferMemories[i]);
+    }
+}
+
+void VulkanApplication::destroyDeviceBuffers(DeviceBufferData & deviceBufferData) {
+    for (size_t i = 0; i < deviceBufferData.buffers.size(); i++) {
+        vkDestroyBuffer(device, deviceBufferData.buffers[i], nullptr);
+        vkFreeMemory(device, deviceBufferData.bufferMemories[i], nullptr);
+    }
+}
+
+size_t VulkanApplication::pushBackComputePipeline() {
+    size_t index = computePipelines.size();
+    computePipelines.push_back({});
+    computePipelines.back().descriptorWrites.resize(swapchain.swapchainImages.size());
+    return index;
+}
+
+void VulkanApplication::attachComputeStorageBuffer(size_t pipelineIndex, size_t storageBufferIndex, 
+                                                   uint32_t binding) {
+    ComputePipeline & pipeline = getComputePipeline(pipelineIndex);
+
+    StorageBufferAttachment attach;
+    attach.descriptorIndex = pushBackBufferDescriptor(pipeline, binding, VK_SHADER_STAGE_COMPUTE_BIT, 
+                                                      swapchain.swapchainImages.size());
+    attach.storageBufferIndex = storageBufferIndex;
+    pipeline.storageBufferAttachments.push_back(attach);
+}
+
+void VulkanApplication::attachComputeDeviceBuffer(size_t pipelineIndex, size_t deviceBufferIndex, 
+                                                  uint32_t binding) {
+    ComputePipeline & pipeline = getComputePipeline(pipelineIndex);
+
+    DeviceBufferAttachment attach;
+    attach.descriptorIndex = pushBackBufferDescriptor(pipeline, binding, VK_SHADER_STAGE_COMPUTE_BIT, 
+                                                      swapchain.swapchainImages.size());
+    attach.deviceBufferIndex = deviceBufferIndex;
+    pipeline.deviceBufferAttachments.push_back(attach);
+}
+
+void VulkanApplication::attachComputeVertexBuffer(size_t pipelineIndex, size_t assetsIndex, 
+                                                  uint32_t binding) {
+    ComputePipeline & pipeline = getComputePipeline(pipelineIndex);
+
+    VertexBufferAttachment attach;
+    attach.descriptorIndex = pushBackBufferDescriptor(pipeline, binding, VK_SHADER_STAGE_COMPUTE_BIT, 
+                                                      swapchain.swapchainImages.size());
+    attach.assetsIndex = assetsIndex;
+    pipeline.vertexBufferAttachments.push_back(attach);
+}
+
 VkCommandBuffer VulkanApplication::beginSingleTimeCommands() {
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1473,11 +2110,13 @@ void VulkanApplication::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
     vkFreeCommandBuffers(device, commandPools[0], 1, &commandBuffer);
 }
 
-void VulkanApplication::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+void VulkanApplication::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
+                                   VkDeviceSize dstOffset) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
     
     VkBufferCopy copyRegion = {};
     copyRegion.size = size;
+    copyRegion.dstOffset = dstOffset;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
     
     endSingleTimeCommands(commandBuffer);
@@ -1498,6 +2137,7 @@ uint32_t VulkanApplication::findMemoryType(uint32_t typeFilter, VkMemoryProperty
 }
 
 void VulkanApplication::createCommandBuffers() {
+    TRACE_SCOPE("vulkan", "VulkanApplication::createCommandBuffers");
     commandBuffers.resize(swapchain.swapchainFramebuffers.size());
     for (size_t i = 0; i < commandBuffers.size(); ++i) {
         //  allocate main command buffer
@@ -1516,6 +2156,8 @@ void VulkanApplication::createCommandBuffers() {
     for (RenderPass & pass : renderPasses) {
         createRenderPassCommandBuffers(pass);
     }
+    staticCommandBuffersOutdated.resize(0);
+    staticCommandBuffersOutdated.resize(commandBuffers.size(), false);
 }
 
 void VulkanApplication::freeCommandBuffers() {
@@ -1560,7 +2202,35 @@ void VulkanApplication::createRenderPassCommandBuffers(RenderPass & pass) {
     }
 }
 
+void VulkanApplication::invalidateStaticCommandBuffers() {
+    for (size_t i = 0; i < staticCommandBuffersOutdated.size(); ++i) {
+        staticCommandBuffersOutdated[i] = true;
+    }
+}
+
+void VulkanApplication::recordStaticCommandBuffers(size_t const imageIndex) {
+    // the image's previous submission has finished, 
+    // so its secondary command buffers are not in use
+    for (RenderPass & pass : renderPasses) {
+        prt::vector<VkFramebuffer> framebuffers = getFramebuffers(pass, imageIndex);
+        for (size_t i = 0; i < framebuffers.size(); ++i) {
+            for (size_t j = 0; j < pass.subpasses.size(); ++j) {
+                SubPass & sub = pass.subpasses[j];
+                if (sub.dynamic) continue;
+
+                vkResetCommandBuffer(sub.commandBuffers[imageIndex][i], 0);
+                createDrawCommands(imageIndex, framebuffers[i], i, pass, j);
+            }
+        }
+    }
+    staticCommandBuffersOutdated[imageIndex] = false;
+}
+
 void VulkanApplication::recordCommandBuffer(size_t const imageIndex) {
+    if (staticCommandBuffersOutdated[imageIndex]) {
+        recordStaticCommandBuffers(imageIndex);
+    }
+
     vkResetCommandPool(device, commandPools[imageIndex], 0);
 
     VkCommandBufferBeginInfo beginInfo = {};
@@ -1573,6 +2243,8 @@ void VulkanApplication::recordCommandBuffer(size_t const imageIndex) {
 
     updateDynamicAssets(imageIndex);
 
+    createComputeCommands(imageIndex);
+
     // create offscreen passes first
     for (RenderPass & renderPass : renderPasses) {
         if (&renderPass == &renderPasses[presentPassIndex]) continue;
@@ -1622,6 +2294,42 @@ void VulkanApplication::createRenderPassCommands(size_t const imageIndex, Render
     }
 }
 
+void VulkanApplication::createComputeCommands(size_t const imageIndex) {
+    bool dispatched = false;
+    for (ComputePipeline & pipeline : computePipelines) {
+        if (pipeline.dispatches.empty()) continue;
+
+        vkCmdBindPipeline(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+        vkCmdBindDescriptorSets(commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_COMPUTE, 
+                                pipeline.pipelineLayout, 0, 1, &pipeline.descriptorSets[imageIndex], 0, nullptr);
+
+        for (Dispatch const & dispatch : pipeline.dispatches) {
+            vkCmdPushConstants(commandBuffers[imageIndex], pipeline.pipelineLayout, 
+                               VK_SHADER_STAGE_COMPUTE_BIT, 
+                               0, 
+                               dispatch.pushConstants.size() * sizeof(dispatch.pushConstants[0]), 
+                               (void *)dispatch.pushConstants.data());
+            vkCmdDispatch(commandBuffers[imageIndex], dispatch.groupCountX, 1, 1);
+        }
+        dispatched = true;
+    }
+    if (!dispatched) return;
+
+    // the previous submission of this image has finished,
+    // so only the reads that follow need to wait
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffers[imageIndex],
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0, 
+                         1, &barrier, 
+                         0, nullptr, 
+                         0, nullptr);
+}
+
 void VulkanApplication::createDrawCommands(size_t const imageIndex, 
                                            VkFramebuffer framebuffer,
                                            size_t framebufferIndex,
@@ -1655,7 +2363,7 @@ void VulkanApplication::createDrawCommands(size_t const imageIndex,
         if (!checkMask(commandBufferRenderGroupMask, pipeline.renderGroup)) continue;
 
         if (renderPass.pushConstantFBIndexByteOffset != -1) {
-            for (auto & drawCall : pipeline.drawCalls) {
+            for (auto & drawCall : pipeline.getDrawCalls(framebufferIndex)) {
                 *reinterpret_cast<int32_t*>(&drawCall.pushConstants[renderPass.pushConstantFBIndexByteOffset]) = framebufferIndex;
             }
         }
@@ -1724,11 +2432,14 @@ void VulkanApplication::createDrawCommands(size_t const imageIndex,
             vkCmdSetScissor(sub.commandBuffers[imageIndex][framebufferIndex], 0, 1, &drawCall.scissor);
             vkCmdDrawIndexed(sub.commandBuffers[imageIndex][framebufferIndex], drawCall.indexCount, 1, drawCall.indexOffset, drawCall.vertexOffset, 0);
         }
-    } else if (!pipeline.drawCalls.empty()){
+    } else if (!pipeline.getDrawCalls(framebufferIndex).empty()){
         Assets& asset = assets[pipeline.assetsIndex];
-        vkCmdBindVertexBuffers(sub.commandBuffers[imageIndex][framebufferIndex], 0, 1, &asset.vertexData.vertexBuffer, &offset);
-        vkCmdBindIndexBuffer(sub.commandBuffers[imageIndex][framebufferIndex], asset.vertexData.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        for (auto const & drawCall : pipeline.drawCalls) {
+        VkBuffer vertexBuffer = pipeline.vertexDeviceBufferIndex != GraphicsPipeline::NULL_INDEX ?
+                                deviceBufferDatas[pipeline.vertexDeviceBufferIndex].buffers[imageIndex] :
+                                asset.vertexData.vertexBuffer;
+        vkCmdBindVertexBuffers(sub.commandBuffers[imageIndex][framebufferIndex], 0, 1, &vertexBuffer, &offset);
+        vkCmdBindIndexBuffer(sub.commandBuffers[imageIndex][framebufferIndex], asset.vertexData.indexBuffer, 0, asset.vertexData.indexType);
+        for (auto const & drawCall : pipeline.getDrawCalls(framebufferIndex)) {
             vkCmdPushConstants(sub.commandBuffers[imageIndex][framebufferIndex], pipeline.pipelineLayout, 
                                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
                                0, 
@@ -1739,7 +2450,7 @@ void VulkanApplication::createDrawCommands(size_t const imageIndex,
                              drawCall.indexCount,
                              1,
                              drawCall.firstIndex,
-                             0,
+                             drawCall.vertexOffset,
                              0);
         }
     }
@@ -1774,6 +2485,13 @@ void VulkanApplication::updateUniformBuffers(uint32_t currentImage) {
     }
 }
 
+void VulkanApplication::updateStorageBuffers(uint32_t currentImage) {
+    for (auto & storageBufferData : storageBufferDatas) {
+        assert(storageBufferData.size <= storageBufferData.data.size());
+        memcpy(storageBufferData.mappedMemories[currentImage], storageBufferData.data.data(), storageBufferData.size);
+    }
+}
+
 void VulkanApplication::updateDynamicAssets(uint32_t const imageIndex) {
     for (DynamicAssets & assets : dynamicAssets) {
         DynamicVertexData & vertexData = assets.vertexData[imageIndex];
@@ -1872,6 +2590,7 @@ uint32_t VulkanApplication::waitForNextImageIndex() {
 
 void VulkanApplication::drawFrame(uint32_t imageIndex) {    
     updateUniformBuffers(imageIndex);
+    updateStorageBuffers(imageIndex);
     recordCommandBuffer(imageIndex);
 
     imagesInFlight[imageIndex] = inFlightFences[currentFrame];
@@ -2100,7 +2819,10 @@ QueueFamilyIndices VulkanApplication::findQueueFamilies(VkPhysicalDevice device)
     
     int i = 0;
     for (const auto& queueFamily : queueFamilies) {
-        if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+        // compute pipelines are dispatched on the graphics queue
+        if (queueFamily.queueCount > 0 && 
+            (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+            (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
             indices.graphicsFamily = i;
         }
         
@@ -7,6 +7,7 @@
 #include "src/graphics/geometry/model.h"
 
 #include "graphics_pipeline.h"
+#include "compute_pipeline.h"
 
 #include "src/input/input.h"
 #include "src/config/config.h"
@@ -60,6 +61,31 @@ struct UniformBufferData {
     prt::vector<VkDeviceMemory> uniformBufferMemories;
 };
 
+/*
+ * Storage buffer per swapchain image, kept mapped. Only the
+ * first size bytes of data are copied to the buffer of the
+ * image that is drawn
+ **/
+struct StorageBufferData {
+    prt::vector<char>           data{prt::getAlignment(alignof(std::max_align_t))};
+    size_t                      size = 0;
+    prt::vector<void*>          mappedMemories;
+    prt::vector<VkBuffer>       storageBuffers;
+    prt::vector<VkDeviceMemory> storageBufferMemories;
+};
+
+/*
+ * Buffer per swapchain image that only the device
+ * reads and writes, e.g. the output of a compute
+ * pipeline
+ **/
+struct DeviceBufferData {
+    VkDeviceSize                size = 0;
+    VkBufferUsageFlags          usage;
+    prt::vector<VkBuffer>       buffers;
+    prt::vector<VkDeviceMemory> bufferMemories;
+};
+
 struct FramebufferAttachment {
     VkImageLayout         imageLayout;
     VkImageCreateInfo     imageInfo;
@@ -170,6 +196,7 @@ protected:
     // Samplers
     VkSampler textureSampler;
     VkSampler shadowMapSampler;
+    VkSampler environmentSampler;
 
     // Swapchain
     Swapchain swapchain;
@@ -200,11 +227,45 @@ protected:
     size_t pushBackRenderPass(bool isPresentPass = false);
     size_t pushBackShadowMap(size_t renderPassIndex);
 
-    void createTexture(TextureImages & textureImages, Texture const & texture, size_t i);
+    /**
+     * Creates the image of a texture in a texture array
+     * @param textureImages texture array
+     * @param texture texture to upload
+     * @param i index in the texture array
+     * @param baseMip finest mip level to upload, the image
+     *                only holds this level and coarser
+     */
+    void createTexture(TextureImages & textureImages, Texture const & texture, size_t i,
+                       uint32_t baseMip = 0);
     void destroyTexture(TextureImages & textureImages, size_t i);
-    
-    void createTextureImage(VkImage& texImage, VkDeviceMemory& texImageMemory, const Texture& texture);
+
+    /**
+     * Replaces the image of a texture in a texture array
+     * with a copy lacking its finest mip levels
+     * @param textureImages texture array
+     * @param i index in the texture array
+     * @param width width of the current image
+     * @param height height of the current image
+     * @param mipLevels mip levels of the current image
+     * @param numDropped number of mip levels to drop
+     */
+    void dropTextureMips(TextureImages & textureImages, size_t i,
+                         uint32_t width, uint32_t height,
+                         uint32_t mipLevels, uint32_t numDropped);
+    
+    void createTextureImage(VkImage& texImage, VkDeviceMemory& texImageMemory, const Texture& texture,
+                            uint32_t baseMip = 0);
+    void createTextureImageFromMips(VkImage& texImage, VkDeviceMemory& texImageMemory, const Texture& texture,
+                                    uint32_t baseMip);
     void createCubeMapImage(VkImage& texImage, VkDeviceMemory& texImageMemory, const prt::array<Texture, 6>& textures);
+    /**
+     * Creates a cube map from a mip chain that is already filtered
+     * @param pixels every mip level in order, each holding
+     *               six RGBA faces
+     */
+    void createCubeMapImage(VkImage& texImage, VkDeviceMemory& texImageMemory, 
+                            unsigned char const * pixels,
+                            uint32_t faceSize, uint32_t mipLevels);
     
     void createTextureImageView(VkImageView& imageView, VkImage &image, uint32_t mipLevels);
     void createCubeMapImageView(VkImageView& imageView, VkImage &image, uint32_t mipLevels);
@@ -214,8 +275,36 @@ protected:
 
     void freeCommandBuffers();
 
+    /**
+     * Marks the static secondary command buffers of
+     * every swapchain image as outdated. They are
+     * re-recorded the next time the image is drawn,
+     * which is needed after changing draw calls
+     */
+    void invalidateStaticCommandBuffers();
+
     void createAndMapBuffer(void* bufferData, VkDeviceSize bufferSize, VkBufferUsageFlagBits bufferUsageFlagBits,
                             VkBuffer& destinationBuffer, VkDeviceMemory& destinationBufferMemory);
+
+    /**
+     * Copies data into part of a device local buffer
+     * through a staging buffer. The buffer may not be
+     * in use by the device
+     * @param bufferData data to copy
+     * @param bufferSize size of the data
+     * @param destinationBuffer buffer to copy into
+     * @param offset offset in the buffer to copy to
+     */
+    void updateBuffer(void const * bufferData, VkDeviceSize bufferSize,
+                      VkBuffer destinationBuffer, VkDeviceSize offset);
+
+    /**
+     * Rewrites the texture descriptors of every pipeline
+     * using the assets, after their images have been
+     * recreated. The descriptor sets may not be in use
+     * @param assetsIndex index of the assets
+     */
+    void updateTextureDescriptors(size_t assetsIndex);
     
     size_t pushBackPipeline();
 
@@ -237,6 +326,87 @@ protected:
     inline UniformBufferData& getUniformBufferData(size_t index) { return uniformBufferDatas[index]; } 
     inline UniformBufferData const & getUniformBufferData(size_t index) const { return uniformBufferDatas[index]; } 
     
+    /**
+     * @param capacity initial capacity in bytes
+     * @return index of the storage buffer
+     */
+    size_t pushBackStorageBufferData(size_t capacity);
+
+    /**
+     * Grows a storage buffer to fit at least capacity bytes.
+     * The device must be idle, and the descriptor sets must be
+     * created again before the buffer is drawn with
+     * @param index index of the storage buffer
+     * @param capacity capacity in bytes
+     */
+    void reserveStorageBufferData(size_t index, size_t capacity);
+
+    inline StorageBufferData& getStorageBufferData(size_t index) { return storageBufferDatas[index]; } 
+    inline StorageBufferData const & getStorageBufferData(size_t index) const { return storageBufferDatas[index]; } 
+
+    /**
+     * Binds a storage buffer to a pipeline, before
+     * its descriptor sets are created
+     * @param pipelineIndex index of the pipeline
+     * @param storageBufferIndex index of the storage buffer
+     * @param binding binding in the descriptor set
+     * @param stageFlags shader stages that read the buffer
+     */
+    void attachStorageBuffer(size_t pipelineIndex, size_t storageBufferIndex,
+                             uint32_t binding, VkShaderStageFlags stageFlags);
+
+    /**
+     * @param size initial size in bytes
+     * @param usage usage besides storage buffer
+     * @return index of the device buffer
+     */
+    size_t pushBackDeviceBufferData(VkDeviceSize size, VkBufferUsageFlags usage);
+
+    /**
+     * Grows a device buffer to at least size bytes, which
+     * discards its contents. The device must be idle, and the
+     * descriptor sets and command buffers must be created
+     * again before the buffer is used
+     * @param index index of the device buffer
+     * @param size size in bytes
+     */
+    void reserveDeviceBufferData(size_t index, VkDeviceSize size);
+
+    inline DeviceBufferData const & getDeviceBufferData(size_t index) const { return deviceBufferDatas[index]; }
+
+    size_t pushBackComputePipeline();
+
+    inline ComputePipeline & getComputePipeline(size_t index) { return computePipelines[index]; }
+    inline ComputePipeline const & getComputePipeline(size_t index) const { return computePipelines[index]; }
+
+    /**
+     * Binds a storage buffer to a compute pipeline,
+     * before its descriptor sets are created
+     * @param pipelineIndex index of the compute pipeline
+     * @param storageBufferIndex index of the storage buffer
+     * @param binding binding in the descriptor set
+     */
+    void attachComputeStorageBuffer(size_t pipelineIndex, size_t storageBufferIndex, uint32_t binding);
+
+    /**
+     * Binds a device buffer to a compute pipeline,
+     * before its descriptor sets are created
+     * @param pipelineIndex index of the compute pipeline
+     * @param deviceBufferIndex index of the device buffer
+     * @param binding binding in the descriptor set
+     */
+    void attachComputeDeviceBuffer(size_t pipelineIndex, size_t deviceBufferIndex, uint32_t binding);
+
+    /**
+     * Binds the vertex buffer of assets to a compute pipeline,
+     * before its descriptor sets are created. The buffer must
+     * have been created with storage buffer usage
+     * @param pipelineIndex index of the compute pipeline
+     * @param assetsIndex index of the assets
+     * @param binding binding in the descriptor set
+     */
+    void attachComputeVertexBuffer(size_t pipelineIndex, size_t assetsIndex, uint32_t binding);
+    
     prt::vector<size_t> getPipelineIndicesByType(PipelineType type);
     prt::vector<size_t> getPipelineIndicesBySubPass(SubPass const & subpass);
 
@@ -274,11 +444,18 @@ private:
     prt::vector<VkFence> imagesInFlight;
     unsigned int currentFrame = 0;
 
+    // static command buffers that need to be re-recorded,
+    // per swapchain image
+    prt::vector<bool> staticCommandBuffersOutdated;
+
     prt::vector<GraphicsPipeline> graphicsPipelines;
+    prt::vector<ComputePipeline> computePipelines;
 
     prt::vector<Assets> assets;
     prt::vector<DynamicAssets> dynamicAssets;
     prt::vector<UniformBufferData> uniformBufferDatas;
+    prt::vector<StorageBufferData> storageBufferDatas;
+    prt::vector<DeviceBufferData> deviceBufferDatas;
     
     bool framebufferResized = false;
 
@@ -305,23 +482,29 @@ private:
     void createSwapchainImageViews();
     
     void createShadowMapSampler();
+    void createEnvironmentSampler();
 
     void prepareGraphicsPipelines();
     
     void createDescriptorSetLayouts(prt::vector<GraphicsPipeline> & pipelines);
-    void createDescriptorSetLayout(GraphicsPipeline & pipeline);
+    template<typename Pipeline>
+    void createDescriptorSetLayout(Pipeline & pipeline);
 
     void createPipelineCaches(prt::vector<GraphicsPipeline> & pipelines);
     void createPipelineCache(GraphicsPipeline & pipeline);
 
     void createGraphicsPipelines(prt::vector<GraphicsPipeline> const & pipelines);
     void createGraphicsPipeline(GraphicsPipeline & materialPipeline);
+
+    void prepareComputePipelines();
+    void createComputePipeline(ComputePipeline & pipeline);
     
     void createCommandPool(VkCommandPool & pool, VkCommandPoolCreateFlags flags); 
     
     void createCommandBuffers();
     void createRenderPassCommandBuffers(RenderPass & pass);
     void recordCommandBuffer(size_t const imageIndex);
+    void recordStaticCommandBuffers(size_t const imageIndex);
 
     void createSwapchainFrameBuffers();
     
@@ -340,6 +523,14 @@ private:
 
     void createRenderPassCommands(size_t const imageIndex, RenderPass & renderPass);
 
+    /**
+     * Records the dispatches of every compute pipeline,
+     * followed by a barrier that makes what they write
+     * visible to vertex input
+     * @param imageIndex index of the swapchain image
+     */
+    void createComputeCommands(size_t const imageIndex);
+
     void createRenderPasses();
     void createRenderPass(RenderPass & renderpass);
     
@@ -377,7 +568,8 @@ private:
                            uint32_t layerCount);
     
     void createDescriptorPools();
-    void createDescriptorPool(GraphicsPipeline & pipeline);
+    template<typename Pipeline>
+    void createDescriptorPool(Pipeline & pipeline);
     
     void createDescriptorSets();
     
@@ -390,13 +582,21 @@ private:
     
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
     
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size,
+                    VkDeviceSize dstOffset = 0);
     
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
     void createSyncObjects();
 
     void updateUniformBuffers(uint32_t currentImage);
+    void updateStorageBuffers(uint32_t currentImage);
+
+    void createStorageBuffers(StorageBufferData & storageBufferData);
+    void destroyStorageBuffers(StorageBufferData & storageBufferData);
+
+    void createDeviceBuffers(DeviceBufferData & deviceBufferData);
+    void destroyDeviceBuffers(DeviceBufferData & deviceBufferData);
 
     void updateDynamicAssets(uint32_t const imageIndex);
     
@@ -2,20 +2,31 @@
 
 #include "src/container/vector.h"
 #include "src/config/config.h"
+#include "src/util/scene_file.h"
+#include "src/util/io_util.h"
+#include "src/util/trace_util.h"
 
 #include <GLFW/glfw3.h>
 
 #include <chrono>
 #include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 Application::Application()
 : m_input(),
   m_renderer(DEFAULT_WIDTH, DEFAULT_HEIGHT),
   m_renderData{},
   m_camera(m_input),
-  m_assetManager(RESOURCE_PATH),
+  m_assetManager(RESOURCE_PATH, SOURCE_RESOURCE_PATH, ASSET_CACHE_PATH),
+  m_worldPartition(),
+  m_animationLOD(),
+  m_lastCameraPosition(0.0f),
   m_frameRate(FRAME_RATE),
   m_microsecondsPerFrame(1000000 / m_frameRate),
   m_sun{},
@@ -51,6 +62,18 @@ void Application::run() {
         if (nextSecond <= clock::now()) {
             nextSecond += std::chrono::seconds(1);
             std::cout << "Frame rate: " << framesMeasured << "FPS" << std::endl;
+            AnimationLOD::Counters const & counters = m_animationLOD.getCounters();
+            std::cout << "Animated instances (full/reduced/low/frozen): "
+                      << counters.instances[ANIMATION_LOD_FULL] << "/"
+                      << counters.instances[ANIMATION_LOD_REDUCED] << "/"
+                      << counters.instances[ANIMATION_LOD_LOW] << "/"
+                      << counters.instances[ANIMATION_LOD_FROZEN] << ", "
+                      << counters.bones << " bones evaluated, "
+                      << counters.deferred << " deferred" << std::endl;
+            size_t requested, sampled;
+            m_assetManager.getModelManager().getPoseCacheCounts(requested, sampled);
+            std::cout << "Clip samples: " << sampled << " of " << requested 
+                      << " requested" << std::endl;
             framesMeasured = 0;
         }
 
@@ -63,8 +86,10 @@ void Application::run() {
 void Application::update(float deltaTime) {
     m_time += deltaTime;
     m_input.update(false);
+    reloadChangedAssets();
     updateSun();
     updateCamera(deltaTime);
+    streamWorld(deltaTime);
     renderScene(m_camera, deltaTime);
 }
 
@@ -76,7 +101,6 @@ void Application::updateSun() {
     // float ph = 0.2f*m_time;
     // m_sun.phase = ph;
     // m_sun.direction = glm::normalize(glm::vec3(0.2f, glm::cos(ph), glm::sin(ph)));
-    m_sun.direction = glm::normalize(glm::vec3(-1,-1,1));
     float distToNoon = glm::acos(glm::dot(-m_sun.direction, glm::vec3(0,1,0))) / glm::pi<float>();
     // m_sun.color = glm::mix(glm::vec3(255,255,255), glm::vec3(255,153,51), distToNoon)/255.0f;
     m_sun.color = glm::mix(glm::vec3(100,100,255), glm::vec3(255,153,51), distToNoon)/255.0f;
@@ -89,115 +113,372 @@ void Application::updateSun() {
     // m_sun.sunColor = glm::mix(glm::vec3(255.0f,255.0f,230.0f), glm::vec3(255.0f,153.0f,51.0f), m_sun.distToNoon)/255.0f;
 }
 
-void Application::updateRenderData() {
-    m_renderData.staticTransforms[0] = glm::mat4{1.0f};
+void Application::updateRenderData(float deltaTime) {
+    for (BlendedAnimation & blend : m_renderData.animationBlends) {
+        if (!blend.paused) {
+            blend.time += deltaTime;
+        }
+    }
+}
+
+void Application::streamWorld(float deltaTime) {
+    glm::vec3 position = m_camera.getPosition();
+    glm::vec3 velocity = deltaTime > 0.0f ? (position - m_lastCameraPosition) / deltaTime 
+                                          : glm::vec3(0.0f);
+    m_lastCameraPosition = position;
+
+    if (!m_worldPartition.update(position, velocity, 
+                                 m_assetManager.getModelManager(), 
+                                 m_currentFrame,
+                                 m_worldPartition.cellLoadsPerUpdate)) {
+        return;
+    }
+
+    // only the models of the loaded cells are bound
+    collectRenderData();
+    bindScene();
+    m_assetManager.evictAssets();
 }
 
-void Application::sampleAnimation(prt::vector<glm::mat4> & bones) {
-    prt::vector<BlendedAnimation> blends;
-    blends.resize(m_renderData.animatedModelIDs.size());
+void Application::sampleAnimation(Camera const & camera, float deltaTime) {
+    int w = 0, h = 0;
+    m_renderer.getWindowSize(w, h);
+    // projected size in pixels of one world unit at unit distance
+    float pixelsPerUnit = float(h) / (2.0f * glm::tan(0.5f * glm::radians(camera.getFOV())));
 
-    m_assetManager.getModelManager().getSampledBlendedAnimation(m_renderData.animatedModelIDs.data(),
-                                                                blends.data(),
-                                                                bones,
-                                                                m_renderData.animatedModelIDs.size());
+    m_animationLOD.update(m_assetManager.getModelManager(),
+                          m_renderData.animatedModelIDs.data(),
+                          m_renderData.animatedTransforms.data(),
+                          m_renderData.animationBlends.data(),
+                          m_renderData.animatedModelIDs.size(),
+                          camera.getProjectionMatrix() * camera.getViewMatrix(),
+                          camera.getPosition(),
+                          pixelsPerUnit,
+                          deltaTime);
 }
 
 void Application::renderScene(Camera & camera, float deltaTime) {
-    updateRenderData();
-
-    prt::vector<glm::mat4> bones; 
-    sampleAnimation(bones);
-
-    prt::vector<UBOPointLight> pointLights;
-    //     alignas(16) glm::vec3 pos;
-    // alignas(4)  float a; // quadtratic term
-    // alignas(16) glm::vec3 color;
-    // alignas(4)  float b; // linear term
-    // alignas(4)  float c; // constant term
-    UBOPointLight pointLight1{};
-    pointLight1.pos = glm::vec3{-7.0f, 3.0f, -6.0f};
-    pointLight1.color = glm::vec3{1.0f, 0.4f, 0.4f};
-    pointLight1.a = 0.2f;
-    pointLight1.b = 0.0f;
-    pointLight1.c = 0.0f;
-    UBOPointLight pointLight2{};
-    pointLight2.pos = glm::vec3{-3.0f, 3.0f, -6.0f};
-    pointLight2.color = glm::vec3{1.0f, 0.4f, 0.4f};
-    pointLight2.a = 0.2f;
-    pointLight2.b = 0.0f;
-    pointLight2.c = 0.0f;
-    UBOPointLight pointLight3{};
-    pointLight3.pos = glm::vec3{3.0f, 3.0f, -6.0f};
-    pointLight3.color = glm::vec3{1.0f, 0.4f, 0.4f};
-    pointLight3.a = 0.2f;
-    pointLight3.b = 0.0f;
-    pointLight3.c = 0.0f;
-    UBOPointLight pointLight4{};
-    pointLight4.pos = glm::vec3{7.0f, 3.0f, -6.0f};
-    pointLight4.color = glm::vec3{1.0f, 0.4f, 0.4f};
-    pointLight4.a = 0.2f;
-    pointLight4.b = 0.0f;
-    pointLight4.c = 0.0f;
-    pointLights.push_back(pointLight1);
-    pointLights.push_back(pointLight2);
-    pointLights.push_back(pointLight3);
-    pointLights.push_back(pointLight4);
+    updateRenderData(deltaTime);
+
+    sampleAnimation(camera, deltaTime);
 
     double x,y;
     m_input.getCursorPos(x,y);
     m_renderer.update(m_renderData.staticTransforms, 
                       m_renderData.animatedTransforms,
-                      bones,
+                      m_animationLOD.getBones(),
                       camera, 
                       m_sun,
-                      pointLights,
+                      m_renderData.pointLights,
                       m_time);
+    markTexturesUsed();
+    uploadRequestedTextures();
 
     m_renderer.render(deltaTime, m_renderMask);
 }
 
 void Application::loadScene() {
+    TRACE_SCOPE("app", "Application::loadScene");
+    // the skybox is kept, since the scene is bound again
+    // whenever cells are streamed in or out
+    getSkybox(m_skybox, m_environmentMap);
     bindRenderData();
-    
-    prt::array<Texture, 6> skybox;
-    getSkybox(skybox);
+    bindScene();
 
-    m_renderer.bindAssets(m_renderData.models,
-                          m_renderData.nModels,
-                          m_renderData.staticModelIDs.data(),
-                          m_renderData.staticModelIDs.size(),
-                          m_renderData.animatedModelIDs.data(),
-                          m_renderData.boneOffsets.data(),
-                          m_renderData.animatedModelIDs.size(),
-                          m_renderData.textures, m_renderData.nTextures,
-                          skybox);
+    TextureManager const & textureManager = m_assetManager.getTextureManager();
+    if (textureManager.getNumDuplicates() > 0) {
+        std::cout << "Deduplicated " << textureManager.getNumDuplicates() << " textures, saving "
+                  << textureManager.getDuplicateBytes() << " bytes" << std::endl;
+    }
+    // the scene is uploaded, so the CPU copies can go
+    m_assetManager.evictAssets();
+}
+
+void Application::reloadChangedAssets() {
+    prt::vector<ModelID> modelIDs;
+    prt::vector<uint32_t> textureIDs;
+    m_assetManager.reloadChangedAssets(modelIDs, textureIDs);
+    if (modelIDs.empty() && textureIDs.empty()) return;
+
+    // re-imported models may have loaded new textures
+    m_assetManager.getModelManager().getModels(m_renderData.models, m_renderData.nModels);
+    m_assetManager.getTextureManager().getTextures(m_renderData.textures, m_renderData.nTextures);
+    m_assetManager.getModelManager().getBoneOffsets(m_renderData.animatedModelIDs.data(),
+                                                    m_renderData.boneOffsets.data(),
+                                                    m_renderData.animatedModelIDs.size());
+    m_animationLOD.bind(m_assetManager.getModelManager(),
+                        m_renderData.animatedModelIDs.data(),
+                        m_renderData.animatedInstances.data(),
+                        m_renderData.boneOffsets.data(),
+                        m_renderData.animatedModelIDs.size());
+
+    for (uint32_t textureID : textureIDs) {
+        m_renderer.updateTexture(textureID, m_renderData.textures[textureID]);
+    }
+
+    bool updated = true;
+    for (ModelID modelID : modelIDs) {
+        updated = updated && m_renderer.updateModel(modelID,
+                                                    m_renderData.models,
+                                                    m_renderData.nModels,
+                                                    m_renderData.staticModelIDs.data(),
+                                                    m_renderData.staticModelIDs.size(),
+                                                    m_renderData.animatedModelIDs.data(),
+                                                    m_renderData.boneOffsets.data(),
+                                                    m_renderData.animatedModelIDs.size());
+    }
+
+    if (!updated) {
+        // the models no longer fit the bound buffers
+        bindScene();
+    }
+    m_assetManager.evictAssets();
+}
+
+void Application::markTexturesUsed() {
+    // textures are evicted in the order they were last drawn in
+    prt::vector<uint32_t> textureIDs;
+    m_renderer.getUsedTextures(textureIDs);
+
+    TextureManager & textureManager = m_assetManager.getTextureManager();
+    for (uint32_t textureID : textureIDs) {
+        textureManager.markUsed(textureID, m_currentFrame);
+    }
+}
+
+void Application::uploadRequestedTextures() {
+    prt::vector<uint32_t> textureIDs;
+    m_renderer.getRequestedTextures(textureIDs);
+    if (textureIDs.empty()) return;
+
+    TextureManager & textureManager = m_assetManager.getTextureManager();
+    for (uint32_t textureID : textureIDs) {
+        // a texture that fails to load is requested again
+        if (!textureManager.makeResident(textureID)) continue;
+        textureManager.markUsed(textureID, m_currentFrame);
+        m_renderer.updateTexture(textureID, textureManager.getTexture(textureID));
+    }
+    m_assetManager.evictAssets();
+}
+
+void Application::makeSceneResident() {
+    // a model that fails to import again stays evicted,
+    // so its instances are dropped rather than bound
+    ModelManager & modelManager = m_assetManager.getModelManager();
+    size_t numStatic = 0;
+    for (size_t i = 0; i < m_renderData.staticModelIDs.size(); ++i) {
+        if (!modelManager.makeResident(m_renderData.staticModelIDs[i], m_currentFrame)) continue;
+        m_renderData.staticModelIDs[numStatic] = m_renderData.staticModelIDs[i];
+        m_renderData.staticTransforms[numStatic] = m_renderData.staticTransforms[i];
+        ++numStatic;
+    }
+
+    size_t numAnimated = 0;
+    for (size_t i = 0; i < m_renderData.animatedModelIDs.size(); ++i) {
+        if (!modelManager.makeResident(m_renderData.animatedModelIDs[i], m_currentFrame)) continue;
+        m_renderData.animatedModelIDs[numAnimated] = m_renderData.animatedModelIDs[i];
+        m_renderData.animatedTransforms[numAnimated] = m_renderData.animatedTransforms[i];
+        m_renderData.animationBlends[numAnimated] = m_renderData.animationBlends[i];
+        m_renderData.animatedInstances[numAnimated] = m_renderData.animatedInstances[i];
+        ++numAnimated;
+    }
+
+    size_t numDropped = m_renderData.staticModelIDs.size() - numStatic + 
+                        m_renderData.animatedModelIDs.size() - numAnimated;
+    if (numDropped == 0) return;
+
+    std::cout << numDropped << " instances are not drawn, their models failed to import" << std::endl;
+    m_renderData.staticModelIDs.resize(numStatic);
+    m_renderData.staticTransforms.resize(numStatic);
+    m_renderData.animatedModelIDs.resize(numAnimated);
+    m_renderData.animatedTransforms.resize(numAnimated);
+    m_renderData.animationBlends.resize(numAnimated);
+    m_renderData.animatedInstances.resize(numAnimated);
+
+    m_renderData.boneOffsets.resize(numAnimated);
+    modelManager.getBoneOffsets(m_renderData.animatedModelIDs.data(),
+                                m_renderData.boneOffsets.data(),
+                                m_renderData.animatedModelIDs.size());
+    m_animationLOD.bind(modelManager,
+                        m_renderData.animatedModelIDs.data(),
+                        m_renderData.animatedInstances.data(),
+                        m_renderData.boneOffsets.data(),
+                        m_renderData.animatedModelIDs.size());
 }
 
 void Application::bindRenderData() {
+    m_worldPartition.clear();
+    if (!loadSceneFile(DEFAULT_SCENE)) {
+        throw std::runtime_error(std::string("failed to load scene: ") + DEFAULT_SCENE);
+    }
+    m_worldPartition.build();
+
+    // everything in reach of the camera is loaded up front
+    m_lastCameraPosition = m_camera.getPosition();
+    m_worldPartition.update(m_lastCameraPosition, glm::vec3(0.0f),
+                            m_assetManager.getModelManager(),
+                            m_currentFrame, SIZE_MAX);
+    m_renderData.animatedInstances.resize(0);
+    collectRenderData();
+}
+
+void Application::collectRenderData() {
+    // instances that stay loaded keep playing where they were
+    for (size_t i = 0; i < m_renderData.animatedInstances.size(); ++i) {
+        m_worldPartition.setBlend(m_renderData.animatedInstances[i],
+                                  m_renderData.animationBlends[i]);
+    }
+
     // clear previous render data
     m_renderData.staticTransforms.resize(0);
     m_renderData.staticModelIDs.resize(0);
     m_renderData.animatedTransforms.resize(0);
     m_renderData.animatedModelIDs.resize(0);
     m_renderData.boneOffsets.resize(0);
+    m_renderData.animationBlends.resize(0);
+    m_renderData.animatedInstances.resize(0);
+
+    prt::vector<uint32_t> instances;
+    m_worldPartition.getLoadedInstances(instances);
+
+    // every instance takes a model matrix in the uniform buffers
+    size_t numDropped = 0;
+    for (uint32_t index : instances) {
+        WorldPartition::Instance const & instance = m_worldPartition.getInstance(index);
+        ModelID modelID = m_worldPartition.getModelID(instance.model);
+        if (m_worldPartition.isAnimated(instance.model)) {
+            if (m_renderData.animatedModelIDs.size() == NUMBER_SUPPORTED_MODEL_MATRICES) {
+                ++numDropped;
+                continue;
+            }
+            m_renderData.animatedModelIDs.push_back(modelID);
+            m_renderData.animatedTransforms.push_back(instance.transform);
+            m_renderData.animationBlends.push_back(instance.blend);
+            m_renderData.animatedInstances.push_back(index);
+        } else {
+            if (m_renderData.staticModelIDs.size() == NUMBER_SUPPORTED_MODEL_MATRICES) {
+                ++numDropped;
+                continue;
+            }
+            m_renderData.staticModelIDs.push_back(modelID);
+            m_renderData.staticTransforms.push_back(instance.transform);
+        }
+    }
+    if (numDropped > 0) {
+        std::cout << numDropped << " instances of the loaded cells are not drawn, only " 
+                  << NUMBER_SUPPORTED_MODEL_MATRICES << " static and " 
+                  << NUMBER_SUPPORTED_MODEL_MATRICES << " animated instances fit" << std::endl;
+    }
 
-    ModelID modelID = m_assetManager.getModelManager().loadModel("bath/bath.obj", false);
-    m_renderData.staticModelIDs.push_back(modelID);
+    m_worldPartition.getLoadedPointLights(m_renderData.pointLights);
 
     m_assetManager.getModelManager().getModels(m_renderData.models, m_renderData.nModels);
 
-    m_renderData.staticTransforms.resize(m_renderData.staticModelIDs.size(), glm::mat4(1.0f));
-    m_renderData.animatedTransforms.resize(m_renderData.animatedModelIDs.size(), glm::mat4(1.0f));
-
     m_renderData.boneOffsets.resize(m_renderData.animatedModelIDs.size());
     m_assetManager.getModelManager().getBoneOffsets(m_renderData.animatedModelIDs.data(),
                                                     m_renderData.boneOffsets.data(),
                                                     m_renderData.animatedModelIDs.size());
+    m_animationLOD.bind(m_assetManager.getModelManager(),
+                        m_renderData.animatedModelIDs.data(),
+                        m_renderData.animatedInstances.data(),
+                        m_renderData.boneOffsets.data(),
+                        m_renderData.animatedModelIDs.size());
 
     m_assetManager.getTextureManager().getTextures(m_renderData.textures, m_renderData.nTextures);
 }
 
-void Application::getSkybox(prt::array<Texture, 6> & cubeMap) const {
+void Application::bindScene() {
+    makeSceneResident();
+
+    m_renderer.bindAssets(m_renderData.models,
+                          m_renderData.nModels,
+                          m_renderData.staticModelIDs.data(),
+                          m_renderData.staticModelIDs.size(),
+                          m_renderData.animatedModelIDs.data(),
+                          m_renderData.boneOffsets.data(),
+                          m_renderData.animatedModelIDs.size(),
+                          m_renderData.textures, m_renderData.nTextures,
+                          m_skybox, m_environmentMap);
+}
+
+bool Application::loadSceneFile(char const * name) {
+    // the compiled scene is loaded in place of its text,
+    // unless the text has been edited since it was compiled
+    char path[256];
+    char binaryPath[256];
+    snprintf(path, sizeof(path), "%sscenes/%s.scene", RESOURCE_PATH, name);
+    snprintf(binaryPath, sizeof(binaryPath), "%sscenes/%s.bscene", RESOURCE_PATH, name);
+    uint64_t textTime;
+    uint64_t binaryTime;
+    bool hasText = io_util::getModificationTime(path, textTime);
+    bool hasBinary = io_util::getModificationTime(binaryPath, binaryTime);
+    if (hasText && hasBinary && binaryTime < textTime) {
+        std::cout << "compiled scene is older than its text, loading the text: " << path << std::endl;
+    }
+
+    SceneFile scene;
+    bool opened = hasBinary && (!hasText || binaryTime >= textTime) && scene.open(binaryPath);
+    if (!opened && !scene.open(path)) {
+        std::cout << "failed to open scene: " << path << std::endl;
+        return false;
+    }
+
+    m_sun.direction = glm::normalize(glm::vec3(-1,-1,1));
+
+    // models are only loaded once a cell using them is,
+    // so clips are resolved by name by the partition
+    uint32_t model = 0;
+    bool animated = false;
+    uint32_t animation = WorldPartition::noAnimation;
+    char str[256];
+    char clipB[256];
+
+    SceneFile::Record record;
+    while (scene.next(record)) {
+        switch (record.type) {
+        case SceneFile::RECORD_TYPE_MODEL:
+            if (!record.path.copy(str, sizeof(str))) {
+                std::cout << "model path too long in scene: " << path << std::endl;
+                return false;
+            }
+            model = m_worldPartition.addModel(str, record.animated);
+            animated = record.animated;
+            animation = WorldPartition::noAnimation;
+            break;
+        case SceneFile::RECORD_TYPE_INSTANCE:
+            m_worldPartition.addInstance(model, record.transform, animation);
+            break;
+        case SceneFile::RECORD_TYPE_ANIMATION:
+            if (!animated) {
+                std::cout << "animation of a static model in scene: " << path << std::endl;
+                break;
+            }
+            if (!record.clipA.copy(str, sizeof(str)) || !record.clipB.copy(clipB, sizeof(clipB))) {
+                std::cout << "animation clip name too long in scene: " << path << std::endl;
+                break;
+            }
+            animation = m_worldPartition.addAnimation(str, clipB, record.blendFactor);
+            break;
+        case SceneFile::RECORD_TYPE_POINT_LIGHT: {
+            UBOPointLight pointLight{};
+            pointLight.pos = record.position;
+            pointLight.color = record.color;
+            pointLight.a = record.a;
+            pointLight.b = record.b;
+            pointLight.c = record.c;
+            m_worldPartition.addPointLight(pointLight);
+            break;
+        }
+        case SceneFile::RECORD_TYPE_SUN:
+            m_sun.direction = glm::normalize(record.direction);
+            break;
+        }
+    }
+    return !scene.failed();
+}
+
+void Application::getSkybox(prt::array<Texture, 6> & cubeMap,
+                            EnvironmentMap & environmentMap) const {
     m_assetManager.loadCubeMap("night", cubeMap);
+    m_assetManager.loadEnvironmentMap("night", cubeMap, environmentMap);
 }
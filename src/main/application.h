@@ -3,6 +3,8 @@
 
 #include "src/graphics/geometry/model_manager.h"
 #include "src/graphics/geometry/asset_manager.h"
+#include "src/graphics/geometry/world_partition.h"
+#include "src/graphics/geometry/animation_lod.h"
 #include "src/graphics/camera.h"
 #include "src/graphics/renderer.h"
 #include "src/graphics/renderer.h"
@@ -20,6 +22,11 @@ struct RenderData {
     prt::vector<glm::mat4> animatedTransforms;
     prt::vector<ModelID>   animatedModelIDs;
     prt::vector<uint32_t>  boneOffsets;
+    prt::vector<BlendedAnimation> animationBlends;
+    // world partition instance of each animated model
+    prt::vector<uint32_t>  animatedInstances;
+
+    prt::vector<UBOPointLight> pointLights;
 };
 
 class Application {
@@ -38,6 +45,12 @@ private:
     Camera m_camera;
 
     AssetManager m_assetManager;
+    WorldPartition m_worldPartition;
+    AnimationLOD m_animationLOD;
+    glm::vec3 m_lastCameraPosition;
+
+    prt::array<Texture, 6> m_skybox;
+    EnvironmentMap m_environmentMap;
 
     uint32_t m_frameRate;
     uint32_t m_microsecondsPerFrame;
@@ -49,17 +62,27 @@ private:
 
     static constexpr int DEFAULT_WIDTH = 800;
     static constexpr int DEFAULT_HEIGHT = 600;
+    static constexpr char const * DEFAULT_SCENE = "bath";
 
     void update(float deltaTime);
     void updateCamera(float deltaTime);
     void updateSun();
-    void updateRenderData();
-    void sampleAnimation(prt::vector<glm::mat4> & bones);
+    void updateRenderData(float deltaTime);
+    void streamWorld(float deltaTime);
+    void sampleAnimation(Camera const & camera, float deltaTime);
     void renderScene(Camera & camera, float deltaTime);
 
     void loadScene();
+    void reloadChangedAssets();
+    void markTexturesUsed();
+    void uploadRequestedTextures();
+    void makeSceneResident();
     void bindRenderData();
-    void getSkybox(prt::array<Texture, 6>& cubeMap) const;
+    void collectRenderData();
+    void bindScene();
+    bool loadSceneFile(char const * name);
+    void getSkybox(prt::array<Texture, 6>& cubeMap,
+                   EnvironmentMap& environmentMap) const;
 };
 
 #endif
\ No newline at end of file
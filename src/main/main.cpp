@@ -1,12 +1,20 @@
 #include "src/main/application.h"
+#include "src/util/trace_util.h"
 
 #include <stdio.h>
 #include <iostream>
+#include <cstdlib>
 
 int main () {
-    Application app;
-
+    // PBR_TRACE=<path> writes a trace of startup to path
+    char const * tracePath = getenv("PBR_TRACE");
+    if (tracePath != nullptr) {
+        trace_util::begin(tracePath);
+    }
     try {
+        // the scene is loaded on construction, which may fail
+        Application app;
+        trace_util::end();
         app.run();
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
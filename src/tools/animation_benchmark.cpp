@@ -0,0 +1,395 @@
+#include "src/graphics/geometry/model_manager.h"
+#include "src/util/io_util.h"
+#include "src/config/config.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+/*
+ * Measures how fast animated instances are posed and checks
+ * their bone transforms against a straightforward reference.
+ * Models are loaded from the model directory, without any,
+ * procedural skeletons of 30, 100 and 300 bones are used.
+ * usage: animation_benchmark [-n instances] [-f frames]
+ *                            [-t tolerance] [model]...
+ **/
+
+/*
+ * Friend of Model, which fills in procedural
+ * models and reads the skeletons of the reference
+ **/
+class AnimationBenchmark {
+public:
+    struct Result {
+        double sampleNanosPerBone = 0.0;
+        double blendNanosPerBone = 0.0;
+        // largest difference from the reference, relative
+        // to the magnitude of the reference
+        float sampleError = 0.0f;
+        float blendError = 0.0f;
+    };
+
+    // instances that are checked against the reference
+    static constexpr uint32_t maxCheckedInstances = 16;
+
+    // seconds between frames
+    static constexpr float frameTime = 1.0f / 60.0f;
+
+    /**
+     * Fills in a model with a random skeleton that is
+     * animated by two clips with unevenly spaced keys
+     * @param model model to fill in, not loaded
+     * @param numBones number of bones
+     * @param seed random seed
+     */
+    static void generate(Model & model, uint32_t numBones, uint32_t seed);
+
+    /**
+     * @return true if the model has a clip to pose it with
+     */
+    static bool isAnimated(Model const & model) {
+        return model.isloaded() && model.isAnimated() && !model.animations.empty();
+    }
+
+    /**
+     * Poses instances of a model, each instance at its own time
+     * @param model animated model
+     * @param numInstances number of instances
+     * @param numFrames frames to pose every instance in
+     * @return time per bone and error against the reference
+     */
+    static Result run(Model const & model, uint32_t numInstances, uint32_t numFrames);
+
+private:
+    /**
+     * @param model animated model
+     * @param clipA clip that is sampled, and blended
+     * @param clipB clip that clipA is blended with
+     */
+    static void getClips(Model const & model, uint32_t & clipA, uint32_t & clipB);
+
+    static float getInstanceTime(uint32_t instance, uint32_t frame) {
+        return frame * frameTime + instance * 0.37f;
+    }
+
+    /**
+     * Samples a channel the slow way, with a linear search for
+     * the keys and a spherical interpolation of the rotation
+     */
+    static TRS sampleReference(AnimationClip const & clip, uint32_t channel, float t);
+
+    /**
+     * Computes bone transforms the slow way, walking up the
+     * hierarchy from every bone
+     * @param model animated model
+     * @param clipA clip at blend factor 0
+     * @param clipB clip at blend factor 1
+     * @param factor blend factor
+     * @param t time in seconds
+     * @param transforms bone transforms, one per bone
+     */
+    static void poseReference(Model const & model, uint32_t clipA, uint32_t clipB,
+                              float factor, float t, glm::mat4 * transforms);
+
+    /**
+     * @return largest difference relative to the magnitude of b
+     */
+    static float compare(glm::mat4 const * a, glm::mat4 const * b, size_t n);
+};
+
+void AnimationBenchmark::generate(Model & model, uint32_t numBones, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    auto randomAxis = [&]() {
+        glm::vec3 axis{ unit(random), unit(random), unit(random) };
+        return glm::length(axis) > 1e-3f ? glm::normalize(axis) : glm::vec3{ 0.0f, 1.0f, 0.0f };
+    };
+
+    // a random tree, where every node is attached to one
+    // that came before it, is shallow like real skeletons
+    Model::Skeleton & skeleton = model.mSkeleton;
+    skeleton.parents.resize(numBones);
+    skeleton.localTransforms.resize(numBones);
+    skeleton.boneNodes.resize(numBones);
+    prt::vector<bool> hasChildren;
+    hasChildren.resize(numBones, false);
+    for (uint32_t i = 0; i < numBones; ++i) {
+        skeleton.parents[i] = i == 0 ? 0 : std::uniform_int_distribution<uint32_t>(1, i)(random);
+        if (skeleton.parents[i] != 0) hasChildren[skeleton.parents[i] - 1] = true;
+        skeleton.localTransforms[i] = glm::translate(glm::mat4(1.0f), 0.1f * randomAxis()) *
+                                      glm::mat4_cast(glm::angleAxis(unit(random), randomAxis()));
+        skeleton.boneNodes[i] = i + 1;
+    }
+
+    // every node is animated, those with children first
+    skeleton.channelNodes.resize(0);
+    for (bool leaves : { false, true }) {
+        for (uint32_t i = 0; i < numBones; ++i) {
+            if (hasChildren[i] == leaves) continue;
+            skeleton.channelNodes.push_back(i + 1);
+        }
+        if (!leaves) {
+            skeleton.numInnerChannels = skeleton.channelNodes.size();
+        }
+    }
+
+    prt::vector<glm::mat4> nodeTransforms;
+    nodeTransforms.resize(numBones + 1);
+    nodeTransforms[0] = glm::mat4(1.0f);
+    for (uint32_t i = 0; i < numBones; ++i) {
+        nodeTransforms[i + 1] = nodeTransforms[skeleton.parents[i]] * skeleton.localTransforms[i];
+    }
+    model.bones.resize(numBones);
+    for (uint32_t i = 0; i < numBones; ++i) {
+        model.bones[i].offsetMatrix = glm::inverse(nodeTransforms[i + 1]);
+        model.bones[i].meshTransform = glm::mat4(1.0f);
+    }
+    model.mGlobalInverseTransform = glm::mat4(1.0f);
+
+    // keys wander away from the bind pose in small steps
+    uint32_t numChannels = skeleton.channelNodes.size();
+    model.animations.resize(2);
+    for (uint32_t a = 0; a < model.animations.size(); ++a) {
+        uint32_t numKeys = std::uniform_int_distribution<uint32_t>(8, 64)(random);
+        prt::vector<float> keyTimes;
+        keyTimes.push_back(0.0f);
+        for (uint32_t k = 1; k < numKeys; ++k) {
+            keyTimes.push_back(std::uniform_real_distribution<float>(0.01f, 0.99f)(random));
+        }
+        std::sort(keyTimes.begin(), keyTimes.end());
+        for (uint32_t k = 1; k < numKeys; ++k) {
+            keyTimes[k] = std::max(keyTimes[k], keyTimes[k - 1] + 1e-4f);
+        }
+
+        prt::vector<TRS> keys;
+        keys.resize(size_t(numKeys) * numChannels);
+        for (uint32_t c = 0; c < numChannels; ++c) {
+            TRS trs = TRS::fromMatrix(skeleton.localTransforms[skeleton.channelNodes[c] - 1]);
+            for (uint32_t k = 0; k < numKeys; ++k) {
+                trs.rotation = glm::normalize(glm::angleAxis(0.2f * unit(random), randomAxis()) * trs.rotation);
+                trs.translation += 0.01f * glm::vec3{ unit(random), unit(random), unit(random) };
+                keys[k * numChannels + c] = trs;
+            }
+        }
+
+        prt::vector<uint32_t> keptKeys;
+        keptKeys.resize(numKeys);
+        for (uint32_t k = 0; k < numKeys; ++k) {
+            keptKeys[k] = k;
+        }
+        model.animations[a].compress(60.0f, 30.0, numChannels, keys.data(), keyTimes.data(),
+                                     numKeys, keptKeys);
+    }
+
+    model.mAnimated = true;
+    model.mLoaded = true;
+}
+
+void AnimationBenchmark::getClips(Model const & model, uint32_t & clipA, uint32_t & clipB) {
+    clipA = 0;
+    clipB = model.animations.size() > 1 ? 1 : 0;
+}
+
+AnimationBenchmark::Result AnimationBenchmark::run(Model const & model, uint32_t numInstances,
+                                                   uint32_t numFrames) {
+    using clock = std::chrono::steady_clock;
+
+    Result result;
+    uint32_t clipA, clipB;
+    getClips(model, clipA, clipB);
+    size_t numBones = model.getNumBones();
+    size_t numChannels = model.getNumChannels();
+    double numPosedBones = double(numBones) * numInstances * numFrames;
+
+    Model::PoseScratch scratch;
+    model.reservePoseScratch(scratch);
+    prt::vector<TRS> poseB;
+    poseB.resize(numChannels);
+    prt::vector<glm::mat4> transforms;
+    transforms.resize(numBones * numInstances);
+    prt::vector<uint32_t> keyCursors;
+    keyCursors.resize(2 * numInstances, 0);
+
+    // posed as ModelManager poses one layer, and
+    // as it blends two layers with key cursors
+    auto sample = [&](uint32_t instance, float t) {
+        model.sampleAnimation(t, clipA, scratch, transforms.data() + instance * numBones);
+    };
+    auto blend = [&](uint32_t instance, float t) {
+        model.samplePose(t, clipA, scratch.pose.data(), false, &keyCursors[2 * instance]);
+        model.samplePose(t, clipB, poseB.data(), false, &keyCursors[2 * instance + 1]);
+        animation_util::blendPoses(scratch.pose.data(), poseB.data(), 0.5f, scratch.pose.data(), numChannels);
+        model.poseBones(scratch.pose.data(), false, scratch, transforms.data() + instance * numBones);
+    };
+
+    auto start = clock::now();
+    for (uint32_t f = 0; f < numFrames; ++f) {
+        for (uint32_t i = 0; i < numInstances; ++i) {
+            sample(i, getInstanceTime(i, f));
+        }
+    }
+    result.sampleNanosPerBone = std::chrono::duration<double, std::nano>(clock::now() - start).count() /
+                                numPosedBones;
+
+    start = clock::now();
+    for (uint32_t f = 0; f < numFrames; ++f) {
+        for (uint32_t i = 0; i < numInstances; ++i) {
+            blend(i, getInstanceTime(i, f));
+        }
+    }
+    result.blendNanosPerBone = std::chrono::duration<double, std::nano>(clock::now() - start).count() /
+                               numPosedBones;
+
+    // checked over the same frames again, so
+    // that the key cursors play forward
+    prt::vector<glm::mat4> reference;
+    reference.resize(numBones);
+    std::fill(keyCursors.begin(), keyCursors.end(), 0);
+    uint32_t numChecked = std::min(numInstances, maxCheckedInstances);
+    for (uint32_t f = 0; f < numFrames; ++f) {
+        for (uint32_t i = 0; i < numChecked; ++i) {
+            float t = getInstanceTime(i, f);
+            glm::mat4 const * posed = transforms.data() + i * numBones;
+
+            sample(i, t);
+            poseReference(model, clipA, clipA, 0.0f, t, reference.data());
+            result.sampleError = std::max(result.sampleError, compare(posed, reference.data(), numBones));
+
+            blend(i, t);
+            poseReference(model, clipA, clipB, 0.5f, t, reference.data());
+            result.blendError = std::max(result.blendError, compare(posed, reference.data(), numBones));
+        }
+    }
+    return result;
+}
+
+TRS AnimationBenchmark::sampleReference(AnimationClip const & clip, uint32_t channel, float t) {
+    uint32_t numKeys = clip.getNumKeys();
+    float clipTime = t / clip.getDuration();
+    clipTime -= std::floor(clipTime);
+    uint32_t prevKey = 0;
+    while (prevKey + 1 < numKeys && clip.getKeyTime(prevKey + 1) <= clipTime) {
+        ++prevKey;
+    }
+    uint32_t nextKey = prevKey + 1 < numKeys ? prevKey + 1 : 0;
+    float nextTime = prevKey + 1 < numKeys ? clip.getKeyTime(nextKey) : 1.0f;
+    float factor = (clipTime - clip.getKeyTime(prevKey)) / (nextTime - clip.getKeyTime(prevKey));
+
+    TRS a = clip.getKey(channel, prevKey);
+    TRS b = clip.getKey(channel, nextKey);
+    TRS trs;
+    trs.translation = glm::mix(a.translation, b.translation, factor);
+    trs.rotation = glm::slerp(a.rotation, b.rotation, factor);
+    trs.scale = glm::mix(a.scale, b.scale, factor);
+    return trs;
+}
+
+void AnimationBenchmark::poseReference(Model const & model, uint32_t clipA, uint32_t clipB,
+                                       float factor, float t, glm::mat4 * transforms) {
+    Model::Skeleton const & skeleton = model.mSkeleton;
+    prt::vector<glm::mat4> localTransforms;
+    localTransforms.resize(skeleton.getNumNodes() + 1);
+    localTransforms[0] = glm::mat4(1.0f);
+    for (size_t i = 0; i < skeleton.getNumNodes(); ++i) {
+        localTransforms[i + 1] = skeleton.localTransforms[i];
+    }
+    for (uint32_t c = 0; c < skeleton.channelNodes.size(); ++c) {
+        TRS a = sampleReference(model.animations[clipA], c, t);
+        TRS b = sampleReference(model.animations[clipB], c, t);
+        glm::quat rotationB = glm::dot(a.rotation, b.rotation) < 0.0f ? -b.rotation : b.rotation;
+        TRS trs;
+        trs.translation = glm::mix(a.translation, b.translation, factor);
+        trs.rotation = glm::slerp(a.rotation, rotationB, factor);
+        trs.scale = glm::mix(a.scale, b.scale, factor);
+        localTransforms[skeleton.channelNodes[c]] = trs.toMatrix();
+    }
+
+    for (size_t i = 0; i < model.getNumBones(); ++i) {
+        uint32_t node = skeleton.boneNodes[i];
+        glm::mat4 transform = localTransforms[node];
+        for (uint32_t parent = skeleton.parents[node - 1]; parent != 0; parent = skeleton.parents[parent - 1]) {
+            transform = localTransforms[parent] * transform;
+        }
+        transforms[i] = transform * model.bones[i].offsetMatrix;
+    }
+}
+
+float AnimationBenchmark::compare(glm::mat4 const * a, glm::mat4 const * b, size_t n) {
+    float error = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        for (int col = 0; col < 4; ++col) {
+            for (int row = 0; row < 4; ++row) {
+                float difference = std::fabs(a[i][col][row] - b[i][col][row]);
+                error = std::max(error, difference / std::max(std::fabs(b[i][col][row]), 1.0f));
+            }
+        }
+    }
+    return error;
+}
+
+int main(int argc, char ** argv) {
+    uint32_t numInstances = 100;
+    uint32_t numFrames = 100;
+    float tolerance = 1e-3f;
+    prt::vector<char const *> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+            numInstances = std::max(atoi(argv[++i]), 1);
+        } else if (i + 1 < argc && strcmp(argv[i], "-f") == 0) {
+            numFrames = std::max(atoi(argv[++i]), 1);
+        } else if (i + 1 < argc && strcmp(argv[i], "-t") == 0) {
+            tolerance = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            std::cerr << "usage: " << argv[0] << " [-n instances] [-f frames] [-t tolerance] [model]..." << std::endl;
+            return EXIT_FAILURE;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    bool passed = true;
+    auto report = [&](char const * name, Model const & model) {
+        AnimationBenchmark::Result result = AnimationBenchmark::run(model, numInstances, numFrames);
+        bool fits = result.sampleError <= tolerance && result.blendError <= tolerance;
+        passed = passed && fits;
+        std::cout << name << ": " << model.getNumBones() << " bones, "
+                  << numInstances << " instances, " << numFrames << " frames\n"
+                  << "    sample: " << result.sampleNanosPerBone << " ns/bone, error " << result.sampleError << "\n"
+                  << "    blend:  " << result.blendNanosPerBone << " ns/bone, error " << result.blendError
+                  << (fits ? "" : " FAILED") << std::endl;
+    };
+
+    if (paths.empty()) {
+        for (uint32_t numBones : { 30u, 100u, 300u }) {
+            char name[64];
+            snprintf(name, sizeof(name), "procedural_%u", numBones);
+            Model model(name);
+            AnimationBenchmark::generate(model, numBones, numBones);
+            report(name, model);
+        }
+    } else {
+        AssetArchive archive;
+        io_util::createDirectory(ASSET_CACHE_PATH);
+        TextureManager textureManager(RESOURCE_PATH "textures/", ASSET_CACHE_PATH, archive);
+        ModelManager modelManager(RESOURCE_PATH "models/", ASSET_CACHE_PATH, textureManager, archive);
+        for (char const * path : paths) {
+            ModelID id = modelManager.loadModel(path, true);
+            if (id == -1 || !AnimationBenchmark::isAnimated(modelManager.getModel(id))) {
+                std::cerr << "not an animated model: " << path << std::endl;
+                passed = false;
+                continue;
+            }
+            report(path, modelManager.getModel(id));
+        }
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
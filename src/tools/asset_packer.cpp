@@ -0,0 +1,61 @@
+#include "src/util/asset_archive.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+/*
+ * Packs every file in the given subdirectories of a
+ * resource directory into an asset archive.
+ * usage: asset_packer <resource directory> <archive> <subdirectory>...
+ **/
+
+namespace {
+    void listFiles(char const * root, std::string const & directory,
+                   prt::vector<std::string> & names) {
+        DIR * dir = opendir((std::string(root) + directory).c_str());
+        if (dir == nullptr) {
+            std::cout << "failed to open directory: " << root << directory << std::endl;
+            return;
+        }
+
+        while (dirent * entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') continue;
+
+            std::string name = directory + "/" + entry->d_name;
+            if (entry->d_type == DT_DIR) {
+                listFiles(root, name, names);
+            } else if (entry->d_type == DT_REG) {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0] << " <resource directory> <archive> <subdirectory>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    char const * root = argv[1];
+    char const * archive = argv[2];
+
+    prt::vector<std::string> names;
+    for (int i = 3; i < argc; ++i) {
+        listFiles(root, argv[i], names);
+    }
+    // keep files of the same directory next to each other
+    std::sort(names.begin(), names.end());
+
+    if (!AssetArchive::pack(archive, root, names)) {
+        std::cerr << "failed to write archive: " << archive << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "packed " << names.size() << " files into " << archive << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#include "src/util/scene_file.h"
+
+#include <iostream>
+
+/*
+ * Compiles a text scene to the binary form read at
+ * load time, see SceneFile.
+ * usage: scene_compiler <text scene> <binary scene>
+ **/
+
+int main(int argc, char ** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <text scene> <binary scene>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!SceneFile::compile(argv[1], argv[2])) {
+        std::cerr << "failed to compile scene: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "compiled " << argv[1] << " into " << argv[2] << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+#include "asset_archive.h"
+
+#include "src/util/hash_util.h"
+#include "src/util/io_util.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+AssetArchive::AssetArchive()
+    : m_data(nullptr), m_size(0), m_entries(nullptr),
+      m_numEntries(0), m_names(nullptr), m_root{}, m_rootLength(0) {}
+
+AssetArchive::~AssetArchive() {
+    close();
+}
+
+bool AssetArchive::open(char const * path, char const * root) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+
+    void * mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    m_data = static_cast<char const *>(mapped);
+    m_size = st.st_size;
+
+    Header const & header = *reinterpret_cast<Header const *>(m_data);
+    bool valid = header.magic == magic &&
+                 header.version == version &&
+                 header.archiveSize == m_size &&
+                 header.entriesOffset % alignof(Entry) == 0 &&
+                 // compared without summing, which could overflow
+                 header.entriesOffset <= m_size &&
+                 header.numEntries <= (m_size - header.entriesOffset) / sizeof(Entry) &&
+                 header.namesOffset <= m_size &&
+                 header.namesSize <= m_size - header.namesOffset;
+    if (!valid) {
+        std::cout << "invalid asset archive: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    m_entries = reinterpret_cast<Entry const *>(m_data + header.entriesOffset);
+    m_numEntries = header.numEntries;
+    m_names = m_data + header.namesOffset;
+    for (size_t i = 0; i < m_numEntries; ++i) {
+        Entry const & entry = m_entries[i];
+        if (entry.offset > m_size || entry.size > m_size - entry.offset ||
+            entry.nameOffset > header.namesSize || 
+            entry.nameLength > header.namesSize - entry.nameOffset) {
+            std::cout << "invalid asset archive: " << path << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    strcpy(m_root, root);
+    m_rootLength = strlen(m_root);
+    return true;
+}
+
+void AssetArchive::close() {
+    if (m_data != nullptr) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_entries = nullptr;
+    m_numEntries = 0;
+    m_names = nullptr;
+}
+
+bool AssetArchive::find(char const * path, char const * & data, size_t & size) const {
+    if (m_data == nullptr || strncmp(path, m_root, m_rootLength) != 0) return false;
+
+    char const * name = path + m_rootLength;
+    size_t nameLength = strlen(name);
+    uint64_t nameHash = hash_util::hash64(name, nameLength);
+
+    Entry const * end = m_entries + m_numEntries;
+    Entry const * it = std::lower_bound(m_entries, end, nameHash,
+                                        [](Entry const & entry, uint64_t hash) {
+                                            return entry.nameHash < hash;
+                                        });
+    for (; it != end && it->nameHash == nameHash; ++it) {
+        if (it->nameLength == nameLength &&
+            memcmp(m_names + it->nameOffset, name, nameLength) == 0) {
+            data = m_data + it->offset;
+            size = it->size;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AssetArchive::hashFile(char const * path, uint64_t & hash, uint64_t seed) const {
+    char const * data;
+    size_t size;
+    if (find(path, data, size)) {
+        hash = hash_util::hashContents(data, size, seed);
+        return true;
+    }
+    return hash_util::hashFile(path, hash, seed);
+}
+
+void AssetArchive::prefetch() const {
+    if (m_data != nullptr) {
+        madvise(const_cast<char *>(m_data), m_size, MADV_WILLNEED);
+    }
+}
+
+bool AssetArchive::pack(char const * path, char const * root,
+                        prt::vector<std::string> const & names) {
+    size_t const n = names.size();
+
+    prt::vector<Entry> entries;
+    entries.resize(n);
+    prt::vector<char> nameData;
+    for (size_t i = 0; i < n; ++i) {
+        entries[i].nameHash = hash_util::hash64(names[i].c_str(), names[i].size());
+        entries[i].nameOffset = nameData.size();
+        entries[i].nameLength = names[i].size();
+        nameData.resize(nameData.size() + names[i].size());
+        memcpy(&nameData[entries[i].nameOffset], names[i].c_str(), names[i].size());
+    }
+
+    Header header = {};
+    header.magic = magic;
+    header.version = version;
+    header.numEntries = n;
+    header.entriesOffset = sizeof(Header);
+    header.namesOffset = header.entriesOffset + n * sizeof(Entry);
+    header.namesSize = nameData.size();
+
+    // file data follows the names, in the given order so
+    // related files can be read sequentially
+    prt::vector<char> fileData;
+    size_t offset = header.namesOffset + header.namesSize;
+    std::string fullPath;
+    for (size_t i = 0; i < n; ++i) {
+        fullPath = std::string(root) + names[i];
+        if (!io_util::readFile(fullPath.c_str(), fileData)) {
+            std::cout << "failed to read: " << fullPath << std::endl;
+            return false;
+        }
+        offset = (offset + dataAlignment - 1) / dataAlignment * dataAlignment;
+        entries[i].offset = offset;
+        entries[i].size = fileData.size();
+        offset += fileData.size();
+    }
+    header.archiveSize = offset;
+
+    std::sort(entries.begin(), entries.end(),
+              [](Entry const & a, Entry const & b) { return a.nameHash < b.nameHash; });
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(entries.data()), n * sizeof(Entry));
+    file.write(nameData.data(), nameData.size());
+
+    // the files are read a second time to avoid
+    // holding the whole archive in memory
+    static char const padding[dataAlignment] = {};
+    size_t written = header.namesOffset + header.namesSize;
+    for (size_t i = 0; i < n; ++i) {
+        fullPath = std::string(root) + names[i];
+        if (!io_util::readFile(fullPath.c_str(), fileData)) return false;
+        size_t aligned = (written + dataAlignment - 1) / dataAlignment * dataAlignment;
+        file.write(padding, aligned - written);
+        file.write(fileData.data(), fileData.size());
+        written = aligned + fileData.size();
+    }
+
+    return file.good();
+}
@@ -0,0 +1,111 @@
+#ifndef ASSET_ARCHIVE_H
+#define ASSET_ARCHIVE_H
+
+#include "src/container/vector.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+ * Read-only archive packing many asset files into one
+ * memory mapped file. Files are looked up by name through
+ * a table of contents sorted by name hash, and are read
+ * in place without any per-file open or stat.
+ *
+ * Layout:
+ *  Header
+ *  Entry[numEntries], sorted by nameHash
+ *  names, not null terminated
+ *  file data, every file aligned to dataAlignment
+ **/
+class AssetArchive {
+public:
+    static constexpr uint32_t magic = 0x43524150; // "PARC"
+    static constexpr uint32_t version = 1;
+    static constexpr size_t dataAlignment = 64;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t numEntries;
+        uint64_t entriesOffset;
+        uint64_t namesOffset;
+        uint64_t namesSize;
+        uint64_t archiveSize;
+        uint64_t reserved[2];
+    };
+
+    struct Entry {
+        uint64_t nameHash;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    AssetArchive();
+    ~AssetArchive();
+
+    AssetArchive(AssetArchive const &) = delete;
+    AssetArchive & operator=(AssetArchive const &) = delete;
+
+    /**
+     * Maps an archive into memory
+     * @param path path of the archive
+     * @param root directory the archived names are
+     *             relative to, used to look up full paths
+     * @return true if the archive could be mapped
+     */
+    bool open(char const * path, char const * root);
+
+    void close();
+
+    inline bool isOpen() const { return m_data != nullptr; }
+
+    /**
+     * Finds an archived file
+     * @param path full path of the file, starting with root
+     * @param data start of the file contents
+     * @param size size of the file
+     * @return true if the file is in the archive
+     */
+    bool find(char const * path, char const * & data, size_t & size) const;
+
+    /**
+     * Hashes a file the same way as hash_util::hashFile,
+     * reading it from the archive if it is archived and
+     * from disk otherwise
+     * @param path full path of the file
+     * @param hash hash of the file contents
+     * @param seed hash seed
+     * @return true if the file could be read
+     */
+    bool hashFile(char const * path, uint64_t & hash, uint64_t seed = 0) const;
+
+    /**
+     * Hints the OS to read the whole archive ahead of use
+     */
+    void prefetch() const;
+
+    /**
+     * Packs files into an archive
+     * @param path path of the archive to write
+     * @param root directory the names are relative to
+     * @param names names of the files to pack
+     * @return true if the archive was written
+     */
+    static bool pack(char const * path, char const * root,
+                     prt::vector<std::string> const & names);
+
+private:
+    char const * m_data;
+    size_t m_size;
+    Entry const * m_entries;
+    size_t m_numEntries;
+    char const * m_names;
+    char m_root[256];
+    size_t m_rootLength;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#include "file_watcher.h"
+
+#include <sys/inotify.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+
+namespace {
+    // saving in place closes the file after writing, while
+    // most editors save to a temporary file and rename it
+    constexpr uint32_t fileEvents = IN_CLOSE_WRITE | IN_MOVED_TO;
+    constexpr uint32_t directoryEvents = IN_CREATE | IN_ONLYDIR;
+}
+
+FileWatcher::FileWatcher()
+    : m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+    if (m_fd == -1) {
+        std::cout << "failed to initialize inotify" << std::endl;
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool FileWatcher::watchDirectory(char const * directory) {
+    if (m_fd == -1) return false;
+
+    std::string path = directory;
+    if (!addWatch(path)) return false;
+
+    DIR * dir = opendir(directory);
+    if (dir == nullptr) return false;
+
+    while (dirent * entry = readdir(dir)) {
+        if (entry->d_type != DT_DIR || entry->d_name[0] == '.') continue;
+        watchDirectory((path + entry->d_name + "/").c_str());
+    }
+    closedir(dir);
+    return true;
+}
+
+void FileWatcher::poll(prt::vector<std::string> & changedFiles) {
+    changedFiles.resize(0);
+    if (m_fd == -1) return;
+
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            if (length == -1 && errno != EAGAIN) {
+                std::cout << "failed to read inotify events" << std::endl;
+            }
+            return;
+        }
+
+        for (char * ptr = buffer; ptr < buffer + length; 
+             ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len) {
+            inotify_event const & event = *reinterpret_cast<inotify_event*>(ptr);
+            if (event.len == 0) continue;
+
+            std::string const * directory = getDirectory(event.wd);
+            if (directory == nullptr) continue;
+
+            std::string path = *directory + event.name;
+            if (event.mask & IN_ISDIR) {
+                if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                    watchDirectory((path + "/").c_str());
+                }
+                continue;
+            }
+            if (!(event.mask & fileEvents)) continue;
+
+            bool listed = false;
+            for (auto const & file : changedFiles) {
+                listed = listed || file == path;
+            }
+            if (!listed) {
+                changedFiles.push_back(path);
+            }
+        }
+    }
+}
+
+bool FileWatcher::addWatch(std::string const & directory) {
+    int watch = inotify_add_watch(m_fd, directory.c_str(), fileEvents | directoryEvents);
+    if (watch == -1) {
+        std::cout << "failed to watch directory: " << directory << std::endl;
+        return false;
+    }
+
+    // inotify returns the same descriptor when
+    // a directory is watched twice
+    if (getDirectory(watch) == nullptr) {
+        m_watches.push_back(watch);
+        m_directories.push_back(directory);
+    }
+    return true;
+}
+
+std::string const * FileWatcher::getDirectory(int watch) const {
+    for (size_t i = 0; i < m_watches.size(); ++i) {
+        if (m_watches[i] == watch) return &m_directories[i];
+    }
+    return nullptr;
+}
@@ -0,0 +1,46 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include "src/container/vector.h"
+
+#include <string>
+
+/*
+ * Watches directory trees for files that have been
+ * written to, using inotify. Polling never blocks.
+ **/
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(FileWatcher const &) = delete;
+    FileWatcher & operator=(FileWatcher const &) = delete;
+
+    /**
+     * Watches a directory and every directory in it,
+     * including directories created later
+     * @param directory path of the directory, ending with '/'
+     * @return true if the directory could be watched
+     */
+    bool watchDirectory(char const * directory);
+
+    /**
+     * Collects the files that have been written to or
+     * moved into a watched directory since the last poll
+     * @param changedFiles full paths of the changed
+     *                     files, each listed once
+     */
+    void poll(prt::vector<std::string> & changedFiles);
+
+private:
+    int m_fd;
+    // watch descriptors and the paths they watch
+    prt::vector<int> m_watches;
+    prt::vector<std::string> m_directories;
+
+    bool addWatch(std::string const & directory);
+    std::string const * getDirectory(int watch) const;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#include "hash_util.h"
+
+#include <fstream>
+#include <cstring>
+
+uint64_t hash_util::hash64(void const * data, size_t size, uint64_t seed) {
+    static constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+    static constexpr int r = 47;
+
+    uint64_t h = seed ^ (size * m);
+
+    unsigned char const * bytes = static_cast<unsigned char const *>(data);
+    unsigned char const * end = bytes + (size / 8) * 8;
+    while (bytes != end) {
+        uint64_t k;
+        memcpy(&k, bytes, sizeof(k));
+        bytes += 8;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (size & 7) {
+    case 7: h ^= uint64_t(bytes[6]) << 48; [[fallthrough]];
+    case 6: h ^= uint64_t(bytes[5]) << 40; [[fallthrough]];
+    case 5: h ^= uint64_t(bytes[4]) << 32; [[fallthrough]];
+    case 4: h ^= uint64_t(bytes[3]) << 24; [[fallthrough]];
+    case 3: h ^= uint64_t(bytes[2]) << 16; [[fallthrough]];
+    case 2: h ^= uint64_t(bytes[1]) << 8; [[fallthrough]];
+    case 1: h ^= uint64_t(bytes[0]);
+            h *= m;
+    };
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+namespace {
+    // files are hashed in chunks, chaining through the seed
+    constexpr size_t chunkSize = 1 << 16;
+}
+
+uint64_t hash_util::hashContents(void const * data, size_t size, uint64_t seed) {
+    char const * bytes = static_cast<char const *>(data);
+    uint64_t hash = seed;
+    size_t remaining = size;
+    do {
+        size_t n = remaining < chunkSize ? remaining : chunkSize;
+        hash = hash64(bytes, n, hash);
+        bytes += n;
+        remaining -= n;
+    } while (remaining > 0);
+    return hash;
+}
+
+bool hash_util::hashFile(char const * path, uint64_t & hash, uint64_t seed) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) return false;
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    char buffer[chunkSize];
+    hash = seed;
+    size_t remaining = fileSize;
+    do {
+        size_t n = remaining < chunkSize ? remaining : chunkSize;
+        file.read(buffer, n);
+        if (!file) return false;
+        hash = hash64(buffer, n, hash);
+        remaining -= n;
+    } while (remaining > 0);
+
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef HASH_UTIL_H
+#define HASH_UTIL_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace hash_util {
+    /**
+     * Computes a 64 bit hash of a byte range
+     * (MurmurHash64A)
+     * @param data bytes to hash
+     * @param size number of bytes
+     * @param seed hash seed, may be used to chain hashes
+     * @return hash value
+     */
+    uint64_t hash64(void const * data, size_t size, uint64_t seed = 0);
+
+    /**
+     * Hashes a byte range in fixed size chunks, giving
+     * the same result as hashing a file with the same
+     * contents through hashFile
+     * @param data bytes to hash
+     * @param size number of bytes
+     * @param seed hash seed
+     * @return hash value
+     */
+    uint64_t hashContents(void const * data, size_t size, uint64_t seed = 0);
+
+    /**
+     * Hashes the contents of a file
+     * @param path path of the file
+     * @param hash hash of the file contents
+     * @param seed hash seed
+     * @return true if the file could be read
+     */
+    bool hashFile(char const * path, uint64_t & hash, uint64_t seed = 0);
+
+    /**
+     * Combines a value into a hash
+     * @param hash hash to combine into
+     * @param value value to combine
+     */
+    template<typename T>
+    inline void combine(uint64_t & hash, T const & value) {
+        hash = hash64(&value, sizeof(T), hash);
+    }
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "io_util.h"
 
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
 prt::vector<char> io_util::readFile(const std::string& filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
     if (!file.is_open()) {
@@ -17,11 +22,48 @@ prt::vector<char> io_util::readFile(const std::string& filename) {
     return buffer;
 }
 
+bool io_util::readFile(char const * path, prt::vector<char> & buffer) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) return false;
+
+    size_t fileSize = (size_t) file.tellg();
+    buffer.resize(fileSize);
+
+    file.seekg(0);
+    file.read(buffer.data(), fileSize);
+    return file.good();
+}
+
 bool io_util::is_file_exist(char const * fileName) {
     std::ifstream infile(fileName);
     return infile.good();
 }
 
+void io_util::prefetchFile(char const * path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+bool io_util::writeFile(char const * path, void const * data, size_t size) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+    file.write(static_cast<char const *>(data), size);
+    return file.good();
+}
+
+bool io_util::createDirectory(char const * path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool io_util::getModificationTime(char const * path, uint64_t & time) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    time = uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec);
+    return true;
+}
+
 static constexpr size_t MAX_FILENAME_LEN = 512;
 static constexpr size_t ABSOLUTE_NAME_START = 1; // Perhaps should be 3 for windos systems
 #define SLASH '/' // Perhaps should be '\\' for windows systems
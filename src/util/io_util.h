@@ -3,16 +3,136 @@
 
 #include "src/container/vector.h"
 #include <fstream>
+#include <cstring>
+#include <cstdint>
 
 namespace io_util {
     prt::vector<char> readFile(const std::string& filename);
 
+    /**
+     * Reads a whole file
+     * @param path path of the file
+     * @param buffer file contents
+     * @return true if the file could be read
+     */
+    bool readFile(char const * path, prt::vector<char> & buffer);
+
     bool is_file_exist(char const * file);
 
+    /**
+     * Hints the OS to start reading a file into the page
+     * cache in the background. Returns without waiting
+     * @param path path of the file
+     */
+    void prefetchFile(char const * path);
+
     /*
      * Make sure dest can hold 512 bytes + null terminator
      **/
     void getRelativePath(char const * base, char const * absolute, char * relative);
+
+    /**
+     * Writes a buffer to a file, replacing its contents
+     * @param path path of the file
+     * @param data data to write
+     * @param size number of bytes
+     * @return true if the file was written
+     */
+    bool writeFile(char const * path, void const * data, size_t size);
+
+    /**
+     * Creates a directory if it doesn't already exist
+     * @param path path of the directory
+     * @return true if the directory exists
+     */
+    bool createDirectory(char const * path);
+
+    /**
+     * @param path path of the file
+     * @param time time the file was last modified,
+     *             in nanoseconds since the epoch
+     * @return true if the file exists
+     */
+    bool getModificationTime(char const * path, uint64_t & time);
+
+    /*
+     * Appends trivially copyable values and arrays 
+     * to a byte buffer
+     **/
+    class BinaryWriter {
+    public:
+        BinaryWriter(prt::vector<char> & buffer) : m_buffer(buffer) {}
+
+        template<typename T>
+        void write(T const & value) { writeBytes(&value, sizeof(T)); }
+
+        template<typename T>
+        void writeArray(T const * data, size_t n) {
+            write(uint64_t(n));
+            writeBytes(data, n * sizeof(T));
+        }
+
+        template<typename T>
+        void writeVector(prt::vector<T> const & vector) { writeArray(vector.data(), vector.size()); }
+
+        void writeString(char const * str) { writeArray(str, strlen(str)); }
+
+    private:
+        void writeBytes(void const * data, size_t size) {
+            size_t offset = m_buffer.size();
+            m_buffer.resize(offset + size);
+            if (size > 0) memcpy(&m_buffer[offset], data, size);
+        }
+
+        prt::vector<char> & m_buffer;
+    };
+
+    /*
+     * Reads back what a BinaryWriter wrote. Every read
+     * fails once the end of the data has been reached
+     **/
+    class BinaryReader {
+    public:
+        BinaryReader(char const * data, size_t size) : m_data(data), m_size(size), m_position(0) {}
+
+        template<typename T>
+        bool read(T & value) { return readBytes(&value, sizeof(T)); }
+
+        template<typename T>
+        bool readVector(prt::vector<T> & vector) {
+            uint64_t n;
+            // divided rather than multiplied, which could overflow
+            if (!read(n) || n > (m_size - m_position) / sizeof(T)) return false;
+            vector.resize(n);
+            return readBytes(vector.data(), n * sizeof(T));
+        }
+
+        /**
+         * @param str buffer to read into
+         * @param capacity size of the buffer, including
+         *                 the null terminator
+         */
+        bool readString(char * str, size_t capacity) {
+            uint64_t n;
+            if (!read(n) || n >= capacity) return false;
+            str[n] = '\0';
+            return readBytes(str, n);
+        }
+
+        bool atEnd() const { return m_position == m_size; }
+
+    private:
+        bool readBytes(void * data, size_t size) {
+            if (size > m_size - m_position) return false;
+            if (size > 0) memcpy(data, m_data + m_position, size);
+            m_position += size;
+            return true;
+        }
+
+        char const * m_data;
+        size_t m_size;
+        size_t m_position;
+    };
 }
 
 #endif
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "math_util.h"
 
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 glm::quat math_util::safeQuatLookAt(glm::vec3 const & lookFrom,
                          glm::vec3 const & lookTo,
                          glm::vec3 const & up,
@@ -30,39 +36,112 @@ glm::mat4 math_util::safeLookAt(glm::vec3 const & lookFrom,
     return glm::toMat4(safeQuatLookAt(lookFrom, lookTo, up, alternativeUp));
 }
 
-// thank you Joachim Kopp: http://www.mpi-hd.mpg.de/personalhomes/globes/3x3/
 glm::mat3 math_util::diagonalizer(glm::mat3 const & A) {
-	// A must be a symmetric matrix.
-	// returns matrix Q 
-	// can be used to Diagonalize A
-	// Diagonal matrix D = Q * A * Transpose(Q);  and  A = QT*D*Q
-	// The rows of q are the eigenvectors D's diagonal is the eigenvalues
-	// As per 'row' convention if float3x3 Q = q.getmatrix(); then v*Q = q*v*conj(q)
-	int maxsteps=24;  // certainly wont need that many.
-	int i;
-	glm::quat q(0.0f,0.0f,0.0f,1.0f);
-	for(i = 0;i < maxsteps; ++i) {
-		glm::mat3 Q  = glm::toMat3(q); // v*Q == q*v*conj(q)
-		glm::mat3 D  = A * glm::transpose(Q) * Q;  // A = Q^T*D*Q
-		glm::vec3 offdiag(D[1][2],D[0][2],D[0][1]); // elements not on the diagonal
-		glm::vec3 om(fabsf(offdiag.x),fabsf(offdiag.y),fabsf(offdiag.z)); // mag of each offdiag elem
-		int k = (om.x > om.y && om.x > om.z) ? 0 : (om.y > om.z)? 1 : 2; // index of largest element of offdiag
-		int k1 = (k + 1) % 3;
-		int k2 = (k + 2) % 3;
-		if(offdiag[k]==0.0f) break;  // diagonal already
-		float thet = (D[k2][k2]-D[k1][k1])/(2.0f*offdiag[k]);
-		float sgn = (thet > 0.0f)?1.0f:-1.0f;
-		thet    *= sgn; // make it positive
-		float t = sgn /(thet +((thet < 1.E6f)?sqrtf((thet*thet)+1.0f):thet)) ; // sign(T)/(|T|+sqrt(T^2+1))
-		float c = 1.0f/sqrtf((t*t)+1.0f); //  c= 1/(t^2+1) , t=s/c 
-		if(c==1.0f) break;  // no room for improvement - reached machine precision.
-		glm::quat jr(0,0,0,0); // jacobi rotation for this iteration.
-		jr[k] = sgn*sqrtf((1.0f-c)/2.0f);  // using 1/2 angle identity sin(a/2) = sqrt((1-cos(a))/2)  
-		jr[k] *= -1.0f; // since our quat-to-matrix convention was for v*M instead of M*v
-		jr.w  = sqrtf(1.0f - (jr[k]*jr[k]));
-		if(jr.w==1.0f) break; // reached limits of floating point precision
-		q =  q*jr;  
-		q = glm::normalize(q);
-	} 
-	return glm::toMat3(q);
-  }
+    // Jacobi rotations, each of which zeroes the
+    // largest element off the diagonal. The columns of
+    // V become the eigenvectors, so that D = V^T * A * V
+    glm::mat3 B = A;
+    glm::mat3 V{ 1.0f };
+    static constexpr int maxSteps = 24;
+    for (int step = 0; step < maxSteps; ++step) {
+        int p = 0;
+        int q = 1;
+        if (std::fabs(B[0][2]) > std::fabs(B[p][q])) { p = 0; q = 2; }
+        if (std::fabs(B[1][2]) > std::fabs(B[p][q])) { p = 1; q = 2; }
+        float apq = B[p][q];
+        if (std::fabs(apq) <= 1e-9f * (std::fabs(B[p][p]) + std::fabs(B[q][q]))) break;
+
+        float theta = (B[q][q] - B[p][p]) / (2.0f * apq);
+        // theta squared may overflow, then t is about 1 / (2 theta)
+        float root = std::fabs(theta) < 1e6f ? std::sqrt(theta * theta + 1.0f) : std::fabs(theta);
+        float t = (theta >= 0.0f ? 1.0f : -1.0f) / (std::fabs(theta) + root);
+        float c = 1.0f / std::sqrt(t * t + 1.0f);
+        float s = t * c;
+
+        int r = 3 - p - q;
+        float arp = B[r][p];
+        float arq = B[r][q];
+        B[p][p] -= t * apq;
+        B[q][q] += t * apq;
+        B[p][q] = B[q][p] = 0.0f;
+        B[r][p] = B[p][r] = c * arp - s * arq;
+        B[r][q] = B[q][r] = s * arp + c * arq;
+
+        // element (row, column) of V is V[column][row]
+        glm::vec3 vp = V[p];
+        glm::vec3 vq = V[q];
+        V[p] = c * vp - s * vq;
+        V[q] = s * vp + c * vq;
+    }
+    return glm::transpose(V);
+}
+
+void math_util::frustumPlanes(glm::mat4 const & viewProjection, glm::vec4 * planes) {
+    glm::vec4 row0{ viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0] };
+    glm::vec4 row1{ viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1] };
+    glm::vec4 row2{ viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2] };
+    glm::vec4 row3{ viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3] };
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row2;
+    planes[5] = row3 - row2;
+
+    for (size_t i = 0; i < 6; ++i) {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+}
+
+void math_util::boxesInFrustum(glm::vec4 const * planes, float const * boxes, 
+                               size_t stride, size_t n, uint8_t * visible) {
+    float const * rows[NUM_BOX_ROWS];
+    for (size_t r = 0; r < NUM_BOX_ROWS; ++r) {
+        rows[r] = boxes + r * stride;
+    }
+
+    // a box is outside a plane if its center is further
+    // behind the plane than the box reaches towards it
+#if defined(__SSE2__)
+    static_assert(boxLaneWidth == 4, "boxes are tested four at a time");
+    __m128 const signMask = _mm_set1_ps(-0.0f);
+    for (size_t first = 0; first < n; first += boxLaneWidth) {
+        __m128 outside = _mm_setzero_ps();
+        for (size_t i = 0; i < 6; ++i) {
+            __m128 nx = _mm_set1_ps(planes[i].x);
+            __m128 ny = _mm_set1_ps(planes[i].y);
+            __m128 nz = _mm_set1_ps(planes[i].z);
+            auto dot = [&](size_t row) {
+                return _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(rows[row] + first)),
+                                             _mm_mul_ps(ny, _mm_loadu_ps(rows[row + 1] + first))),
+                                  _mm_mul_ps(nz, _mm_loadu_ps(rows[row + 2] + first)));
+            };
+            __m128 distance = _mm_add_ps(dot(BOX_CENTER_X), _mm_set1_ps(planes[i].w));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, dot(BOX_AXIS_0_X)),
+                                                 _mm_andnot_ps(signMask, dot(BOX_AXIS_1_X))),
+                                      _mm_andnot_ps(signMask, dot(BOX_AXIS_2_X)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        size_t numLanes = n - first < boxLaneWidth ? n - first : boxLaneWidth;
+        for (size_t lane = 0; lane < numLanes; ++lane) {
+            visible[first + lane] = (mask & (1 << lane)) ? 0 : 1;
+        }
+    }
+#else
+    (void)stride;
+    for (size_t b = 0; b < n; ++b) {
+        auto dot = [&](glm::vec4 const & plane, size_t row) {
+            return plane.x * rows[row][b] + plane.y * rows[row + 1][b] + plane.z * rows[row + 2][b];
+        };
+        visible[b] = 1;
+        for (size_t i = 0; i < 6 && visible[b]; ++i) {
+            float reach = std::fabs(dot(planes[i], BOX_AXIS_0_X)) + 
+                          std::fabs(dot(planes[i], BOX_AXIS_1_X)) + 
+                          std::fabs(dot(planes[i], BOX_AXIS_2_X));
+            if (dot(planes[i], BOX_CENTER_X) + planes[i].w + reach < 0.0f) visible[b] = 0;
+        }
+    }
+#endif
+}
@@ -37,12 +37,74 @@ namespace math_util {
     /**
      * returns a diagonalizing matrix Q
      * such that D = Q * A * Transpose(Q) is
-     * a diagonal matrix
-     * @param matrix A
+     * a diagonal matrix, the rows of Q are
+     * the eigenvectors of A
+     * @param A symmetric matrix
      * @return diagonalizing matrix
      */
     glm::mat3 diagonalizer(glm::mat3 const & A);
 
+    /**
+     * Extracts the planes of a view frustum, with
+     * normalized normals pointing into the frustum
+     * @param viewProjection view projection matrix
+     *                       with depth in [0, 1]
+     * @param planes left, right, bottom, top,
+     *               near and far planes
+     */
+    void frustumPlanes(glm::mat4 const & viewProjection, glm::vec4 * planes);
+
+    /**
+     * Tests a sphere against frustum planes
+     * @param planes frustum planes
+     * @param center sphere center
+     * @param radius sphere radius
+     * @return false if the sphere is entirely outside
+     *         the frustum
+     */
+    inline bool sphereInFrustum(glm::vec4 const * planes, glm::vec3 const & center, float radius) {
+        for (size_t i = 0; i < 6; ++i) {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) return false;
+        }
+        return true;
+    }
+
+    // rows of the boxes tested by boxesInFrustum,
+    // a center and three half extents as vectors
+    enum BoxRow {
+        BOX_CENTER_X,
+        BOX_CENTER_Y,
+        BOX_CENTER_Z,
+        BOX_AXIS_0_X,
+        BOX_AXIS_0_Y,
+        BOX_AXIS_0_Z,
+        BOX_AXIS_1_X,
+        BOX_AXIS_1_Y,
+        BOX_AXIS_1_Z,
+        BOX_AXIS_2_X,
+        BOX_AXIS_2_Y,
+        BOX_AXIS_2_Z,
+        NUM_BOX_ROWS
+    };
+
+    // boxes tested at once by boxesInFrustum
+    static constexpr size_t boxLaneWidth = 4;
+
+    /**
+     * Tests oriented boxes against frustum planes,
+     * several boxes at once with SIMD
+     * @param planes frustum planes
+     * @param boxes row r of box i at r * stride + i,
+     *              see BoxRow
+     * @param stride boxes per row, a multiple of
+     *               boxLaneWidth
+     * @param n number of boxes
+     * @param visible per box, 0 if the box is entirely
+     *                outside the frustum and 1 otherwise
+     */
+    void boxesInFrustum(glm::vec4 const * planes, float const * boxes, 
+                        size_t stride, size_t n, uint8_t * visible);
+
 };
 
 #endif
\ No newline at end of file
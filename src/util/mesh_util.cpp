@@ -0,0 +1,451 @@
+#include "mesh_util.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    /*
+     * Symmetric 4x4 error quadric, stored as its
+     * upper triangle, along with the accumulated
+     * weight of the planes that built it
+     **/
+    struct Quadric {
+        float a00 = 0.0f, a01 = 0.0f, a02 = 0.0f, a03 = 0.0f;
+        float a11 = 0.0f, a12 = 0.0f, a13 = 0.0f;
+        float a22 = 0.0f, a23 = 0.0f;
+        float a33 = 0.0f;
+        float w = 0.0f;
+
+        void addPlane(glm::vec3 const & n, float d, float weight) {
+            a00 += weight * n.x * n.x; a01 += weight * n.x * n.y; a02 += weight * n.x * n.z; a03 += weight * n.x * d;
+            a11 += weight * n.y * n.y; a12 += weight * n.y * n.z; a13 += weight * n.y * d;
+            a22 += weight * n.z * n.z; a23 += weight * n.z * d;
+            a33 += weight * d * d;
+            w += weight;
+        }
+
+        void add(Quadric const & q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+            a11 += q.a11; a12 += q.a12; a13 += q.a13;
+            a22 += q.a22; a23 += q.a23;
+            a33 += q.a33;
+            w += q.w;
+        }
+
+        // mean squared distance from p to the planes
+        float error(glm::vec3 const & p) const {
+            if (w == 0.0f) return 0.0f;
+            float e = a00 * p.x * p.x + 2.0f * a01 * p.x * p.y + 2.0f * a02 * p.x * p.z + 2.0f * a03 * p.x
+                    + a11 * p.y * p.y + 2.0f * a12 * p.y * p.z + 2.0f * a13 * p.y
+                    + a22 * p.z * p.z + 2.0f * a23 * p.z
+                    + a33;
+            return glm::max(e, 0.0f) / w;
+        }
+    };
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        float error;
+    };
+
+    /*
+     * Checks if moving vertex "from" onto vertex "to" flips
+     * any of the triangles around "from" that survive the collapse
+     **/
+    bool collapseFlips(uint32_t from, uint32_t to,
+                       prt::vector<uint32_t> const & indices,
+                       prt::vector<uint32_t> const & adjacencyOffsets,
+                       prt::vector<uint32_t> const & adjacency,
+                       glm::vec3 const * positions) {
+        for (uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; ++i) {
+            uint32_t tri = adjacency[i];
+            uint32_t a = indices[3 * tri];
+            uint32_t b = indices[3 * tri + 1];
+            uint32_t c = indices[3 * tri + 2];
+            // triangles sharing the edge are removed
+            if (a == to || b == to || c == to) continue;
+
+            glm::vec3 pa = positions[a];
+            glm::vec3 pb = positions[b];
+            glm::vec3 pc = positions[c];
+            glm::vec3 before = glm::cross(pb - pa, pc - pa);
+
+            if (a == from) pa = positions[to];
+            if (b == from) pb = positions[to];
+            if (c == from) pc = positions[to];
+            glm::vec3 after = glm::cross(pb - pa, pc - pa);
+
+            if (glm::dot(before, after) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+float mesh_util::simplify(uint32_t const * indices, size_t numIndices,
+                          glm::vec3 const * positions, size_t numVertices,
+                          size_t targetIndexCount, float targetError,
+                          prt::vector<uint32_t> & result) {
+    result.resize(numIndices);
+    std::copy(indices, indices + numIndices, result.begin());
+
+    if (numIndices <= targetIndexCount) return 0.0f;
+
+    // accumulate area weighted triangle planes
+    prt::vector<Quadric> quadrics;
+    quadrics.resize(numVertices);
+    for (size_t i = 0; i < numIndices; i += 3) {
+        glm::vec3 const & p0 = positions[indices[i]];
+        glm::vec3 const & p1 = positions[indices[i + 1]];
+        glm::vec3 const & p2 = positions[indices[i + 2]];
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length == 0.0f) continue;
+        n /= length;
+        float area = 0.5f * length;
+        float d = -glm::dot(n, p0);
+        for (size_t j = 0; j < 3; ++j) {
+            quadrics[indices[i + j]].addPlane(n, d, area);
+        }
+    }
+
+    // lock vertices on edges that are only used by one triangle
+    prt::vector<bool> locked;
+    locked.resize(numVertices, false);
+    {
+        prt::vector<uint64_t> edges;
+        edges.resize(numIndices);
+        for (size_t i = 0; i < numIndices; i += 3) {
+            for (size_t j = 0; j < 3; ++j) {
+                uint64_t a = indices[i + j];
+                uint64_t b = indices[i + (j + 1) % 3];
+                edges[i + j] = a < b ? (a << 32) | b : (b << 32) | a;
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        size_t i = 0;
+        while (i < edges.size()) {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i]) ++j;
+            if (j - i == 1) {
+                locked[edges[i] >> 32] = true;
+                locked[edges[i] & 0xffffffff] = true;
+            }
+            i = j;
+        }
+    }
+
+    float const maxSquaredError = targetError * targetError;
+    float resultSquaredError = 0.0f;
+
+    prt::vector<uint32_t> adjacencyOffsets;
+    prt::vector<uint32_t> adjacency;
+    prt::vector<Collapse> collapses;
+    prt::vector<bool> touched;
+
+    while (result.size() > targetIndexCount) {
+        size_t numTriangles = result.size() / 3;
+        // vertex to triangle adjacency
+        adjacencyOffsets.resize(0);
+        adjacencyOffsets.resize(numVertices + 1, 0);
+        for (uint32_t index : result) {
+            ++adjacencyOffsets[index + 1];
+        }
+        for (size_t i = 0; i < numVertices; ++i) {
+            adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+        }
+        adjacency.resize(result.size());
+        {
+            prt::vector<uint32_t> fill;
+            fill.resize(numVertices);
+            std::copy(adjacencyOffsets.begin(), adjacencyOffsets.begin() + numVertices, fill.begin());
+            for (size_t i = 0; i < result.size(); ++i) {
+                adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        // cheapest collapse direction of every edge
+        collapses.resize(0);
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (size_t j = 0; j < 3; ++j) {
+                uint32_t a = result[i + j];
+                uint32_t b = result[i + (j + 1) % 3];
+                // interior edges are seen from both sides
+                if (a > b) continue;
+                if (locked[a] && locked[b]) continue;
+
+                Quadric q = quadrics[a];
+                q.add(quadrics[b]);
+                float errorAB = locked[a] ? FLT_MAX : q.error(positions[b]);
+                float errorBA = locked[b] ? FLT_MAX : q.error(positions[a]);
+                if (errorAB <= errorBA) {
+                    collapses.push_back({ a, b, errorAB });
+                } else {
+                    collapses.push_back({ b, a, errorBA });
+                }
+            }
+        }
+        if (collapses.empty()) break;
+
+        std::sort(collapses.begin(), collapses.end(),
+                  [](Collapse const & a, Collapse const & b) { return a.error < b.error; });
+
+        // every collapse removes about two triangles
+        size_t const triangleGoal = (result.size() - targetIndexCount) / 3;
+        size_t removedTriangles = 0;
+        bool collapsed = false;
+
+        touched.resize(0);
+        touched.resize(numVertices, false);
+        for (Collapse const & collapse : collapses) {
+            if (collapse.error > maxSquaredError) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+            if (collapseFlips(collapse.from, collapse.to, result,
+                              adjacencyOffsets, adjacency, positions)) continue;
+
+            // the neighbourhood of a collapse is stale until the next pass
+            for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; ++i) {
+                uint32_t tri = adjacency[i];
+                touched[result[3 * tri]] = true;
+                touched[result[3 * tri + 1]] = true;
+                touched[result[3 * tri + 2]] = true;
+            }
+            touched[collapse.to] = true;
+
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; ++i) {
+                uint32_t tri = adjacency[i];
+                for (size_t j = 0; j < 3; ++j) {
+                    if (result[3 * tri + j] == collapse.from) {
+                        result[3 * tri + j] = collapse.to;
+                    }
+                }
+            }
+
+            resultSquaredError = glm::max(resultSquaredError, collapse.error);
+            collapsed = true;
+            removedTriangles += 2;
+            if (removedTriangles >= triangleGoal) break;
+        }
+        if (!collapsed) break;
+
+        // remove degenerate triangles
+        size_t write = 0;
+        for (size_t tri = 0; tri < numTriangles; ++tri) {
+            uint32_t a = result[3 * tri];
+            uint32_t b = result[3 * tri + 1];
+            uint32_t c = result[3 * tri + 2];
+            if (a == b || b == c || c == a) continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    return glm::sqrt(resultSquaredError);
+}
+
+void mesh_util::buildMeshlets(uint32_t * indices, size_t numIndices,
+                              size_t numVertices,
+                              size_t maxVertices, size_t maxTriangles,
+                              prt::vector<uint32_t> & meshletOffsets) {
+    static constexpr uint32_t invalid = std::numeric_limits<uint32_t>::max();
+
+    meshletOffsets.resize(0);
+    meshletOffsets.push_back(0);
+    if (numIndices == 0) return;
+
+    size_t const numTriangles = numIndices / 3;
+
+    // vertex to triangle adjacency
+    prt::vector<uint32_t> adjacencyOffsets;
+    adjacencyOffsets.resize(numVertices + 1, 0);
+    for (size_t i = 0; i < numIndices; ++i) {
+        ++adjacencyOffsets[indices[i] + 1];
+    }
+    for (size_t i = 0; i < numVertices; ++i) {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+    prt::vector<uint32_t> adjacency;
+    adjacency.resize(numIndices);
+    {
+        prt::vector<uint32_t> fill;
+        fill.resize(numVertices);
+        std::copy(adjacencyOffsets.begin(), adjacencyOffsets.begin() + numVertices, fill.begin());
+        for (size_t i = 0; i < numIndices; ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    prt::vector<bool> emitted;
+    emitted.resize(numTriangles, false);
+    // meshlet that last used each vertex
+    prt::vector<uint32_t> vertexMeshlet;
+    vertexMeshlet.resize(numVertices, invalid);
+    prt::vector<uint32_t> meshletVertices;
+    meshletVertices.reserve(maxVertices);
+    prt::vector<uint32_t> reordered;
+    reordered.reserve(numIndices);
+
+    uint32_t meshlet = 0;
+    size_t meshletTriangles = 0;
+    size_t scan = 0;
+    uint32_t last = invalid;
+
+    auto newVertices = [&](uint32_t tri) {
+        uint32_t count = 0;
+        for (size_t j = 0; j < 3; ++j) {
+            count += vertexMeshlet[indices[3 * tri + j]] != meshlet;
+        }
+        return count;
+    };
+
+    // picks the unemitted triangle adjacent to vertex v
+    // that adds the fewest vertices to the meshlet
+    auto pickAdjacent = [&](uint32_t v, uint32_t & best, uint32_t & bestNew) {
+        for (uint32_t i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i) {
+            uint32_t tri = adjacency[i];
+            if (emitted[tri]) continue;
+            uint32_t n = newVertices(tri);
+            if (n < bestNew) {
+                best = tri;
+                bestNew = n;
+            }
+        }
+    };
+
+    while (reordered.size() < numTriangles * 3) {
+        uint32_t best = invalid;
+        uint32_t bestNew = 4;
+        // prefer neighbours of the last triangle
+        if (last != invalid) {
+            for (size_t j = 0; j < 3; ++j) {
+                pickAdjacent(indices[3 * last + j], best, bestNew);
+            }
+        }
+        // then neighbours of the rest of the meshlet
+        if (best == invalid) {
+            for (uint32_t v : meshletVertices) {
+                pickAdjacent(v, best, bestNew);
+            }
+        }
+        // otherwise start over at the next unemitted triangle
+        if (best == invalid) {
+            while (emitted[scan]) ++scan;
+            best = static_cast<uint32_t>(scan);
+            bestNew = newVertices(best);
+        }
+
+        if (meshletVertices.size() + bestNew > maxVertices ||
+            meshletTriangles + 1 > maxTriangles) {
+            meshletOffsets.push_back(static_cast<uint32_t>(reordered.size()));
+            ++meshlet;
+            meshletVertices.resize(0);
+            meshletTriangles = 0;
+        }
+
+        for (size_t j = 0; j < 3; ++j) {
+            uint32_t v = indices[3 * best + j];
+            if (vertexMeshlet[v] != meshlet) {
+                vertexMeshlet[v] = meshlet;
+                meshletVertices.push_back(v);
+            }
+            reordered.push_back(v);
+        }
+        emitted[best] = true;
+        ++meshletTriangles;
+        last = best;
+    }
+    meshletOffsets.push_back(static_cast<uint32_t>(reordered.size()));
+
+    std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+void mesh_util::clusterBounds(uint32_t const * indices, size_t numIndices,
+                              glm::vec3 const * positions,
+                              glm::vec3 & center, float & radius,
+                              glm::vec3 & coneAxis, float & coneCutoff) {
+    glm::vec3 min{ FLT_MAX };
+    glm::vec3 max{ -FLT_MAX };
+    for (size_t i = 0; i < numIndices; ++i) {
+        min = glm::min(min, positions[indices[i]]);
+        max = glm::max(max, positions[indices[i]]);
+    }
+    center = 0.5f * (min + max);
+    radius = 0.0f;
+    for (size_t i = 0; i < numIndices; ++i) {
+        radius = glm::max(radius, glm::distance(center, positions[indices[i]]));
+    }
+
+    glm::vec3 normalSum{ 0.0f };
+    for (size_t i = 0; i < numIndices; i += 3) {
+        glm::vec3 const & p0 = positions[indices[i]];
+        glm::vec3 n = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        float length = glm::length(n);
+        if (length > 0.0f) normalSum += n / length;
+    }
+
+    coneAxis = glm::vec3{ 0.0f, 0.0f, 1.0f };
+    coneCutoff = 1.0f;
+    float length = glm::length(normalSum);
+    if (length == 0.0f) return;
+    coneAxis = normalSum / length;
+
+    float minDot = 1.0f;
+    for (size_t i = 0; i < numIndices; i += 3) {
+        glm::vec3 const & p0 = positions[indices[i]];
+        glm::vec3 n = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+        float nLength = glm::length(n);
+        if (nLength > 0.0f) minDot = glm::min(minDot, glm::dot(coneAxis, n / nLength));
+    }
+    // wide cones hardly ever cull anything
+    if (minDot > 0.1f) {
+        coneCutoff = glm::sqrt(1.0f - minDot * minDot);
+    }
+}
+
+void mesh_util::rebaseIndices(uint32_t const * indices, size_t numIndices,
+                              uint32_t base, uint16_t * result) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // SSE2 only packs with signed saturation, so indices are
+    // shifted into the signed 16 bit range and the sign bit
+    // is flipped back after packing
+    __m128i const bias = _mm_set1_epi32(static_cast<int32_t>(base + 0x8000));
+    __m128i const flip = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+    for (; i + 8 <= numIndices; i += 8) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<__m128i const *>(indices + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<__m128i const *>(indices + i + 4));
+        lo = _mm_sub_epi32(lo, bias);
+        hi = _mm_sub_epi32(hi, bias);
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(lo, hi), flip);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(result + i), packed);
+    }
+#endif
+    for (; i < numIndices; ++i) {
+        result[i] = static_cast<uint16_t>(indices[i] - base);
+    }
+}
+
+void mesh_util::rebaseIndices(uint32_t const * indices, size_t numIndices,
+                              uint32_t base, uint32_t * result) {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i const vbase = _mm_set1_epi32(static_cast<int32_t>(base));
+    for (; i + 4 <= numIndices; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(indices + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(result + i), _mm_sub_epi32(v, vbase));
+    }
+#endif
+    for (; i < numIndices; ++i) {
+        result[i] = indices[i] - base;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef MESH_UTIL_H
+#define MESH_UTIL_H
+
+#include "src/container/vector.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace mesh_util {
+    /**
+     * Simplifies a triangle list by collapsing edges in
+     * order of quadric error (Garland & Heckbert).
+     * Vertices are only collapsed onto other existing
+     * vertices, so the result indexes the same vertex
+     * buffer as the input. Vertices on open borders,
+     * which includes attribute seams, are never moved.
+     * @param indices triangle list
+     * @param numIndices number of indices
+     * @param positions vertex positions
+     * @param numVertices number of vertices
+     * @param targetIndexCount number of indices to reduce to
+     * @param targetError maximum distance a collapse may
+     *                    move the surface
+     * @param result simplified triangle list
+     * @return largest distance any collapse moved the
+     *         surface
+     */
+    float simplify(uint32_t const * indices, size_t numIndices,
+                   glm::vec3 const * positions, size_t numVertices,
+                   size_t targetIndexCount, float targetError,
+                   prt::vector<uint32_t> & result);
+
+    /**
+     * Reorders the triangles of a triangle list into
+     * meshlets, groups of spatially close triangles
+     * with bounded vertex and triangle counts.
+     * Triangles are grown from the neighbourhood of
+     * the current meshlet to keep meshlets compact.
+     * @param indices triangle list, reordered in place
+     * @param numIndices number of indices
+     * @param numVertices number of vertices
+     * @param maxVertices maximum unique vertices per meshlet
+     * @param maxTriangles maximum triangles per meshlet
+     * @param meshletOffsets first index of every meshlet,
+     *                       followed by numIndices
+     */
+    void buildMeshlets(uint32_t * indices, size_t numIndices,
+                       size_t numVertices,
+                       size_t maxVertices, size_t maxTriangles,
+                       prt::vector<uint32_t> & meshletOffsets);
+
+    /**
+     * Computes the bounding sphere and backface normal
+     * cone of a triangle cluster. The cluster faces away
+     * from an eye position e if
+     * dot(center - e, coneAxis) >= coneCutoff * length(center - e) + radius
+     * @param indices triangle list
+     * @param numIndices number of indices
+     * @param positions vertex positions
+     * @param center bounding sphere center
+     * @param radius bounding sphere radius
+     * @param coneAxis average normal of the cluster
+     * @param coneCutoff sine of the cone angle,
+     *                   1 if the cluster can't be culled
+     */
+    void clusterBounds(uint32_t const * indices, size_t numIndices,
+                       glm::vec3 const * positions,
+                       glm::vec3 & center, float & radius,
+                       glm::vec3 & coneAxis, float & coneCutoff);
+
+    /**
+     * Subtracts a base vertex from every index and
+     * narrows the result to 16 bits
+     * @param indices indices to rebase, all in
+     *                [base, base + 65535]
+     * @param numIndices number of indices
+     * @param base base vertex
+     * @param result rebased indices
+     */
+    void rebaseIndices(uint32_t const * indices, size_t numIndices,
+                       uint32_t base, uint16_t * result);
+
+    /**
+     * Subtracts a base vertex from every index
+     * @param indices indices to rebase, all >= base
+     * @param numIndices number of indices
+     * @param base base vertex
+     * @param result rebased indices
+     */
+    void rebaseIndices(uint32_t const * indices, size_t numIndices,
+                       uint32_t base, uint32_t * result);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "parallel_util.h"
+
+namespace {
+    thread_local size_t threadIndex = 0;
+};
+
+struct parallel_util::WorkerPool::Job {
+    void (*call)(void const *, size_t, size_t);
+    void const * data;
+    size_t count;
+    size_t chunkSize;
+    std::atomic<size_t> nextChunk{0};
+
+    void work() {
+        size_t numChunks = (count + chunkSize - 1) / chunkSize;
+        for (size_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++) {
+            size_t begin = chunk * chunkSize;
+            size_t end = begin + chunkSize < count ? begin + chunkSize : count;
+            call(data, begin, end);
+        }
+    }
+};
+
+parallel_util::WorkerPool::WorkerPool(size_t numWorkers)
+    : m_numWorkers(numWorkers < maxThreads ? numWorkers : maxThreads - 1) {
+    for (size_t i = 0; i < m_numWorkers; ++i) {
+        m_workers[i] = std::thread(&WorkerPool::work, this, i + 1);
+    }
+}
+
+parallel_util::WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_numWorkers; ++i) {
+        m_workers[i].join();
+    }
+}
+
+size_t parallel_util::WorkerPool::getThreadIndex() {
+    return threadIndex;
+}
+
+void parallel_util::WorkerPool::run(size_t count, size_t chunkSize,
+                                    void (*call)(void const *, size_t, size_t), void const * data) {
+    if (count == 0) return;
+    if (chunkSize == 0) chunkSize = 1;
+
+    Job job;
+    job.call = call;
+    job.data = data;
+    job.count = count;
+    job.chunkSize = chunkSize;
+
+    // a single chunk is not worth waking anyone for
+    bool wake = m_numWorkers > 0 && count > chunkSize;
+    if (wake) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+    }
+
+    job.work();
+
+    if (wake) {
+        // workers may still be running their last chunk
+        // and hold on to the job until they are done
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_job = nullptr;
+        m_idle.wait(lock, [this]() { return m_numActive == 0; });
+    }
+}
+
+void parallel_util::WorkerPool::work(size_t index) {
+    threadIndex = index;
+    uint64_t generation = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [&]() { return m_quit || (m_job != nullptr && m_generation != generation); });
+        if (m_quit) return;
+
+        generation = m_generation;
+        Job * job = m_job;
+        ++m_numActive;
+        lock.unlock();
+
+        job->work();
+
+        lock.lock();
+        if (--m_numActive == 0) {
+            m_idle.notify_all();
+        }
+    }
+}
+
+parallel_util::WorkerPool & parallel_util::getWorkerPool() {
+    static WorkerPool pool{numThreads() - 1};
+    return pool;
+}
@@ -0,0 +1,130 @@
+#ifndef PARALLEL_UTIL_H
+#define PARALLEL_UTIL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace parallel_util {
+    static constexpr size_t maxThreads = 32;
+
+    /**
+     * @return number of threads work is split over
+     */
+    inline size_t numThreads() {
+        size_t n = std::thread::hardware_concurrency();
+        if (n == 0) n = 1;
+        return n < maxThreads ? n : maxThreads;
+    }
+
+    /**
+     * Splits [0, count) into contiguous chunks and calls
+     * f(begin, end) for each chunk on its own thread,
+     * the last chunk on the calling thread. Returns once
+     * every chunk is done. f may not allocate from the
+     * container allocator since it is not thread safe.
+     * @param count number of elements
+     * @param minChunkSize smallest chunk worth a thread
+     * @param f function called with the chunk bounds
+     */
+    template<typename F>
+    void parallelFor(size_t count, size_t minChunkSize, F const & f) {
+        if (count == 0) return;
+        if (minChunkSize == 0) minChunkSize = 1;
+
+        size_t numChunks = (count + minChunkSize - 1) / minChunkSize;
+        if (numChunks > numThreads()) numChunks = numThreads();
+        size_t chunkSize = (count + numChunks - 1) / numChunks;
+
+        std::thread threads[maxThreads];
+        size_t numStarted = 0;
+        size_t begin = 0;
+        while (begin + chunkSize < count) {
+            threads[numStarted++] = std::thread(f, begin, begin + chunkSize);
+            begin += chunkSize;
+        }
+        f(begin, count);
+
+        for (size_t i = 0; i < numStarted; ++i) {
+            threads[i].join();
+        }
+    }
+
+    /*
+     * Threads that are kept alive between jobs, for work
+     * that is split up every frame where starting threads
+     * would cost more than the work itself. Only one
+     * thread may run jobs on a pool at a time
+     **/
+    class WorkerPool {
+    public:
+        /**
+         * @param numWorkers number of threads besides
+         *                   the one running jobs
+         */
+        explicit WorkerPool(size_t numWorkers);
+        ~WorkerPool();
+
+        WorkerPool(WorkerPool const &) = delete;
+        WorkerPool & operator=(WorkerPool const &) = delete;
+
+        /**
+         * Splits [0, count) into chunks that the workers and
+         * the calling thread take until none are left, and
+         * calls f(begin, end) for each. Returns once every
+         * chunk is done. f may not allocate from the
+         * container allocator since it is not thread safe.
+         * @param count number of elements
+         * @param chunkSize number of elements per chunk
+         * @param f function called with the chunk bounds
+         */
+        template<typename F>
+        void parallelFor(size_t count, size_t chunkSize, F const & f) {
+            run(count, chunkSize, [](void const * data, size_t begin, size_t end) {
+                (*static_cast<F const *>(data))(begin, end);
+            }, &f);
+        }
+
+        /**
+         * @return number of threads that run jobs, the
+         *         workers and the calling thread
+         */
+        inline size_t getNumThreads() const { return m_numWorkers + 1; }
+
+        /**
+         * @return index of the thread running the current
+         *         chunk, below getNumThreads(), 0 outside
+         *         of workers
+         */
+        static size_t getThreadIndex();
+
+    private:
+        struct Job;
+
+        std::thread m_workers[maxThreads];
+        size_t m_numWorkers;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_idle;
+        Job * m_job = nullptr;
+        uint64_t m_generation = 0;
+        size_t m_numActive = 0;
+        bool m_quit = false;
+
+        void run(size_t count, size_t chunkSize,
+                 void (*call)(void const *, size_t, size_t), void const * data);
+        void work(size_t threadIndex);
+    };
+
+    /**
+     * @return pool shared by per-frame work, with
+     *         numThreads() threads
+     */
+    WorkerPool & getWorkerPool();
+};
+
+#endif
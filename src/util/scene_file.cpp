@@ -0,0 +1,455 @@
+#include "scene_file.h"
+
+#include "src/container/vector.h"
+#include "src/util/io_util.h"
+
+#include <glm/gtx/transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    /* binary payloads, following the record type **/
+    struct ModelPayload {
+        uint32_t pathOffset;
+        uint32_t pathLength;
+        uint32_t animated;
+    };
+
+    struct InstancePayload {
+        glm::mat4 transform;
+    };
+
+    struct AnimationPayload {
+        uint32_t clipAOffset;
+        uint32_t clipALength;
+        uint32_t clipBOffset;
+        uint32_t clipBLength;
+        float blendFactor;
+    };
+
+    struct PointLightPayload {
+        glm::vec3 position;
+        glm::vec3 color;
+        float a;
+        float b;
+        float c;
+    };
+
+    struct SunPayload {
+        glm::vec3 direction;
+    };
+
+    inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline bool isSeparator(char c) { return isSpace(c) || c == '\n' || c == '#'; }
+
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    void skipSpace(char const * & p, char const * end) {
+        while (p != end && isSpace(*p)) ++p;
+    }
+
+    bool atLineEnd(char const * p, char const * end) {
+        skipSpace(p, end);
+        return p == end || *p == '\n' || *p == '#';
+    }
+
+    SceneFile::String parseToken(char const * & p, char const * end) {
+        skipSpace(p, end);
+        char const * start = p;
+        while (p != end && !isSeparator(*p)) ++p;
+        return { start, uint32_t(p - start) };
+    }
+
+    bool equals(SceneFile::String const & str, char const * literal) {
+        return strlen(literal) == str.length && memcmp(str.data, literal, str.length) == 0;
+    }
+
+    /**
+     * Parses a decimal number. strtof is not used since
+     * the mapped file is not null terminated
+     */
+    bool parseFloat(char const * & p, char const * end, float & value) {
+        skipSpace(p, end);
+        char const * it = p;
+
+        bool negative = false;
+        if (it != end && (*it == '-' || *it == '+')) {
+            negative = *it == '-';
+            ++it;
+        }
+
+        double mantissa = 0.0;
+        int exponent = 0;
+        bool digits = false;
+        for (; it != end && isDigit(*it); ++it) {
+            mantissa = 10.0 * mantissa + (*it - '0');
+            digits = true;
+        }
+        if (it != end && *it == '.') {
+            for (++it; it != end && isDigit(*it); ++it) {
+                mantissa = 10.0 * mantissa + (*it - '0');
+                --exponent;
+                digits = true;
+            }
+        }
+        if (!digits) return false;
+
+        if (it != end && (*it == 'e' || *it == 'E')) {
+            ++it;
+            bool negativeExponent = false;
+            if (it != end && (*it == '-' || *it == '+')) {
+                negativeExponent = *it == '-';
+                ++it;
+            }
+            int e = 0;
+            bool exponentDigits = false;
+            for (; it != end && isDigit(*it); ++it) {
+                e = 10 * e + (*it - '0');
+                exponentDigits = true;
+            }
+            if (!exponentDigits) return false;
+            exponent += negativeExponent ? -e : e;
+        }
+        if (it != end && !isSeparator(*it)) return false;
+
+        double result = exponent == 0 ? mantissa : mantissa * std::pow(10.0, exponent);
+        value = static_cast<float>(negative ? -result : result);
+        p = it;
+        return true;
+    }
+
+    bool parseVec3(char const * & p, char const * end, glm::vec3 & value) {
+        return parseFloat(p, end, value.x) &&
+               parseFloat(p, end, value.y) &&
+               parseFloat(p, end, value.z);
+    }
+
+    void appendString(prt::vector<char> & strings, SceneFile::String const & str,
+                      uint32_t & offset, uint32_t & length) {
+        offset = strings.size();
+        length = str.length;
+        strings.resize(strings.size() + str.length);
+        if (str.length > 0) memcpy(&strings[offset], str.data, str.length);
+    }
+}
+
+bool SceneFile::String::copy(char * buffer, size_t capacity) const {
+    if (length >= capacity) return false;
+    memcpy(buffer, data, length);
+    buffer[length] = '\0';
+    return true;
+}
+
+SceneFile::SceneFile()
+    : m_data(nullptr), m_size(0), m_binary(false),
+      m_position(nullptr), m_end(nullptr), m_strings(nullptr), m_stringsSize(0),
+      m_line(0), m_hasModel(false), m_failed(false), m_path{} {}
+
+SceneFile::~SceneFile() {
+    close();
+}
+
+bool SceneFile::open(char const * path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    strncpy(m_path, path, sizeof(m_path) - 1);
+    m_line = 1;
+    m_hasModel = false;
+    m_failed = false;
+
+    // an empty text scene cannot be mapped
+    if (st.st_size == 0) {
+        ::close(fd);
+        m_binary = false;
+        return true;
+    }
+
+    void * mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    m_data = static_cast<char const *>(mapped);
+    m_size = st.st_size;
+    madvise(const_cast<char *>(m_data), m_size, MADV_SEQUENTIAL);
+
+    uint32_t fileMagic = 0;
+    if (m_size >= sizeof(fileMagic)) {
+        memcpy(&fileMagic, m_data, sizeof(fileMagic));
+    }
+    m_binary = fileMagic == magic;
+
+    if (!m_binary) {
+        m_position = m_data;
+        m_end = m_data + m_size;
+        return true;
+    }
+
+    Header header;
+    bool valid = m_size >= sizeof(Header);
+    if (valid) {
+        memcpy(&header, m_data, sizeof(Header));
+        // compared without summing, which could overflow
+        valid = header.version == version &&
+                header.recordsOffset <= m_size &&
+                header.recordsSize <= m_size - header.recordsOffset &&
+                header.stringsOffset <= m_size &&
+                header.stringsSize <= m_size - header.stringsOffset;
+    }
+    if (!valid) {
+        std::cout << "invalid scene: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    m_position = m_data + header.recordsOffset;
+    m_end = m_position + header.recordsSize;
+    m_strings = m_data + header.stringsOffset;
+    m_stringsSize = header.stringsSize;
+    return true;
+}
+
+void SceneFile::close() {
+    if (m_data != nullptr) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_position = nullptr;
+    m_end = nullptr;
+    m_strings = nullptr;
+    m_stringsSize = 0;
+}
+
+bool SceneFile::next(Record & record) {
+    if (m_failed || m_position == m_end) return false;
+    return m_binary ? nextBinary(record) : nextText(record);
+}
+
+bool SceneFile::nextText(Record & record) {
+    while (m_position != m_end) {
+        String keyword = parseToken(m_position, m_end);
+        if (keyword.length == 0) {
+            // empty or comment line
+            while (m_position != m_end && *m_position != '\n') ++m_position;
+            if (m_position != m_end) ++m_position;
+            ++m_line;
+            continue;
+        }
+
+        if (equals(keyword, "model")) {
+            record.type = RECORD_TYPE_MODEL;
+            record.path = parseToken(m_position, m_end);
+            if (record.path.length == 0) return fail("expected a model path");
+            String flag = parseToken(m_position, m_end);
+            record.animated = equals(flag, "animated");
+            if (flag.length > 0 && !record.animated) return fail("unknown model flag");
+            m_hasModel = true;
+        } else if (equals(keyword, "instance")) {
+            if (!m_hasModel) return fail("instance before any model");
+            record.type = RECORD_TYPE_INSTANCE;
+            glm::vec3 position;
+            glm::vec3 rotation{ 0.0f };
+            glm::vec3 scale{ 1.0f };
+            if (!parseVec3(m_position, m_end, position)) return fail("expected a position");
+            if (!atLineEnd(m_position, m_end) &&
+                !parseVec3(m_position, m_end, rotation)) return fail("expected a rotation");
+            if (!atLineEnd(m_position, m_end) &&
+                !parseVec3(m_position, m_end, scale)) return fail("expected a scale");
+            record.transform = glm::translate(position) *
+                               glm::toMat4(glm::quat(glm::radians(rotation))) *
+                               glm::scale(scale);
+        } else if (equals(keyword, "animation")) {
+            if (!m_hasModel) return fail("animation before any model");
+            record.type = RECORD_TYPE_ANIMATION;
+            record.clipA = parseToken(m_position, m_end);
+            if (record.clipA.length == 0) return fail("expected a clip");
+            record.clipB = parseToken(m_position, m_end);
+            record.blendFactor = 0.0f;
+            if (record.clipB.length > 0 &&
+                !parseFloat(m_position, m_end, record.blendFactor)) return fail("expected a blend factor");
+        } else if (equals(keyword, "pointlight")) {
+            record.type = RECORD_TYPE_POINT_LIGHT;
+            if (!parseVec3(m_position, m_end, record.position)) return fail("expected a position");
+            if (!parseVec3(m_position, m_end, record.color)) return fail("expected a color");
+            if (!parseFloat(m_position, m_end, record.a) ||
+                !parseFloat(m_position, m_end, record.b) ||
+                !parseFloat(m_position, m_end, record.c)) return fail("expected attenuation terms");
+        } else if (equals(keyword, "sun")) {
+            record.type = RECORD_TYPE_SUN;
+            if (!parseVec3(m_position, m_end, record.direction)) return fail("expected a direction");
+        } else {
+            return fail("unknown statement");
+        }
+
+        if (!atLineEnd(m_position, m_end)) return fail("unexpected characters at the end of the line");
+        while (m_position != m_end && *m_position != '\n') ++m_position;
+        if (m_position != m_end) ++m_position;
+        ++m_line;
+        return true;
+    }
+    return false;
+}
+
+bool SceneFile::nextBinary(Record & record) {
+    size_t remaining = m_end - m_position;
+    uint32_t type;
+    if (remaining < sizeof(type)) return fail("truncated record");
+    memcpy(&type, m_position, sizeof(type));
+    char const * payload = m_position + sizeof(type);
+    remaining -= sizeof(type);
+
+    auto getString = [this](uint32_t offset, uint32_t length, String & str) {
+        if (uint64_t(offset) + length > m_stringsSize) return false;
+        str = { m_strings + offset, length };
+        return true;
+    };
+
+    size_t payloadSize;
+    switch (type) {
+    case RECORD_TYPE_MODEL: {
+        ModelPayload model;
+        payloadSize = sizeof(model);
+        if (remaining < payloadSize) return fail("truncated record");
+        memcpy(&model, payload, payloadSize);
+        if (!getString(model.pathOffset, model.pathLength, record.path)) return fail("invalid string");
+        record.animated = model.animated != 0;
+        m_hasModel = true;
+        break;
+    }
+    case RECORD_TYPE_INSTANCE: {
+        if (!m_hasModel) return fail("instance before any model");
+        payloadSize = sizeof(InstancePayload);
+        if (remaining < payloadSize) return fail("truncated record");
+        memcpy(&record.transform, payload, payloadSize);
+        break;
+    }
+    case RECORD_TYPE_ANIMATION: {
+        if (!m_hasModel) return fail("animation before any model");
+        AnimationPayload animation;
+        payloadSize = sizeof(animation);
+        if (remaining < payloadSize) return fail("truncated record");
+        memcpy(&animation, payload, payloadSize);
+        if (!getString(animation.clipAOffset, animation.clipALength, record.clipA) ||
+            !getString(animation.clipBOffset, animation.clipBLength, record.clipB)) return fail("invalid string");
+        record.blendFactor = animation.blendFactor;
+        break;
+    }
+    case RECORD_TYPE_POINT_LIGHT: {
+        PointLightPayload light;
+        payloadSize = sizeof(light);
+        if (remaining < payloadSize) return fail("truncated record");
+        memcpy(&light, payload, payloadSize);
+        record.position = light.position;
+        record.color = light.color;
+        record.a = light.a;
+        record.b = light.b;
+        record.c = light.c;
+        break;
+    }
+    case RECORD_TYPE_SUN: {
+        SunPayload sun;
+        payloadSize = sizeof(sun);
+        if (remaining < payloadSize) return fail("truncated record");
+        memcpy(&sun, payload, payloadSize);
+        record.direction = sun.direction;
+        break;
+    }
+    default:
+        return fail("unknown record type");
+    }
+
+    record.type = static_cast<RecordType>(type);
+    m_position = payload + payloadSize;
+    return true;
+}
+
+bool SceneFile::fail(char const * message) {
+    if (m_binary) {
+        std::cout << "invalid scene " << m_path << ": " << message << std::endl;
+    } else {
+        std::cout << m_path << ":" << m_line << ": " << message << std::endl;
+    }
+    m_failed = true;
+    return false;
+}
+
+bool SceneFile::compile(char const * textPath, char const * binaryPath) {
+    SceneFile text;
+    if (!text.open(textPath)) return false;
+    if (text.m_binary) {
+        std::cout << "scene is already compiled: " << textPath << std::endl;
+        return false;
+    }
+
+    prt::vector<char> records;
+    prt::vector<char> strings;
+    io_util::BinaryWriter writer{records};
+
+    Record record;
+    while (text.next(record)) {
+        writer.write(uint32_t(record.type));
+        switch (record.type) {
+        case RECORD_TYPE_MODEL: {
+            ModelPayload model;
+            appendString(strings, record.path, model.pathOffset, model.pathLength);
+            model.animated = record.animated;
+            writer.write(model);
+            break;
+        }
+        case RECORD_TYPE_INSTANCE:
+            writer.write(InstancePayload{ record.transform });
+            break;
+        case RECORD_TYPE_ANIMATION: {
+            AnimationPayload animation;
+            appendString(strings, record.clipA, animation.clipAOffset, animation.clipALength);
+            appendString(strings, record.clipB, animation.clipBOffset, animation.clipBLength);
+            animation.blendFactor = record.blendFactor;
+            writer.write(animation);
+            break;
+        }
+        case RECORD_TYPE_POINT_LIGHT:
+            writer.write(PointLightPayload{ record.position, record.color,
+                                            record.a, record.b, record.c });
+            break;
+        case RECORD_TYPE_SUN:
+            writer.write(SunPayload{ record.direction });
+            break;
+        }
+    }
+    if (text.failed()) return false;
+
+    Header header = {};
+    header.magic = magic;
+    header.version = version;
+    header.recordsOffset = sizeof(Header);
+    header.recordsSize = records.size();
+    header.stringsOffset = header.recordsOffset + header.recordsSize;
+    header.stringsSize = strings.size();
+
+    prt::vector<char> data;
+    io_util::BinaryWriter fileWriter{data};
+    fileWriter.write(header);
+    data.resize(data.size() + records.size() + strings.size());
+    if (records.size() > 0) memcpy(&data[header.recordsOffset], records.data(), records.size());
+    if (strings.size() > 0) memcpy(&data[header.stringsOffset], strings.data(), strings.size());
+
+    return io_util::writeFile(binaryPath, data.data(), data.size());
+}
@@ -0,0 +1,150 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Scene description listing models, their instances,
+ * animations and lights. Scenes are authored as text and
+ * may be compiled to a binary form for shipping. Both are
+ * read by the same streaming parser, in place in a memory
+ * mapped file and without allocating.
+ *
+ * Text form, one statement per line, # starts a comment:
+ *  model <path> [animated]
+ *  instance <x y z> [<rotation x y z in degrees> [<scale x y z>]]
+ *  animation <clip> [<clip> <blend factor>]
+ *  pointlight <x y z> <r g b> <quadratic> <linear> <constant>
+ *  sun <direction x y z>
+ * Model paths are relative to the model directory. The
+ * instances listed after a model place that model, and an
+ * animation applies to the instances listed after it.
+ *
+ * Binary form:
+ *  Header
+ *  records, each a RecordType followed by its payload
+ *  strings, not null terminated
+ **/
+class SceneFile {
+public:
+    static constexpr uint32_t magic = 0x4e435350; // "PSCN"
+    static constexpr uint32_t version = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t recordsOffset;
+        uint64_t recordsSize;
+        uint64_t stringsOffset;
+        uint64_t stringsSize;
+    };
+
+    enum RecordType : uint32_t {
+        RECORD_TYPE_MODEL,
+        RECORD_TYPE_INSTANCE,
+        RECORD_TYPE_ANIMATION,
+        RECORD_TYPE_POINT_LIGHT,
+        RECORD_TYPE_SUN
+    };
+
+    /* string in the mapped file, not null terminated **/
+    struct String {
+        char const * data;
+        uint32_t length;
+
+        /**
+         * Copies the string to a null terminated buffer
+         * @param buffer buffer to copy to
+         * @param capacity size of the buffer, including
+         *                 the null terminator
+         * @return false if the string does not fit
+         */
+        bool copy(char * buffer, size_t capacity) const;
+    };
+
+    /*
+     * One statement of the scene. Only the fields of
+     * the record type are set
+     **/
+    struct Record {
+        RecordType type;
+        // model
+        String path;
+        bool animated;
+        // instance
+        glm::mat4 transform;
+        // animation, clipB is empty for a single clip
+        String clipA;
+        String clipB;
+        float blendFactor;
+        // point light and sun
+        glm::vec3 position;
+        glm::vec3 color;
+        float a; // quadratic term
+        float b; // linear term
+        float c; // constant term
+        glm::vec3 direction;
+    };
+
+    SceneFile();
+    ~SceneFile();
+
+    SceneFile(SceneFile const &) = delete;
+    SceneFile & operator=(SceneFile const &) = delete;
+
+    /**
+     * Maps a scene into memory, in either form
+     * @param path path of the scene
+     * @return true if the scene could be mapped
+     */
+    bool open(char const * path);
+
+    void close();
+
+    /**
+     * Parses the next record
+     * @param record parsed record
+     * @return false at the end of the scene or if
+     *         the scene is malformed, see failed
+     */
+    bool next(Record & record);
+
+    /**
+     * @return true if parsing stopped at an error
+     */
+    inline bool failed() const { return m_failed; }
+
+    /**
+     * Compiles a text scene to the binary form
+     * @param textPath path of the text scene
+     * @param binaryPath path of the binary scene to write
+     * @return true if the binary scene was written
+     */
+    static bool compile(char const * textPath, char const * binaryPath);
+
+private:
+    char const * m_data;
+    size_t m_size;
+    bool m_binary;
+    // text: next character, binary: next record
+    char const * m_position;
+    char const * m_end;
+    char const * m_strings;
+    size_t m_stringsSize;
+    size_t m_line;
+    bool m_hasModel;
+    bool m_failed;
+    char m_path[256];
+
+    bool nextText(Record & record);
+    bool nextBinary(Record & record);
+    bool fail(char const * message);
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "trace_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    struct Event {
+        char const * category;
+        char const * name;
+        char asset[trace_util::maxNameLength];
+        uint32_t thread;
+        uint64_t start;
+        // set once the scope ends
+        std::atomic<bool> done;
+        uint64_t end;
+    };
+
+    Event events[trace_util::maxEvents];
+    std::atomic<size_t> numEvents{0};
+    std::atomic<bool> recording{false};
+    std::atomic<uint32_t> numThreads{0};
+    char tracePath[512];
+    uint64_t traceStart;
+
+    uint64_t now() {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t getThread() {
+        thread_local uint32_t thread = ++numThreads;
+        return thread;
+    }
+
+    void writeString(FILE * file, char const * str) {
+        fputc('"', file);
+        for (char const * c = str; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', file);
+                fputc(*c, file);
+            } else if (static_cast<unsigned char>(*c) < 0x20) {
+                fprintf(file, "\\u%04x", static_cast<unsigned char>(*c));
+            } else {
+                fputc(*c, file);
+            }
+        }
+        fputc('"', file);
+    }
+
+    void writeEvent(FILE * file, char const * category, char const * name, char const * asset,
+                    uint32_t thread, uint64_t start, uint64_t end) {
+        // timestamps are in microseconds
+        fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"cat\":",
+                thread, (start - traceStart) / 1000.0, (end - start) / 1000.0);
+        writeString(file, category);
+        fputs(",\"name\":", file);
+        writeString(file, name);
+        if (asset[0] != '\0') {
+            fputs(",\"args\":{\"asset\":", file);
+            writeString(file, asset);
+            fputc('}', file);
+        }
+        fputc('}', file);
+    }
+}
+
+void trace_util::begin(char const * path) {
+    strncpy(tracePath, path, sizeof(tracePath) - 1);
+    tracePath[sizeof(tracePath) - 1] = '\0';
+    numEvents = 0;
+    traceStart = now();
+    // the recording thread is listed first
+    getThread();
+    recording = true;
+}
+
+bool trace_util::end() {
+    if (!recording) return false;
+    recording = false;
+    uint64_t traceEnd = now();
+
+    FILE * file = fopen(tracePath, "w");
+    if (file == nullptr) {
+        std::cout << "failed to write trace: " << tracePath << std::endl;
+        return false;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"main\"}}",
+            getThread());
+    writeEvent(file, "app", "trace", "", getThread(), traceStart, traceEnd);
+
+    size_t n = numEvents < maxEvents ? size_t(numEvents) : maxEvents;
+    for (size_t i = 0; i < n; ++i) {
+        Event const & event = events[i];
+        // scopes still open are left out
+        if (!event.done) continue;
+        writeEvent(file, event.category, event.name, event.asset,
+                   event.thread, event.start, event.end);
+    }
+    fputs("\n]}\n", file);
+    bool written = fclose(file) == 0;
+
+    if (numEvents > maxEvents) {
+        std::cout << "trace is missing " << numEvents - maxEvents << " events" << std::endl;
+    }
+    std::cout << "wrote trace: " << tracePath << std::endl;
+    return written;
+}
+
+bool trace_util::isRecording() {
+    return recording;
+}
+
+trace_util::Scope::Scope(char const * category, char const * name, char const * asset)
+    : m_event(maxEvents) {
+    if (!recording) return;
+
+    size_t index = numEvents++;
+    if (index >= maxEvents) return;
+
+    Event & event = events[index];
+    event.category = category;
+    event.name = name;
+    event.asset[0] = '\0';
+    if (asset != nullptr) {
+        strncpy(event.asset, asset, maxNameLength - 1);
+        event.asset[maxNameLength - 1] = '\0';
+    }
+    event.thread = getThread();
+    event.done = false;
+    m_event = index;
+    event.start = now();
+}
+
+trace_util::Scope::~Scope() {
+    if (m_event == maxEvents) return;
+
+    Event & event = events[m_event];
+    event.end = now();
+    event.done = true;
+}
@@ -0,0 +1,70 @@
+#ifndef TRACE_UTIL_H
+#define TRACE_UTIL_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Scoped timing markers written as a Chrome trace, which
+ * can be opened in chrome://tracing or ui.perfetto.dev.
+ * Markers cost a single check while no trace is recorded.
+ *
+ * Events are kept in a fixed buffer so that markers may
+ * be placed on worker threads, which must not allocate
+ * from the container allocator.
+ **/
+namespace trace_util {
+    static constexpr size_t maxEvents = 16384;
+    static constexpr size_t maxNameLength = 128;
+
+    /**
+     * Starts recording events
+     * @param path path of the trace file written by end
+     */
+    void begin(char const * path);
+
+    /**
+     * Stops recording and writes the recorded events,
+     * along with one spanning the whole recording
+     * @return true if the trace was written
+     */
+    bool end();
+
+    /**
+     * @return true while events are recorded
+     */
+    bool isRecording();
+
+    /*
+     * Records the lifetime of the scope as an event
+     **/
+    class Scope {
+    public:
+        /**
+         * @param category category of the event, must outlive
+         *                 the recording
+         * @param name name of the event, must outlive the
+         *             recording
+         * @param asset asset the work is done for, or nullptr.
+         *              Names longer than maxNameLength are cut
+         */
+        Scope(char const * category, char const * name, char const * asset = nullptr);
+        ~Scope();
+
+        Scope(Scope const &) = delete;
+        Scope & operator=(Scope const &) = delete;
+
+    private:
+        // index of the recorded event, maxEvents if none
+        size_t m_event;
+    };
+}
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(category, name) \
+    trace_util::Scope TRACE_CONCAT(traceScope, __LINE__)(category, name)
+#define TRACE_SCOPE_ASSET(category, name, asset) \
+    trace_util::Scope TRACE_CONCAT(traceScope, __LINE__)(category, name, asset)
+
+#endif